@@ -46,9 +46,23 @@ ExternalService.prototype.success = function(extensionID, request, sendResponse)
       return;
     }
 
-    // Call the plugin service to set the wallpaper.
-    this.controller.getPluginService().setWallpaper(request.data.url, request.data.position);
-    sendResponse({status: true, message: 'WallpaperSet'});
+    // Call the plugin service to set the wallpaper, and respond once it is.
+    var started = this.controller.getPluginService().setWallpaper(
+        request.data.url, request.data.position, function(report) {
+      if (report.status == 'success') {
+        sendResponse({status: true, message: 'WallpaperSet', timings: report.timings});
+      }
+      else if (report.status == 'cancelled') {
+        // A newer wallpaper replaced it before it was shown.
+        sendResponse({status: false, message: 'WallpaperCancelled'});
+      }
+      else {
+        sendResponse({status: false, message: 'WallpaperFailed', error: report.error});
+      }
+    });
+    if (!started) {
+      sendResponse({status: false, message: 'WallpaperFailed'});
+    }
   }
   else {
     sendResponse({status: false, message: 'InvalidRequest'});
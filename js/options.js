@@ -47,6 +47,10 @@ function onRestore() {
   });
   debugElement.checked = bkg.settings.debug;
   
+  // Statistics
+  $('stats-refresh').addEventListener('click', renderStats, false);
+  renderStats();
+  
   // Opt out
   var optElement = $('opt_out');
   optElement.addEventListener('click', function(e) {
@@ -81,6 +85,66 @@ function onRestore() {
 
 }
 
+/**
+ * Shows what the plugin counted so far, and how long each stage of setting a
+ * wallpaper usually takes.
+ */
+function renderStats() {
+  var stats = bkg.controller.getPluginService().getStats();
+  var lines = [
+    'Wallpapers: ' + stats.jobsStarted + ' started, ' +
+        stats.jobsCompleted + ' completed, ' + stats.jobsFailed +
+        ' failed, ' + stats.jobsCancelled + ' cancelled',
+    'Downloaded: ' + formatBytes(stats.bytesDownloaded) + ', written: ' +
+        formatBytes(stats.bytesWritten),
+    'Cache: ' + stats.cacheHits + ' hits, ' + stats.cacheMisses + ' misses',
+    'Image memory: ' + formatBytes(stats.bufferBytes) + ', peak: ' +
+        formatBytes(stats.peakBufferBytes),
+    '',
+    'Stage      count      p50      p95      p99 (ms)'
+  ];
+  for (var stage in stats.latencies) {
+    var latency = stats.latencies[stage];
+    lines.push(pad(stage, -8) + pad(latency.count, 8) +
+               pad(latency.p50.toFixed(1), 9) +
+               pad(latency.p95.toFixed(1), 9) +
+               pad(latency.p99.toFixed(1), 9));
+  }
+  $('stats').textContent = lines.join('\n');
+}
+
+/**
+ * Pads a value with spaces.
+ *
+ * @param {*} value The value to pad.
+ * @param {number} width The width to pad to, on the left if positive and on
+ *     the right if negative.
+ * @returns {string} The padded value.
+ */
+function pad(value, width) {
+  var text = String(value);
+  while (text.length < Math.abs(width)) {
+    text = width < 0 ? text + ' ' : ' ' + text;
+  }
+  return text;
+}
+
+/**
+ * Formats a number of bytes for humans.
+ *
+ * @param {number} bytes The number of bytes.
+ * @returns {string} The size in the largest unit it has at least one of.
+ */
+function formatBytes(bytes) {
+  var units = ['bytes', 'KB', 'MB', 'GB'];
+  var unit = 0;
+  while (bytes >= 1024 && unit < units.length - 1) {
+    bytes /= 1024;
+    unit++;
+  }
+  return (unit ? bytes.toFixed(1) : bytes) + ' ' + units[unit];
+}
+
 /**
  * Create Position Option
  *
@@ -58,7 +58,71 @@ PluginService.prototype.getSystemColor = function() {
 
 /**
  * Access the setWallpaper native plugin call.
+ *
+ * @param {string} imageURL The image to set as the wallpaper.
+ * @param {number} imageStyle The PositionEnum ordinal to display it with.
+ * @param {Function<object>} opt_callback Called once the wallpaper is set, or
+ *     failed to be, with {id, status, error, format, passedThrough, fromCache,
+ *     pixels, timings}. status is 'success', 'failed' or 'cancelled' and
+ *     timings holds the milliseconds spent in the queue, download, decode,
+ *     resample, convert, encode, write and apply stages. Setting another
+ *     wallpaper cancels this one if it isn't set yet.
+ * @return {number} The id of the job setting the wallpaper, also passed to
+ *     opt_callback.
+ */
+PluginService.prototype.setWallpaper = function(imageURL, imageStyle, opt_callback) {
+  if (!opt_callback) {
+    return this.getPlugin().setWallpaper(imageURL, imageStyle);
+  }
+  return this.getPlugin().setWallpaper(imageURL, imageStyle, function(status, details) {
+    var report = JSON.parse(details);
+    report.status = status;
+    opt_callback(report);
+  });
+};
+
+/**
+ * Access the cancelWallpaper native plugin call.
+ *
+ * @param {number} id The id setWallpaper returned.
+ * @return {boolean} Whether the wallpaper was still on its way, in which case
+ *     its callback is called with status 'cancelled'.
+ */
+PluginService.prototype.cancelWallpaper = function(id) {
+  return this.getPlugin().cancelWallpaper(id);
+};
+
+/**
+ * Access the tracing native plugin property. While on, the plugin records
+ * how long every stage of every wallpaper takes.
+ *
+ * @param {boolean} enabled Whether to record. Turning it on drops what was
+ *     recorded before.
+ */
+PluginService.prototype.setTracing = function(enabled) {
+  this.getPlugin().tracing = enabled;
+};
+
+/**
+ * Access the writeTrace native plugin call.
+ *
+ * @return {string} The path of the file the recorded trace was written to,
+ *     which chrome://tracing can load.
+ */
+PluginService.prototype.writeTrace = function() {
+  return this.getPlugin().writeTrace();
+};
+
+/**
+ * Access the stats native plugin property.
+ *
+ * @return {object} What the plugin counted since the browser started:
+ *     jobsStarted, jobsCompleted, jobsFailed, jobsCancelled, bytesDownloaded,
+ *     bytesWritten, cacheHits, cacheMisses, bufferBytes and peakBufferBytes,
+ *     and latencies holding {count, p50, p95, p99} in milliseconds for every
+ *     stage that ran: queue, download, decode, resample, convert, encode,
+ *     write, apply and total.
  */
-PluginService.prototype.setWallpaper = function(imageURL, imageStyle) {
-  return this.getPlugin().setWallpaper(imageURL, imageStyle);
+PluginService.prototype.getStats = function() {
+  return JSON.parse(this.getPlugin().stats);
 };
\ No newline at end of file
@@ -167,10 +167,10 @@ PreviewRenderer.prototype._renderTile = function()
 };
 
 /**
- * Fill Renderer, Enlarge or shrink the image to fill the screen, retaining the
- * aspect ratio of the original image. If necessary, the image is padded either
- * on the top and bottom or on the right and left with the background color to
- * fill any screen area not covered by the image.
+ * Fill Renderer, Enlarge or shrink the image to cover the whole screen,
+ * retaining the aspect ratio of the original image. If necessary, the image is
+ * cropped either on the top and bottom or on the left and right to fit the
+ * screen.
  * @private
  */
 PreviewRenderer.prototype._renderFill = function() 
@@ -181,35 +181,17 @@ PreviewRenderer.prototype._renderFill = function()
   var width = this.imageDimension.width / this.factor.width;
   var height = this.imageDimension.height / this.factor.height;
   
-  // Lets check if it needs to enlarge or shrink.
-  if (width < this.canvasDimension.width &&
-      height < this.canvasDimension.height) { 
-    // Enlarging.
-    var widthDiff = this.canvasDimension.width - width;
-    var heightDiff = this.canvasDimension.height - height;
-    // Enlarging till the smaller side.
-    if (widthDiff < heightDiff) {
-      width = (width * this.canvasDimension.height) / height;
-      height = this.canvasDimension.height;
-    }
-    else {
-      height = (height * this.canvasDimension.width) / width;
-      width = this.canvasDimension.width;
-    }
+  // Match the side that leaves the image covering the whole canvas: the
+  // height for an image proportionally wider than the canvas, whose sides
+  // are then cropped, the width otherwise.
+  if (width * this.canvasDimension.height >
+      height * this.canvasDimension.width) {
+    width = (width * this.canvasDimension.height) / height;
+    height = this.canvasDimension.height;
   }
   else {
-    // Shrinking.
-    var widthDiff = width - this.canvasDimension.width;
-    var heightDiff = height - this.canvasDimension.height;
-    // Shrinking till the smaller side.
-    if (widthDiff < heightDiff) {
-      height = (height * this.canvasDimension.width) / width;
-      width = this.canvasDimension.width;
-    }
-    else {
-      width = (width * this.canvasDimension.height) / height;
-      height = this.canvasDimension.height;
-    }
+    height = (height * this.canvasDimension.width) / width;
+    width = this.canvasDimension.width;
   }
   
   // Move the wallpaper to the center.
@@ -219,10 +201,10 @@ PreviewRenderer.prototype._renderFill = function()
 };
 
 /**
- * Fit Renderer, Enlarge or shrink the image to fill the screen, retaining
- * the aspect ratio of the original image. If necessary, the image is cropped
- * either on the top and bottom or on the left and right as necessary to fit the
- * screen.
+ * Fit Renderer, Enlarge or shrink the image until it just fits on the
+ * screen, retaining the aspect ratio of the original image. If necessary, the
+ * image is padded either on the top and bottom or on the right and left with
+ * the background color to fill any screen area not covered by the image.
  * @private
  */
 PreviewRenderer.prototype._renderFit = function() 
@@ -233,35 +215,17 @@ PreviewRenderer.prototype._renderFit = function()
   var width = this.imageDimension.width / this.factor.width;
   var height = this.imageDimension.height / this.factor.height;
   
-  // Lets check if it needs to enlarge or shrink.
-  if (width < this.canvasDimension.width &&
-      height < this.canvasDimension.height) { 
-    // Enlarging.
-    var widthDiff = this.canvasDimension.width - width;
-    var heightDiff = this.canvasDimension.height - height;
-    // Enlarging till the larger side.
-    if (widthDiff > heightDiff) {
-      width = (width * this.canvasDimension.height) / height;
-      height = this.canvasDimension.height;
-    }
-    else {
-      height = (height * this.canvasDimension.width) / width;
-      width = this.canvasDimension.width;
-    }
+  // Match the side that leaves the whole image on the canvas: the height
+  // for an image proportionally narrower than the canvas, which is then
+  // padded on the sides, the width otherwise.
+  if (width * this.canvasDimension.height <
+      height * this.canvasDimension.width) {
+    width = (width * this.canvasDimension.height) / height;
+    height = this.canvasDimension.height;
   }
   else {
-    // Shrinking.
-    var widthDiff = width - this.canvasDimension.width;
-    var heightDiff = height - this.canvasDimension.height;
-    // Shrink till the larger side.
-    if (widthDiff > heightDiff) {
-      height = (height * this.canvasDimension.width) / width;
-      width = this.canvasDimension.width;
-    }
-    else {
-      width = (width * this.canvasDimension.height) / height;
-      height = this.canvasDimension.height;
-    }
+    height = (height * this.canvasDimension.width) / width;
+    width = this.canvasDimension.width;
   }
   
   // Move the wallpaper to the center.
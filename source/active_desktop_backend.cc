@@ -0,0 +1,81 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "active_desktop_backend.h"
+
+namespace set_wallpaper_extension {
+
+ActiveDesktopBackend::ActiveDesktopBackend()
+    : com_initialized_(false),
+      active_desktop_(NULL) {
+}
+
+ActiveDesktopBackend::~ActiveDesktopBackend() {
+  Disconnect();
+}
+
+bool ActiveDesktopBackend::Connect(std::string* error) {
+  HRESULT hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
+  if (FAILED(hr)) {
+    *error = "SetWallpaper::COM failed!";
+    return false;
+  }
+  com_initialized_ = true;
+
+  hr = CoCreateInstance(CLSID_ActiveDesktop, NULL, CLSCTX_INPROC_SERVER,
+                        IID_IActiveDesktop, (void**)&active_desktop_);
+  if (FAILED(hr)) {
+    active_desktop_ = NULL;
+    Disconnect();
+    *error = "SetWallpaper::Creation failed!";
+    return false;
+  }
+  return true;
+}
+
+void ActiveDesktopBackend::Disconnect() {
+  if (active_desktop_) {
+    active_desktop_->Release();
+    active_desktop_ = NULL;
+  }
+  if (com_initialized_) {
+    CoUninitialize();
+    com_initialized_ = false;
+  }
+}
+
+bool ActiveDesktopBackend::Apply(const std::string& path,
+                                 WallpaperStyle style,
+                                 std::string* error) {
+  WCHAR file_name[MAX_PATH];
+  if (!MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, file_name,
+                           MAX_PATH)) {
+    *error = "SetWallpaper::Path too long!";
+    return false;
+  }
+
+  HRESULT hr = active_desktop_->SetWallpaper(file_name, 0);
+  if (FAILED(hr)) {
+    *error = "SetWallpaper::Image failed!";
+    return false;
+  }
+
+  WALLPAPEROPT wallpaper_options;
+  wallpaper_options.dwSize = sizeof(WALLPAPEROPT);
+  wallpaper_options.dwStyle = style;
+  hr = active_desktop_->SetWallpaperOptions(&wallpaper_options, 0);
+  if (FAILED(hr)) {
+    *error = "SetWallpaper::Options failed!";
+    return false;
+  }
+
+  hr = active_desktop_->ApplyChanges(AD_APPLY_ALL);
+  if (FAILED(hr)) {
+    *error = "SetWallpaper::Apply::Error";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,39 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ACTIVE_DESKTOP_BACKEND_H_
+#define ACTIVE_DESKTOP_BACKEND_H_
+
+#include <windows.h>
+#include <wininet.h>
+#include <shlobj.h>
+
+#include <string>
+
+#include "engine/desktop_backend.h"
+
+namespace set_wallpaper_extension {
+
+// Sets the wallpaper with IActiveDesktop, which is the simplest way and is
+// supported on Win2K and later. Connecting joins a single threaded COM
+// apartment and creates the IActiveDesktop, both of which are then kept for
+// as long as the apply thread runs.
+class ActiveDesktopBackend : public DesktopBackend {
+ public:
+  ActiveDesktopBackend();
+  virtual ~ActiveDesktopBackend();
+
+  virtual bool Connect(std::string* error);
+  virtual void Disconnect();
+  virtual bool Apply(const std::string& path, WallpaperStyle style,
+                     std::string* error);
+
+ private:
+  bool com_initialized_;
+  IActiveDesktop* active_desktop_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ACTIVE_DESKTOP_BACKEND_H_
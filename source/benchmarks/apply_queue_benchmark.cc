@@ -0,0 +1,132 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+// Measures what keeping the desktop connected on the apply thread saves over
+// setting it up for every wallpaper, and how bursts of wallpapers from many
+// threads collapse into a few applies. The desktop is a FakeDesktopBackend
+// made as slow as a typical COM setup and ApplyChanges().
+
+#include <stdio.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+#include "engine/apply_queue.h"
+#include "engine/fake_desktop_backend.h"
+
+using namespace set_wallpaper_extension;
+
+namespace {
+
+const int64_t kConnectNanoseconds = 2000000;
+const int64_t kApplyNanoseconds = 1000000;
+
+const int kApplies = 20;
+
+FakeDesktopBackend* NewBackend() {
+  FakeDesktopBackend* backend = new FakeDesktopBackend();
+  backend->set_connect_nanoseconds(kConnectNanoseconds);
+  backend->set_apply_nanoseconds(kApplyNanoseconds);
+  return backend;
+}
+
+ApplyRequest MakeRequest(int index) {
+  char path[32];
+  sprintf(path, "wallpaper-%d.bmp", index);
+  ApplyRequest request;
+  request.path = path;
+  return request;
+}
+
+}  // namespace
+
+int main() {
+  bool ok = true;
+
+  // What every wallpaper used to cost: set up, apply, tear down.
+  std::unique_ptr<FakeDesktopBackend> per_call(NewBackend());
+  double per_call_seconds = MeasureSeconds([&]() {
+    std::string error;
+    for (int i = 0; i < kApplies; ++i) {
+      per_call->Connect(&error);
+      per_call->Apply(MakeRequest(i).path, WALLPAPER_STYLE_STRETCH, &error);
+      per_call->Disconnect();
+    }
+  });
+
+  FakeDesktopBackend* backend = NewBackend();
+  ApplyQueue queue((std::unique_ptr<DesktopBackend>(backend)));
+  double queued_seconds = MeasureSeconds([&]() {
+    for (int i = 0; i < kApplies; ++i) {
+      if (queue.Apply(MakeRequest(i)).status != APPLY_STATUS_APPLIED)
+        ok = false;
+    }
+  });
+  if (!ok || backend->connects() != 1) {
+    printf("The apply queue reconnected or failed!\n");
+    ok = false;
+  }
+
+  printf("%-28s %10s\n", "sequential", "ms/apply");
+  printf("%-28s %10.2f\n", "connect per apply",
+         per_call_seconds * 1e3 / kApplies);
+  printf("%-28s %10.2f\n", "apply queue",
+         queued_seconds * 1e3 / kApplies);
+
+  // Bursts: every thread sets wallpapers as fast as it can.
+  printf("\n%-8s %10s %10s %10s %10s\n", "threads", "requests", "applied",
+         "superseded", "ms");
+  for (int threads = 1; threads <= 16; threads *= 2) {
+    ApplyQueue burst_queue((std::unique_ptr<DesktopBackend>(NewBackend())));
+    int64_t start = MonotonicNanoseconds();
+    std::vector<std::thread> senders;
+    for (int t = 0; t < threads; ++t) {
+      senders.push_back(std::thread([&burst_queue, t]() {
+        for (int i = 0; i < kApplies; ++i)
+          burst_queue.Apply(MakeRequest(t * kApplies + i));
+      }));
+    }
+    for (size_t t = 0; t < senders.size(); ++t)
+      senders[t].join();
+    double ms = (MonotonicNanoseconds() - start) / 1e6;
+
+    int64_t requests = threads * kApplies;
+    if (burst_queue.applied() + burst_queue.superseded() != requests) {
+      printf("Requests went missing!\n");
+      ok = false;
+    }
+    printf("%-8d %10d %10d %10d %10.1f\n", threads,
+           static_cast<int>(requests),
+           static_cast<int>(burst_queue.applied()),
+           static_cast<int>(burst_queue.superseded()), ms);
+  }
+
+  // Posting doesn't wait for the desktop, and every request hears back,
+  // even the ones still queued when the queue goes away.
+  std::atomic<int> answered(0);
+  int64_t post_nanoseconds;
+  {
+    ApplyQueue post_queue((std::unique_ptr<DesktopBackend>(NewBackend())));
+    int64_t start = MonotonicNanoseconds();
+    for (int i = 0; i < kApplies; ++i) {
+      post_queue.Post(MakeRequest(i), [&answered](const ApplyOutcome&) {
+        ++answered;
+      });
+    }
+    post_nanoseconds = MonotonicNanoseconds() - start;
+  }
+  printf("\n%-28s %10.2f\n", "post", post_nanoseconds / 1e6 / kApplies);
+  if (answered != kApplies) {
+    printf("Posted requests went unanswered!\n");
+    ok = false;
+  }
+  if (post_nanoseconds >= kApplies * kApplyNanoseconds) {
+    printf("Posting waited for the desktop!\n");
+    ok = false;
+  }
+
+  return ok ? 0 : 1;
+}
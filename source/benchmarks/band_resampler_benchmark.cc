@@ -0,0 +1,452 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+// Converts a gigapixel class JPEG for a 1080p screen under a memory budget
+// and checks that neither the pixel buffers nor the process grew past it.
+// Screen-sized layouts resample the image a band at a time while it is
+// decoded, tiling and a screen the size of the image leave it whole, so its
+// rows are encoded into the output file as they are decoded. Tiling is also
+// converted from a download, fed to a StreamingDecoder in chunks. For each
+// layout it reports the time, the most memory pixel buffers held at once and
+// how far the resident size of the process rose. Then compares decoding
+// the JPEG reduced in the DCT domain with decoding it whole, in time and in
+// how close the pixels are, and checks that resampling a band at a time
+// gives the same pixels as resampling the whole image.
+//
+// Usage: band_resampler_benchmark [source width] [corpus directory]
+// The source is 3:2, 12000 pixels wide by default. The corpus goes to the
+// current directory by default and the JPEG is reused by the next runs.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#endif
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "engine/band_resampler.h"
+#include "engine/file_util.h"
+#include "engine/image_decoder.h"
+#include "engine/pixel_converter.h"
+#include "engine/resampler.h"
+#include "engine/stats.h"
+#include "engine/streaming_decoder.h"
+#include "engine/wallpaper_engine.h"
+#include "engine/worker_pool.h"
+#include "image_corpus.h"
+
+using namespace set_wallpaper_extension;
+
+namespace {
+
+const int kScreenWidth = 1920;
+const int kScreenHeight = 1080;
+
+// Small enough that the whole source never fits.
+const size_t kMemoryBudget = 64 << 20;
+
+// What the process may grow by besides the pixel buffers and the encoded
+// image, which is mapped while it is decoded: the decoders, the encoders and
+// whatever the conversion cache keeps.
+const size_t kResidentSlack = 32 << 20;
+
+// Bytes of the download handed to the StreamingDecoder at a time.
+const size_t kChunkBytes = 64 * 1024;
+
+struct Case {
+  int source_width;
+  int source_height;
+  WallpaperStyle style;
+};
+
+const Case kCases[] = {
+  { 10000, 5000, WALLPAPER_STYLE_FILL },   // Panorama, cropped at the sides.
+  { 6000, 9000, WALLPAPER_STYLE_FIT },     // Portrait scan, letterboxed.
+  { 4000, 3000, WALLPAPER_STYLE_STRETCH },
+  { 3000, 2000, WALLPAPER_STYLE_CENTER },  // Cropped, not scaled.
+  { 1280, 720, WALLPAPER_STYLE_FILL },     // Upscaled.
+  { 1920, 1080, WALLPAPER_STYLE_FILL },    // Already the right size.
+};
+
+// Reduced decoding is expected to be this close to decoding the whole image,
+// in dB. Scaled down to the screen, they are rarely below 45.
+const double kMinReducedPsnr = 40.0;
+
+const WallpaperStyle kReducedStyles[] = {
+  WALLPAPER_STYLE_FILL,
+  WALLPAPER_STYLE_FIT,
+  WALLPAPER_STYLE_STRETCH,
+};
+
+struct BudgetCase {
+  const char* name;
+  WallpaperStyle style;
+  // Of the screen the size of the image rather than kScreenWidth x
+  // kScreenHeight, which leaves the image as it is.
+  bool screen_is_source;
+  // Fed to a StreamingDecoder rather than converted from the file.
+  bool streamed;
+};
+
+const BudgetCase kBudgetCases[] = {
+  { "fill", WALLPAPER_STYLE_FILL, false, false },
+  { "fit", WALLPAPER_STYLE_FIT, false, false },
+  { "center", WALLPAPER_STYLE_CENTER, false, false },
+  { "tile", WALLPAPER_STYLE_TILE, false, false },
+  { "tile, streamed", WALLPAPER_STYLE_TILE, false, true },
+  { "fill, identity", WALLPAPER_STYLE_FILL, true, false },
+};
+
+const char* StyleName(WallpaperStyle style) {
+  switch (style) {
+  case WALLPAPER_STYLE_CENTER: return "center";
+  case WALLPAPER_STYLE_TILE: return "tile";
+  case WALLPAPER_STYLE_STRETCH: return "stretch";
+  case WALLPAPER_STYLE_FIT: return "fit";
+  case WALLPAPER_STYLE_FILL: return "fill";
+  }
+  return "?";
+}
+
+// Restarts the peak resident size of the process from the current one, so
+// it covers what comes next. Only Linux allows it, elsewhere the peak stays
+// the one of the whole run and false is returned.
+bool ResetPeakResident() {
+#if defined(__linux__)
+  FILE* clear_refs = fopen("/proc/self/clear_refs", "w");
+  if (!clear_refs)
+    return false;
+  bool ok = fputs("5", clear_refs) >= 0;
+  return (fclose(clear_refs) == 0) && ok;
+#else
+  return false;
+#endif
+}
+
+// Current and peak resident size of the process, in bytes.
+void ReadResident(int64_t* current, int64_t* peak) {
+  *current = *peak = 0;
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                           sizeof(counters))) {
+    *current = counters.WorkingSetSize;
+    *peak = counters.PeakWorkingSetSize;
+  }
+#elif defined(__linux__)
+  FILE* status = fopen("/proc/self/status", "r");
+  if (!status)
+    return;
+  char line[256];
+  long long kilobytes;
+  while (fgets(line, sizeof(line), status)) {
+    if (sscanf(line, "VmRSS: %lld kB", &kilobytes) == 1)
+      *current = kilobytes * 1024;
+    else if (sscanf(line, "VmHWM: %lld kB", &kilobytes) == 1)
+      *peak = kilobytes * 1024;
+  }
+  fclose(status);
+#endif
+}
+
+// Converts |image| for |test| the way it says, into |result|.
+bool ConvertForBudget(WallpaperEngine* engine, const CorpusImage& image,
+                      const BudgetCase& test, const std::string& output_base,
+                      ConversionResult* result, std::string* error) {
+  ConversionOptions options;
+  options.style = test.style;
+  options.screen_width = test.screen_is_source ? image.width : kScreenWidth;
+  options.screen_height =
+      test.screen_is_source ? image.height : kScreenHeight;
+  if (!test.streamed) {
+    return engine->ConvertFile(image.path, options, output_base, result,
+                               error);
+  }
+
+  MappedFile download;
+  if (!download.Map(image.path)) {
+    *error = "Unable to read " + image.path;
+    return false;
+  }
+  StreamingDecoder decoder(engine, options, output_base);
+  for (size_t offset = 0; offset < download.size(); offset += kChunkBytes) {
+    size_t size = std::min(kChunkBytes, download.size() - offset);
+    if (!decoder.Write(download.data() + offset, size, error))
+      return false;
+  }
+  download.Unmap();
+  return engine->ConvertStream(&decoder, options, output_base, result, error);
+}
+
+// Passes the rows through to another sink but has the image decoded whole.
+class FullSizeSink : public RowSink {
+ public:
+  explicit FullSizeSink(RowSink* sink) : sink_(sink) {}
+
+  virtual bool Begin(int width, int height, PixelFormat format) {
+    return sink_->Begin(width, height, format);
+  }
+  virtual uint8_t* BeginRow(int y) { return sink_->BeginRow(y); }
+  virtual void EndRow(int y) { sink_->EndRow(y); }
+
+ private:
+  RowSink* sink_;
+};
+
+// Peak signal to noise ratio of |image| against the same sized |reference|,
+// in dB.
+double PeakSignalToNoise(const PixelBuffer& image,
+                         const PixelBuffer& reference) {
+  double squares = 0.0;
+  for (size_t i = 0; i < reference.size(); ++i) {
+    double difference = image.data()[i] - reference.data()[i];
+    squares += difference * difference;
+  }
+  if (squares == 0.0)
+    return 99.0;
+  return 10.0 * log10(255.0 * 255.0 * reference.size() / squares);
+}
+
+// Decodes |encoded| for |style| reduced and whole and compares the two.
+bool CheckReduced(WallpaperEngine* engine,
+                  const std::vector<uint8_t>& encoded,
+                  WallpaperStyle style) {
+  PixelBuffer reduced;
+  PixelBuffer full;
+  int reduction = 1;
+  std::string error;
+  double reduced_seconds = MeasureSeconds([&]() {
+    BandResampler band(style, kScreenWidth, kScreenHeight, 0,
+                       engine->worker_pool());
+    if (!engine->DecodeRows(&encoded[0], encoded.size(), &band, &error) ||
+        !band.Finish(&reduced, &error)) {
+      reduced.Clear();
+    }
+    reduction = band.reduction();
+  }, 0.0);
+  double full_seconds = MeasureSeconds([&]() {
+    BandResampler band(style, kScreenWidth, kScreenHeight, 0,
+                       engine->worker_pool());
+    FullSizeSink sink(&band);
+    if (!engine->DecodeRows(&encoded[0], encoded.size(), &sink, &error) ||
+        !band.Finish(&full, &error)) {
+      full.Clear();
+    }
+  }, 0.0);
+
+  if (reduced.empty() || full.empty()) {
+    printf("%s: %s\n", StyleName(style), error.c_str());
+    return false;
+  }
+  char reduction_text[16] = "none";
+  if (reduction > 1)
+    sprintf(reduction_text, "1/%d", reduction);
+  printf("%-8s %5dx%-5d %9s %10.1f ms %10.1f ms ", StyleName(style),
+         full.width(), full.height(), reduction_text, full_seconds * 1e3,
+         reduced_seconds * 1e3);
+  if (reduced.width() != full.width() || reduced.height() != full.height()) {
+    printf("%dx%d!\n", reduced.width(), reduced.height());
+    return false;
+  }
+  double psnr = PeakSignalToNoise(reduced, full);
+  printf("%6.1f dB\n", psnr);
+  if (psnr < kMinReducedPsnr) {
+    printf("Decoding reduced lost too much detail!\n");
+    return false;
+  }
+  return true;
+}
+
+// Resamples |source| for |test| both ways, on |workers|, and compares the
+// pixels.
+bool CheckCase(const Case& test, const PixelBuffer& source,
+               WorkerPool* workers) {
+  PrescalePlan plan;
+  PixelBuffer reference;
+  if (!PlanPrescale(test.style, source.width(), source.height(),
+                    kScreenWidth, kScreenHeight, &plan) ||
+      plan.IsIdentity(source.width(), source.height())) {
+    reference.Allocate(source.width(), source.height(), source.format());
+    memcpy(reference.data(), source.data(), source.size());
+  } else {
+    Resampler::ResampleRegion(source, plan.scaled_width, plan.scaled_height,
+                              plan.crop_x, plan.crop_y, plan.width,
+                              plan.height, 0, workers, &reference);
+  }
+
+  PixelBuffer output;
+  std::string error;
+  double seconds = MeasureSeconds([&]() {
+    BandResampler band(test.style, kScreenWidth, kScreenHeight, 0, workers);
+    if (!CopyRowsToSink(source, &band) || !band.Finish(&output, &error))
+      output.Clear();
+  }, 1.0);
+
+  printf("%5dx%-5d %-8s %5dx%-5d %8.1f ms  ", test.source_width,
+         test.source_height, StyleName(test.style), output.width(),
+         output.height(), seconds * 1e3);
+  if (output.width() != reference.width() ||
+      output.height() != reference.height() ||
+      memcmp(output.data(), reference.data(), reference.size()) != 0) {
+    printf("different pixels!\n");
+    return false;
+  }
+  printf("same pixels\n");
+  return true;
+}
+
+// Writes |source| through a BandResampler into a file with |encoder|, a row
+// at a time, and compares the file with encoding the whole image.
+bool CheckWritten(const PixelBuffer& source, ImageEncoder* encoder,
+                  const std::string& path, WorkerPool* workers) {
+  const uint32_t kBackground = 0x336699;
+  std::vector<uint8_t> expected;
+  std::vector<uint8_t> written;
+  PixelBuffer converted;
+  PixelBuffer output;
+  std::string error;
+  BandResampler band(WALLPAPER_STYLE_TILE, kScreenWidth, kScreenHeight, 0,
+                     workers);
+  band.set_writer(std::unique_ptr<ImageFileWriter>(
+                      encoder->CreateFileWriter(path)),
+                  kBackground, 0);
+  bool ok = PixelConverter::ToBGR24(source, kBackground, &converted) &&
+            encoder->Encode(converted, &expected, &error) &&
+            CopyRowsToSink(source, &band) && band.Finish(&output, &error) &&
+            band.writer() && output.empty() &&
+            band.writer()->Finish(&error) &&
+            ReadFileToBuffer(path, &written);
+  remove(path.c_str());
+
+  printf("%5dx%-5d %-8s %-11s %11s  ", source.width(), source.height(),
+         "tile", ImageFormatName(encoder->format()), "by rows");
+  if (!ok) {
+    printf("%s\n", error.empty() ? "failed!" : error.c_str());
+    return false;
+  }
+  if (written != expected) {
+    printf("different file!\n");
+    return false;
+  }
+  printf("same file\n");
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int source_width = argc > 1 ? atoi(argv[1]) : 12000;
+  std::string directory = argc > 2 ? argv[2] : ".";
+  if (source_width < kScreenWidth)
+    source_width = kScreenWidth;
+
+  // First, so the peak resident size is the one of the conversions.
+  bool ok = true;
+  CorpusImage image;
+  std::string error;
+  if (!MakeCorpusImage(directory, CORPUS_JPEG, source_width,
+                       source_width * 2 / 3, &image, &error)) {
+    printf("%s\n", error.c_str());
+    return 1;
+  }
+  PixelBuffer::SetMemoryBudget(kMemoryBudget);
+  printf("%dx%d JPEG, %lld bytes, %d MB decoded, %d MB budget\n",
+         image.width, image.height, static_cast<long long>(image.bytes),
+         static_cast<int>(static_cast<int64_t>(image.width) *
+                          image.height * 4 >> 20),
+         static_cast<int>(kMemoryBudget >> 20));
+  printf("%-16s %11s %11s %13s %12s\n", "layout", "pixels", "time",
+         "peak buffers", "RSS growth");
+
+  WorkerPool workers(0);
+  WallpaperEngine engine;
+  engine.set_worker_pool(&workers);
+  std::string output_base = directory + "/band_resampler_output";
+  for (size_t c = 0; c < sizeof(kBudgetCases) / sizeof(kBudgetCases[0]);
+       ++c) {
+    const BudgetCase& test = kBudgetCases[c];
+    ConversionResult result;
+    Stats::ResetPeakBufferBytes();
+    bool measures_resident = ResetPeakResident();
+    int64_t resident_before, peak;
+    ReadResident(&resident_before, &peak);
+    int64_t start = MonotonicNanoseconds();
+    if (!ConvertForBudget(&engine, image, test, output_base, &result,
+                          &error)) {
+      printf("%s: %s\n", test.name, error.c_str());
+      ok = false;
+      continue;
+    }
+    double seconds = (MonotonicNanoseconds() - start) / 1e9;
+    int64_t resident_after;
+    ReadResident(&resident_after, &peak);
+    remove(result.output_path.c_str());
+
+    Stats::Snapshot snapshot;
+    Stats::Read(&snapshot);
+    int64_t growth = peak - resident_before;
+    printf("%-16s %11lld %8.1f ms %10.1f MB %9.1f MB\n", test.name,
+           static_cast<long long>(result.pixels), seconds * 1e3,
+           snapshot.peak_buffer_bytes / 1048576.0, growth / 1048576.0);
+    if (snapshot.peak_buffer_bytes > static_cast<int64_t>(kMemoryBudget)) {
+      printf("Pixel buffers went over the budget!\n");
+      ok = false;
+    }
+    if (measures_resident &&
+        growth > static_cast<int64_t>(kMemoryBudget + kResidentSlack) +
+                     image.bytes) {
+      printf("The process grew with the image!\n");
+      ok = false;
+    }
+  }
+  PixelBuffer::SetMemoryBudget(0);
+
+  std::vector<uint8_t> encoded;
+  if (!ReadFileToBuffer(image.path, &encoded)) {
+    printf("Unable to read %s\n", image.path.c_str());
+    return 1;
+  }
+  printf("\n%-8s %-11s %9s %13s %13s %9s\n", "style", "output", "reduction",
+         "whole", "reduced", "PSNR");
+  for (size_t s = 0; s < sizeof(kReducedStyles) / sizeof(kReducedStyles[0]);
+       ++s) {
+    ok = CheckReduced(&engine, encoded, kReducedStyles[s]) && ok;
+  }
+
+  printf("\n%-11s %-8s %-11s %11s\n", "source", "style", "output", "time");
+  for (size_t c = 0; c < sizeof(kCases) / sizeof(kCases[0]); ++c) {
+    PixelBuffer source;
+    if (!source.Allocate(kCases[c].source_width, kCases[c].source_height,
+                         PIXEL_FORMAT_BGRA32)) {
+      printf("Unable to allocate %dx%d\n", kCases[c].source_width,
+             kCases[c].source_height);
+      return 1;
+    }
+    FillWithNoise(&source, 42);
+    ok = CheckCase(kCases[c], source, &workers) && ok;
+  }
+
+  // Transparent, so the background shows through. Not a multiple of four
+  // pixels wide, so BMP rows are padded.
+  PixelBuffer translucent;
+  translucent.Allocate(1023, 257, PIXEL_FORMAT_RGBA32);
+  FillWithNoise(&translucent, 7);
+  BmpEncoder bmp_encoder;
+  ok = CheckWritten(translucent, &bmp_encoder, output_base + ".bmp",
+                    &workers) && ok;
+#if defined(HAVE_LIBJPEG)
+  JpegEncoder jpeg_encoder;
+  ok = CheckWritten(translucent, &jpeg_encoder, output_base + ".jpg",
+                    &workers) && ok;
+#endif
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,46 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef BENCHMARKS_BENCHMARK_H_
+#define BENCHMARKS_BENCHMARK_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "engine/clock.h"
+#include "engine/pixel_buffer.h"
+
+namespace set_wallpaper_extension {
+
+// Calls |function| repeatedly for at least |min_seconds| after one warm-up
+// call and returns the fastest call in seconds. The fastest call is the one
+// least disturbed by the rest of the system.
+template <typename Function>
+double MeasureSeconds(Function function, double min_seconds = 0.5) {
+  function();
+  int64_t budget = static_cast<int64_t>(min_seconds * 1e9);
+  int64_t best = -1;
+  int64_t started = MonotonicNanoseconds();
+  int iterations = 0;
+  while (iterations < 3 || MonotonicNanoseconds() - started < budget) {
+    int64_t start = MonotonicNanoseconds();
+    function();
+    int64_t elapsed = MonotonicNanoseconds() - start;
+    if (best < 0 || elapsed < best)
+      best = elapsed;
+    ++iterations;
+  }
+  return best / 1e9;
+}
+
+// Fills |image| with reproducible noise.
+inline void FillWithNoise(PixelBuffer* image, unsigned seed) {
+  srand(seed);
+  for (size_t i = 0; i < image->size(); ++i)
+    image->data()[i] = static_cast<uint8_t>(rand() >> 4);
+}
+
+}  // namespace set_wallpaper_extension
+
+#endif  // BENCHMARKS_BENCHMARK_H_
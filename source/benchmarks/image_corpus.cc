@@ -0,0 +1,412 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "image_corpus.h"
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "engine/bmp_codec.h"
+#include "engine/file_util.h"
+
+#if defined(HAVE_LIBJPEG)
+extern "C" {
+#include <jpeglib.h>
+}
+#endif
+
+#if defined(HAVE_LIBPNG)
+#include <png.h>
+#endif
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+const char* const kVariantNames[CORPUS_VARIANT_COUNT] = {
+  "jpeg",
+  "jpeg-progressive",
+  "png",
+  "png-transparent",
+  "bmp",
+  "gif"
+};
+
+const char* const kVariantExtensions[CORPUS_VARIANT_COUNT] = {
+  ".jpg", ".jpg", ".png", ".png", ".bmp", ".gif"
+};
+
+const int kJpegQuality = 90;
+
+// Literal codes a GIF gets between clear codes, few enough that the code
+// size never grows past 9 bits.
+const int kGifLiteralsPerClear = 250;
+
+uint32_t Hash(uint32_t x, uint32_t y) {
+  uint32_t h = x * 73856093u ^ y * 19349663u;
+  h ^= h >> 13;
+  h *= 0x5bd1e995u;
+  h ^= h >> 15;
+  return h;
+}
+
+uint8_t Clamp(int value) {
+  return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+// Row |y| of the |width| x |height| image, as RGB or, with 4 |channels|,
+// RGBA. A stand-in for a photo: gradients for the sky and a large disc, which
+// compress well like most of a photo does, and grain so the encoders have
+// some detail to keep.
+void FillRow(int y, int width, int height, int channels, uint8_t* row) {
+  int64_t radius = (width < height ? width : height) / 4;
+  int64_t dy = y - height * 2 / 3;
+  int margin = (width < height ? width : height) / 8;
+  if (margin < 1)
+    margin = 1;
+  for (int x = 0; x < width; ++x) {
+    int r = 30 + x * 200 / width;
+    int g = 40 + y * 180 / height;
+    int b = 255 - (x + y) * 160 / (width + height);
+    int64_t dx = x - width / 3;
+    if (dx * dx + dy * dy < radius * radius) {
+      r = 250 - y * 60 / height;
+      g = 200 - x * 80 / width;
+      b = 60;
+    }
+    int grain = static_cast<int>(Hash(x, y) & 15) - 8;
+    uint8_t* pixel = row + x * channels;
+    pixel[0] = Clamp(r + grain);
+    pixel[1] = Clamp(g + grain);
+    pixel[2] = Clamp(b + grain);
+    if (4 == channels) {
+      int edge = x;
+      if (y < edge)
+        edge = y;
+      if (width - 1 - x < edge)
+        edge = width - 1 - x;
+      if (height - 1 - y < edge)
+        edge = height - 1 - y;
+      pixel[3] = edge >= margin ? 255 : Clamp(edge * 255 / margin);
+    }
+  }
+}
+
+bool WriteBmp(FILE* file, int width, int height, std::string* error) {
+  uint8_t header[kBmpHeaderSize];
+  BmpEncoder::WriteHeader(width, height, header);
+  if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+    *error = "Unable to write the BMP header.";
+    return false;
+  }
+  std::vector<uint8_t> rgb(width * 3);
+  std::vector<uint8_t> bgr((width * 3 + 3) & ~3);
+  // Bottom-up, like BmpEncoder writes them.
+  for (int y = height - 1; y >= 0; --y) {
+    FillRow(y, width, height, 3, &rgb[0]);
+    for (int x = 0; x < width; ++x) {
+      bgr[x * 3] = rgb[x * 3 + 2];
+      bgr[x * 3 + 1] = rgb[x * 3 + 1];
+      bgr[x * 3 + 2] = rgb[x * 3];
+    }
+    if (fwrite(&bgr[0], 1, bgr.size(), file) != bgr.size()) {
+      *error = "Unable to write the BMP pixels.";
+      return false;
+    }
+  }
+  return true;
+}
+
+#if defined(HAVE_LIBJPEG)
+
+struct JpegErrorManager {
+  jpeg_error_mgr pub;
+  jmp_buf setjmp_buffer;
+  char message[JMSG_LENGTH_MAX];
+};
+
+void JpegErrorExit(j_common_ptr cinfo) {
+  JpegErrorManager* err = reinterpret_cast<JpegErrorManager*>(cinfo->err);
+  (*cinfo->err->format_message)(cinfo, err->message);
+  longjmp(err->setjmp_buffer, 1);
+}
+
+bool WriteJpeg(FILE* file, int width, int height, bool progressive,
+               std::string* error) {
+  jpeg_compress_struct cinfo;
+  JpegErrorManager jerr;
+  std::vector<uint8_t> row(width * 3);
+
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = &JpegErrorExit;
+  if (setjmp(jerr.setjmp_buffer)) {
+    *error = std::string("JPEG encode failed: ") + jerr.message;
+    jpeg_destroy_compress(&cinfo);
+    return false;
+  }
+
+  jpeg_create_compress(&cinfo);
+  jpeg_stdio_dest(&cinfo, file);
+  cinfo.image_width = width;
+  cinfo.image_height = height;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, kJpegQuality, TRUE);
+  if (progressive)
+    jpeg_simple_progression(&cinfo);
+  jpeg_start_compress(&cinfo, TRUE);
+
+  JSAMPROW rows[1] = { &row[0] };
+  while (cinfo.next_scanline < cinfo.image_height) {
+    FillRow(cinfo.next_scanline, width, height, 3, &row[0]);
+    jpeg_write_scanlines(&cinfo, rows, 1);
+  }
+
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+  return true;
+}
+
+#endif  // defined(HAVE_LIBJPEG)
+
+#if defined(HAVE_LIBPNG)
+
+bool WritePng(FILE* file, int width, int height, bool transparent,
+              std::string* error) {
+  png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL,
+                                            NULL);
+  png_infop info = png ? png_create_info_struct(png) : NULL;
+  if (NULL == info) {
+    png_destroy_write_struct(&png, NULL);
+    *error = "Unable to create the PNG encoder.";
+    return false;
+  }
+  int channels = transparent ? 4 : 3;
+  std::vector<uint8_t> row(width * channels);
+
+  if (setjmp(png_jmpbuf(png))) {
+    *error = "PNG encode failed.";
+    png_destroy_write_struct(&png, &info);
+    return false;
+  }
+
+  png_init_io(png, file);
+  png_set_IHDR(png, info, width, height, 8,
+               transparent ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB,
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+               PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(png, info);
+  for (int y = 0; y < height; ++y) {
+    FillRow(y, width, height, channels, &row[0]);
+    png_write_row(png, &row[0]);
+  }
+  png_write_end(png, info);
+  png_destroy_write_struct(&png, &info);
+  return true;
+}
+
+#endif  // defined(HAVE_LIBPNG)
+
+// Packs LZW codes least significant bit first into the 255 byte sub-blocks
+// GIF image data comes in.
+class GifCodeWriter {
+ public:
+  explicit GifCodeWriter(FILE* file)
+      : file_(file), bits_(0), bit_count_(0), block_size_(0), ok_(true) {}
+
+  void Write(int code, int code_size) {
+    bits_ |= static_cast<uint32_t>(code) << bit_count_;
+    bit_count_ += code_size;
+    while (bit_count_ >= 8) {
+      AddByte(static_cast<uint8_t>(bits_));
+      bits_ >>= 8;
+      bit_count_ -= 8;
+    }
+  }
+
+  // Writes the bits left and the last sub-block, then the block terminator.
+  bool Finish() {
+    if (bit_count_ > 0)
+      AddByte(static_cast<uint8_t>(bits_));
+    FlushBlock();
+    ok_ = ok_ && fputc(0, file_) != EOF;
+    return ok_;
+  }
+
+ private:
+  void AddByte(uint8_t byte) {
+    block_[block_size_++] = byte;
+    if (255 == block_size_)
+      FlushBlock();
+  }
+
+  void FlushBlock() {
+    if (0 == block_size_)
+      return;
+    ok_ = ok_ && fputc(block_size_, file_) != EOF &&
+          fwrite(block_, 1, block_size_, file_) ==
+              static_cast<size_t>(block_size_);
+    block_size_ = 0;
+  }
+
+  FILE* file_;
+  uint32_t bits_;
+  int bit_count_;
+  uint8_t block_[255];
+  int block_size_;
+  bool ok_;
+};
+
+void WriteLittleEndian16(int value, uint8_t* out) {
+  out[0] = static_cast<uint8_t>(value);
+  out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+// A GIF89a on a 6x6x6 color cube. The LZW data only uses literal codes,
+// which is a valid stream any decoder reads, just not a compressed one.
+// Wallpapers published as GIF aren't compressed well either.
+bool WriteGif(FILE* file, int width, int height, std::string* error) {
+  if (width > 0xFFFF || height > 0xFFFF) {
+    *error = "Too large for a GIF.";
+    return false;
+  }
+  uint8_t header[13 + 256 * 3 + 10 + 1];
+  memset(header, 0, sizeof(header));
+  memcpy(header, "GIF89a", 6);
+  WriteLittleEndian16(width, header + 6);
+  WriteLittleEndian16(height, header + 8);
+  // Global color table of 256 entries, 8 bits per primary.
+  header[10] = 0xF7;
+  uint8_t* palette = header + 13;
+  for (int i = 0; i < 216; ++i) {
+    palette[i * 3] = static_cast<uint8_t>(i / 36 * 51);
+    palette[i * 3 + 1] = static_cast<uint8_t>(i / 6 % 6 * 51);
+    palette[i * 3 + 2] = static_cast<uint8_t>(i % 6 * 51);
+  }
+  uint8_t* descriptor = palette + 256 * 3;
+  descriptor[0] = 0x2C;
+  WriteLittleEndian16(width, descriptor + 5);
+  WriteLittleEndian16(height, descriptor + 7);
+  // The LZW minimum code size.
+  descriptor[10] = 8;
+  if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+    *error = "Unable to write the GIF header.";
+    return false;
+  }
+
+  const int kClearCode = 256;
+  const int kEndCode = 257;
+  const int kCodeSize = 9;
+  GifCodeWriter codes(file);
+  std::vector<uint8_t> row(width * 3);
+  int literals = kGifLiteralsPerClear;
+  for (int y = 0; y < height; ++y) {
+    FillRow(y, width, height, 3, &row[0]);
+    for (int x = 0; x < width; ++x) {
+      if (kGifLiteralsPerClear == literals) {
+        codes.Write(kClearCode, kCodeSize);
+        literals = 0;
+      }
+      const uint8_t* pixel = &row[x * 3];
+      int index = (pixel[0] * 5 + 127) / 255 * 36 +
+                  (pixel[1] * 5 + 127) / 255 * 6 +
+                  (pixel[2] * 5 + 127) / 255;
+      codes.Write(index, kCodeSize);
+      ++literals;
+    }
+  }
+  codes.Write(kEndCode, kCodeSize);
+  if (!codes.Finish() || fputc(0x3B, file) == EOF) {
+    *error = "Unable to write the GIF pixels.";
+    return false;
+  }
+  return true;
+}
+
+bool WriteImage(FILE* file, CorpusVariant variant, int width, int height,
+                std::string* error) {
+  switch (variant) {
+#if defined(HAVE_LIBJPEG)
+  case CORPUS_JPEG:
+    return WriteJpeg(file, width, height, false, error);
+  case CORPUS_JPEG_PROGRESSIVE:
+    return WriteJpeg(file, width, height, true, error);
+#endif
+#if defined(HAVE_LIBPNG)
+  case CORPUS_PNG:
+    return WritePng(file, width, height, false, error);
+  case CORPUS_PNG_TRANSPARENT:
+    return WritePng(file, width, height, true, error);
+#endif
+  case CORPUS_BMP:
+    return WriteBmp(file, width, height, error);
+  case CORPUS_GIF:
+    return WriteGif(file, width, height, error);
+  default:
+    *error = std::string("This build can't write ") +
+             kVariantNames[variant] + " images.";
+    return false;
+  }
+}
+
+// Size of the file at |path|, or -1 if there is none.
+int64_t FileSize(const std::string& path) {
+  FILE* file = OpenFile(path, "rb");
+  if (NULL == file)
+    return -1;
+  int64_t size = -1;
+  if (0 == fseek(file, 0, SEEK_END))
+    size = ftell(file);
+  fclose(file);
+  return size;
+}
+
+}  // namespace
+
+const char* CorpusVariantName(CorpusVariant variant) {
+  return kVariantNames[variant];
+}
+
+bool MakeCorpusImage(const std::string& directory, CorpusVariant variant,
+                     int width, int height, CorpusImage* image,
+                     std::string* error) {
+  char name[64];
+  sprintf(name, "/%s-%dx%d%s", kVariantNames[variant], width, height,
+          kVariantExtensions[variant]);
+  image->variant = variant;
+  image->width = width;
+  image->height = height;
+  image->path = directory + name;
+  image->bytes = FileSize(image->path);
+  if (image->bytes > 0)
+    return true;
+
+  // Written next to its final name, so an interrupted run doesn't leave a
+  // truncated image behind for the next one to reuse.
+  std::string partial_path = image->path + ".part";
+  FILE* file = OpenFile(partial_path, "wb");
+  if (NULL == file) {
+    *error = "Unable to create " + partial_path;
+    return false;
+  }
+  bool written = WriteImage(file, variant, width, height, error);
+  if (0 != fclose(file) && written) {
+    *error = "Unable to write " + partial_path;
+    written = false;
+  }
+  if (!written || !RenameFile(partial_path, image->path)) {
+    if (written)
+      *error = "Unable to rename " + partial_path;
+    RemoveFile(partial_path);
+    return false;
+  }
+  image->bytes = FileSize(image->path);
+  return true;
+}
+
+}  // namespace set_wallpaper_extension
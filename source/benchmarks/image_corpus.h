@@ -0,0 +1,51 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef BENCHMARKS_IMAGE_CORPUS_H_
+#define BENCHMARKS_IMAGE_CORPUS_H_
+
+#include <stdint.h>
+
+#include <string>
+
+namespace set_wallpaper_extension {
+
+// The kinds of image in the corpus, each a way wallpapers are commonly
+// published.
+enum CorpusVariant {
+  CORPUS_JPEG,
+  CORPUS_JPEG_PROGRESSIVE,
+  CORPUS_PNG,
+  // RGBA, opaque in the middle and fading to fully transparent at the edges.
+  CORPUS_PNG_TRANSPARENT,
+  CORPUS_BMP,
+  CORPUS_GIF,
+  CORPUS_VARIANT_COUNT
+};
+
+// Short name of |variant|, also the start of its file names.
+const char* CorpusVariantName(CorpusVariant variant);
+
+struct CorpusImage {
+  CorpusVariant variant;
+  int width;
+  int height;
+  std::string path;
+  int64_t bytes;
+};
+
+// Makes sure the |width| x |height| image of |variant| is in |directory| and
+// describes it in |image|. The pixels only depend on the size, so the corpus
+// is the same on every machine, and an image already written by an earlier
+// run is reused, since the large ones take a while to encode. Images are
+// generated a row at a time, so a 16K one doesn't need 16K worth of memory.
+// Returns false with a description in |error| if the image can't be written,
+// JPEG and PNG need libjpeg and libpng.
+bool MakeCorpusImage(const std::string& directory, CorpusVariant variant,
+                     int width, int height, CorpusImage* image,
+                     std::string* error);
+
+}  // namespace set_wallpaper_extension
+
+#endif  // BENCHMARKS_IMAGE_CORPUS_H_
@@ -0,0 +1,638 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "mock_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "engine/clock.h"
+#include "engine/file_util.h"
+
+namespace set_wallpaper_extension {
+
+const int32_t MockHost::kStreamChunkBytes;
+
+// A GetURLNotify() request, from opening the file to notifying the plugin.
+struct MockHost::Download {
+  Download()
+      : notify_data(NULL),
+        file(NULL),
+        type(NP_NORMAL),
+        offset(0),
+        opened(false),
+        finished(false) {
+    memset(&stream, 0, sizeof(stream));
+  }
+  ~Download() {
+    if (file)
+      fclose(file);
+  }
+
+  std::string url;
+  std::string path;
+  std::string mime_type;
+  void* notify_data;
+  NPStream stream;
+  FILE* file;
+  uint16_t type;
+  uint32_t offset;
+  // Set once NPP_NewStream() took the stream, which then has to be destroyed.
+  bool opened;
+  // Set once NPP_URLNotify() was called, later steps do nothing.
+  bool finished;
+};
+
+namespace {
+
+// What an NPIdentifier points to.
+struct Identifier {
+  bool is_string;
+  std::string name;
+  int32_t value;
+};
+
+// Shared by every MockHost, the way a browser shares identifiers and the
+// plugin's functions between plugin instances.
+struct HostState {
+  HostState() : initialized(false) {
+    memset(&browser_functions, 0, sizeof(browser_functions));
+    memset(&plugin_functions, 0, sizeof(plugin_functions));
+  }
+
+  std::mutex lock;
+  std::map<std::string, Identifier*> strings;
+  std::map<int32_t, Identifier*> ints;
+  std::string last_exception;
+
+  bool initialized;
+  NPNetscapeFuncs browser_functions;
+  NPPluginFuncs plugin_functions;
+};
+
+// Never freed, identifiers live as long as the process.
+HostState* State() {
+  static HostState* state = new HostState();
+  return state;
+}
+
+MockHost* HostFor(NPP npp) {
+  return static_cast<MockHost*>(npp->ndata);
+}
+
+// The window object and its console. Each one knows its host, so messages
+// end up with the right instance.
+struct PageObject {
+  NPObject object;
+  MockHost* host;
+};
+
+NPObject* AllocatePageObject(NPP npp, NPClass*) {
+  PageObject* object = new PageObject();
+  object->host = HostFor(npp);
+  return &object->object;
+}
+
+void DeallocatePageObject(NPObject* object) {
+  delete reinterpret_cast<PageObject*>(object);
+}
+
+bool IsNamed(NPIdentifier identifier, const char* name) {
+  return static_cast<Identifier*>(identifier)->is_string &&
+         static_cast<Identifier*>(identifier)->name == name;
+}
+
+bool ConsoleHasMethod(NPObject*, NPIdentifier name) {
+  return IsNamed(name, "debug") || IsNamed(name, "log");
+}
+
+bool ConsoleInvoke(NPObject* object, NPIdentifier name, const NPVariant* args,
+                   uint32_t arg_count, NPVariant* result) {
+  if (!ConsoleHasMethod(object, name))
+    return false;
+  std::string message;
+  for (uint32_t i = 0; i < arg_count; ++i) {
+    if (NPVARIANT_IS_STRING(args[i])) {
+      if (!message.empty())
+        message += ' ';
+      message.append(args[i].value.stringValue.UTF8Characters,
+                     args[i].value.stringValue.UTF8Length);
+    }
+  }
+  reinterpret_cast<PageObject*>(object)->host->AddConsoleMessage(message);
+  VOID_TO_NPVARIANT(*result);
+  return true;
+}
+
+NPClass console_class = {
+  NP_CLASS_STRUCT_VERSION,
+  AllocatePageObject,
+  DeallocatePageObject,
+  NULL,
+  ConsoleHasMethod,
+  ConsoleInvoke,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+};
+
+bool WindowHasProperty(NPObject*, NPIdentifier name) {
+  return IsNamed(name, "console");
+}
+
+bool WindowGetProperty(NPObject* object, NPIdentifier name,
+                       NPVariant* result) {
+  if (!WindowHasProperty(object, name))
+    return false;
+  MockHost* host = reinterpret_cast<PageObject*>(object)->host;
+  OBJECT_TO_NPVARIANT(NPN_CreateObject(host->npp(), &console_class), *result);
+  return true;
+}
+
+NPClass window_class = {
+  NP_CLASS_STRUCT_VERSION,
+  AllocatePageObject,
+  DeallocatePageObject,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  WindowHasProperty,
+  WindowGetProperty,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+};
+
+// What the server would have said the file is.
+std::string MimeTypeFor(const std::string& path) {
+  static const char* const kTypes[][2] = {
+    { ".jpg", "image/jpeg" },
+    { ".jpeg", "image/jpeg" },
+    { ".png", "image/png" },
+    { ".bmp", "image/bmp" },
+    { ".gif", "image/gif" },
+  };
+  for (size_t i = 0; i < sizeof(kTypes) / sizeof(kTypes[0]); ++i) {
+    size_t length = strlen(kTypes[i][0]);
+    if (path.size() >= length &&
+        0 == path.compare(path.size() - length, length, kTypes[i][0]))
+      return kTypes[i][1];
+  }
+  return "application/octet-stream";
+}
+
+// The NPNetscapeFuncs of the host. Only what the plugin uses is there.
+
+NPError HostGetURLNotify(NPP npp, const char* url, const char* target,
+                         void* notify_data) {
+  // Loading into a frame or window needs a page.
+  if (target)
+    return NPERR_GENERIC_ERROR;
+  return HostFor(npp)->GetURLNotify(url, notify_data);
+}
+
+NPError HostDestroyStream(NPP npp, NPStream* stream, NPReason reason) {
+  HostFor(npp)->DestroyStream(stream, reason);
+  return NPERR_NO_ERROR;
+}
+
+const char* HostUserAgent(NPP) {
+  return "MockHost";
+}
+
+void* HostMemAlloc(uint32_t size) {
+  return malloc(size);
+}
+
+void HostMemFree(void* ptr) {
+  free(ptr);
+}
+
+NPError HostGetValue(NPP npp, NPNVariable variable, void* value) {
+  if (NPNVWindowNPObject != variable)
+    return NPERR_GENERIC_ERROR;
+  *static_cast<NPObject**>(value) = NPN_CreateObject(npp, &window_class);
+  return NPERR_NO_ERROR;
+}
+
+void HostPluginThreadAsyncCall(NPP npp, void (*function)(void*),
+                               void* data) {
+  HostFor(npp)->PostTask([function, data]() { function(data); }, 0);
+}
+
+NPIdentifier HostGetStringIdentifier(const NPUTF8* name) {
+  HostState* state = State();
+  std::lock_guard<std::mutex> hold(state->lock);
+  Identifier*& identifier = state->strings[name];
+  if (NULL == identifier) {
+    identifier = new Identifier();
+    identifier->is_string = true;
+    identifier->name = name;
+    identifier->value = 0;
+  }
+  return identifier;
+}
+
+void HostGetStringIdentifiers(const NPUTF8** names, int32_t name_count,
+                              NPIdentifier* identifiers) {
+  for (int32_t i = 0; i < name_count; ++i)
+    identifiers[i] = HostGetStringIdentifier(names[i]);
+}
+
+NPIdentifier HostGetIntIdentifier(int32_t intid) {
+  HostState* state = State();
+  std::lock_guard<std::mutex> hold(state->lock);
+  Identifier*& identifier = state->ints[intid];
+  if (NULL == identifier) {
+    identifier = new Identifier();
+    identifier->is_string = false;
+    identifier->value = intid;
+  }
+  return identifier;
+}
+
+bool HostIdentifierIsString(NPIdentifier identifier) {
+  return static_cast<Identifier*>(identifier)->is_string;
+}
+
+NPUTF8* HostUTF8FromIdentifier(NPIdentifier identifier) {
+  Identifier* id = static_cast<Identifier*>(identifier);
+  if (!id->is_string)
+    return NULL;
+  NPUTF8* name = static_cast<NPUTF8*>(HostMemAlloc(id->name.size() + 1));
+  memcpy(name, id->name.c_str(), id->name.size() + 1);
+  return name;
+}
+
+int32_t HostIntFromIdentifier(NPIdentifier identifier) {
+  return static_cast<Identifier*>(identifier)->value;
+}
+
+NPObject* HostCreateObject(NPP npp, NPClass* object_class) {
+  NPObject* object = object_class->allocate ?
+      object_class->allocate(npp, object_class) :
+      static_cast<NPObject*>(HostMemAlloc(sizeof(NPObject)));
+  if (NULL == object)
+    return NULL;
+  object->_class = object_class;
+  object->referenceCount = 1;
+  return object;
+}
+
+NPObject* HostRetainObject(NPObject* object) {
+  if (object)
+    ++object->referenceCount;
+  return object;
+}
+
+void HostReleaseObject(NPObject* object) {
+  if (NULL == object || --object->referenceCount > 0)
+    return;
+  if (object->_class->deallocate)
+    object->_class->deallocate(object);
+  else
+    HostMemFree(object);
+}
+
+void HostReleaseVariantValue(NPVariant* variant) {
+  if (NPVARIANT_IS_STRING(*variant)) {
+    HostMemFree(
+        const_cast<NPUTF8*>(variant->value.stringValue.UTF8Characters));
+  } else if (NPVARIANT_IS_OBJECT(*variant)) {
+    HostReleaseObject(variant->value.objectValue);
+  }
+  VOID_TO_NPVARIANT(*variant);
+}
+
+bool HostHasMethod(NPP, NPObject* object, NPIdentifier name) {
+  return object && object->_class->hasMethod &&
+         object->_class->hasMethod(object, name);
+}
+
+bool HostInvoke(NPP, NPObject* object, NPIdentifier name,
+                const NPVariant* args, uint32_t arg_count,
+                NPVariant* result) {
+  return object && object->_class->invoke &&
+         object->_class->invoke(object, name, args, arg_count, result);
+}
+
+bool HostInvokeDefault(NPP, NPObject* object, const NPVariant* args,
+                       uint32_t arg_count, NPVariant* result) {
+  return object && object->_class->invokeDefault &&
+         object->_class->invokeDefault(object, args, arg_count, result);
+}
+
+bool HostHasProperty(NPP, NPObject* object, NPIdentifier name) {
+  return object && object->_class->hasProperty &&
+         object->_class->hasProperty(object, name);
+}
+
+bool HostGetProperty(NPP, NPObject* object, NPIdentifier name,
+                     NPVariant* result) {
+  return object && object->_class->getProperty &&
+         object->_class->getProperty(object, name, result);
+}
+
+bool HostSetProperty(NPP, NPObject* object, NPIdentifier name,
+                     const NPVariant* value) {
+  return object && object->_class->setProperty &&
+         object->_class->setProperty(object, name, value);
+}
+
+bool HostRemoveProperty(NPP, NPObject* object, NPIdentifier name) {
+  return object && object->_class->removeProperty &&
+         object->_class->removeProperty(object, name);
+}
+
+void HostSetException(NPObject*, const NPUTF8* message) {
+  HostState* state = State();
+  std::lock_guard<std::mutex> hold(state->lock);
+  state->last_exception = message ? message : "";
+}
+
+// Hands the functions of the host to the plugin and takes its own, once per
+// process like a browser loading the library.
+void LoadPlugin(HostState* state) {
+  if (state->initialized)
+    return;
+  state->initialized = true;
+
+  NPNetscapeFuncs* browser = &state->browser_functions;
+  browser->size = sizeof(*browser);
+  browser->version = (NP_VERSION_MAJOR << 8) | NP_VERSION_MINOR;
+  browser->geturlnotify = HostGetURLNotify;
+  browser->destroystream = HostDestroyStream;
+  browser->uagent = HostUserAgent;
+  browser->memalloc = HostMemAlloc;
+  browser->memfree = HostMemFree;
+  browser->getvalue = HostGetValue;
+  browser->pluginthreadasynccall = HostPluginThreadAsyncCall;
+  browser->getstringidentifier = HostGetStringIdentifier;
+  browser->getstringidentifiers = HostGetStringIdentifiers;
+  browser->getintidentifier = HostGetIntIdentifier;
+  browser->identifierisstring = HostIdentifierIsString;
+  browser->utf8fromidentifier = HostUTF8FromIdentifier;
+  browser->intfromidentifier = HostIntFromIdentifier;
+  browser->createobject = HostCreateObject;
+  browser->retainobject = HostRetainObject;
+  browser->releaseobject = HostReleaseObject;
+  browser->invoke = HostInvoke;
+  browser->invokeDefault = HostInvokeDefault;
+  browser->getproperty = HostGetProperty;
+  browser->setproperty = HostSetProperty;
+  browser->removeproperty = HostRemoveProperty;
+  browser->hasproperty = HostHasProperty;
+  browser->hasmethod = HostHasMethod;
+  browser->releasevariantvalue = HostReleaseVariantValue;
+  browser->setexception = HostSetException;
+
+  NPPluginFuncs* plugin = &state->plugin_functions;
+  plugin->size = sizeof(*plugin);
+  NPError error;
+#if defined(XP_UNIX) && !defined(XP_MACOSX)
+  error = NP_Initialize(browser, plugin);
+#else
+  error = NP_GetEntryPoints(plugin);
+  if (NPERR_NO_ERROR == error)
+    error = NP_Initialize(browser);
+#endif
+  if (error != NPERR_NO_ERROR) {
+    fprintf(stderr, "NP_Initialize failed with %d.\n", error);
+    abort();
+  }
+}
+
+}  // namespace
+
+MockHost::MockHost() {
+  memset(&instance_, 0, sizeof(instance_));
+  instance_.ndata = this;
+
+  HostState* state = State();
+  LoadPlugin(state);
+  char mime_type[] = "application/x-vnd-set-wallpaper";
+  new_error_ = state->plugin_functions.newp(mime_type, &instance_,
+                                            NP_EMBED, 0, NULL, NULL, NULL);
+}
+
+MockHost::~MockHost() {
+  // The page goes away: the downloads are broken off first.
+  std::vector<std::shared_ptr<Download> > downloads;
+  downloads.swap(downloads_);
+  for (size_t i = 0; i < downloads.size(); ++i)
+    FinishDownload(downloads[i], NPRES_USER_BREAK);
+
+  if (NPERR_NO_ERROR == new_error_)
+    State()->plugin_functions.destroy(&instance_, NULL);
+
+  // Calls posted for the instance know it's gone, they only clean up.
+  RunPendingCalls();
+  std::lock_guard<std::mutex> hold(lock_);
+  delayed_tasks_.clear();
+}
+
+NPObject* MockHost::GetScriptableObject() {
+  NPObject* object = NULL;
+  if (State()->plugin_functions.getvalue(&instance_,
+                                         NPPVpluginScriptableNPObject,
+                                         &object) != NPERR_NO_ERROR)
+    return NULL;
+  return object;
+}
+
+int MockHost::RunPendingCalls() {
+  int count = 0;
+  for (;;) {
+    Task task;
+    {
+      std::lock_guard<std::mutex> hold(lock_);
+      int64_t now = MonotonicNanoseconds();
+      while (!delayed_tasks_.empty() && delayed_tasks_.begin()->first <= now) {
+        tasks_.push_back(delayed_tasks_.begin()->second);
+        delayed_tasks_.erase(delayed_tasks_.begin());
+      }
+      if (tasks_.empty())
+        return count;
+      task.swap(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+    ++count;
+  }
+}
+
+bool MockHost::RunUntil(const std::function<bool()>& done,
+                        int64_t timeout_nanoseconds) {
+  int64_t deadline = MonotonicNanoseconds() + timeout_nanoseconds;
+  for (;;) {
+    RunPendingCalls();
+    if (done())
+      return true;
+
+    std::unique_lock<std::mutex> hold(lock_);
+    int64_t now = MonotonicNanoseconds();
+    if (now >= deadline)
+      return false;
+    if (!tasks_.empty())
+      continue;
+    int64_t wake_at = deadline;
+    if (!delayed_tasks_.empty())
+      wake_at = std::min(wake_at, delayed_tasks_.begin()->first);
+    wake_.wait_for(hold, std::chrono::nanoseconds(wake_at - now));
+  }
+}
+
+void MockHost::PostTask(const Task& task, int64_t delay_nanoseconds) {
+  {
+    std::lock_guard<std::mutex> hold(lock_);
+    if (delay_nanoseconds > 0) {
+      delayed_tasks_.insert(std::make_pair(
+          MonotonicNanoseconds() + delay_nanoseconds, task));
+    } else {
+      tasks_.push_back(task);
+    }
+  }
+  wake_.notify_one();
+}
+
+std::vector<std::string> MockHost::console_messages() const {
+  std::lock_guard<std::mutex> hold(lock_);
+  return console_messages_;
+}
+
+void MockHost::AddConsoleMessage(const std::string& message) {
+  std::lock_guard<std::mutex> hold(lock_);
+  console_messages_.push_back(message);
+}
+
+std::string MockHost::last_exception() {
+  HostState* state = State();
+  std::lock_guard<std::mutex> hold(state->lock);
+  return state->last_exception;
+}
+
+NPError MockHost::GetURLNotify(const char* url, void* notify_data) {
+  std::string path(url);
+  const std::string kFileScheme = "file://";
+  if (0 == path.compare(0, kFileScheme.size(), kFileScheme))
+    path.erase(0, kFileScheme.size());
+  else if (path.find("://") != std::string::npos)
+    return NPERR_INVALID_URL;
+
+  std::shared_ptr<Download> download(new Download());
+  download->url = url;
+  download->path = path;
+  download->mime_type = MimeTypeFor(path);
+  download->notify_data = notify_data;
+  download->stream.url = download->url.c_str();
+  download->stream.notifyData = notify_data;
+  downloads_.push_back(download);
+  PostTask([this, download]() { OpenDownload(download); }, 0);
+  return NPERR_NO_ERROR;
+}
+
+void MockHost::DestroyStream(NPStream* stream, NPReason reason) {
+  for (size_t i = 0; i < downloads_.size(); ++i) {
+    if (&downloads_[i]->stream == stream) {
+      std::shared_ptr<Download> download = downloads_[i];
+      PostTask([this, download, reason]() {
+        FinishDownload(download, reason);
+      }, 0);
+      return;
+    }
+  }
+}
+
+void MockHost::OpenDownload(const std::shared_ptr<Download>& download) {
+  if (download->finished)
+    return;
+  download->file = OpenFile(download->path, "rb");
+  if (NULL == download->file) {
+    FinishDownload(download, NPRES_NETWORK_ERR);
+    return;
+  }
+  fseek(download->file, 0, SEEK_END);
+  download->stream.end = static_cast<uint32_t>(ftell(download->file));
+  fseek(download->file, 0, SEEK_SET);
+
+  const NPPluginFuncs& plugin = State()->plugin_functions;
+  std::vector<char> mime_type(download->mime_type.begin(),
+                              download->mime_type.end());
+  mime_type.push_back('\0');
+  download->type = NP_NORMAL;
+  if (plugin.newstream(&instance_, &mime_type[0], &download->stream, false,
+                       &download->type) != NPERR_NO_ERROR) {
+    // The stream was refused, so it isn't destroyed, only notified.
+    FinishDownload(download, NPRES_NETWORK_ERR);
+    return;
+  }
+  download->opened = true;
+
+  if (NP_ASFILEONLY == download->type || NP_ASFILE == download->type) {
+    // The file is already on disk, it's handed over as is.
+    plugin.asfile(&instance_, &download->stream, download->path.c_str());
+    FinishDownload(download, NPRES_DONE);
+    return;
+  }
+  WriteDownload(download);
+}
+
+void MockHost::WriteDownload(const std::shared_ptr<Download>& download) {
+  if (download->finished)
+    return;
+  const NPPluginFuncs& plugin = State()->plugin_functions;
+  int32_t ready = plugin.writeready(&instance_, &download->stream);
+  if (ready <= 0) {
+    // The plugin is behind, ask again in a moment like a browser polls.
+    PostTask([this, download]() { WriteDownload(download); }, 1000000);
+    return;
+  }
+
+  char chunk[kStreamChunkBytes];
+  int32_t wanted = std::min(ready, kStreamChunkBytes);
+  size_t read = fread(chunk, 1, wanted, download->file);
+  if (0 == read) {
+    FinishDownload(download,
+                   ferror(download->file) ? NPRES_NETWORK_ERR : NPRES_DONE);
+    return;
+  }
+  int32_t written = plugin.write(&instance_, &download->stream,
+                                 download->offset, static_cast<int32_t>(read),
+                                 chunk);
+  if (written < 0) {
+    FinishDownload(download, NPRES_NETWORK_ERR);
+    return;
+  }
+  // Whatever the plugin didn't take comes again in the next chunk.
+  written = std::min(written, static_cast<int32_t>(read));
+  download->offset += written;
+  fseek(download->file, download->offset, SEEK_SET);
+  PostTask([this, download]() { WriteDownload(download); }, 0);
+}
+
+void MockHost::FinishDownload(const std::shared_ptr<Download>& download,
+                              NPReason reason) {
+  if (download->finished)
+    return;
+  download->finished = true;
+  downloads_.erase(std::remove(downloads_.begin(), downloads_.end(), download),
+                   downloads_.end());
+
+  const NPPluginFuncs& plugin = State()->plugin_functions;
+  if (download->opened)
+    plugin.destroystream(&instance_, &download->stream, reason);
+  plugin.urlnotify(&instance_, download->url.c_str(), reason,
+                   download->notify_data);
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,115 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef BENCHMARKS_MOCK_HOST_H_
+#define BENCHMARKS_MOCK_HOST_H_
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "npapi.h"
+#include "npfunctions.h"
+#include "npruntime.h"
+
+namespace set_wallpaper_extension {
+
+// Stands in for the browser so the plugin can be driven and measured in a
+// plain process. The first host loads the plugin the way a browser does,
+// handing its NPNetscapeFuncs to NP_Initialize() and taking the NPP_
+// functions back, and every host is one instance of the plugin, created with
+// NPP_New() and destroyed with NPP_Destroy(). So all of npn_gate.cc,
+// npp_gate.cc and npp_module.cc run, and CreateDesktopService() picks the
+// service.
+//
+// Identifiers are interned for the life of the process, objects are
+// reference counted and dispatched through their NPClass, and the window has
+// a console whose debug() messages are kept. NPN_GetURLNotify() serves local
+// files, "file://" URLs or plain paths, as an NP_NORMAL stream of chunks or
+// as a file, whichever NPP_NewStream() asks for.
+//
+// The thread that creates a host is its plugin thread. Nothing calls into
+// the plugin on its own: RunPendingCalls() or RunUntil() run the event loop,
+// which runs the calls posted with NPN_PluginThreadAsyncCall() and the steps
+// of the downloads in the order they were posted.
+class MockHost {
+ public:
+  typedef std::function<void()> Task;
+
+  // Most bytes the host hands NPP_Write() at once, whatever the plugin is
+  // ready to take.
+  static const int32_t kStreamChunkBytes = 64 << 10;
+
+  MockHost();
+
+  // Breaks off the downloads still running and destroys the instance.
+  ~MockHost();
+
+  NPP npp() { return &instance_; }
+
+  // What NPP_New() returned.
+  NPError new_error() const { return new_error_; }
+
+  // The scriptable object of the instance, from NPP_GetValue(). The caller
+  // owns the reference, like the page would.
+  NPObject* GetScriptableObject();
+
+  // Runs the calls and download steps that are due, including the ones they
+  // post, on the calling thread. Returns how many ran.
+  int RunPendingCalls();
+
+  // Runs the event loop, waiting for calls posted from other threads, until
+  // |done| returns true or |timeout_nanoseconds| passed. Returns whether
+  // |done| did.
+  bool RunUntil(const std::function<bool()>& done,
+                int64_t timeout_nanoseconds);
+
+  // Posts |task| to the event loop, to run once |delay_nanoseconds| passed.
+  // May be called from any thread.
+  void PostTask(const Task& task, int64_t delay_nanoseconds);
+
+  // Messages script would have seen on the console, oldest first.
+  std::vector<std::string> console_messages() const;
+
+  // The message of the last NPN_SetException, or "".
+  static std::string last_exception();
+
+  // Called by the NPN_ functions of the host.
+  NPError GetURLNotify(const char* url, void* notify_data);
+  void DestroyStream(NPStream* stream, NPReason reason);
+  void AddConsoleMessage(const std::string& message);
+
+ private:
+  struct Download;
+
+  // The steps of a download, each one a task of the event loop.
+  void OpenDownload(const std::shared_ptr<Download>& download);
+  void WriteDownload(const std::shared_ptr<Download>& download);
+  void FinishDownload(const std::shared_ptr<Download>& download,
+                      NPReason reason);
+
+  NPP_t instance_;
+  NPError new_error_;
+
+  // Downloads whose stream is open or about to be. Plugin thread only.
+  std::vector<std::shared_ptr<Download> > downloads_;
+
+  mutable std::mutex lock_;
+  std::condition_variable wake_;
+  std::deque<Task> tasks_;
+  // Tasks that aren't due yet, by when they are.
+  std::multimap<int64_t, Task> delayed_tasks_;
+  std::vector<std::string> console_messages_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // BENCHMARKS_MOCK_HOST_H_
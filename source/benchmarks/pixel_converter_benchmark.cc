@@ -0,0 +1,89 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+// Measures the pixel-convert stage with every kernel the CPU supports. The
+// throughput counts the bytes read and the bytes written, so it can be put
+// next to the memory bandwidth of the machine.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "benchmark.h"
+#include "engine/pixel_converter.h"
+
+using namespace set_wallpaper_extension;
+
+namespace {
+
+struct Size {
+  int width;
+  int height;
+};
+
+const Size kSizes[] = {
+  { 1024, 768 },
+  { 1920, 1080 },
+  { 3840, 2160 },
+  { 7680, 4320 },
+};
+
+const PixelKernel kKernels[] = {
+  PIXEL_KERNEL_SCALAR,
+  PIXEL_KERNEL_SSE2,
+  PIXEL_KERNEL_AVX2,
+};
+
+// Same color GetSystemColor() typically reports.
+const uint32_t kBackground = 0x3A6EA5;
+
+bool SameBuffers(const PixelBuffer& a, const PixelBuffer& b) {
+  return a.width() == b.width() && a.height() == b.height() &&
+         a.size() == b.size() && memcmp(a.data(), b.data(), a.size()) == 0;
+}
+
+}  // namespace
+
+int main() {
+  bool ok = true;
+  printf("%-11s %-6s %-7s %10s %10s\n", "size", "format", "kernel", "ms",
+         "GB/s");
+
+  for (size_t s = 0; s < sizeof(kSizes) / sizeof(kSizes[0]); ++s) {
+    for (int f = 0; f < 2; ++f) {
+      PixelFormat format = f ? PIXEL_FORMAT_RGBA32 : PIXEL_FORMAT_BGRA32;
+      PixelBuffer source;
+      source.Allocate(kSizes[s].width, kSizes[s].height, format);
+      FillWithNoise(&source, 1234);
+
+      PixelBuffer reference;
+      PixelConverter::ToBGR24WithKernel(PIXEL_KERNEL_SCALAR, source,
+                                        kBackground, &reference);
+
+      for (size_t k = 0; k < sizeof(kKernels) / sizeof(kKernels[0]); ++k) {
+        PixelKernel kernel = kKernels[k];
+        if (!PixelConverter::IsKernelSupported(kernel))
+          continue;
+
+        PixelBuffer output;
+        double seconds = MeasureSeconds([&]() {
+          PixelConverter::ToBGR24WithKernel(kernel, source, kBackground,
+                                            &output);
+        });
+        if (!SameBuffers(output, reference)) {
+          printf("%s output differs from scalar!\n",
+                 PixelConverter::KernelName(kernel));
+          ok = false;
+        }
+
+        double bytes = static_cast<double>(source.size() + output.size());
+        char size[32];
+        sprintf(size, "%dx%d", source.width(), source.height());
+        printf("%-11s %-6s %-7s %10.3f %10.2f\n", size, f ? "RGBA" : "BGRA",
+               PixelConverter::KernelName(kernel), seconds * 1e3,
+               bytes / seconds / 1e9);
+      }
+    }
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,88 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+// Measures how the resample stage scales with the number of threads on the
+// kind of panoramas and scans people set as wallpaper, and checks that every
+// thread count produces the same pixels.
+//
+// Usage: resampler_benchmark [max_threads]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "benchmark.h"
+#include "engine/parallel_for.h"
+#include "engine/resampler.h"
+#include "engine/worker_pool.h"
+
+using namespace set_wallpaper_extension;
+
+namespace {
+
+struct Case {
+  int source_width;
+  int source_height;
+  int width;
+  int height;
+};
+
+const Case kCases[] = {
+  { 10000, 5000, 1920, 1080 },   // 50 MP panorama to a 1080p screen.
+  { 12000, 9000, 3840, 2160 },   // 108 MP scan to a 4K screen.
+  { 1280, 720, 3840, 2160 },     // Upscaling a small image.
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int max_threads = argc > 1 ? atoi(argv[1]) : DefaultThreadCount();
+  if (max_threads < 1)
+    max_threads = 1;
+
+  // The calling thread is one of them.
+  WorkerPool workers(max_threads > 1 ? max_threads - 1 : 1);
+  bool ok = true;
+  printf("%-12s %-10s %7s %10s %8s\n", "source", "output", "threads", "ms",
+         "speedup");
+
+  for (size_t c = 0; c < sizeof(kCases) / sizeof(kCases[0]); ++c) {
+    const Case& test = kCases[c];
+    PixelBuffer source;
+    if (!source.Allocate(test.source_width, test.source_height,
+                         PIXEL_FORMAT_BGRA32)) {
+      printf("Unable to allocate %dx%d\n", test.source_width,
+             test.source_height);
+      return 1;
+    }
+    FillWithNoise(&source, 42);
+
+    PixelBuffer reference;
+    double single = 0.0;
+    for (int threads = 1; threads <= max_threads; ++threads) {
+      PixelBuffer output;
+      double seconds = MeasureSeconds([&]() {
+        Resampler::Resample(source, test.width, test.height, threads,
+                            &workers, &output);
+      }, 2.0);
+
+      if (threads == 1) {
+        single = seconds;
+        reference.Swap(&output);
+      } else if (memcmp(output.data(), reference.data(),
+                        reference.size()) != 0) {
+        printf("%d threads produced different pixels!\n", threads);
+        ok = false;
+      }
+
+      char source_size[32];
+      char output_size[32];
+      sprintf(source_size, "%dx%d", test.source_width, test.source_height);
+      sprintf(output_size, "%dx%d", test.width, test.height);
+      printf("%-12s %-10s %7d %10.1f %7.2fx\n", source_size, output_size,
+             threads, seconds * 1e3, single / seconds);
+    }
+  }
+  return ok ? 0 : 1;
+}
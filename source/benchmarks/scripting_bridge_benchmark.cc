@@ -0,0 +1,221 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+// Measures how fast script calls get through the scripting bridge: Invoke(),
+// with and without arguments to convert, and GetProperty() from the
+// browser's side, through a MockHost that loads the plugin like a browser,
+// and the member lookup alone next to the per-instance std::map the bridge
+// used to search. Also checks every name finds its member and nothing else
+// does.
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+
+#include "benchmark.h"
+#include "desktop_service.h"
+#include "identifier_table.h"
+#include "mock_host.h"
+
+using namespace set_wallpaper_extension;
+
+namespace {
+
+const int kCalls = 1000000;
+
+const char* const kColor = "3A6EA5";
+
+// Answers the bridge without touching a desktop.
+class BenchmarkService : public DesktopService {
+ public:
+  explicit BenchmarkService(NPP npp)
+      : DesktopService(npp, std::unique_ptr<DesktopBackend>()) {}
+  virtual ~BenchmarkService() { StopWorkers(); }
+
+  virtual bool GetSystemColor(NPVariant* result) {
+    char* color = static_cast<char*>(NPN_MemAlloc(7));
+    memcpy(color, kColor, 7);
+    STRINGN_TO_NPVARIANT(color, 6, *result);
+    return true;
+  }
+  virtual bool GetWallpaperStyle(NPVariant* result) {
+    INT32_TO_NPVARIANT(WALLPAPER_STYLE_STRETCH, *result);
+    return true;
+  }
+  virtual bool SetWallpaper(NPVariant*, const StringView&, int, NPObject*) {
+    return false;
+  }
+  virtual void DownloadCompletionStatus(const char*, NPReason) {}
+
+ protected:
+  virtual std::string GetWallpaperBasePath() { return std::string(); }
+};
+
+// Every name script may use, and one it may not.
+const NPUTF8* const kNames[] = {
+  "systemColor", "wallpaperStyle", "setWallpaper", "cancelWallpaper",
+  "debug", "streaming",
+};
+const size_t kNameCount = sizeof(kNames) / sizeof(kNames[0]);
+
+void PrintRate(const char* name, double seconds) {
+  printf("%-28s %10.1f %10.1f\n", name, seconds * 1e9 / kCalls,
+         kCalls / seconds / 1e6);
+}
+
+}  // namespace
+
+namespace set_wallpaper_extension {
+
+DesktopService* CreateDesktopService(NPP npp) {
+  return new BenchmarkService(npp);
+}
+
+}  // namespace set_wallpaper_extension
+
+int main() {
+  bool ok = true;
+  MockHost host;
+  NPObject* bridge = host.GetScriptableObject();
+  if (NULL == bridge) {
+    printf("The plugin has no scriptable object!\n");
+    return 1;
+  }
+  NPP npp = host.npp();
+
+  NPIdentifier ids[kNameCount];
+  for (size_t i = 0; i < kNameCount; ++i)
+    ids[i] = NPN_GetStringIdentifier(kNames[i]);
+  NPIdentifier system_color = ids[0];
+  NPIdentifier cancel_wallpaper = ids[3];
+  NPIdentifier debug = ids[4];
+  NPIdentifier unknown = NPN_GetStringIdentifier("wallpaper");
+
+  NPVariant enabled;
+  BOOLEAN_TO_NPVARIANT(true, enabled);
+  if (!NPN_SetProperty(npp, bridge, debug, &enabled)) {
+    printf("Unable to turn debugging on!\n");
+    ok = false;
+  }
+
+  // Every method is a method and every property a property, nothing else.
+  for (size_t i = 0; i < kNameCount; ++i) {
+    bool method = i < 4;
+    if (NPN_HasMethod(npp, bridge, ids[i]) != method ||
+        NPN_HasProperty(npp, bridge, ids[i]) == method) {
+      printf("%s was looked up wrong!\n", kNames[i]);
+      ok = false;
+    }
+  }
+  if (NPN_HasMethod(npp, bridge, unknown) ||
+      NPN_HasProperty(npp, bridge, unknown)) {
+    printf("An unknown name was found!\n");
+    ok = false;
+  }
+
+  printf("%-28s %10s %10s\n", "call", "ns/call", "Mcalls/s");
+
+  double seconds = MeasureSeconds([&]() {
+    for (int i = 0; i < kCalls; ++i) {
+      NPVariant result;
+      if (!NPN_Invoke(npp, bridge, system_color, NULL, 0, &result) ||
+          !NPVARIANT_IS_STRING(result) ||
+          memcmp(result.value.stringValue.UTF8Characters, kColor, 6) != 0)
+        ok = false;
+      NPN_ReleaseVariantValue(&result);
+    }
+  });
+  PrintRate("Invoke(systemColor)", seconds);
+
+  seconds = MeasureSeconds([&]() {
+    for (int i = 0; i < kCalls; ++i) {
+      NPVariant result;
+      if (!NPN_GetProperty(npp, bridge, debug, &result) ||
+          !NPVARIANT_IS_BOOLEAN(result) || !NPVARIANT_TO_BOOLEAN(result))
+        ok = false;
+    }
+  });
+  PrintRate("GetProperty(debug)", seconds);
+
+  // An argument to convert, a number that arrives as a Double.
+  NPVariant id;
+  DOUBLE_TO_NPVARIANT(42.0, id);
+  seconds = MeasureSeconds([&]() {
+    for (int i = 0; i < kCalls; ++i) {
+      NPVariant result;
+      if (!NPN_Invoke(npp, bridge, cancel_wallpaper, &id, 1, &result) ||
+          !NPVARIANT_IS_BOOLEAN(result) || NPVARIANT_TO_BOOLEAN(result))
+        ok = false;
+    }
+  });
+  PrintRate("Invoke(cancelWallpaper, id)", seconds);
+
+  // Numbers that don't fit an int32_t id must not convert.
+  const double kBadIds[] = { NAN, INFINITY, -INFINITY, 1e10, -1e10 };
+  for (size_t i = 0; i < sizeof(kBadIds) / sizeof(kBadIds[0]); ++i) {
+    NPVariant bad_id;
+    DOUBLE_TO_NPVARIANT(kBadIds[i], bad_id);
+    NPVariant result;
+    if (NPN_Invoke(npp, bridge, cancel_wallpaper, &bad_id, 1, &result)) {
+      printf("cancelWallpaper() took %g as an id!\n", kBadIds[i]);
+      ok = false;
+    }
+  }
+
+  seconds = MeasureSeconds([&]() {
+    for (int i = 0; i < kCalls; ++i) {
+      NPVariant result;
+      if (NPN_Invoke(npp, bridge, unknown, NULL, 0, &result))
+        ok = false;
+    }
+  });
+  PrintRate("Invoke(unknown)", seconds);
+  if (!ok)
+    printf("A call through the bridge returned the wrong result!\n");
+
+  // The lookup alone, cycling through every name and a miss.
+  NPIdentifier lookups[kNameCount + 1];
+  memcpy(lookups, ids, sizeof(ids));
+  lookups[kNameCount] = unknown;
+  const size_t kLookupCount = kNameCount + 1;
+
+  std::map<NPIdentifier, int> map;
+  for (size_t i = 0; i < kNameCount; ++i)
+    map[ids[i]] = static_cast<int>(i);
+  IdentifierTable table(kNames, kNameCount);
+
+  volatile int sink = 0;
+  seconds = MeasureSeconds([&]() {
+    int sum = 0;
+    for (int i = 0; i < kCalls; ++i) {
+      std::map<NPIdentifier, int>::const_iterator it =
+          map.find(lookups[i % kLookupCount]);
+      sum += it == map.end() ? -1 : it->second;
+    }
+    sink = sum;
+  });
+  PrintRate("lookup std::map", seconds);
+
+  seconds = MeasureSeconds([&]() {
+    int sum = 0;
+    for (int i = 0; i < kCalls; ++i)
+      sum += table.Find(lookups[i % kLookupCount]);
+    sink = sum;
+  });
+  PrintRate("lookup IdentifierTable", seconds);
+
+  for (size_t i = 0; i < kLookupCount; ++i) {
+    int expected = i < kNameCount ? static_cast<int>(i) : -1;
+    if (table.Find(lookups[i]) != expected) {
+      printf("The identifier table found the wrong name!\n");
+      ok = false;
+    }
+  }
+
+  // The reference the page held.
+  NPN_ReleaseObject(bridge);
+  return ok ? 0 : 1;
+}
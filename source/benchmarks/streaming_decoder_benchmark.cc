@@ -0,0 +1,267 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+// Feeds every image of a small synthetic corpus to a StreamingDecoder in
+// the chunks a network could deliver it in, and checks that the pixels and
+// the content hash always come out the same as decoding the whole file in
+// one go. The chunks are single bytes, splits anywhere in the first 16
+// bytes, where the format is sniffed, splits inside every JPEG marker and
+// PNG chunk, and random sizes. Each image is decoded as is and laid out for
+// a small screen. It reports how long the single byte feed took next to the
+// one-shot decode.
+//
+// Usage: streaming_decoder_benchmark [corpus directory]
+// The corpus goes to the current directory by default.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "engine/band_resampler.h"
+#include "engine/content_hash.h"
+#include "engine/file_util.h"
+#include "engine/streaming_decoder.h"
+#include "engine/wallpaper_engine.h"
+#include "engine/worker_pool.h"
+#include "image_corpus.h"
+
+using namespace set_wallpaper_extension;
+
+namespace {
+
+const int kImageWidth = 320;
+const int kImageHeight = 200;
+
+// Screen the images are also laid out for, smaller than them so they are
+// scaled down and cropped on the way.
+const int kScreenWidth = 256;
+const int kScreenHeight = 144;
+
+// Splits made one at a time in the first bytes, where the format is sniffed
+// from.
+const size_t kSniffBytes = 16;
+
+// Largest of the random chunks.
+const size_t kMaxRandomChunk = 997;
+
+// Where a stream is cut into chunks, in increasing order.
+typedef std::vector<size_t> Cuts;
+
+// Cuts |size| bytes into single bytes.
+Cuts SingleBytes(size_t size) {
+  Cuts cuts;
+  for (size_t i = 1; i < size; ++i)
+    cuts.push_back(i);
+  return cuts;
+}
+
+// Cuts |size| bytes into reproducible random chunks.
+Cuts RandomChunks(size_t size, unsigned seed) {
+  srand(seed);
+  Cuts cuts;
+  for (size_t i = 1 + rand() % kMaxRandomChunk; i < size;
+       i += 1 + rand() % kMaxRandomChunk) {
+    cuts.push_back(i);
+  }
+  return cuts;
+}
+
+// Offsets inside the structures the decoders read piece by piece: between
+// the 0xFF of a JPEG marker and its code, and inside its length, or inside
+// the length, type, data and CRC of a PNG chunk. Each makes a stream of two
+// chunks.
+std::vector<size_t> StructureSplits(const std::vector<uint8_t>& data,
+                                    ImageFormat format) {
+  std::vector<size_t> splits;
+  if (format == IMAGE_FORMAT_JPEG) {
+    for (size_t i = 0; i + 3 < data.size(); ++i) {
+      if (0xFF == data[i] && 0x00 != data[i + 1] && 0xFF != data[i + 1]) {
+        splits.push_back(i + 1);
+        splits.push_back(i + 3);
+      }
+    }
+  } else if (format == IMAGE_FORMAT_PNG) {
+    // Chunks start after the 8 byte signature.
+    for (size_t chunk = 8; chunk + 12 <= data.size();) {
+      size_t length = (static_cast<size_t>(data[chunk]) << 24) |
+                      (data[chunk + 1] << 16) | (data[chunk + 2] << 8) |
+                      data[chunk + 3];
+      splits.push_back(chunk + 2);
+      splits.push_back(chunk + 6);
+      if (length > 0)
+        splits.push_back(chunk + 8 + length / 2);
+      splits.push_back(chunk + 8 + length + 2);
+      chunk += 12 + length;
+    }
+  }
+  return splits;
+}
+
+// Layout the image is decoded for, with |screen| or as is.
+ConversionOptions MakeOptions(bool screen) {
+  ConversionOptions options;
+  // Nothing passes through, everything is decoded.
+  options.allow_pass_through = false;
+  if (screen) {
+    options.style = WALLPAPER_STYLE_FILL;
+    options.screen_width = kScreenWidth;
+    options.screen_height = kScreenHeight;
+  }
+  return options;
+}
+
+// Decodes |data| in one go, the way the engine does a downloaded file.
+bool DecodeWhole(WallpaperEngine* engine, const ConversionOptions& options,
+                 const std::vector<uint8_t>& data, PixelBuffer* output,
+                 std::string* error) {
+  BandResampler band(options.style, options.screen_width,
+                     options.screen_height, engine->thread_count(),
+                     engine->worker_pool());
+  return engine->DecodeRows(&data[0], data.size(), &band, error) &&
+         band.Finish(output, error);
+}
+
+// Feeds |data| to a StreamingDecoder cut at |cuts|.
+bool DecodeChunks(WallpaperEngine* engine, const ConversionOptions& options,
+                  const std::vector<uint8_t>& data, const Cuts& cuts,
+                  PixelBuffer* output, uint64_t* hash, std::string* error) {
+  StreamingDecoder decoder(engine, options, std::string());
+  size_t start = 0;
+  for (size_t i = 0; i <= cuts.size(); ++i) {
+    size_t end = i < cuts.size() ? cuts[i] : data.size();
+    if (!decoder.Write(&data[start], end - start, error))
+      return false;
+    start = end;
+  }
+  if (decoder.bytes_received() != data.size()) {
+    *error = "Bytes went missing.";
+    return false;
+  }
+  *hash = decoder.content_hash();
+  return decoder.Finish(output, error);
+}
+
+// Checks that decoding |data| cut at |cuts| gives |reference|.
+bool CheckCuts(WallpaperEngine* engine, const ConversionOptions& options,
+               const std::vector<uint8_t>& data, const Cuts& cuts,
+               const PixelBuffer& reference, const char* name,
+               const char* feed) {
+  PixelBuffer output;
+  uint64_t hash = 0;
+  std::string error;
+  if (!DecodeChunks(engine, options, data, cuts, &output, &hash, &error)) {
+    printf("%s, %s: %s\n", name, feed, error.c_str());
+    return false;
+  }
+  if (hash != ContentHasher::Hash(&data[0], data.size())) {
+    printf("%s, %s: different content hash!\n", name, feed);
+    return false;
+  }
+  if (output.width() != reference.width() ||
+      output.height() != reference.height() ||
+      output.format() != reference.format() ||
+      memcmp(output.data(), reference.data(), reference.size()) != 0) {
+    printf("%s, %s: different pixels!\n", name, feed);
+    return false;
+  }
+  return true;
+}
+
+// Runs every feed on |data| for |options|.
+bool CheckImage(WallpaperEngine* engine, const ConversionOptions& options,
+                const std::vector<uint8_t>& data, const char* name) {
+  PixelBuffer reference;
+  std::string error;
+  if (!DecodeWhole(engine, options, data, &reference, &error)) {
+    printf("%s: %s\n", name, error.c_str());
+    return false;
+  }
+
+  bool ok = CheckCuts(engine, options, data, Cuts(), reference, name,
+                      "one chunk");
+  Cuts single_bytes = SingleBytes(data.size());
+  ok = CheckCuts(engine, options, data, single_bytes, reference, name,
+                 "single bytes") && ok;
+  for (size_t split = 1; split <= kSniffBytes; ++split) {
+    char feed[32];
+    sprintf(feed, "split at %d", static_cast<int>(split));
+    ok = CheckCuts(engine, options, data, Cuts(1, split), reference, name,
+                   feed) && ok;
+  }
+  std::vector<size_t> splits =
+      StructureSplits(data, SniffImageFormat(&data[0], data.size()));
+  for (size_t i = 0; i < splits.size(); ++i) {
+    char feed[32];
+    sprintf(feed, "split at %d", static_cast<int>(splits[i]));
+    ok = CheckCuts(engine, options, data, Cuts(1, splits[i]), reference,
+                   name, feed) && ok;
+  }
+  for (unsigned seed = 1; seed <= 8; ++seed) {
+    char feed[32];
+    sprintf(feed, "random chunks %u", seed);
+    ok = CheckCuts(engine, options, data, RandomChunks(data.size(), seed),
+                   reference, name, feed) && ok;
+  }
+
+  PixelBuffer output;
+  uint64_t hash;
+  double whole_seconds = MeasureSeconds([&]() {
+    DecodeWhole(engine, options, data, &output, &error);
+  }, 0.2);
+  double bytes_seconds = MeasureSeconds([&]() {
+    DecodeChunks(engine, options, data, single_bytes, &output, &hash, &error);
+  }, 0.2);
+  printf("%-36s %8d %7d %10.2f ms %10.2f ms  %s\n", name,
+         static_cast<int>(data.size()), static_cast<int>(splits.size()),
+         whole_seconds * 1e3, bytes_seconds * 1e3, ok ? "same" : "FAILED");
+  return ok;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string directory = argc > 1 ? argv[1] : ".";
+
+  WorkerPool workers(0);
+  WallpaperEngine engine;
+  engine.set_worker_pool(&workers);
+  bool ok = true;
+  printf("%-36s %8s %7s %13s %13s\n", "image", "bytes", "splits", "one chunk",
+         "single bytes");
+  for (int variant = 0; variant < CORPUS_VARIANT_COUNT; ++variant) {
+    CorpusVariant corpus_variant = static_cast<CorpusVariant>(variant);
+    CorpusImage image;
+    std::string error;
+    if (!MakeCorpusImage(directory, corpus_variant, kImageWidth, kImageHeight,
+                         &image, &error)) {
+      printf("%s: %s\n", CorpusVariantName(corpus_variant), error.c_str());
+      ok = false;
+      continue;
+    }
+    std::vector<uint8_t> data;
+    if (!ReadFileToBuffer(image.path, &data) || data.empty()) {
+      printf("Unable to read %s\n", image.path.c_str());
+      ok = false;
+      continue;
+    }
+    if (!engine.DecoderFor(SniffImageFormat(&data[0], data.size()))) {
+      printf("%-36s skipped, nothing decodes it in this build\n",
+             CorpusVariantName(corpus_variant));
+      continue;
+    }
+
+    for (int screen = 0; screen < 2; ++screen) {
+      char name[64];
+      sprintf(name, "%s %dx%d%s", CorpusVariantName(corpus_variant),
+              kImageWidth, kImageHeight,
+              screen ? " for 256x144" : "");
+      ok = CheckImage(&engine, MakeOptions(screen != 0), data, name) && ok;
+    }
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,378 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+// Measures the time to wallpaper: from script calling setWallpaper() to its
+// callback, through a MockHost that downloads the image, the engine that
+// converts it for a 1080p screen and the ApplyQueue, with a
+// FakeDesktopBackend as slow as a real desktop standing in for Windows. The
+// images are a synthetic corpus of every format and variant from 640x480 to
+// 16K, written to a directory on the first run and reused by the next ones.
+// For each image it reports the distribution of the time to wallpaper, the
+// median of every stage, the throughput and the most memory pixel buffers
+// held at once. The conversion cache is off, so every run does all the work.
+// GIF only decodes through GDI+, which the benchmark sets up like the
+// Windows service does, so only Windows builds have GIF rows.
+//
+// Usage: wallpaper_benchmark [max width] [corpus directory]
+// The 16K images take a few GB of memory and a while to convert, a max width
+// of 7680 stops at 8K. The corpus goes to the current directory by default.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <gdiplus.h>
+#endif
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "desktop_service.h"
+#include "engine/fake_desktop_backend.h"
+#include "engine/stats.h"
+#if defined(_WIN32)
+#include "gdiplus_decoder.h"
+#endif
+#include "image_corpus.h"
+#include "mock_host.h"
+
+using namespace set_wallpaper_extension;
+
+namespace {
+
+const int kScreenWidth = 1920;
+const int kScreenHeight = 1080;
+const uint32_t kBackgroundColor = 0x3A6EA5;
+
+const int64_t kConnectNanoseconds = 2000000;
+const int64_t kApplyNanoseconds = 1000000;
+
+// Every image runs once to warm up, then at least kMinRuns times and until
+// kMinSeconds passed, but no more than kMaxRuns times.
+const int kMinRuns = 3;
+const int kMaxRuns = 25;
+const double kMinSeconds = 2.0;
+
+const int64_t kTimeoutNanoseconds = 300 * 1000000000LL;
+
+struct Size {
+  int width;
+  int height;
+};
+
+const Size kSizes[] = {
+  { 640, 480 },
+  { 1920, 1080 },
+  { 3840, 2160 },
+  { 7680, 4320 },
+  { 15360, 8640 },
+};
+
+const ImageFormat kVariantFormats[CORPUS_VARIANT_COUNT] = {
+  IMAGE_FORMAT_JPEG,
+  IMAGE_FORMAT_JPEG,
+  IMAGE_FORMAT_PNG,
+  IMAGE_FORMAT_PNG,
+  IMAGE_FORMAT_BMP,
+  IMAGE_FORMAT_GIF
+};
+
+std::string g_directory = ".";
+
+// Sets wallpapers the way every DesktopService does, on a fake desktop as
+// slow as a real one.
+class BenchmarkService : public DesktopService {
+ public:
+  BenchmarkService(NPP npp, FakeDesktopBackend* backend)
+      : DesktopService(npp, std::unique_ptr<DesktopBackend>(backend)) {
+    backend->set_connect_nanoseconds(kConnectNanoseconds);
+    backend->set_apply_nanoseconds(kApplyNanoseconds);
+    engine()->cache()->set_capacity(0);
+#if defined(_WIN32)
+    gdiplus_token_ = 0;
+    Gdiplus::GdiplusStartupInput gdiplus_startup_input;
+    Gdiplus::GdiplusStartup(&gdiplus_token_, &gdiplus_startup_input, NULL);
+    engine()->AddPlatformDecoder(&gdiplus_decoder_);
+#endif
+  }
+  virtual ~BenchmarkService() {
+    StopWorkers();
+#if defined(_WIN32)
+    if (gdiplus_token_)
+      Gdiplus::GdiplusShutdown(gdiplus_token_);
+#endif
+  }
+
+  bool CanDecode(ImageFormat format) {
+    return NULL != engine()->DecoderFor(format);
+  }
+
+  virtual bool GetSystemColor(NPVariant*) { return false; }
+  virtual bool GetWallpaperStyle(NPVariant*) { return false; }
+
+  virtual bool SetWallpaper(NPVariant* result, const StringView& url,
+                            int style, NPObject* callback) {
+    int id = StartImageDownload(url, style, callback);
+    if (!id)
+      return false;
+    INT32_TO_NPVARIANT(id, *result);
+    return true;
+  }
+
+  virtual void DownloadCompletionStatus(const char*, NPReason) {}
+
+ protected:
+  virtual ConversionOptions GetConversionOptions(WallpaperStyle style) {
+    ConversionOptions options;
+    options.style = style;
+    options.screen_width = kScreenWidth;
+    options.screen_height = kScreenHeight;
+    options.background_color = kBackgroundColor;
+    return options;
+  }
+
+  virtual std::string GetWallpaperBasePath() {
+    return g_directory + "/wallpaper";
+  }
+
+#if defined(_WIN32)
+ private:
+  ULONG_PTR gdiplus_token_;
+  GdiplusDecoder gdiplus_decoder_;
+#endif
+};
+
+BenchmarkService* g_service = NULL;
+
+// What the callback of the last setWallpaper() was called with.
+struct Completion {
+  bool done;
+  std::string status;
+  std::string details;
+};
+
+Completion g_completion;
+
+bool CompleteInvokeDefault(NPObject*, const NPVariant* args,
+                           uint32_t arg_count, NPVariant* result) {
+  g_completion.done = true;
+  if (arg_count >= 2 && NPVARIANT_IS_STRING(args[0]) &&
+      NPVARIANT_IS_STRING(args[1])) {
+    const NPString& status = NPVARIANT_TO_STRING(args[0]);
+    const NPString& details = NPVARIANT_TO_STRING(args[1]);
+    g_completion.status.assign(status.UTF8Characters, status.UTF8Length);
+    g_completion.details.assign(details.UTF8Characters, details.UTF8Length);
+  }
+  VOID_TO_NPVARIANT(*result);
+  return true;
+}
+
+NPClass g_callback_class = {
+  NP_CLASS_STRUCT_VERSION, NULL, NULL, NULL, NULL, NULL,
+  &CompleteInvokeDefault, NULL, NULL, NULL, NULL, NULL, NULL
+};
+
+// The number |name| has in |json|, 0 if it has none.
+double JsonNumber(const std::string& json, const char* name) {
+  std::string key = std::string("\"") + name + "\":";
+  size_t position = json.find(key);
+  if (std::string::npos == position)
+    return 0;
+  return atof(json.c_str() + position + key.size());
+}
+
+// The string |name| has in |json|, without unescaping it.
+std::string JsonString(const std::string& json, const char* name) {
+  std::string key = std::string("\"") + name + "\":\"";
+  size_t start = json.find(key);
+  if (std::string::npos == start)
+    return std::string();
+  start += key.size();
+  size_t end = start;
+  while (end < json.size() && json[end] != '"')
+    end += '\\' == json[end] ? 2 : 1;
+  return json.substr(start, std::min(end, json.size()) - start);
+}
+
+// One wallpaper: the time to it and to each of its stages, in milliseconds.
+struct Run {
+  double total;
+  double download;
+  double decode;
+  double resample;
+  // Converting, encoding and writing the output.
+  double output;
+  double apply;
+};
+
+// Sets |path| as the wallpaper through the bridge, like the options page
+// does, and waits for the callback. Returns false with the error reported
+// if the wallpaper wasn't set.
+bool SetWallpaper(MockHost* host, NPObject* bridge, const std::string& path,
+                  Run* run, std::string* error) {
+  NPP npp = host->npp();
+  NPObject* callback = NPN_CreateObject(npp, &g_callback_class);
+  NPVariant args[3];
+  STRINGN_TO_NPVARIANT(path.c_str(), static_cast<uint32_t>(path.size()),
+                       args[0]);
+  DOUBLE_TO_NPVARIANT(WALLPAPER_STYLE_FILL, args[1]);
+  OBJECT_TO_NPVARIANT(callback, args[2]);
+  g_completion = Completion();
+
+  int64_t start = MonotonicNanoseconds();
+  NPVariant id;
+  bool started = NPN_Invoke(npp, bridge,
+                            NPN_GetStringIdentifier("setWallpaper"), args, 3,
+                            &id);
+  NPN_ReleaseObject(callback);
+  if (!started) {
+    *error = "setWallpaper() failed: " + MockHost::last_exception();
+    return false;
+  }
+  if (!host->RunUntil([]() { return g_completion.done; },
+                      kTimeoutNanoseconds)) {
+    *error = "Timed out.";
+    return false;
+  }
+  run->total = (MonotonicNanoseconds() - start) / 1e6;
+
+  const std::string& details = g_completion.details;
+  if (g_completion.status != "success") {
+    *error = g_completion.status + ": " + JsonString(details, "error");
+    return false;
+  }
+  run->download = JsonNumber(details, "download");
+  run->decode = JsonNumber(details, "decode");
+  run->resample = JsonNumber(details, "resample");
+  run->output = JsonNumber(details, "convert") +
+                JsonNumber(details, "encode") + JsonNumber(details, "write");
+  run->apply = JsonNumber(details, "apply");
+  return true;
+}
+
+// The value |percent| of |values| are at or below, |values| sorted.
+double Percentile(const std::vector<double>& values, int percent) {
+  size_t rank = (values.size() * percent + 99) / 100;
+  return values[rank > 0 ? rank - 1 : 0];
+}
+
+double Median(const std::vector<Run>& runs, double Run::*stage) {
+  std::vector<double> values;
+  for (size_t i = 0; i < runs.size(); ++i)
+    values.push_back(runs[i].*stage);
+  std::sort(values.begin(), values.end());
+  return Percentile(values, 50);
+}
+
+}  // namespace
+
+namespace set_wallpaper_extension {
+
+DesktopService* CreateDesktopService(NPP npp) {
+  g_service = new BenchmarkService(npp, new FakeDesktopBackend());
+  return g_service;
+}
+
+}  // namespace set_wallpaper_extension
+
+int main(int argc, char** argv) {
+  int max_width = argc > 1 ? atoi(argv[1]) : kSizes[4].width;
+  if (argc > 2)
+    g_directory = argv[2];
+
+  bool ok = true;
+  MockHost host;
+  NPObject* bridge = host.GetScriptableObject();
+  if (NULL == bridge) {
+    printf("The plugin has no scriptable object!\n");
+    return 1;
+  }
+
+  printf("%-34s %7s %4s %8s %8s %8s %7s %7s %7s %7s %7s %7s %7s %7s\n",
+         "image", "MB", "runs", "p50 ms", "p95 ms", "max ms", "down",
+         "decode", "resamp", "output", "apply", "MP/s", "MB/s", "peak MB");
+
+  for (size_t size = 0; size < sizeof(kSizes) / sizeof(kSizes[0]); ++size) {
+    if (kSizes[size].width > max_width)
+      break;
+    for (int variant = 0; variant < CORPUS_VARIANT_COUNT; ++variant) {
+      CorpusVariant corpus_variant = static_cast<CorpusVariant>(variant);
+      char name[64];
+      sprintf(name, "%s %dx%d", CorpusVariantName(corpus_variant),
+              kSizes[size].width, kSizes[size].height);
+
+#if !defined(_WIN32)
+      if (CORPUS_GIF == corpus_variant)
+        continue;
+#endif
+      if (!g_service->CanDecode(kVariantFormats[variant])) {
+        printf("%-34s nothing decodes it in this build!\n", name);
+        ok = false;
+        continue;
+      }
+
+      CorpusImage image;
+      std::string error;
+      if (!MakeCorpusImage(g_directory, corpus_variant, kSizes[size].width,
+                           kSizes[size].height, &image, &error)) {
+        printf("%-34s %s\n", name, error.c_str());
+        ok = false;
+        continue;
+      }
+
+      Run run;
+      if (!SetWallpaper(&host, bridge, image.path, &run, &error)) {
+        printf("%-34s %s\n", name, error.c_str());
+        ok = false;
+        continue;
+      }
+
+      Stats::ResetPeakBufferBytes();
+      std::vector<Run> runs;
+      int64_t started = MonotonicNanoseconds();
+      while (static_cast<int>(runs.size()) < kMinRuns ||
+             (static_cast<int>(runs.size()) < kMaxRuns &&
+              MonotonicNanoseconds() - started < kMinSeconds * 1e9)) {
+        if (!SetWallpaper(&host, bridge, image.path, &run, &error)) {
+          printf("%-34s %s\n", name, error.c_str());
+          ok = false;
+          break;
+        }
+        runs.push_back(run);
+      }
+      if (runs.empty())
+        continue;
+      Stats::Snapshot snapshot;
+      Stats::Read(&snapshot);
+
+      std::vector<double> totals;
+      for (size_t i = 0; i < runs.size(); ++i)
+        totals.push_back(runs[i].total);
+      std::sort(totals.begin(), totals.end());
+      double p50 = Percentile(totals, 50);
+      double megabytes = image.bytes / 1e6;
+      double megapixels = static_cast<double>(image.width) * image.height /
+                          1e6;
+      printf("%-34s %7.1f %4d %8.1f %8.1f %8.1f %7.1f %7.1f %7.1f %7.1f "
+             "%7.1f %7.1f %7.1f %7.1f\n",
+             name, megabytes, static_cast<int>(runs.size()), p50,
+             Percentile(totals, 95), totals.back(),
+             Median(runs, &Run::download), Median(runs, &Run::decode),
+             Median(runs, &Run::resample), Median(runs, &Run::output),
+             Median(runs, &Run::apply), megapixels * 1e3 / p50,
+             megabytes * 1e3 / p50, snapshot.peak_buffer_bytes / 1e6);
+      fflush(stdout);
+    }
+  }
+  if (!ok)
+    printf("Not every wallpaper could be set!\n");
+
+  // The reference the page held.
+  NPN_ReleaseObject(bridge);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,532 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+// Drives overlapping setWallpaper() calls through a MockHost and checks that
+// every callback is called once, with the id its call returned and the
+// outcome of its own job, however the downloads and conversions of the jobs
+// interleave: a wallpaper cancelled with cancelWallpaper() in the middle of
+// its stream, one superseded mid-stream so its NPP_URLNotify() comes after
+// the stream of the next one opened, jobs started back to back so they are
+// superseded before their download opens, streamed and as files, one
+// superseded while a worker converts it, which may complete after the job
+// that replaced it, a URL the browser refuses, and a download that fails.
+// For each case it reports the time until every callback was called and the
+// order they were called in.
+//
+// Usage: wallpaper_job_benchmark [corpus directory]
+// The corpus goes to the current directory by default.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "desktop_service.h"
+#include "engine/fake_desktop_backend.h"
+#include "engine/stats.h"
+#include "image_corpus.h"
+#include "mock_host.h"
+
+using namespace set_wallpaper_extension;
+
+namespace {
+
+const int kScreenWidth = 1920;
+const int kScreenHeight = 1080;
+
+const int64_t kTimeoutNanoseconds = 60 * 1000000000LL;
+
+// Chunks of the large image the host delivers before the job is cancelled
+// or superseded, a few of the dozens it has.
+const int kChunksBeforeCancel = 4;
+
+// Jobs started in a row without running the event loop.
+const int kBackToBackJobs = 4;
+
+std::string g_directory = ".";
+
+// Sets wallpapers the way every DesktopService does, on a fake desktop that
+// applies them right away.
+class BenchmarkService : public DesktopService {
+ public:
+  BenchmarkService(NPP npp, FakeDesktopBackend* backend)
+      : DesktopService(npp, std::unique_ptr<DesktopBackend>(backend)),
+        backend_(backend) {
+    backend_->set_connect_nanoseconds(0);
+    backend_->set_apply_nanoseconds(0);
+    engine()->cache()->set_capacity(0);
+  }
+  virtual ~BenchmarkService() { StopWorkers(); }
+
+  virtual bool GetSystemColor(NPVariant*) { return false; }
+  virtual bool GetWallpaperStyle(NPVariant*) { return false; }
+
+  virtual bool SetWallpaper(NPVariant* result, const StringView& url,
+                            int style, NPObject* callback) {
+    int id = StartImageDownload(url, style, callback);
+    if (!id)
+      return false;
+    INT32_TO_NPVARIANT(id, *result);
+    return true;
+  }
+
+  virtual void DownloadCompletionStatus(const char*, NPReason) {}
+
+  // Paths of the wallpapers applied so far, oldest first.
+  std::vector<std::string> applied_paths() const {
+    return backend_->applied_paths();
+  }
+
+ protected:
+  virtual ConversionOptions GetConversionOptions(WallpaperStyle style) {
+    ConversionOptions options;
+    options.style = style;
+    options.screen_width = kScreenWidth;
+    options.screen_height = kScreenHeight;
+    return options;
+  }
+
+  virtual std::string GetWallpaperBasePath() {
+    return g_directory + "/job-wallpaper";
+  }
+
+ private:
+  // Owned by the DesktopService.
+  FakeDesktopBackend* backend_;
+};
+
+BenchmarkService* g_service = NULL;
+
+// What a callback was called with. Callbacks are told apart by their
+// object, which the benchmark keeps until the end so no other callback
+// gets its address.
+struct Completion {
+  Completion() : calls(0) {}
+
+  int calls;
+  std::string status;
+  std::string details;
+};
+
+std::map<NPObject*, Completion> g_completions;
+
+// The callbacks in the order they were called.
+std::vector<NPObject*> g_completion_order;
+
+bool CompleteInvokeDefault(NPObject* callback, const NPVariant* args,
+                           uint32_t arg_count, NPVariant* result) {
+  Completion& completion = g_completions[callback];
+  ++completion.calls;
+  g_completion_order.push_back(callback);
+  if (arg_count >= 2 && NPVARIANT_IS_STRING(args[0]) &&
+      NPVARIANT_IS_STRING(args[1])) {
+    const NPString& status = NPVARIANT_TO_STRING(args[0]);
+    const NPString& details = NPVARIANT_TO_STRING(args[1]);
+    completion.status.assign(status.UTF8Characters, status.UTF8Length);
+    completion.details.assign(details.UTF8Characters, details.UTF8Length);
+  }
+  VOID_TO_NPVARIANT(*result);
+  return true;
+}
+
+NPClass g_callback_class = {
+  NP_CLASS_STRUCT_VERSION, NULL, NULL, NULL, NULL, NULL,
+  &CompleteInvokeDefault, NULL, NULL, NULL, NULL, NULL, NULL
+};
+
+// The number |name| has in |json|, 0 if it has none.
+double JsonNumber(const std::string& json, const char* name) {
+  std::string key = std::string("\"") + name + "\":";
+  size_t position = json.find(key);
+  if (std::string::npos == position)
+    return 0;
+  return atof(json.c_str() + position + key.size());
+}
+
+// The string |name| has in |json|, without unescaping it.
+std::string JsonString(const std::string& json, const char* name) {
+  std::string key = std::string("\"") + name + "\":\"";
+  size_t start = json.find(key);
+  if (std::string::npos == start)
+    return std::string();
+  start += key.size();
+  size_t end = start;
+  while (end < json.size() && json[end] != '"')
+    end += '\\' == json[end] ? 2 : 1;
+  return json.substr(start, std::min(end, json.size()) - start);
+}
+
+// A setWallpaper() call and what it is expected to end with.
+struct Job {
+  Job() : callback(NULL), id(0), expected_status(NULL),
+          expected_error(NULL) {}
+
+  std::string path;
+  NPObject* callback;
+  // What setWallpaper() returned.
+  int id;
+  const char* expected_status;
+  // NULL if any error will do.
+  const char* expected_error;
+};
+
+// Every job started, so their callbacks are released at the end.
+std::vector<Job*> g_jobs;
+
+// Starts setting |path| as the wallpaper through the bridge, like the
+// options page does, and returns the job, expected to end with |status| and
+// |error|. The job is NULL if setWallpaper() failed.
+Job* StartWallpaper(MockHost* host, NPObject* bridge, const std::string& path,
+                    const char* status, const char* error) {
+  NPP npp = host->npp();
+  Job* job = new Job();
+  job->path = path;
+  job->callback = NPN_CreateObject(npp, &g_callback_class);
+  job->expected_status = status;
+  job->expected_error = error;
+  g_jobs.push_back(job);
+
+  NPVariant args[3];
+  STRINGN_TO_NPVARIANT(path.c_str(), static_cast<uint32_t>(path.size()),
+                       args[0]);
+  DOUBLE_TO_NPVARIANT(WALLPAPER_STYLE_FILL, args[1]);
+  OBJECT_TO_NPVARIANT(job->callback, args[2]);
+  NPVariant id;
+  if (!NPN_Invoke(npp, bridge, NPN_GetStringIdentifier("setWallpaper"), args,
+                  3, &id)) {
+    printf("setWallpaper() failed: %s\n", MockHost::last_exception().c_str());
+    return NULL;
+  }
+  if (NPVARIANT_IS_INT32(id))
+    job->id = NPVARIANT_TO_INT32(id);
+  else if (NPVARIANT_IS_DOUBLE(id))
+    job->id = static_cast<int>(NPVARIANT_TO_DOUBLE(id));
+  return job;
+}
+
+// Calls cancelWallpaper(|id|) through the bridge. Returns what it returned,
+// or false if the call failed.
+bool CancelWallpaper(MockHost* host, NPObject* bridge, int id) {
+  NPVariant args[1];
+  INT32_TO_NPVARIANT(id, args[0]);
+  NPVariant result;
+  if (!NPN_Invoke(host->npp(), bridge,
+                  NPN_GetStringIdentifier("cancelWallpaper"), args, 1,
+                  &result)) {
+    return false;
+  }
+  return NPVARIANT_IS_BOOLEAN(result) && NPVARIANT_TO_BOOLEAN(result);
+}
+
+// Runs |task| on the event loop once the downloads that are running got
+// |chunks| more steps. The host runs its tasks in the order they were
+// posted, so each hop lets every download write one more chunk.
+void AfterChunks(MockHost* host, int chunks, const MockHost::Task& task) {
+  if (chunks <= 0) {
+    task();
+    return;
+  }
+  host->PostTask([host, chunks, task]() {
+    AfterChunks(host, chunks - 1, task);
+  }, 0);
+}
+
+bool Completed(const std::vector<Job*>& jobs) {
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    if (g_completions[jobs[i]->callback].calls == 0)
+      return false;
+  }
+  return true;
+}
+
+int64_t BytesDownloaded() {
+  Stats::Snapshot snapshot;
+  Stats::Read(&snapshot);
+  return snapshot.counters[STATS_BYTES_DOWNLOADED];
+}
+
+// Checks that the callback of |job| was called once, with its id and the
+// outcome it expects.
+bool CheckJob(const Job& job) {
+  const Completion& completion = g_completions[job.callback];
+  const std::string& details = completion.details;
+  std::string error = JsonString(details, "error");
+  if (completion.calls != 1) {
+    printf("job %d called back %d times!\n", job.id, completion.calls);
+    return false;
+  }
+  if (static_cast<int>(JsonNumber(details, "id")) != job.id) {
+    printf("job %d called back with the report of job %d!\n", job.id,
+           static_cast<int>(JsonNumber(details, "id")));
+    return false;
+  }
+  if (completion.status != job.expected_status ||
+      (job.expected_error && error != job.expected_error)) {
+    printf("job %d %s: \"%s\", expected %s: \"%s\"!\n", job.id,
+           completion.status.c_str(), error.c_str(), job.expected_status,
+           job.expected_error ? job.expected_error : "...");
+    return false;
+  }
+  if (completion.status == "success" &&
+      static_cast<int>(JsonNumber(details, "pixels")) !=
+          kScreenWidth * kScreenHeight) {
+    printf("job %d reported %d pixels!\n", job.id,
+           static_cast<int>(JsonNumber(details, "pixels")));
+    return false;
+  }
+  return true;
+}
+
+// Waits for the callbacks of |jobs| and checks them, then reports the case
+// as |name| with the time since |start|.
+bool FinishCase(MockHost* host, const char* name,
+                const std::vector<Job*>& jobs, int64_t start) {
+  bool ok = true;
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    if (NULL == jobs[i]) {
+      printf("%s: not every job started!\n", name);
+      return false;
+    }
+  }
+  if (!host->RunUntil([&jobs]() { return Completed(jobs); },
+                      kTimeoutNanoseconds)) {
+    printf("%s: timed out!\n", name);
+    ok = false;
+  }
+  double milliseconds = (MonotonicNanoseconds() - start) / 1e6;
+  // Whatever would call back a second time.
+  host->RunPendingCalls();
+
+  std::string order;
+  for (size_t i = 0; i < g_completion_order.size(); ++i) {
+    for (size_t j = 0; j < jobs.size(); ++j) {
+      if (jobs[j]->callback == g_completion_order[i]) {
+        char id[16];
+        sprintf(id, "%s%d", order.empty() ? "" : ", ", jobs[j]->id);
+        order += id;
+      }
+    }
+  }
+  for (size_t i = 0; i < jobs.size(); ++i)
+    ok = CheckJob(*jobs[i]) && ok;
+  printf("%-40s %8.1f ms  %-16s %s\n", name, milliseconds, order.c_str(),
+         ok ? "ok" : "FAILED");
+  g_completion_order.clear();
+  return ok;
+}
+
+// Cancels a job with cancelWallpaper() after a few chunks of its stream.
+bool CheckCancelMidStream(MockHost* host, NPObject* bridge,
+                          const CorpusImage& large) {
+  g_service->set_is_streaming(true);
+  int64_t start = MonotonicNanoseconds();
+  int64_t bytes = BytesDownloaded();
+  Job* job = StartWallpaper(host, bridge, large.path, "cancelled",
+                            "The download was cancelled.");
+  if (NULL == job)
+    return false;
+  bool cancelled = false;
+  AfterChunks(host, kChunksBeforeCancel, [&]() {
+    cancelled = CancelWallpaper(host, bridge, job->id);
+  });
+  bool ok = FinishCase(host, "cancelled mid-stream",
+                       std::vector<Job*>(1, job), start);
+  bytes = BytesDownloaded() - bytes;
+  if (!cancelled) {
+    printf("cancelWallpaper() didn't find the job!\n");
+    ok = false;
+  }
+  if (bytes <= 0 || bytes >= large.bytes) {
+    printf("%lld of %lld bytes downloaded, the stream wasn't cut short!\n",
+           static_cast<long long>(bytes), static_cast<long long>(large.bytes));
+    ok = false;
+  }
+  if (CancelWallpaper(host, bridge, job->id)) {
+    printf("cancelWallpaper() found the job after it completed!\n");
+    ok = false;
+  }
+  return ok;
+}
+
+// Supersedes a job after a few chunks of its stream. The next job's stream
+// opens and gets its first chunk before the browser destroys the first
+// stream and notifies its URL.
+bool CheckSupersedeMidStream(MockHost* host, NPObject* bridge,
+                             const CorpusImage& large,
+                             const CorpusImage& small) {
+  g_service->set_is_streaming(true);
+  int64_t start = MonotonicNanoseconds();
+  std::vector<Job*> jobs;
+  jobs.push_back(StartWallpaper(host, bridge, large.path, "cancelled",
+                                "The download was cancelled."));
+  AfterChunks(host, kChunksBeforeCancel, [&]() {
+    jobs.push_back(StartWallpaper(host, bridge, small.path, "success", ""));
+  });
+  // The second job only starts on the event loop.
+  if (!host->RunUntil([&jobs]() { return jobs.size() == 2; },
+                      kTimeoutNanoseconds)) {
+    printf("superseded mid-stream: the second job never started!\n");
+    return false;
+  }
+  return FinishCase(host, "superseded mid-stream", jobs, start);
+}
+
+// Starts a few jobs in a row, so all but the last are superseded before
+// their download opens and the browser is refused their stream.
+bool CheckBackToBack(MockHost* host, NPObject* bridge,
+                     const CorpusImage& large, const CorpusImage& small,
+                     bool streaming) {
+  g_service->set_is_streaming(streaming);
+  int64_t start = MonotonicNanoseconds();
+  std::vector<Job*> jobs;
+  for (int i = 0; i < kBackToBackJobs; ++i) {
+    bool last = i + 1 == kBackToBackJobs;
+    jobs.push_back(StartWallpaper(host, bridge,
+                                  i % 2 ? small.path : large.path,
+                                  last ? "success" : "cancelled",
+                                  last ? "" : "The download was cancelled."));
+  }
+  return FinishCase(host, streaming ? "back to back, streamed" :
+                                      "back to back, as files",
+                    jobs, start);
+}
+
+// Supersedes a job once its file was handed to a worker, which notices at
+// the next stage of the conversion. Its callback may be called before or
+// after the one of the job that replaced it.
+bool CheckSupersedeConverting(MockHost* host, NPObject* bridge,
+                              const CorpusImage& large,
+                              const CorpusImage& small) {
+  g_service->set_is_streaming(false);
+  int64_t start = MonotonicNanoseconds();
+  int64_t bytes = BytesDownloaded();
+  std::vector<Job*> jobs;
+  jobs.push_back(StartWallpaper(host, bridge, large.path, "cancelled", NULL));
+  // The file is counted once it is mapped, right before the worker gets it.
+  if (!host->RunUntil([bytes]() { return BytesDownloaded() > bytes; },
+                      kTimeoutNanoseconds)) {
+    printf("superseded converting: the file never came!\n");
+    return false;
+  }
+  jobs.push_back(StartWallpaper(host, bridge, small.path, "success", ""));
+  return FinishCase(host, "superseded converting", jobs, start);
+}
+
+// A URL the browser refuses to get fails setWallpaper() right away: the
+// job in flight goes on, and the refused callback is neither called nor
+// kept.
+bool CheckRefusedUrl(MockHost* host, NPObject* bridge,
+                     const CorpusImage& small) {
+  g_service->set_is_streaming(true);
+  int64_t start = MonotonicNanoseconds();
+  std::vector<Job*> jobs;
+  jobs.push_back(StartWallpaper(host, bridge, small.path, "success", ""));
+
+  NPP npp = host->npp();
+  NPObject* refused = NPN_CreateObject(npp, &g_callback_class);
+  const std::string kUrl = "http://example.com/wallpaper.png";
+  NPVariant args[3];
+  STRINGN_TO_NPVARIANT(kUrl.c_str(), static_cast<uint32_t>(kUrl.size()),
+                       args[0]);
+  DOUBLE_TO_NPVARIANT(WALLPAPER_STYLE_FILL, args[1]);
+  OBJECT_TO_NPVARIANT(refused, args[2]);
+  NPVariant id;
+  bool ok = true;
+  if (NPN_Invoke(npp, bridge, NPN_GetStringIdentifier("setWallpaper"), args,
+                 3, &id)) {
+    printf("setWallpaper() took a URL the browser refused!\n");
+    ok = false;
+  }
+  ok = FinishCase(host, "refused URL", jobs, start) && ok;
+  if (g_completions[refused].calls != 0 || refused->referenceCount != 1) {
+    printf("The refused callback was called %d times and kept %u times!\n",
+           g_completions[refused].calls, refused->referenceCount - 1);
+    ok = false;
+  }
+  NPN_ReleaseObject(refused);
+  return ok;
+}
+
+// A download that fails reports it to its own callback.
+bool CheckFailedDownload(MockHost* host, NPObject* bridge) {
+  g_service->set_is_streaming(true);
+  int64_t start = MonotonicNanoseconds();
+  std::vector<Job*> jobs;
+  jobs.push_back(StartWallpaper(host, bridge, g_directory + "/missing.png",
+                                "failed", "Unable to download the image."));
+  return FinishCase(host, "failed download", jobs, start);
+}
+
+}  // namespace
+
+namespace set_wallpaper_extension {
+
+DesktopService* CreateDesktopService(NPP npp) {
+  g_service = new BenchmarkService(npp, new FakeDesktopBackend());
+  return g_service;
+}
+
+}  // namespace set_wallpaper_extension
+
+int main(int argc, char** argv) {
+  if (argc > 1)
+    g_directory = argv[1];
+
+  // Dozens of stream chunks, and a few for the job that replaces it.
+  CorpusImage large;
+  CorpusImage small;
+  std::string error;
+  if (!MakeCorpusImage(g_directory, CORPUS_PNG, 1920, 1080, &large, &error) ||
+      !MakeCorpusImage(g_directory, CORPUS_JPEG, 640, 480, &small, &error)) {
+    printf("%s\n", error.c_str());
+    return 1;
+  }
+
+  bool ok = true;
+  {
+    MockHost host;
+    NPObject* bridge = host.GetScriptableObject();
+    if (NULL == bridge) {
+      printf("The plugin has no scriptable object!\n");
+      return 1;
+    }
+
+    printf("%-40s %11s  %-16s\n", "case", "time", "called back");
+    ok = CheckCancelMidStream(&host, bridge, large) && ok;
+    ok = CheckSupersedeMidStream(&host, bridge, large, small) && ok;
+    ok = CheckBackToBack(&host, bridge, large, small, true) && ok;
+    ok = CheckBackToBack(&host, bridge, large, small, false) && ok;
+    ok = CheckSupersedeConverting(&host, bridge, large, small) && ok;
+    ok = CheckRefusedUrl(&host, bridge, small) && ok;
+    ok = CheckFailedDownload(&host, bridge) && ok;
+
+    // Only the jobs that succeeded got to the desktop.
+    int successes = 0;
+    for (size_t i = 0; i < g_jobs.size(); ++i) {
+      if (g_completions[g_jobs[i]->callback].status == "success")
+        ++successes;
+    }
+    std::vector<std::string> applied = g_service->applied_paths();
+    if (static_cast<int>(applied.size()) != successes) {
+      printf("%d wallpapers applied for %d jobs that succeeded!\n",
+             static_cast<int>(applied.size()), successes);
+      ok = false;
+    }
+    for (size_t i = 0; i < applied.size(); ++i)
+      remove(applied[i].c_str());
+
+    for (size_t i = 0; i < g_jobs.size(); ++i) {
+      NPN_ReleaseObject(g_jobs[i]->callback);
+      delete g_jobs[i];
+    }
+    // The reference the page held.
+    NPN_ReleaseObject(bridge);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+// Checks the geometry every style lays images out with on a 1080p screen,
+// for landscape and portrait images larger than the screen, ones smaller
+// than it and one exactly its size, then measures how long planning takes.
+// FILL has to cover the screen and crop, FIT has to show the whole image and
+// leave bars, whichever way the image is off from the screen.
+//
+// Usage: wallpaper_layout_benchmark
+
+#include <math.h>
+#include <stdio.h>
+
+#include "benchmark.h"
+#include "engine/wallpaper_layout.h"
+
+using namespace set_wallpaper_extension;
+
+namespace {
+
+const int kScreenWidth = 1920;
+const int kScreenHeight = 1080;
+
+struct Case {
+  WallpaperStyle style;
+  int image_width;
+  int image_height;
+  // What PlanPrescale() is expected to give, all 0 if it can't plan.
+  int scaled_width;
+  int scaled_height;
+  int crop_x;
+  int crop_y;
+  int width;
+  int height;
+};
+
+const Case kCases[] = {
+  // 3:2 photo, proportionally taller than the screen.
+  { WALLPAPER_STYLE_CENTER, 12000, 8000, 12000, 8000, 5040, 3460, 1920, 1080 },
+  { WALLPAPER_STYLE_TILE, 12000, 8000, 0, 0, 0, 0, 0, 0 },
+  { WALLPAPER_STYLE_STRETCH, 12000, 8000, 1920, 1080, 0, 0, 1920, 1080 },
+  { WALLPAPER_STYLE_FIT, 12000, 8000, 1620, 1080, 0, 0, 1620, 1080 },
+  { WALLPAPER_STYLE_FILL, 12000, 8000, 1920, 1280, 0, 100, 1920, 1080 },
+  // 5:1 panorama, proportionally wider than the screen.
+  { WALLPAPER_STYLE_CENTER, 10000, 2000, 10000, 2000, 4040, 460, 1920, 1080 },
+  { WALLPAPER_STYLE_STRETCH, 10000, 2000, 1920, 1080, 0, 0, 1920, 1080 },
+  { WALLPAPER_STYLE_FIT, 10000, 2000, 1920, 384, 0, 0, 1920, 384 },
+  { WALLPAPER_STYLE_FILL, 10000, 2000, 5400, 1080, 1740, 0, 1920, 1080 },
+  // Portrait.
+  { WALLPAPER_STYLE_CENTER, 3000, 4000, 3000, 4000, 540, 1460, 1920, 1080 },
+  { WALLPAPER_STYLE_TILE, 3000, 4000, 0, 0, 0, 0, 0, 0 },
+  { WALLPAPER_STYLE_STRETCH, 3000, 4000, 1920, 1080, 0, 0, 1920, 1080 },
+  { WALLPAPER_STYLE_FIT, 3000, 4000, 810, 1080, 0, 0, 810, 1080 },
+  { WALLPAPER_STYLE_FILL, 3000, 4000, 1920, 2560, 0, 740, 1920, 1080 },
+  // 4:3, larger than the screen on both sides.
+  { WALLPAPER_STYLE_FIT, 4000, 3000, 1440, 1080, 0, 0, 1440, 1080 },
+  { WALLPAPER_STYLE_FILL, 4000, 3000, 1920, 1440, 0, 180, 1920, 1080 },
+  // 4:3, smaller than the screen, enlarged by every style that scales.
+  { WALLPAPER_STYLE_CENTER, 640, 480, 640, 480, 0, 0, 640, 480 },
+  { WALLPAPER_STYLE_TILE, 640, 480, 0, 0, 0, 0, 0, 0 },
+  { WALLPAPER_STYLE_STRETCH, 640, 480, 1920, 1080, 0, 0, 1920, 1080 },
+  { WALLPAPER_STYLE_FIT, 640, 480, 1440, 1080, 0, 0, 1440, 1080 },
+  { WALLPAPER_STYLE_FILL, 640, 480, 1920, 1440, 0, 180, 1920, 1080 },
+  // Smaller than the screen and wider than it proportionally.
+  { WALLPAPER_STYLE_FIT, 800, 200, 1920, 480, 0, 0, 1920, 480 },
+  { WALLPAPER_STYLE_FILL, 800, 200, 4320, 1080, 1200, 0, 1920, 1080 },
+  // Exactly the size of the screen, left as it is.
+  { WALLPAPER_STYLE_CENTER, 1920, 1080, 1920, 1080, 0, 0, 1920, 1080 },
+  { WALLPAPER_STYLE_TILE, 1920, 1080, 0, 0, 0, 0, 0, 0 },
+  { WALLPAPER_STYLE_STRETCH, 1920, 1080, 1920, 1080, 0, 0, 1920, 1080 },
+  { WALLPAPER_STYLE_FIT, 1920, 1080, 1920, 1080, 0, 0, 1920, 1080 },
+  { WALLPAPER_STYLE_FILL, 1920, 1080, 1920, 1080, 0, 0, 1920, 1080 },
+};
+
+const char* StyleName(WallpaperStyle style) {
+  switch (style) {
+  case WALLPAPER_STYLE_CENTER: return "center";
+  case WALLPAPER_STYLE_TILE: return "tile";
+  case WALLPAPER_STYLE_STRETCH: return "stretch";
+  case WALLPAPER_STYLE_FIT: return "fit";
+  case WALLPAPER_STYLE_FILL: return "fill";
+  }
+  return "?";
+}
+
+// Checks the plan and the placement of |test|.
+bool CheckCase(const Case& test) {
+  PrescalePlan plan;
+  bool planned = PlanPrescale(test.style, test.image_width, test.image_height,
+                              kScreenWidth, kScreenHeight, &plan);
+  WallpaperPlacement placement = PlaceWallpaper(
+      test.style, test.image_width, test.image_height, kScreenWidth,
+      kScreenHeight);
+
+  printf("%5dx%-5d %-8s ", test.image_width, test.image_height,
+         StyleName(test.style));
+  if (!planned) {
+    printf("%-32s ", "not planned");
+  } else {
+    char text[64];
+    sprintf(text, "%dx%d, %dx%d at %d,%d", plan.scaled_width,
+            plan.scaled_height, plan.width, plan.height, plan.crop_x,
+            plan.crop_y);
+    printf("%-32s ", text);
+  }
+
+  bool expect_plan = test.scaled_width > 0;
+  if (planned != expect_plan ||
+      (planned && (plan.scaled_width != test.scaled_width ||
+                   plan.scaled_height != test.scaled_height ||
+                   plan.crop_x != test.crop_x ||
+                   plan.crop_y != test.crop_y ||
+                   plan.width != test.width ||
+                   plan.height != test.height))) {
+    printf("expected %dx%d, %dx%d at %d,%d!\n", test.scaled_width,
+           test.scaled_height, test.width, test.height, test.crop_x,
+           test.crop_y);
+    return false;
+  }
+
+  // The first tile goes in the corner, everything else is centered at the
+  // size the plan rounds.
+  double x = 0.0;
+  double y = 0.0;
+  double width = test.image_width;
+  double height = test.image_height;
+  if (planned) {
+    x = (kScreenWidth - plan.scaled_width) / 2.0;
+    y = (kScreenHeight - plan.scaled_height) / 2.0;
+    width = plan.scaled_width;
+    height = plan.scaled_height;
+  }
+  if (fabs(placement.x - x) > 0.5 || fabs(placement.y - y) > 0.5 ||
+      fabs(placement.width - width) > 0.5 ||
+      fabs(placement.height - height) > 0.5) {
+    printf("placed at %.1f,%.1f, %.1fx%.1f!\n", placement.x, placement.y,
+           placement.width, placement.height);
+    return false;
+  }
+  printf("ok\n");
+  return true;
+}
+
+}  // namespace
+
+int main() {
+  bool ok = true;
+  for (size_t c = 0; c < sizeof(kCases) / sizeof(kCases[0]); ++c)
+    ok = CheckCase(kCases[c]) && ok;
+
+  PrescalePlan plan;
+  double seconds = MeasureSeconds([&]() {
+    for (int i = 0; i < 1000; ++i) {
+      PlanPrescale(static_cast<WallpaperStyle>(i % 5), 1000 + i, 3000 - i,
+                   kScreenWidth, kScreenHeight, &plan);
+    }
+  });
+  printf("\n%.1f ns per plan\n", seconds * 1e9 / 1000);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "command_desktop_backend.h"
+
+#include <errno.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+namespace set_wallpaper_extension {
+
+// Every wallpaper is installed at the same path, and GNOME doesn't reload a
+// picture-uri that didn't change, so the keys are reset before they are set.
+// Newer versions of GNOME show picture-uri-dark in dark mode, older ones
+// don't have it, so it isn't an error if setting it fails.
+const char CommandDesktopBackend::kGnomeCommand[] =
+    "gsettings set org.gnome.desktop.background picture-options \"$2\" && "
+    "gsettings reset org.gnome.desktop.background picture-uri && "
+    "gsettings set org.gnome.desktop.background picture-uri \"$3\" && "
+    "{ { gsettings reset org.gnome.desktop.background picture-uri-dark && "
+    "gsettings set org.gnome.desktop.background picture-uri-dark \"$3\"; "
+    "} 2>/dev/null || true; }";
+
+CommandDesktopBackend::CommandDesktopBackend(const std::string& command)
+    : command_(command) {
+}
+
+bool CommandDesktopBackend::Connect(std::string* error) {
+  if (command_.empty()) {
+    *error = "SetWallpaper::No command to set the wallpaper with!";
+    return false;
+  }
+  return true;
+}
+
+void CommandDesktopBackend::Disconnect() {
+}
+
+bool CommandDesktopBackend::Apply(const std::string& path,
+                                  WallpaperStyle style,
+                                  std::string* error) {
+  // The path and style are arguments, not part of the command, so the shell
+  // never interprets them.
+  std::string uri = FileUri(path);
+  const char* argv[] = {
+    "sh", "-c", command_.c_str(), "sh", path.c_str(), StyleName(style),
+    uri.c_str(), NULL
+  };
+  pid_t pid;
+  int result = posix_spawn(&pid, "/bin/sh", NULL, NULL,
+                           const_cast<char* const*>(argv), environ);
+  if (result != 0) {
+    *error = std::string("SetWallpaper::Unable to run the command: ") +
+             strerror(result);
+    return false;
+  }
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      *error = std::string("SetWallpaper::Lost the command: ") +
+               strerror(errno);
+      return false;
+    }
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    char message[64];
+    sprintf(message, "SetWallpaper::The command failed with %d!",
+            WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    *error = message;
+    return false;
+  }
+  return true;
+}
+
+const char* CommandDesktopBackend::StyleName(WallpaperStyle style) {
+  switch (style) {
+  case WALLPAPER_STYLE_CENTER:
+    return "centered";
+  case WALLPAPER_STYLE_TILE:
+    return "wallpaper";
+  case WALLPAPER_STYLE_FIT:
+    return "scaled";
+  case WALLPAPER_STYLE_FILL:
+    return "zoom";
+  case WALLPAPER_STYLE_STRETCH:
+  default:
+    return "stretched";
+  }
+}
+
+std::string CommandDesktopBackend::FileUri(const std::string& path) {
+  static const char kHexDigits[] = "0123456789ABCDEF";
+  std::string uri = "file://";
+  for (size_t i = 0; i < path.size(); ++i) {
+    // Not isalnum(), which depends on the locale.
+    unsigned char c = static_cast<unsigned char>(path[i]);
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9') || (c && strchr("-._~/", c))) {
+      uri += static_cast<char>(c);
+    } else {
+      uri += '%';
+      uri += kHexDigits[c >> 4];
+      uri += kHexDigits[c & 0xF];
+    }
+  }
+  return uri;
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,46 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef COMMAND_DESKTOP_BACKEND_H_
+#define COMMAND_DESKTOP_BACKEND_H_
+
+#include <string>
+
+#include "engine/desktop_backend.h"
+
+namespace set_wallpaper_extension {
+
+// Sets the wallpaper by running a shell command, which is how the desktops of
+// Linux and the BSDs are told about a new one: gsettings on GNOME, xfconf-query
+// on Xfce, feh or nitrogen on bare window managers. The command runs with
+// /bin/sh, with the path of the image as $1, the style as $2, named the way
+// the picture-options of GNOME name it: "centered", "wallpaper",
+// "stretched", "scaled" or "zoom", and the path as a file:// URI as $3. A
+// command that exits with anything but 0 failed to apply the wallpaper.
+class CommandDesktopBackend : public DesktopBackend {
+ public:
+  // The command GNOME, and the desktops built on its settings, take.
+  static const char kGnomeCommand[];
+
+  explicit CommandDesktopBackend(const std::string& command);
+
+  virtual bool Connect(std::string* error);
+  virtual void Disconnect();
+  virtual bool Apply(const std::string& path, WallpaperStyle style,
+                     std::string* error);
+
+  // What $2 is for |style|.
+  static const char* StyleName(WallpaperStyle style);
+
+  // What $3 is for |path|, an absolute path: file:// followed by the path
+  // with every byte but the unreserved ones of RFC 3986 and / escaped.
+  static std::string FileUri(const std::string& path);
+
+ private:
+  std::string command_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // COMMAND_DESKTOP_BACKEND_H_
@@ -0,0 +1,144 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "console_log.h"
+
+#include <stdio.h>
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// Messages the ring holds between two flushes, a power of two. A flush runs
+// on the next turn of the plugin thread, so only a stall of the page fills
+// it up.
+const size_t kRingSize = 1024;
+
+}  // namespace
+
+ConsoleLog::ConsoleLog(NPP npp)
+    : npp_(npp),
+      level_(LOG_LEVEL_OFF),
+      slots_(new Slot[kRingSize]),
+      mask_(kRingSize - 1),
+      write_position_(0),
+      read_position_(0),
+      flush_pending_(false),
+      dropped_(0),
+      console_(NULL),
+      debug_id_(NULL) {
+  for (size_t i = 0; i < kRingSize; ++i)
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+ConsoleLog::~ConsoleLog() {
+  if (console_)
+    NPN_ReleaseObject(console_);
+}
+
+// A bounded queue in the style of Dmitry Vyukov's: a slot whose sequence
+// equals the position being written is free for that lap. A writer claims
+// the position, fills the slot and publishes it by moving the sequence one
+// ahead, which is what Flush() waits for. Flush() hands the slot back to the
+// writers by moving it a whole lap ahead.
+bool ConsoleLog::Write(LogLevel level, std::string* message) {
+  if (!IsEnabled(level))
+    return false;
+
+  size_t position = write_position_.load(std::memory_order_relaxed);
+  Slot* slot;
+  for (;;) {
+    slot = &slots_[position & mask_];
+    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    intptr_t lag = static_cast<intptr_t>(sequence) -
+                   static_cast<intptr_t>(position);
+    if (0 == lag) {
+      if (write_position_.compare_exchange_weak(position, position + 1,
+                                                std::memory_order_relaxed))
+        break;
+    } else if (lag < 0) {
+      // A lap ahead of Flush(): the ring is full.
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return !flush_pending_.exchange(true);
+    } else {
+      position = write_position_.load(std::memory_order_relaxed);
+    }
+  }
+  slot->message.swap(*message);
+  slot->sequence.store(position + 1, std::memory_order_release);
+  return !flush_pending_.exchange(true);
+}
+
+void ConsoleLog::Flush() {
+  // Cleared first, so a message written while the batch is assembled
+  // schedules the next flush instead of waiting for one that already ran.
+  flush_pending_.store(false);
+
+  std::string batch;
+  for (;;) {
+    Slot& slot = slots_[read_position_ & mask_];
+    if (slot.sequence.load(std::memory_order_acquire) != read_position_ + 1)
+      break;
+    if (!batch.empty())
+      batch += '\n';
+    batch += slot.message;
+    slot.message.clear();
+    slot.sequence.store(read_position_ + mask_ + 1, std::memory_order_release);
+    ++read_position_;
+  }
+  // The messages that didn't fit came after the ones in the ring.
+  int64_t dropped = dropped_.exchange(0);
+  if (dropped > 0) {
+    char note[64];
+    sprintf(note, "(%lld messages dropped)", static_cast<long long>(dropped));
+    if (!batch.empty())
+      batch += '\n';
+    batch += note;
+  }
+  if (batch.empty())
+    return;
+
+  // Checked again, the level may have been lowered since the messages were
+  // written.
+  if (level() == LOG_LEVEL_OFF)
+    return;
+  NPObject* console = Console();
+  if (NULL == console)
+    return;
+
+  NPVariant args[1];
+  STRINGN_TO_NPVARIANT(batch.c_str(), static_cast<uint32_t>(batch.size()),
+                       args[0]);
+  NPVariant result;
+  VOID_TO_NPVARIANT(result);
+  if (NPN_Invoke(npp_, console, debug_id_, args, 1, &result))
+    NPN_ReleaseVariantValue(&result);
+}
+
+NPObject* ConsoleLog::Console() {
+  if (console_)
+    return console_;
+
+  NPObject* window = NULL;
+  if (NPN_GetValue(npp_, NPNVWindowNPObject, &window) != NPERR_NO_ERROR ||
+      NULL == window)
+    return NULL;
+
+  NPVariant console;
+  VOID_TO_NPVARIANT(console);
+  if (NPN_GetProperty(npp_, window, NPN_GetStringIdentifier("console"),
+                      &console)) {
+    if (NPVARIANT_IS_OBJECT(console)) {
+      // The reference the variant holds is the one kept.
+      console_ = NPVARIANT_TO_OBJECT(console);
+      debug_id_ = NPN_GetStringIdentifier("debug");
+    } else {
+      NPN_ReleaseVariantValue(&console);
+    }
+  }
+  NPN_ReleaseObject(window);
+  return console_;
+}
+
+}  // namespace set_wallpaper_extension
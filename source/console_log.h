@@ -0,0 +1,92 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef CONSOLE_LOG_H_
+#define CONSOLE_LOG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "npapi.h"
+#include "npruntime.h"
+
+namespace set_wallpaper_extension {
+
+// How much a message matters. Messages below the level of the log are
+// dropped before they are formatted.
+enum LogLevel {
+  LOG_LEVEL_DEBUG,
+  LOG_LEVEL_ERROR,
+  // Only as the level of the log: nothing is written.
+  LOG_LEVEL_OFF
+};
+
+// Collects messages for the console of the page hosting the plugin. Any
+// thread can write one without waiting: it goes into a fixed size lock-free
+// ring, and the plugin thread later hands everything written since its last
+// flush to a single console.debug() call. The console object and the
+// identifiers to reach it are looked up once and kept.
+class ConsoleLog {
+ public:
+  explicit ConsoleLog(NPP npp);
+
+  // Releases the console. Must be called on the plugin thread.
+  ~ConsoleLog();
+
+  // Whether messages of |level| are written. Formatting should be skipped
+  // if not.
+  bool IsEnabled(LogLevel level) const {
+    return level >= level_.load(std::memory_order_relaxed);
+  }
+
+  LogLevel level() const { return level_.load(std::memory_order_relaxed); }
+  void set_level(LogLevel level) { level_.store(level); }
+
+  // Queues |message| if its |level| is enabled, and takes its contents.
+  // Returns true if a flush has to be scheduled on the plugin thread, which
+  // is the case for the first message after the last Flush(). If the ring
+  // is full the message is dropped and counted. May be called from any
+  // thread.
+  bool Write(LogLevel level, std::string* message);
+
+  // Writes every queued message to the console in one call. Must be called
+  // on the plugin thread.
+  void Flush();
+
+  // Messages dropped because the ring was full.
+  int64_t dropped() const { return dropped_.load(); }
+
+ private:
+  struct Slot {
+    // Tells which lap around the ring the slot is ready for, see Write().
+    std::atomic<size_t> sequence;
+    std::string message;
+  };
+
+  // Looks up window.console the first time, returns NULL if there is none.
+  NPObject* Console();
+
+  NPP npp_;
+  std::atomic<LogLevel> level_;
+
+  std::unique_ptr<Slot[]> slots_;
+  size_t mask_;
+  std::atomic<size_t> write_position_;
+  // Only used by Flush().
+  size_t read_position_;
+  std::atomic<bool> flush_pending_;
+  std::atomic<int64_t> dropped_;
+
+  // Plugin thread only.
+  NPObject* console_;
+  NPIdentifier debug_id_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // CONSOLE_LOG_H_
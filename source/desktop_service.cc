@@ -1,16 +1,239 @@
 #include "desktop_service.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <utility>
+
 #include "scripting_bridge.h"
+#include "engine/clock.h"
+#include "engine/file_util.h"
+#include "engine/stats.h"
+#include "engine/streaming_decoder.h"
+#include "engine/trace_log.h"
 
 namespace set_wallpaper_extension {
 
-DesktopService::DesktopService(NPP npp)
+namespace {
+
+// Largest chunk NPP_Write() is asked to take at once.
+const int32_t kStreamChunkBytes = 1 << 20;
+
+// How far a download may get ahead of its decoder before the browser is told
+// to hold off.
+const int64_t kMaxQueuedStreamBytes = 16 << 20;
+
+// Most pixels jobs keep in memory at once, past which they go to scratch
+// files. A screen-sized image takes 33 MB at 4K, this leaves room for a few
+// jobs along with the bands of the images they are decoding.
+const size_t kPixelMemoryBudget = 256 << 20;
+
+// A task on its way to the plugin thread through NPN_PluginThreadAsyncCall.
+struct PluginThreadCall {
+  WorkerPool::Task task;
+  std::shared_ptr<bool> alive;
+};
+
+void RunPluginThreadCall(void* data) {
+  std::unique_ptr<PluginThreadCall> call(static_cast<PluginThreadCall*>(data));
+  if (*call->alive) {
+    call->task();
+  }
+}
+
+void AppendJSONString(const std::string& value, std::ostringstream* out) {
+  *out << '"';
+  for (size_t i = 0; i < value.size(); ++i) {
+    unsigned char c = static_cast<unsigned char>(value[i]);
+    if (c == '"' || c == '\\') {
+      *out << '\\' << c;
+    } else if (c < 0x20) {
+      char escaped[8];
+      sprintf(escaped, "\\u%04x", c);
+      *out << escaped;
+    } else {
+      *out << c;
+    }
+  }
+  *out << '"';
+}
+
+// Stage timings are reported in milliseconds, which is what script measures
+// time in.
+void AppendTiming(const char* name, int64_t nanoseconds,
+                  std::ostringstream* out) {
+  *out << '"' << name << "\":" << nanoseconds / 1e6;
+}
+
+// The details passed to the callback of a SetWallpaper() call.
+std::string WallpaperJobToJSON(const WallpaperJob& job) {
+  const WallpaperReport& report = job.report;
+  const ConversionResult& conversion = report.conversion;
+  const ConversionTimings& timings = conversion.timings;
+  std::ostringstream out;
+  out << "{\"id\":" << job.id << ",\"error\":";
+  AppendJSONString(report.error, &out);
+  out << ",\"format\":";
+  AppendJSONString(ImageFormatName(conversion.format), &out);
+  out << ",\"passedThrough\":" << (conversion.passed_through ? "true" : "false")
+      << ",\"fromCache\":" << (conversion.from_cache ? "true" : "false")
+      << ",\"pixels\":" << conversion.pixels
+      << ",\"timings\":{";
+  AppendTiming("queue", report.queue, &out);
+  out << ',';
+  AppendTiming("download", report.download, &out);
+  out << ',';
+  AppendTiming("decode", timings.decode, &out);
+  out << ',';
+  AppendTiming("resample", timings.resample, &out);
+  out << ',';
+  AppendTiming("convert", timings.convert, &out);
+  out << ',';
+  AppendTiming("encode", timings.encode, &out);
+  out << ',';
+  AppendTiming("write", timings.write, &out);
+  out << ',';
+  AppendTiming("apply", report.apply, &out);
+  out << "}}";
+  return out.str();
+}
+
+// Records how |job| ended, and how long each of its stages took, in Stats.
+// Stages that didn't run are left out.
+void RecordJobStats(const WallpaperJob& job, int64_t end) {
+  const WallpaperReport& report = job.report;
+  StatsCounter outcome = STATS_JOBS_COMPLETED;
+  if (!report.success) {
+    outcome = job.cancellation.IsCancelled() ? STATS_JOBS_CANCELLED :
+                                               STATS_JOBS_FAILED;
+  }
+  Stats::Add(outcome, 1);
+
+  const ConversionTimings& timings = report.conversion.timings;
+  const int64_t stages[STATS_STAGE_COUNT] = {
+    report.queue,
+    report.download,
+    timings.decode,
+    timings.resample,
+    timings.convert,
+    timings.encode,
+    timings.write,
+    report.apply,
+    end - job.download_start
+  };
+  for (int i = 0; i < STATS_STAGE_COUNT; ++i) {
+    if (stages[i] > 0)
+      Stats::AddLatency(static_cast<StatsStage>(i), stages[i]);
+  }
+}
+
+// What the stats property returns: the counters by name, the memory held by
+// pixel buffers and the percentiles of every stage that ran, in
+// milliseconds.
+std::string StatsToJSON(const Stats::Snapshot& snapshot) {
+  std::ostringstream out;
+  out << '{';
+  for (int i = 0; i < STATS_COUNTER_COUNT; ++i) {
+    out << '"' << Stats::CounterName(static_cast<StatsCounter>(i)) << "\":"
+        << snapshot.counters[i] << ',';
+  }
+  out << "\"bufferBytes\":" << snapshot.buffer_bytes
+      << ",\"peakBufferBytes\":" << snapshot.peak_buffer_bytes
+      << ",\"latencies\":{";
+  bool first = true;
+  for (int i = 0; i < STATS_STAGE_COUNT; ++i) {
+    const Stats::Latency& latency = snapshot.latencies[i];
+    if (0 == latency.count)
+      continue;
+    if (!first)
+      out << ',';
+    first = false;
+    out << '"' << Stats::StageName(static_cast<StatsStage>(i))
+        << "\":{\"count\":" << latency.count << ',';
+    AppendTiming("p50", latency.p50, &out);
+    out << ',';
+    AppendTiming("p95", latency.p95, &out);
+    out << ',';
+    AppendTiming("p99", latency.p99, &out);
+    out << '}';
+  }
+  out << "}}";
+  return out.str();
+}
+
+}  // namespace
+
+// An NP_NORMAL stream. Its bytes are fed to the decoder in order by a task
+// sequence, and the sequence ends with handing the decoder over to
+// ImageStreamComplete().
+struct DesktopService::ImageStream {
+  ImageStream(WallpaperEngine* engine,
+              const std::shared_ptr<WallpaperJob>& job,
+              const std::string& output_base, WorkerPool* workers)
+      : job(job),
+        decoder(engine, job->options, output_base),
+        sequence(TaskSequence::Create(workers)),
+        queued_bytes(0),
+        failed(false),
+        last_write_end(0) {}
+
+  std::shared_ptr<WallpaperJob> job;
+  StreamingDecoder decoder;
+  // Plugin thread only. Released once the stream ended, after that only the
+  // tasks still queued keep it, so if the workers stop before running them
+  // nothing keeps them and the stream in a cycle.
+  std::shared_ptr<TaskSequence> sequence;
+  // Bytes received from the browser the decoder didn't consume yet.
+  std::atomic<int64_t> queued_bytes;
+  // Set once the decoder rejected the image, the rest of it is ignored.
+  std::atomic<bool> failed;
+
+  // Only used by the tasks of |sequence|: why the decoder failed, and when
+  // it last finished with a chunk.
+  std::string error;
+  int64_t last_write_end;
+};
+
+DesktopService::DesktopService(NPP npp,
+                               std::unique_ptr<DesktopBackend> backend)
     : npp_(npp),
       scripting_bridge_(NULL),
-      is_debug_(false) {
+      console_log_(npp),
+      is_streaming_(true),
+      last_job_id_(0),
+      plugin_thread_(std::this_thread::get_id()),
+      alive_(new bool(true)),
+      workers_(new WorkerPool(0)) {
+  PixelBuffer::SetMemoryBudget(kPixelMemoryBudget);
+  // Conversions resample on the workers that are idle rather than threads
+  // of their own, so however many run at once they share the pool.
+  engine_.set_worker_pool(workers_.get());
+  if (backend) {
+    apply_queue_.reset(new ApplyQueue(std::move(backend)));
+  }
 }
 
 DesktopService::~DesktopService()
 {
+  StopWorkers();
+  // The jobs still queued are superseded, their callbacks run before the
+  // rest of the instance goes away.
+  apply_queue_.reset();
+  *alive_ = false;
+
+  // Nobody is going to hear about the jobs that were still in flight.
+  for (std::map<int, std::shared_ptr<WallpaperJob> >::iterator it =
+           jobs_.begin(); it != jobs_.end(); ++it) {
+    if (it->second->callback) {
+      NPN_ReleaseObject(it->second->callback);
+      it->second->callback = NULL;
+    }
+  }
+
   if (scripting_bridge_) {
     NPN_ReleaseObject(scripting_bridge_);
   }
@@ -28,47 +251,523 @@ NPObject* DesktopService::GetScriptableObject()
   return scripting_bridge_;
 }
 
-void DesktopService::WriteToConsole(const char* message) {
-  if (!is_debug()) {
+void DesktopService::WriteToConsole(LogLevel level, std::string message) {
+  if (console_log_.Write(level, &message))
+    PostToPluginThread([this]() { console_log_.Flush(); });
+}
+
+void DesktopService::ReportError(const std::string& message) {
+  // An exception only reaches script while it is calling into the plugin,
+  // which can't be the case for work finishing on a worker.
+  if (IsPluginThread()) {
+    NPN_SetException(GetScriptableObject(), message.c_str());
+  }
+  if (IsLogging(LOG_LEVEL_ERROR))
+    WriteToConsole(LOG_LEVEL_ERROR, message);
+}
+
+void DesktopService::PostTask(const WorkerPool::Task& task)
+{
+  if (workers_) {
+    workers_->Post(task);
+  }
+}
+
+void DesktopService::PostToPluginThread(const WorkerPool::Task& task)
+{
+  PluginThreadCall* call = new PluginThreadCall;
+  call->task = task;
+  call->alive = alive_;
+  NPN_PluginThreadAsyncCall(npp_, &RunPluginThreadCall, call);
+}
+
+bool DesktopService::IsPluginThread() const
+{
+  return std::this_thread::get_id() == plugin_thread_;
+}
+
+void DesktopService::StopWorkers()
+{
+  // Running conversions give up at their next stage instead of holding up
+  // the destruction of the instance.
+  for (std::map<int, std::shared_ptr<WallpaperJob> >::iterator it =
+           jobs_.begin(); it != jobs_.end(); ++it) {
+    it->second->cancellation.Cancel();
+  }
+  workers_.reset();
+  engine_.set_worker_pool(NULL);
+}
+
+int DesktopService::StartImageDownload(const StringView& image_url, int style,
+                                       NPObject* callback)
+{
+  std::shared_ptr<WallpaperJob> job(new WallpaperJob(
+      last_job_id_ + 1,
+      GetConversionOptions(static_cast<WallpaperStyle>(style)),
+      callback));
+  job->download_start = MonotonicNanoseconds();
+
+  // Whatever is still in flight would only be replaced by this one.
+  std::vector<std::shared_ptr<WallpaperJob> > superseded;
+  for (std::map<int, std::shared_ptr<WallpaperJob> >::iterator it =
+           jobs_.begin(); it != jobs_.end(); ++it) {
+    superseded.push_back(it->second);
+  }
+
+  // The job is registered, and holds its callback, before the browser sees
+  // it: it may call back into the stream functions before GetURLNotify
+  // returns.
+  if (callback) {
+    NPN_RetainObject(callback);
+  }
+  last_job_id_ = job->id;
+  jobs_[job->id] = job;
+
+  // Ask browser to retrieve this file for us. The job travels with the
+  // download as its notifyData until NPP_URLNotify(), the actual
+  // wallpaper-setting process is completed by ImageDownloadComplete().
+  std::shared_ptr<WallpaperJob>* notify_data =
+      new std::shared_ptr<WallpaperJob>(job);
+  // The browser wants a NUL terminated URL, script gave a view.
+  std::string url = image_url.ToString();
+  NPError err = NPN_GetURLNotify(npp(), url.c_str(), 0, notify_data);
+  if (err != NPERR_NO_ERROR) {
+    delete notify_data;
+    jobs_.erase(job->id);
+    last_job_id_ = job->id - 1;
+    if (callback) {
+      NPN_ReleaseObject(callback);
+      job->callback = NULL;
+    }
+    return 0;
+  }
+  Stats::Add(STATS_JOBS_STARTED, 1);
+
+  for (size_t i = 0; i < superseded.size(); ++i) {
+    CancelJob(superseded[i].get());
+  }
+  return job->id;
+}
+
+bool DesktopService::CancelWallpaper(int id)
+{
+  std::map<int, std::shared_ptr<WallpaperJob> >::iterator it = jobs_.find(id);
+  if (it == jobs_.end()) {
+    return false;
+  }
+  // Aborting the stream may complete the job, and erase it, right away.
+  std::shared_ptr<WallpaperJob> job = it->second;
+  CancelJob(job.get());
+  return true;
+}
+
+void DesktopService::CancelJob(WallpaperJob* job)
+{
+  job->cancellation.Cancel();
+
+  // The browser calls NPP_DestroyStream() for it, maybe before this returns,
+  // which completes the job. Jobs whose stream didn't open yet have it
+  // refused by BeginImageStream(), and complete in ImageDownloadFinished().
+  NPStream* stream = job->stream;
+  if (stream) {
+    job->stream = NULL;
+    NPN_DestroyStream(npp_, stream, NPRES_USER_BREAK);
+  }
+}
+
+std::shared_ptr<WallpaperJob> DesktopService::JobFor(void* notify_data)
+{
+  if (NULL == notify_data) {
+    return std::shared_ptr<WallpaperJob>();
+  }
+  return *static_cast<std::shared_ptr<WallpaperJob>*>(notify_data);
+}
+
+void DesktopService::ImageDownloadFinished(const char* url, NPReason reason,
+                                           void* notify_data)
+{
+  std::shared_ptr<WallpaperJob> job = JobFor(notify_data);
+  delete static_cast<std::shared_ptr<WallpaperJob>*>(notify_data);
+
+  // Downloads that delivered a stream were taken care of when it ended.
+  if (job && !job->download_finished) {
+    job->download_finished = true;
+    job->report.error = job->cancellation.IsCancelled() ?
+        "The download was cancelled." : "Unable to download the image.";
+    int64_t end = MonotonicNanoseconds();
+    job->report.download = end - job->download_start;
+    TraceLog::AddSpan("download", job->id, job->download_start, end);
+    CompleteWallpaper(job);
+  }
+
+  DownloadCompletionStatus(url, reason);
+}
+
+void DesktopService::CompleteWallpaper(
+    const std::shared_ptr<WallpaperJob>& job)
+{
+  if (!IsPluginThread()) {
+    PostToPluginThread([this, job]() { CompleteWallpaper(job); });
+    return;
+  }
+  jobs_.erase(job->id);
+  int64_t end = MonotonicNanoseconds();
+  TraceLog::AddSpan("wallpaper", job->id, job->download_start, end);
+  RecordJobStats(*job, end);
+  if (NULL == job->callback) {
     return;
   }
 
-  // Get window object.
-  NPObject* window = NULL;
-  NPN_GetValue(npp_, NPNVWindowNPObject, &window);
+  const WallpaperReport& report = job->report;
+  const char* status = "success";
+  if (!report.success) {
+    status = job->cancellation.IsCancelled() ? "cancelled" : "failed";
+  }
+  std::string details = WallpaperJobToJSON(*job);
+  NPVariant args[2];
+  STRINGN_TO_NPVARIANT(status, static_cast<uint32_t>(strlen(status)),
+                       args[0]);
+  STRINGN_TO_NPVARIANT(details.c_str(), static_cast<uint32_t>(details.size()),
+                       args[1]);
+  NPVariant result;
+  VOID_TO_NPVARIANT(result);
+  if (NPN_InvokeDefault(npp_, job->callback, args, 2, &result)) {
+    NPN_ReleaseVariantValue(&result);
+  }
+  NPN_ReleaseObject(job->callback);
+  job->callback = NULL;
+}
+
+ConversionOptions DesktopService::GetConversionOptions(WallpaperStyle style)
+{
+  ConversionOptions options;
+  options.style = style;
+  return options;
+}
+
+std::string DesktopService::GetTracePath()
+{
+  std::string base_path = GetWallpaperBasePath();
+  if (base_path.empty()) {
+    return std::string();
+  }
+  return base_path + "-trace.json";
+}
+
+std::string DesktopService::GetJobBasePath(const WallpaperJob& job)
+{
+  std::ostringstream path;
+  path << GetWallpaperBasePath() << "-" << job.id;
+  return path.str();
+}
+
+bool DesktopService::ImageDownloadComplete(MappedFile* encoded,
+                                           WallpaperJob* job)
+{
+  LOG_TO_CONSOLE(this, LOG_LEVEL_DEBUG, "Job " << job->id << " downloaded "
+                 << encoded->size() << " bytes");
+
+  WallpaperReport* report = &job->report;
+  if (!engine_.ConvertMapped(encoded, job->options, GetJobBasePath(*job),
+                             &report->conversion, &report->error)) {
+    ReportError("ERROR: " + report->error);
+    return false;
+  }
+  return true;
+}
+
+bool DesktopService::ImageStreamComplete(StreamingDecoder* decoder,
+                                         WallpaperJob* job)
+{
+  // Unless the image can be used as is, it was decoded while downloading.
+  LOG_TO_CONSOLE(this, LOG_LEVEL_DEBUG, "Job " << job->id << " streamed "
+                 << decoder->bytes_received() << " bytes");
+
+  WallpaperReport* report = &job->report;
+  if (!engine_.ConvertStream(decoder, job->options, GetJobBasePath(*job),
+                             &report->conversion, &report->error)) {
+    ReportError("ERROR: " + report->error);
+    return false;
+  }
+  return true;
+}
+
+void DesktopService::ApplyWallpaper(const std::shared_ptr<WallpaperJob>& job)
+{
+  WallpaperReport* report = &job->report;
+  ConversionResult& result = report->conversion;
+  if (!apply_queue_) {
+    report->error = "There is no desktop to set the wallpaper on.";
+    ReportError("ERROR: " + report->error);
+    CompleteWallpaper(job);
+    return;
+  }
+
+  // The file the desktop uses is replaced in one step, so it is never seen
+  // half written.
+  ApplyRequest request;
+  request.path = result.output_path;
+  request.install_path = GetWallpaperBasePath() +
+                         ImageFormatExtension(result.format);
+  request.style = job->options.style;
+  request.cancellation = &job->cancellation;
+  request.trace_id = job->id;
+  apply_queue_->Post(request, [this, job](const ApplyOutcome& outcome) {
+    AppliedWallpaper(outcome, job.get());
+    CompleteWallpaper(job);
+  });
+}
 
-  // Get console object.
-  NPVariant consoleVar;
-  NPIdentifier id = NPN_GetStringIdentifier("console");
-  NPN_GetProperty(npp_, window, id, &consoleVar);
-  NPObject* console = NPVARIANT_TO_OBJECT(consoleVar);
+void DesktopService::AppliedWallpaper(const ApplyOutcome& outcome,
+                                      WallpaperJob* job)
+{
+  WallpaperReport* report = &job->report;
+  ConversionResult& result = report->conversion;
+  report->queue += outcome.wait;
 
-  // Get the debug object.
-  id = NPN_GetStringIdentifier("debug");
+  if (outcome.status == APPLY_STATUS_SUPERSEDED) {
+    // A newer wallpaper is on its way, this one would only flash by.
+    job->cancellation.Cancel();
+    report->error = outcome.error;
+    return;
+  }
+  if (outcome.status != APPLY_STATUS_APPLIED) {
+    report->error = outcome.error;
+    ReportError("ERROR: " + report->error);
+    return;
+  }
+  result.output_path = outcome.path;
 
-  // Invoke the call with the message!
-  NPVariant type;
-  STRINGZ_TO_NPVARIANT(message, type);
-  NPVariant args[] = { type };
-  NPVariant voidResponse;
-  NPN_Invoke(npp_, console, id, args,
-             sizeof(args) / sizeof(args[0]),
-             &voidResponse);
+  if (IsLogging(LOG_LEVEL_DEBUG)) {
+    std::ostringstream oss;
+    if (result.passed_through) {
+      oss << "Saved wallpaper as is to ";
+    } else if (result.from_cache) {
+      oss << "Saved previously converted wallpaper to ";
+    } else {
+      oss << "Converted and saved wallpaper to ";
+    }
+    oss << result.output_path << ". Conversion cache: "
+        << engine_.cache()->hits() << " hits, " << engine_.cache()->misses()
+        << " misses";
+    WriteToConsole(LOG_LEVEL_DEBUG, oss.str());
+  }
 
-  // Cleanup all allocated objects, otherwise, reference count and
-  // memory leaks will happen.
-  NPN_ReleaseObject(window);
-  NPN_ReleaseVariantValue(&consoleVar);
-  NPN_ReleaseVariantValue(&voidResponse);
+  // The desktop may have to decode and convert the file itself, which is
+  // part of what choosing the output format trades off.
+  report->apply = outcome.apply;
+  if (!result.passed_through) {
+    engine_.format_selector()->RecordApply(result.format, result.pixels,
+                                           report->apply);
+  }
+
+  report->success = true;
 }
 
-bool DesktopService::StartImageDownload(NPString image_url) const
+bool DesktopService::WriteTrace(NPVariant* result)
 {
-  // Ask browser to retrieve this file for us. The actual wallpaper-setting
-  // process is completed by ImageDownloadComplete().
-  NPError err = NPN_GetURLNotify(npp(), image_url.UTF8Characters, 0, 0);
+  std::string path = GetTracePath();
+  if (path.empty()) {
+    ReportError("ERROR: There is nowhere to write a trace to.");
+    return false;
+  }
+  std::string error;
+  if (!TraceLog::WriteJson(path, &error)) {
+    ReportError("ERROR: " + error);
+    return false;
+  }
 
-  return err == NPERR_NO_ERROR;
+  char* copy = static_cast<char*>(NPN_MemAlloc(path.size() + 1));
+  memcpy(copy, path.c_str(), path.size() + 1);
+  STRINGN_TO_NPVARIANT(copy, static_cast<uint32_t>(path.size()), *result);
+  return true;
+}
+
+bool DesktopService::GetStats(NPVariant* result)
+{
+  Stats::Snapshot snapshot;
+  Stats::Read(&snapshot);
+  std::string json = StatsToJSON(snapshot);
+
+  char* copy = static_cast<char*>(NPN_MemAlloc(json.size() + 1));
+  memcpy(copy, json.c_str(), json.size() + 1);
+  STRINGN_TO_NPVARIANT(copy, static_cast<uint32_t>(json.size()), *result);
+  return true;
+}
+
+std::shared_ptr<DesktopService::ImageStream>* DesktopService::ImageStreamFor(
+    NPStream* stream)
+{
+  return static_cast<std::shared_ptr<ImageStream>*>(stream->pdata);
+}
+
+NPError DesktopService::BeginImageStream(NPStream* stream, uint16_t* stype)
+{
+  *stype = NP_ASFILEONLY;
+  std::shared_ptr<WallpaperJob> job = JobFor(stream->notifyData);
+  if (!job) {
+    return NPERR_NO_ERROR;
+  }
+  if (job->cancellation.IsCancelled()) {
+    return NPERR_GENERIC_ERROR;
+  }
+
+  job->stream = stream;
+  if (is_streaming() && workers_) {
+    stream->pdata = new std::shared_ptr<ImageStream>(
+        new ImageStream(engine(), job, GetJobBasePath(*job),
+                        workers_.get()));
+    *stype = NP_NORMAL;
+  }
+  return NPERR_NO_ERROR;
+}
+
+int32_t DesktopService::ImageStreamWriteReady(NPStream* stream)
+{
+  std::shared_ptr<ImageStream>* image = ImageStreamFor(stream);
+  if (NULL == image || (*image)->failed) {
+    // Let the next NPP_Write() through so it can abort the stream.
+    return kStreamChunkBytes;
+  }
+
+  int64_t room = kMaxQueuedStreamBytes - (*image)->queued_bytes;
+  return static_cast<int32_t>(
+      std::max<int64_t>(0, std::min<int64_t>(room, kStreamChunkBytes)));
+}
+
+int32_t DesktopService::WriteImageStream(NPStream* stream, const void* buffer,
+                                         int32_t len)
+{
+  std::shared_ptr<ImageStream>* holder = ImageStreamFor(stream);
+  if (NULL == holder || (*holder)->failed) {
+    return -1;
+  }
+
+  // The browser owns |buffer| only for the duration of this call.
+  const uint8_t* bytes = static_cast<const uint8_t*>(buffer);
+  std::shared_ptr<std::vector<uint8_t> > chunk(
+      new std::vector<uint8_t>(bytes, bytes + len));
+  std::shared_ptr<ImageStream> image = *holder;
+  image->queued_bytes += len;
+  Stats::Add(STATS_BYTES_DOWNLOADED, len);
+  image->sequence->Post([this, image, chunk]() {
+    ScopedTrace trace("decode", image->job->id);
+    if (!image->failed && !image->job->cancellation.IsCancelled() &&
+        !image->decoder.Write(chunk->data(), chunk->size(), &image->error)) {
+      image->failed = true;
+      ReportError("ERROR: " + image->error);
+    }
+    image->queued_bytes -= chunk->size();
+    image->last_write_end = MonotonicNanoseconds();
+  });
+  return len;
+}
+
+void DesktopService::EndImageStream(NPStream* stream, NPReason reason)
+{
+  std::shared_ptr<WallpaperJob> stream_job = JobFor(stream->notifyData);
+  if (stream_job && stream_job->stream == stream) {
+    stream_job->stream = NULL;
+  }
+
+  std::shared_ptr<ImageStream>* holder = ImageStreamFor(stream);
+  if (NULL == holder) {
+    return;
+  }
+  stream->pdata = NULL;
+  std::shared_ptr<ImageStream> image = *holder;
+  delete holder;
+  std::shared_ptr<TaskSequence> sequence;
+  sequence.swap(image->sequence);
+
+  std::shared_ptr<WallpaperJob> job = image->job;
+  int64_t end = MonotonicNanoseconds();
+  job->download_finished = true;
+  job->report.download = end - job->download_start;
+  TraceLog::AddSpan("download", job->id, job->download_start, end);
+  if (NPRES_DONE != reason) {
+    job->report.error = job->cancellation.IsCancelled() ?
+        "The download was cancelled." : "Unable to download the image.";
+    CompleteWallpaper(job);
+    return;
+  }
+
+  sequence->Post([this, image, job, end]() {
+    // Decoding the last chunks isn't waiting.
+    WallpaperReport* report = &job->report;
+    int64_t queued = std::max(end, image->last_write_end);
+    int64_t started = MonotonicNanoseconds();
+    report->queue = started - queued;
+    TraceLog::AddSpan("queue", job->id, queued, started);
+    if (job->cancellation.IsCancelled()) {
+      report->error = "The wallpaper was cancelled.";
+    } else if (image->failed) {
+      report->error = image->error;
+      report->conversion.timings.decode = image->decoder.decode_nanoseconds();
+    } else if (ImageStreamComplete(&image->decoder, job.get())) {
+      // Completed once the apply thread is done with it.
+      ApplyWallpaper(job);
+      return;
+    }
+    CompleteWallpaper(job);
+  });
+}
+
+void DesktopService::ImageFileReady(NPStream* stream, const char* filename)
+{
+  std::shared_ptr<WallpaperJob> job = JobFor(stream->notifyData);
+  if (!job) {
+    return;
+  }
+  int64_t posted = MonotonicNanoseconds();
+  job->download_finished = true;
+  job->report.download = posted - job->download_start;
+  TraceLog::AddSpan("download", job->id, job->download_start, posted);
+  if (job->cancellation.IsCancelled()) {
+    job->report.error = "The wallpaper was cancelled.";
+    CompleteWallpaper(job);
+    return;
+  }
+
+  // The browser passes no file when it couldn't save the download.
+  if (NULL == filename) {
+    job->report.error = "Unable to download the image.";
+    ReportError("ERROR: " + job->report.error);
+    CompleteWallpaper(job);
+    return;
+  }
+
+  // Mapping doesn't read anything yet, the worker's decoder pulls the pages
+  // in as it goes.
+  std::string path(filename);
+  std::shared_ptr<MappedFile> file(new MappedFile());
+  if (!file->Map(path)) {
+    job->report.error = "Unable to read " + path;
+    ReportError("ERROR: " + job->report.error);
+    CompleteWallpaper(job);
+    return;
+  }
+  Stats::Add(STATS_BYTES_DOWNLOADED, static_cast<int64_t>(file->size()));
+
+  PostTask([this, file, job, posted]() {
+    int64_t started = MonotonicNanoseconds();
+    job->report.queue = started - posted;
+    TraceLog::AddSpan("queue", job->id, posted, started);
+    bool converted = false;
+    if (job->cancellation.IsCancelled()) {
+      job->report.error = "The wallpaper was cancelled.";
+    } else {
+      converted = ImageDownloadComplete(file.get(), job.get());
+    }
+    // Whatever the conversion didn't unmap already.
+    file->Unmap();
+    if (converted) {
+      // Completed once the apply thread is done with it.
+      ApplyWallpaper(job);
+    } else {
+      CompleteWallpaper(job);
+    }
+  });
 }
 
 } // namespace set_wallpaper_extension 
@@ -5,14 +5,39 @@
 #ifndef DESKTOP_SERVICE_H_
 #define DESKTOP_SERVICE_H_
 
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "npapi.h"
 #include "npruntime.h"
+#include "console_log.h"
+#include "engine/apply_queue.h"
+#include "engine/file_util.h"
+#include "engine/streaming_decoder.h"
+#include "engine/trace_log.h"
+#include "engine/wallpaper_engine.h"
+#include "engine/worker_pool.h"
+#include "variant_binding.h"
+#include "wallpaper_job.h"
 
 namespace set_wallpaper_extension {
 
+// Decoding, converting and applying images is slow, so it happens on worker
+// threads and the thread the browser calls the plugin on, the plugin thread,
+// only hands work out. Anything that talks to the browser is marshalled back
+// to the plugin thread.
 class DesktopService {
  public:
-  DesktopService(NPP npp);
+  // Wallpapers are set with |backend|, on a thread of its own. Without one,
+  // every wallpaper fails to be applied.
+  DesktopService(NPP npp, std::unique_ptr<DesktopBackend> backend);
 
   virtual ~DesktopService();
 
@@ -22,42 +47,220 @@ class DesktopService {
   // Return the current desktop wallpaper style.
   virtual bool GetWallpaperStyle(NPVariant* result) = 0;
 
-  // Start the process of downloading 'url' to be used as a desktop background.
-  virtual bool SetWallpaper(NPVariant* result, const NPString& url, int style) = 0;
+  // Start the process of downloading 'url' to be used as a desktop background
+  // and return the id of the job in |result|. |callback|, which may be NULL,
+  // is called with the outcome once the wallpaper was set or failed to be,
+  // see CompleteWallpaper(). Only the latest wallpaper matters, so starting
+  // one cancels every job still in flight.
+  virtual bool SetWallpaper(NPVariant* result, const StringView& url,
+                            int style, NPObject* callback) = 0;
 
-  // After requesting an image with StartImageDownload(), this function will
-  // be called when the image is successfully downloaded and stored on disk
-  // under the name 'filename'. Implement this function to actually set the
-  // desktop background.
-  virtual void ImageDownloadComplete(NPStream* stream, const char* filename) = 0;
+  // Cancels the job SetWallpaper() returned |id| for, unless it completed
+  // already. Its download is aborted, stages that didn't run yet are
+  // skipped and its callback is told it was "cancelled". Returns whether
+  // there was such a job in flight.
+  bool CancelWallpaper(int id);
 
   // This function is called to indicate the success or failure of downloading
   // an image.
   virtual void DownloadCompletionStatus(const char* url, NPReason reason) = 0;
 
+  // Called by the browser once the download of |url| for the job in
+  // |notify_data| is over. Reports downloads that failed to the job's
+  // callback, then hands over to DownloadCompletionStatus().
+  void ImageDownloadFinished(const char* url, NPReason reason,
+                             void* notify_data);
+
+  // Called when the browser opens |stream|. Sets |stype| to NP_NORMAL if the
+  // image should be delivered through WriteImageStream() and decoded as it
+  // arrives, or to NP_ASFILEONLY if the browser should write it to a file
+  // first. Returns an error to refuse the stream of a cancelled job.
+  NPError BeginImageStream(NPStream* stream, uint16_t* stype);
+
+  // Number of bytes of |stream| the plugin is ready to accept. Goes down to
+  // zero while the workers are behind, so a fast download doesn't pile up
+  // in memory.
+  int32_t ImageStreamWriteReady(NPStream* stream);
+
+  // Queues the next |len| bytes of |stream| for its decoder. Returns the
+  // number of bytes accepted, or -1 to make the browser abort the stream.
+  int32_t WriteImageStream(NPStream* stream, const void* buffer, int32_t len);
+
+  // Called when the browser is done with |stream|. If it completed, its
+  // decoder is handed to ImageStreamComplete() once it consumed every byte.
+  void EndImageStream(NPStream* stream, NPReason reason);
+
+  // Called when the browser saved a non-streamed image to |filename|. The
+  // file is mapped right away, since the browser may delete it once this
+  // returns, and decoded from the mapping by ImageDownloadComplete() on a
+  // worker.
+  void ImageFileReady(NPStream* stream, const char* filename);
+
   // Although the scripting bridge is the connection between javascript world
   // and a DesktopService instance, it's convenient for a DesktopService
   // instance to own the scripting bridge because the DesktopService gets
   // created first and both should be destroyed at the same time.
   NPObject* GetScriptableObject();
 
-  // Write a message to the console for the background.html page within Chrome.
-  // Messages are written only if is_debug_ is true.
-  void WriteToConsole(const char* message);
+  // Write a message to the console for the background.html page within Chrome,
+  // if its |level| is enabled. Messages are batched and written by the
+  // plugin thread. May be called from any thread, use LOG_TO_CONSOLE() to
+  // skip formatting messages that won't be written.
+  void WriteToConsole(LogLevel level, std::string message);
+
+  bool IsLogging(LogLevel level) const {
+    return console_log_.IsEnabled(level);
+  }
+
+  // Reports |message| as an error. On the plugin thread it is also thrown as
+  // an exception to the script calling into the plugin. May be called from
+  // any thread.
+  void ReportError(const std::string& message);
 
-  bool is_debug() const { return is_debug_; }
-  void set_is_debug(bool val) { is_debug_ = val; }
+  // Whether messages are written to the console at all.
+  bool is_debug() const { return IsLogging(LOG_LEVEL_DEBUG); }
+  void set_is_debug(bool val) {
+    console_log_.set_level(val ? LOG_LEVEL_DEBUG : LOG_LEVEL_OFF);
+  }
+
+  // Whether spans of the work on every wallpaper are recorded, see TraceLog.
+  // Tracing is process wide.
+  bool is_tracing() const { return TraceLog::IsEnabled(); }
+  void set_is_tracing(bool val) { TraceLog::SetEnabled(val); }
+
+  // Writes the spans recorded so far to GetTracePath() as a trace for
+  // chrome://tracing and returns the path of the file in |result|.
+  bool WriteTrace(NPVariant* result);
+
+  // Returns the counters and latency percentiles of Stats, for every
+  // instance in the process, as a JSON string in |result|.
+  bool GetStats(NPVariant* result);
+
+  // Whether images are decoded while they download (NP_NORMAL streams) rather
+  // than after the browser saved them to disk (NP_ASFILEONLY).
+  bool is_streaming() const { return is_streaming_; }
+  void set_is_streaming(bool val) { is_streaming_ = val; }
 
  protected:
-  bool StartImageDownload(NPString image_url) const;
+  // Starts a job downloading |image_url| and setting it as the wallpaper
+  // with |style|. |callback| is retained until the job completes. Returns the
+  // id of the job, or 0 if the download couldn't be started.
+  int StartImageDownload(const StringView& image_url, int style,
+                         NPObject* callback);
+
+  // Options images for a wallpaper of |style| are converted with. The
+  // default leaves sizing to the desktop, implementations that know the
+  // screen override it so images are pre-scaled for it.
+  virtual ConversionOptions GetConversionOptions(WallpaperStyle style);
+
+  // Path, in UTF-8 and without extension, of the file the desktop uses as
+  // its wallpaper. The extension is the one of the format the engine picked.
+  // Jobs convert their image next to it.
+  virtual std::string GetWallpaperBasePath() = 0;
+
+  // Runs |task| on a worker thread.
+  void PostTask(const WorkerPool::Task& task);
+
+  // Runs |task| on the plugin thread, unless the instance is destroyed first.
+  // May be called from any thread.
+  void PostToPluginThread(const WorkerPool::Task& task);
+
+  bool IsPluginThread() const;
+
+  // Cancels every job in flight, waits for the tasks that are running on the
+  // workers and discards the others. Implementations call this first thing
+  // in their destructor, so no task runs on a partly destroyed instance.
+  void StopWorkers();
+
   NPP npp() const { return npp_; }
+  WallpaperEngine* engine() { return &engine_; }
 
  private:
+  struct ImageStream;
+
+  static std::shared_ptr<ImageStream>* ImageStreamFor(NPStream* stream);
+
+  // The job a download was started for, from its notifyData.
+  static std::shared_ptr<WallpaperJob> JobFor(void* notify_data);
+
+  // Where WriteTrace() writes, in UTF-8, next to the wallpaper. Empty if
+  // there is no place for it.
+  std::string GetTracePath();
+
+  // Path, in UTF-8 and without extension, |job| converts its image to before
+  // it becomes the wallpaper.
+  std::string GetJobBasePath(const WallpaperJob& job);
+
+  // Called on a worker thread with the image downloaded for |job| mapped in
+  // |encoded|. Converts it with the options of |job|, filling in the outcome
+  // and the time spent in the report of |job|, and returns whether it is
+  // ready for ApplyWallpaper(). Jobs run concurrently.
+  bool ImageDownloadComplete(MappedFile* encoded, WallpaperJob* job);
+
+  // When streaming, called instead of ImageDownloadComplete() with the
+  // decoder that consumed the image while it downloaded, also on a worker
+  // thread.
+  bool ImageStreamComplete(StreamingDecoder* decoder, WallpaperJob* job);
+
+  // Posts the file |job| converted its image to to the apply thread, which
+  // moves it in place and hands it to the backend, and returns right away.
+  // The job is completed from there, so no worker waits for the desktop.
+  void ApplyWallpaper(const std::shared_ptr<WallpaperJob>& job);
+
+  // Called on the apply thread with what became of the file of |job|.
+  // Reports how long applying it took to the engine and in the report of
+  // |job|.
+  void AppliedWallpaper(const ApplyOutcome& outcome, WallpaperJob* job);
+
+  // Hands the report of |job| to its callback, if any, as
+  // callback(status, details) where |details| is a JSON string, and releases
+  // the callback. May be called from any thread.
+  void CompleteWallpaper(const std::shared_ptr<WallpaperJob>& job);
+
+  // Flags |job| as cancelled and aborts its download, if the browser still
+  // has it open.
+  void CancelJob(WallpaperJob* job);
+
   NPP npp_;
   NPObject* scripting_bridge_;
-  bool is_debug_;
+  ConsoleLog console_log_;
+  bool is_streaming_;
+  WallpaperEngine engine_;
+
+  // Id of the last job started, and the jobs that didn't complete yet by id.
+  // Only used on the plugin thread.
+  int last_job_id_;
+  std::map<int, std::shared_ptr<WallpaperJob> > jobs_;
+
+  std::thread::id plugin_thread_;
+  // Cleared when the instance is destroyed, checked by the calls posted with
+  // PostToPluginThread() before they touch it.
+  std::shared_ptr<bool> alive_;
+  std::unique_ptr<WorkerPool> workers_;
+
+  // Jobs convert concurrently, each to a file of its own, but they all end
+  // up in the one file the desktop uses, so they apply one at a time. NULL
+  // without a backend.
+  std::unique_ptr<ApplyQueue> apply_queue_;
 };
 
+// Creates the DesktopService NPP_New() gives the plugin instance |npp|, or
+// returns NULL if there is no memory for it or it can't be set up. Each
+// platform defines it next to its DesktopService, hosts that drive the
+// plugin without a browser define their own.
+DesktopService* CreateDesktopService(NPP npp);
+
 } // namespace set_wallpaper_extension
 
+// Writes the streamed |message| to the console of the DesktopService
+// |service| at |level|. Nothing is formatted unless the level is enabled.
+#define LOG_TO_CONSOLE(service, level, message) \
+do { \
+  if ((service)->IsLogging(level)) { \
+    std::ostringstream oss; \
+    oss << message; \
+    (service)->WriteToConsole(level, oss.str()); \
+  } \
+} while (0)
+
 #endif // DESKTOP_SERVICE_H_
@@ -0,0 +1,189 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "apply_queue.h"
+
+#include "clock.h"
+#include "file_util.h"
+#include "trace_log.h"
+
+namespace set_wallpaper_extension {
+
+// A request waiting for the apply thread.
+struct ApplyQueue::Pending {
+  Pending(const ApplyRequest& request, const Callback& callback)
+      : request(request),
+        callback(callback),
+        queued(MonotonicNanoseconds()) {}
+
+  ApplyRequest request;
+  Callback callback;
+  int64_t queued;
+  ApplyOutcome outcome;
+};
+
+ApplyQueue::ApplyQueue(std::unique_ptr<DesktopBackend> backend)
+    : backend_(std::move(backend)),
+      connected_(false),
+      stopping_(false),
+      applied_(0),
+      superseded_(0) {
+  thread_ = std::thread(&ApplyQueue::Run, this);
+}
+
+ApplyQueue::~ApplyQueue() {
+  {
+    std::lock_guard<std::mutex> hold(lock_);
+    stopping_ = true;
+  }
+  queued_.notify_one();
+  thread_.join();
+}
+
+void ApplyQueue::Post(const ApplyRequest& request, const Callback& callback) {
+  Pending* pending = new Pending(request, callback);
+  {
+    std::lock_guard<std::mutex> hold(lock_);
+    if (!stopping_) {
+      pending_.push_back(pending);
+      queued_.notify_one();
+      return;
+    }
+  }
+  Supersede(pending);
+  Finish(pending);
+}
+
+ApplyOutcome ApplyQueue::Apply(const ApplyRequest& request) {
+  std::mutex lock;
+  std::condition_variable done;
+  bool finished = false;
+  ApplyOutcome outcome;
+  Post(request, [&](const ApplyOutcome& result) {
+    // Notified with |lock| held so |done| is still there.
+    std::lock_guard<std::mutex> hold(lock);
+    outcome = result;
+    finished = true;
+    done.notify_one();
+  });
+  std::unique_lock<std::mutex> hold(lock);
+  done.wait(hold, [&finished]() { return finished; });
+  return outcome;
+}
+
+int64_t ApplyQueue::applied() const {
+  std::lock_guard<std::mutex> hold(lock_);
+  return applied_;
+}
+
+int64_t ApplyQueue::superseded() const {
+  std::lock_guard<std::mutex> hold(lock_);
+  return superseded_;
+}
+
+void ApplyQueue::Run() {
+  std::unique_lock<std::mutex> hold(lock_);
+  for (;;) {
+    queued_.wait(hold, [this]() { return stopping_ || !pending_.empty(); });
+
+    // Everything but the newest request would be replaced right away.
+    std::deque<Pending*> replaced;
+    while (pending_.size() > 1 || (stopping_ && !pending_.empty())) {
+      replaced.push_back(pending_.front());
+      pending_.pop_front();
+    }
+    Pending* pending = NULL;
+    if (!pending_.empty()) {
+      pending = pending_.front();
+      pending_.pop_front();
+    }
+
+    // Callbacks may take their time, or queue the next request.
+    hold.unlock();
+    for (size_t i = 0; i < replaced.size(); ++i) {
+      Supersede(replaced[i]);
+      Finish(replaced[i]);
+    }
+    if (pending) {
+      ApplyPending(pending);
+      Finish(pending);
+    }
+    hold.lock();
+    if (NULL == pending && stopping_) {
+      break;
+    }
+  }
+  hold.unlock();
+
+  if (connected_) {
+    backend_->Disconnect();
+    connected_ = false;
+  }
+}
+
+void ApplyQueue::ApplyPending(Pending* pending) {
+  const ApplyRequest& request = pending->request;
+  ApplyOutcome* outcome = &pending->outcome;
+  int64_t start = MonotonicNanoseconds();
+  outcome->wait = start - pending->queued;
+  TraceLog::AddSpan("apply_wait", request.trace_id, pending->queued, start);
+
+  if (request.cancellation && request.cancellation->IsCancelled()) {
+    Supersede(pending);
+    return;
+  }
+
+  outcome->path = request.path;
+  if (!request.install_path.empty()) {
+    if (!RenameFile(request.path, request.install_path)) {
+      outcome->status = APPLY_STATUS_FAILED;
+      outcome->error = "Unable to move " + request.path;
+      return;
+    }
+    outcome->path = request.install_path;
+  }
+
+  if (!connected_) {
+    ScopedTrace trace("connect", request.trace_id);
+    connected_ = backend_->Connect(&outcome->error);
+    if (!connected_) {
+      outcome->status = APPLY_STATUS_FAILED;
+      return;
+    }
+  }
+
+  if (!backend_->Apply(outcome->path, request.style, &outcome->error)) {
+    // Reconnect for the next request, the desktop may have gone away.
+    backend_->Disconnect();
+    connected_ = false;
+    outcome->status = APPLY_STATUS_FAILED;
+    return;
+  }
+  int64_t end = MonotonicNanoseconds();
+  outcome->apply = end - start;
+  outcome->status = APPLY_STATUS_APPLIED;
+  TraceLog::AddSpan("apply", request.trace_id, start, end);
+}
+
+void ApplyQueue::Finish(Pending* pending) {
+  {
+    std::lock_guard<std::mutex> hold(lock_);
+    if (pending->outcome.status == APPLY_STATUS_APPLIED) {
+      ++applied_;
+    } else if (pending->outcome.status == APPLY_STATUS_SUPERSEDED) {
+      ++superseded_;
+    }
+  }
+  pending->callback(pending->outcome);
+  delete pending;
+}
+
+void ApplyQueue::Supersede(Pending* pending) {
+  pending->outcome.wait = MonotonicNanoseconds() - pending->queued;
+  RemoveFile(pending->request.path);
+  pending->outcome.status = APPLY_STATUS_SUPERSEDED;
+  pending->outcome.error = "A newer wallpaper replaced this one.";
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,132 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_APPLY_QUEUE_H_
+#define ENGINE_APPLY_QUEUE_H_
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "cancellation_flag.h"
+#include "desktop_backend.h"
+#include "wallpaper_layout.h"
+
+namespace set_wallpaper_extension {
+
+// A wallpaper ready to be applied.
+struct ApplyRequest {
+  ApplyRequest()
+      : style(WALLPAPER_STYLE_STRETCH),
+        cancellation(NULL),
+        trace_id(0) {}
+
+  // The converted image.
+  std::string path;
+  // Where |path| is moved right before it is applied, if not empty. Lets
+  // every wallpaper end up in the same file without one overwriting another
+  // that is still being applied.
+  std::string install_path;
+  WallpaperStyle style;
+  // The request is skipped once it is set. Not owned, may be NULL.
+  const CancellationFlag* cancellation;
+  // Identifies the wallpaper in the spans the apply thread records, see
+  // TraceLog.
+  int trace_id;
+};
+
+enum ApplyStatus {
+  APPLY_STATUS_APPLIED,
+  // A newer request came in before this one's turn, or it was cancelled. Its
+  // file was removed instead of applied.
+  APPLY_STATUS_SUPERSEDED,
+  APPLY_STATUS_FAILED,
+};
+
+// What became of an ApplyRequest.
+struct ApplyOutcome {
+  ApplyOutcome()
+      : status(APPLY_STATUS_FAILED),
+        wait(0),
+        apply(0) {}
+
+  ApplyStatus status;
+  // What went wrong, when failed.
+  std::string error;
+  // The file the desktop displays once applied.
+  std::string path;
+  // Nanoseconds spent waiting for the apply thread, and in the backend.
+  int64_t wait;
+  int64_t apply;
+};
+
+// Applies wallpapers one at a time on a thread of its own, where the
+// DesktopBackend stays connected from one wallpaper to the next instead of
+// being set up and torn down for each. Only the latest wallpaper matters, so
+// when several requests are waiting, the newest is applied and the others are
+// superseded without touching the desktop.
+class ApplyQueue {
+ public:
+  typedef std::function<void(const ApplyOutcome& outcome)> Callback;
+
+  // Starts the apply thread. |backend| is only used on it.
+  explicit ApplyQueue(std::unique_ptr<DesktopBackend> backend);
+
+  // Finishes the request being applied, supersedes the others, calling
+  // their callbacks, and disconnects the backend.
+  ~ApplyQueue();
+
+  // Queues |request| and returns right away. The apply thread calls
+  // |callback| with the outcome once it is done with it, or the calling
+  // thread does before returning if the queue is being destroyed. May be
+  // called from any number of threads at once.
+  void Post(const ApplyRequest& request, const Callback& callback);
+
+  // Same as Post() but waits for the outcome and returns it.
+  ApplyOutcome Apply(const ApplyRequest& request);
+
+  // Number of requests applied and superseded so far.
+  int64_t applied() const;
+  int64_t superseded() const;
+
+ private:
+  struct Pending;
+
+  void Run();
+
+  // Applies |pending| with the backend, connecting it first if needed.
+  void ApplyPending(Pending* pending);
+
+  // Marks |pending| as superseded and removes its file.
+  static void Supersede(Pending* pending);
+
+  // Counts |pending| as applied or superseded, calls its callback and
+  // deletes it. |lock_| must not be held.
+  void Finish(Pending* pending);
+
+  std::unique_ptr<DesktopBackend> backend_;
+  // Only used on the apply thread.
+  bool connected_;
+
+  mutable std::mutex lock_;
+  // Signalled when a request is queued.
+  std::condition_variable queued_;
+  // Owned.
+  std::deque<Pending*> pending_;
+  bool stopping_;
+  int64_t applied_;
+  int64_t superseded_;
+
+  std::thread thread_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_APPLY_QUEUE_H_
@@ -0,0 +1,252 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "band_resampler.h"
+
+#include <string.h>
+
+#include <vector>
+
+#include "clock.h"
+#include "parallel_for.h"
+#include "pixel_converter.h"
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// Source rows decoded before they are filtered together. Enough to keep a
+// few threads busy, while a band of the widest image is still only 16 MB.
+const int kBandRows = 64;
+
+// Smallest run of rows handed to a thread.
+const int kMinThreadRows = 16;
+
+}  // namespace
+
+BandResampler::BandResampler(WallpaperStyle style, int screen_width,
+                             int screen_height, int threads,
+                             WorkerPool* pool)
+    : style_(style),
+      screen_width_(screen_width),
+      screen_height_(screen_height),
+      threads_(threads),
+      pool_(pool),
+      background_(0),
+      max_held_bytes_(0),
+      drop_whole_(false),
+      mode_(MODE_WHOLE),
+      reduction_(1),
+      source_width_(0),
+      source_height_(0),
+      rows_received_(0),
+      first_row_(0),
+      last_row_(0),
+      band_start_(0),
+      next_output_row_(0),
+      resample_nanoseconds_(0),
+      convert_nanoseconds_(0),
+      encode_nanoseconds_(0) {
+}
+
+BandResampler::~BandResampler() {
+}
+
+void BandResampler::set_writer(std::unique_ptr<ImageFileWriter> writer,
+                               uint32_t background,
+                               uint64_t max_held_bytes) {
+  writer_ = std::move(writer);
+  background_ = background;
+  max_held_bytes_ = max_held_bytes;
+}
+
+int BandResampler::ChooseReduction(int width, int height,
+                                   int max_reduction) {
+  reduction_ = 1;
+  PrescalePlan plan;
+  if (!PlanPrescale(style_, width, height, screen_width_, screen_height_,
+                    &plan)) {
+    return reduction_;
+  }
+  // Reducing any further would leave the filters upscaling, or blurring
+  // what the image was only cropped for.
+  for (int next = 2; next <= max_reduction; next *= 2) {
+    if ((width + next - 1) / next < plan.scaled_width ||
+        (height + next - 1) / next < plan.scaled_height) {
+      break;
+    }
+    reduction_ = next;
+  }
+  if (reduction_ > 1)
+    plan_ = plan;
+  return reduction_;
+}
+
+bool BandResampler::Begin(int width, int height, PixelFormat format) {
+  source_width_ = width;
+  source_height_ = height;
+  rows_received_ = 0;
+  // A reduced image keeps the plan of the full one, so the output has the
+  // size and crop it would have had.
+  bool planned = reduction_ > 1 ||
+                 PlanPrescale(style_, width, height, screen_width_,
+                              screen_height_, &plan_);
+  if (format == PIXEL_FORMAT_BGR24 || !planned ||
+      plan_.IsIdentity(width, height)) {
+    uint64_t bytes =
+        static_cast<uint64_t>(PixelBuffer::StrideFor(width,
+                                                     PIXEL_FORMAT_BGR24)) *
+        height;
+    if (drop_whole_ && 1 == reduction_) {
+      mode_ = MODE_DROP;
+      return discard_.Allocate(width, 1, format);
+    }
+    if (writer_ && 1 == reduction_ && bytes > max_held_bytes_) {
+      mode_ = MODE_WRITE;
+      band_start_ = 0;
+      if (!writer_->Begin(width, height, &write_error_))
+        return false;
+      return band_.Allocate(width, kBandRows, format) &&
+             (format == PIXEL_FORMAT_BGR24 ||
+              converted_.Allocate(width, kBandRows, PIXEL_FORMAT_BGR24));
+    }
+    mode_ = MODE_WHOLE;
+    return output_.Allocate(width, height, format);
+  }
+
+  if (!output_.Allocate(plan_.width, plan_.height, format) ||
+      !discard_.Allocate(width, 1, format)) {
+    return false;
+  }
+  if (plan_.scaled_width == width && plan_.scaled_height == height) {
+    mode_ = MODE_CROP;
+    return true;
+  }
+
+  mode_ = MODE_SCALE;
+  horizontal_.reset(new ResampleFilter(width, plan_.scaled_width,
+                                       plan_.crop_x, plan_.width));
+  vertical_.reset(new ResampleFilter(height, plan_.scaled_height,
+                                     plan_.crop_y, plan_.height));
+  first_row_ = vertical_->start(0);
+  last_row_ = vertical_->start(plan_.height - 1) + vertical_->taps();
+  band_start_ = first_row_;
+  next_output_row_ = 0;
+  // A band is filtered into the ring while the output rows still waiting
+  // for it need up to taps - 1 of the rows before it.
+  return band_.Allocate(width, kBandRows, format) &&
+         ring_.Allocate(plan_.width, kBandRows + vertical_->taps(), format);
+}
+
+uint8_t* BandResampler::BeginRow(int y) {
+  switch (mode_) {
+  case MODE_WHOLE:
+    return output_.row(y);
+  case MODE_WRITE:
+    return band_.row(y - band_start_);
+  case MODE_DROP:
+  case MODE_CROP:
+    return discard_.row(0);
+  case MODE_SCALE:
+  default:
+    if (y < first_row_ || y >= last_row_)
+      return discard_.row(0);
+    return band_.row(y - band_start_);
+  }
+}
+
+void BandResampler::EndRow(int y) {
+  ++rows_received_;
+  if (mode_ == MODE_CROP) {
+    if (y >= plan_.crop_y && y < plan_.crop_y + plan_.height) {
+      int bytes_per_pixel = PixelBuffer::BytesPerPixel(output_.format());
+      memcpy(output_.row(y - plan_.crop_y),
+             discard_.row(0) + plan_.crop_x * bytes_per_pixel,
+             plan_.width * bytes_per_pixel);
+    }
+  } else if (mode_ == MODE_SCALE && y >= first_row_ && y < last_row_) {
+    if (y + 1 - band_start_ == kBandRows || y + 1 == last_row_)
+      FilterBand(y + 1);
+  } else if (mode_ == MODE_WRITE) {
+    if (y + 1 - band_start_ == kBandRows || y + 1 == source_height_)
+      WriteBand(y + 1);
+  }
+}
+
+bool BandResampler::Finish(PixelBuffer* output, std::string* error) {
+  if (0 == source_height_ || rows_received_ != source_height_) {
+    *error = "The decoder left rows of the image out.";
+    return false;
+  }
+  if (!write_error_.empty()) {
+    *error = write_error_;
+    return false;
+  }
+  discard_.Clear();
+  band_.Clear();
+  ring_.Clear();
+  converted_.Clear();
+  output->Swap(&output_);
+  output_.Clear();
+  return true;
+}
+
+void BandResampler::FilterBand(int end) {
+  int64_t start = MonotonicNanoseconds();
+  const ResampleFilter& horizontal = *horizontal_;
+  const ResampleFilter& vertical = *vertical_;
+
+  ParallelFor(band_start_, end, kMinThreadRows, threads_, pool_,
+              [&](int first, int last) {
+    for (int y = first; y < last; ++y) {
+      Resampler::FilterRow(band_.row(y - band_start_), horizontal,
+                           ring_.row(y % ring_.height()));
+    }
+  });
+  band_start_ = end;
+
+  int ready = next_output_row_;
+  while (ready < plan_.height &&
+         vertical.start(ready) + vertical.taps() <= end) {
+    ++ready;
+  }
+  ParallelFor(next_output_row_, ready, kMinThreadRows, threads_, pool_,
+              [&](int first, int last) {
+    int bytes = plan_.width * 4;
+    std::vector<int32_t> accumulator(bytes);
+    std::vector<const uint8_t*> rows(vertical.taps());
+    for (int y = first; y < last; ++y) {
+      for (int k = 0; k < vertical.taps(); ++k)
+        rows[k] = ring_.row((vertical.start(y) + k) % ring_.height());
+      Resampler::FilterColumns(&rows[0], vertical, y, bytes, &accumulator[0],
+                               output_.row(y));
+    }
+  });
+  next_output_row_ = ready;
+  resample_nanoseconds_ += MonotonicNanoseconds() - start;
+}
+
+void BandResampler::WriteBand(int end) {
+  int rows = end - band_start_;
+  band_start_ = end;
+  // Once the writer failed, the rest of the image is only decoded.
+  if (!write_error_.empty())
+    return;
+
+  int64_t start = MonotonicNanoseconds();
+  const PixelBuffer* pixels = &band_;
+  if (band_.format() != PIXEL_FORMAT_BGR24) {
+    PixelConverter::RowsToBGR24(band_, rows, background_, &converted_);
+    pixels = &converted_;
+  }
+  int64_t converted = MonotonicNanoseconds();
+  for (int y = 0; y < rows; ++y) {
+    if (!writer_->WriteRow(pixels->row(y), &write_error_))
+      break;
+  }
+  convert_nanoseconds_ += converted - start;
+  encode_nanoseconds_ += MonotonicNanoseconds() - converted;
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,174 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_BAND_RESAMPLER_H_
+#define ENGINE_BAND_RESAMPLER_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "image_decoder.h"
+#include "image_encoder.h"
+#include "pixel_buffer.h"
+#include "resampler.h"
+#include "wallpaper_layout.h"
+
+namespace set_wallpaper_extension {
+
+class WorkerPool;
+
+// Resample stage run on the rows of an image while they are decoded. Scales
+// and crops the image for a screen, see PlanPrescale(), but only ever holds
+// the few source rows the filters still need rather than the whole image:
+// rows are decoded a band at a time, filtered horizontally into a ring of
+// rows, and every output row whose taps are all in the ring is filtered
+// vertically right away. The output is bit-identical to
+// Resampler::ResampleRegion().
+//
+// Decoders that can decode an image smaller at little cost, like JPEG, are
+// asked to, down to the smallest size that still covers the scaled image.
+// The filters then finish the job from there, so the output has the same
+// size and position, only less was decoded to get it.
+//
+// Images the plan leaves as they are, TILE ones, which the desktop repeats
+// at full size, and BGR24 ones, which the filters don't take, come out as
+// large as they went in. Rather than holding them, set_writer() has their
+// rows converted and encoded into the output file a band at a time as they
+// are decoded, and set_drop_whole() has them dropped when only their size
+// matters. Either way memory stays the same however large the source is.
+// Otherwise they are decoded whole into one PixelBuffer, which the memory
+// budget can move to a scratch file but whose pages still count towards the
+// resident size of the process as they are written.
+class BandResampler : public RowSink {
+ public:
+  // Lays images out for |style| on a |screen_width| x |screen_height|
+  // screen, filtering on up to |threads| threads, 0 meaning one per core, the
+  // decoding one and workers of |pool|, see ParallelFor().
+  BandResampler(WallpaperStyle style, int screen_width, int screen_height,
+                int threads, WorkerPool* pool);
+  virtual ~BandResampler();
+
+  // Has images the plan leaves whole and that have more than
+  // |max_held_bytes| of BGR24 pixels go to |writer|: their rows are
+  // composited over |background|, given as 0xRRGGBB, and encoded as they are
+  // decoded. Smaller ones are still held, so they can be cached. Call before
+  // the image begins.
+  void set_writer(std::unique_ptr<ImageFileWriter> writer,
+                  uint32_t background, uint64_t max_held_bytes);
+
+  // Has the rows of images the plan leaves whole dropped, for when they are
+  // handed to the desktop as encoded and only their size matters. Call
+  // before the image begins.
+  void set_drop_whole(bool drop) { drop_whole_ = drop; }
+
+  virtual int ChooseReduction(int width, int height, int max_reduction);
+  virtual bool Begin(int width, int height, PixelFormat format);
+  virtual uint8_t* BeginRow(int y);
+  virtual void EndRow(int y);
+
+  // Hands the image over to |output| once every row went through, unless
+  // it went to writer() or was dropped, which leaves |output| empty. On
+  // failure, returns false and describes the problem in |error|.
+  bool Finish(PixelBuffer* output, std::string* error);
+
+  // The writer set_writer() gave if the image went to it, with every row
+  // written but the file left to complete. NULL otherwise.
+  ImageFileWriter* writer() const {
+    return mode_ == MODE_WRITE ? writer_.get() : NULL;
+  }
+
+  // Size of the decoded image, before it was scaled or cropped.
+  int source_width() const { return source_width_; }
+  int source_height() const { return source_height_; }
+
+  // How many times smaller than the encoded image the decoder made it.
+  int reduction() const { return reduction_; }
+
+  // True if the image was reduced, scaled or cropped. Otherwise it is
+  // exactly what was encoded.
+  bool resampled() const {
+    return mode_ == MODE_CROP || mode_ == MODE_SCALE || reduction_ > 1;
+  }
+
+  // Time spent filtering rather than decoding.
+  int64_t resample_nanoseconds() const { return resample_nanoseconds_; }
+
+  // Time spent converting and encoding the rows that went to writer().
+  int64_t convert_nanoseconds() const { return convert_nanoseconds_; }
+  int64_t encode_nanoseconds() const { return encode_nanoseconds_; }
+
+ private:
+  enum Mode {
+    // Rows are decoded straight into the output.
+    MODE_WHOLE,
+    // Rows go to |writer_| a band at a time.
+    MODE_WRITE,
+    // Rows are decoded into |discard_| and dropped.
+    MODE_DROP,
+    // The columns and rows on the screen are copied out of each row.
+    MODE_CROP,
+    // Rows are filtered a band at a time.
+    MODE_SCALE
+  };
+
+  // Filters the source rows from |band_start_| up to |end| into the ring,
+  // then every output row that has all its taps.
+  void FilterBand(int end);
+
+  // Converts the source rows from |band_start_| up to |end| and hands them to
+  // |writer_|.
+  void WriteBand(int end);
+
+  WallpaperStyle style_;
+  int screen_width_;
+  int screen_height_;
+  int threads_;
+  // Not owned, may be NULL.
+  WorkerPool* pool_;
+  std::unique_ptr<ImageFileWriter> writer_;
+  uint32_t background_;
+  uint64_t max_held_bytes_;
+  bool drop_whole_;
+
+  Mode mode_;
+  // Planned for the full size of the image when the decoder reduces it.
+  PrescalePlan plan_;
+  int reduction_;
+  int source_width_;
+  int source_height_;
+  int rows_received_;
+
+  std::unique_ptr<ResampleFilter> horizontal_;
+  std::unique_ptr<ResampleFilter> vertical_;
+  // Source rows the vertical filter reads. The others are decoded into
+  // |discard_| and dropped, as is every row in MODE_CROP once copied.
+  int first_row_;
+  int last_row_;
+  PixelBuffer discard_;
+  // Source rows from |band_start_| on waiting for the horizontal filter, or
+  // for |writer_|.
+  PixelBuffer band_;
+  int band_start_;
+  // Source row y, filtered horizontally, is row y % ring_.height().
+  PixelBuffer ring_;
+  int next_output_row_;
+  PixelBuffer output_;
+  // |band_| in BGR24, for |writer_|.
+  PixelBuffer converted_;
+  // Why |writer_| failed, empty if it didn't.
+  std::string write_error_;
+
+  int64_t resample_nanoseconds_;
+  int64_t convert_nanoseconds_;
+  int64_t encode_nanoseconds_;
+
+  BandResampler(const BandResampler&);
+  void operator=(const BandResampler&);
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_BAND_RESAMPLER_H_
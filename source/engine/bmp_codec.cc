@@ -0,0 +1,359 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "bmp_codec.h"
+
+#include <string.h>
+
+#include "file_util.h"
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// Values of the biCompression field we understand.
+const uint32_t kBiRgb = 0;
+const uint32_t kBiBitfields = 3;
+
+uint16_t ReadLE16(const uint8_t* p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t ReadLE32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) |
+         (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+void WriteLE16(uint8_t* p, uint16_t value) {
+  p[0] = static_cast<uint8_t>(value);
+  p[1] = static_cast<uint8_t>(value >> 8);
+}
+
+void WriteLE32(uint8_t* p, uint32_t value) {
+  p[0] = static_cast<uint8_t>(value);
+  p[1] = static_cast<uint8_t>(value >> 8);
+  p[2] = static_cast<uint8_t>(value >> 16);
+  p[3] = static_cast<uint8_t>(value >> 24);
+}
+
+// Extracts one channel described by a BI_BITFIELDS style |mask| and scales it
+// to the 0-255 range.
+class ChannelMask {
+ public:
+  explicit ChannelMask(uint32_t mask) : mask_(mask), shift_(0), max_(0) {
+    if (mask_ == 0)
+      return;
+    while (((mask_ >> shift_) & 1) == 0)
+      ++shift_;
+    max_ = mask_ >> shift_;
+  }
+
+  bool empty() const { return mask_ == 0; }
+
+  uint8_t Extract(uint32_t pixel) const {
+    if (max_ == 0)
+      return 0;
+    uint32_t value = (pixel & mask_) >> shift_;
+    return static_cast<uint8_t>((value * 255 + max_ / 2) / max_);
+  }
+
+ private:
+  uint32_t mask_;
+  int shift_;
+  uint32_t max_;
+};
+
+// Writes every row straight to where it goes in a bottom-up BMP, so the
+// first row written ends the file and the last one starts the pixels.
+class BmpFileWriter : public ImageFileWriter {
+ public:
+  explicit BmpFileWriter(const std::string& path)
+      : path_(path),
+        height_(0),
+        stride_(0),
+        rows_written_(0),
+        bytes_written_(0) {}
+
+  virtual bool Begin(int width, int height, std::string* error) {
+    height_ = height;
+    stride_ = PixelBuffer::StrideFor(width, PIXEL_FORMAT_BGR24);
+    rows_written_ = 0;
+    uint64_t size = kBmpHeaderSize + static_cast<uint64_t>(stride_) * height;
+    if (size > 0xffffffffu) {
+      *error = "The image is too large for a BMP.";
+      return false;
+    }
+    uint8_t header[kBmpHeaderSize];
+    BmpEncoder::WriteHeader(width, height, header);
+    if (!file_.Open(path_, size) ||
+        !file_.WriteAt(0, header, kBmpHeaderSize)) {
+      *error = "Unable to write " + path_;
+      return false;
+    }
+    bytes_written_ = kBmpHeaderSize;
+    return true;
+  }
+
+  virtual bool WriteRow(const uint8_t* row, std::string* error) {
+    uint64_t offset = kBmpHeaderSize +
+        static_cast<uint64_t>(height_ - 1 - rows_written_) * stride_;
+    if (rows_written_ >= height_ || !file_.WriteAt(offset, row, stride_)) {
+      *error = "Unable to write " + path_;
+      return false;
+    }
+    ++rows_written_;
+    bytes_written_ += stride_;
+    return true;
+  }
+
+  virtual bool Finish(std::string* error) {
+    if (rows_written_ != height_ || !file_.Commit()) {
+      *error = "Unable to write " + path_;
+      return false;
+    }
+    return true;
+  }
+
+  virtual ImageFormat format() const { return IMAGE_FORMAT_BMP; }
+  virtual uint64_t bytes_written() const { return bytes_written_; }
+
+ private:
+  std::string path_;
+  PartialFile file_;
+  int height_;
+  int stride_;
+  int rows_written_;
+  uint64_t bytes_written_;
+};
+
+}  // namespace
+
+bool BmpDecoder::CanDecode(ImageFormat format) const {
+  return format == IMAGE_FORMAT_BMP;
+}
+
+bool BmpDecoder::Decode(const uint8_t* data, size_t size,
+                        PixelBuffer* output, std::string* error) {
+  PixelBufferSink sink(output);
+  return DecodeRows(data, size, &sink, error);
+}
+
+bool BmpDecoder::DecodeRows(const uint8_t* data, size_t size, RowSink* sink,
+                            std::string* error) {
+  if (size < kBmpHeaderSize || data[0] != 'B' || data[1] != 'M') {
+    *error = "Not a BMP file.";
+    return false;
+  }
+
+  uint32_t pixel_offset = ReadLE32(data + 10);
+  uint32_t info_size = ReadLE32(data + 14);
+  if (info_size < 40 || 14 + static_cast<size_t>(info_size) > size) {
+    *error = "Unsupported BMP info header.";
+    return false;
+  }
+
+  const uint8_t* info = data + 14;
+  int32_t width = static_cast<int32_t>(ReadLE32(info + 4));
+  int32_t height = static_cast<int32_t>(ReadLE32(info + 8));
+  uint16_t bit_count = ReadLE16(info + 14);
+  uint32_t compression = ReadLE32(info + 16);
+  uint32_t colors_used = ReadLE32(info + 32);
+
+  bool top_down = height < 0;
+  if (top_down)
+    height = -height;
+
+  if (compression != kBiRgb && compression != kBiBitfields) {
+    *error = "Compressed BMP files are not supported.";
+    return false;
+  }
+
+  // Channel masks. BI_RGB implies 5-5-5 for 16-bit and 8-8-8 for 32-bit.
+  uint32_t red_mask = 0, green_mask = 0, blue_mask = 0, alpha_mask = 0;
+  if (bit_count == 16) {
+    red_mask = 0x7C00;
+    green_mask = 0x03E0;
+    blue_mask = 0x001F;
+  } else if (bit_count == 32) {
+    red_mask = 0x00FF0000;
+    green_mask = 0x0000FF00;
+    blue_mask = 0x000000FF;
+  }
+  if (compression == kBiBitfields) {
+    if (bit_count != 16 && bit_count != 32) {
+      *error = "BI_BITFIELDS requires a 16 or 32-bit BMP.";
+      return false;
+    }
+    // The masks either follow a 40-byte header or live inside a V4/V5 one.
+    const uint8_t* masks = info + 40;
+    if (masks + 12 > data + size) {
+      *error = "Truncated BMP bit masks.";
+      return false;
+    }
+    red_mask = ReadLE32(masks);
+    green_mask = ReadLE32(masks + 4);
+    blue_mask = ReadLE32(masks + 8);
+    if (info_size >= 56)
+      alpha_mask = ReadLE32(masks + 12);
+  }
+
+  // Palette, if any, follows the info header.
+  const uint8_t* palette = NULL;
+  uint32_t palette_size = 0;
+  if (bit_count == 1 || bit_count == 4 || bit_count == 8) {
+    palette_size = colors_used ? colors_used : (1u << bit_count);
+    if (palette_size > (1u << bit_count))
+      palette_size = 1u << bit_count;
+    palette = info + info_size;
+    if (palette + palette_size * 4 > data + size) {
+      *error = "Truncated BMP palette.";
+      return false;
+    }
+  } else if (bit_count != 16 && bit_count != 24 && bit_count != 32) {
+    *error = "Unsupported BMP bit depth.";
+    return false;
+  }
+
+  if (!sink->Begin(width, height, PIXEL_FORMAT_BGRA32)) {
+    *error = "Invalid BMP dimensions.";
+    return false;
+  }
+
+  size_t src_stride = ((static_cast<size_t>(width) * bit_count + 31) / 32) * 4;
+  if (pixel_offset > size || src_stride * height > size - pixel_offset) {
+    *error = "Truncated BMP pixel data.";
+    return false;
+  }
+
+  ChannelMask red(red_mask), green(green_mask), blue(blue_mask),
+              alpha(alpha_mask);
+
+  for (int y = 0; y < height; ++y) {
+    int src_y = top_down ? y : height - 1 - y;
+    const uint8_t* src = data + pixel_offset + src_stride * src_y;
+    uint8_t* dst = sink->BeginRow(y);
+
+    for (int x = 0; x < width; ++x, dst += 4) {
+      switch (bit_count) {
+      case 1:
+      case 4:
+      case 8: {
+        int bit = x * bit_count;
+        int index = (src[bit >> 3] >> (8 - bit_count - (bit & 7))) &
+                    ((1 << bit_count) - 1);
+        if (static_cast<uint32_t>(index) >= palette_size)
+          index = 0;
+        const uint8_t* color = palette + index * 4;
+        dst[0] = color[0];
+        dst[1] = color[1];
+        dst[2] = color[2];
+        dst[3] = 0xFF;
+        break;
+      }
+      case 24:
+        dst[0] = src[x * 3];
+        dst[1] = src[x * 3 + 1];
+        dst[2] = src[x * 3 + 2];
+        dst[3] = 0xFF;
+        break;
+      case 16:
+      case 32: {
+        uint32_t pixel = bit_count == 16 ? ReadLE16(src + x * 2)
+                                         : ReadLE32(src + x * 4);
+        dst[0] = blue.Extract(pixel);
+        dst[1] = green.Extract(pixel);
+        dst[2] = red.Extract(pixel);
+        dst[3] = alpha.empty() ? 0xFF : alpha.Extract(pixel);
+        break;
+      }
+      }
+    }
+    sink->EndRow(y);
+  }
+
+  return true;
+}
+
+bool BmpEncoder::Encode(const PixelBuffer& input,
+                        std::vector<uint8_t>* output,
+                        std::string* error) {
+  if (input.format() != PIXEL_FORMAT_BGR24) {
+    *error = "BMP encoder expects BGR24 pixels.";
+    return false;
+  }
+
+  // PixelBuffer pads BGR24 rows exactly like a DIB, so every row can be
+  // copied as a whole. Only the order has to be flipped to bottom-up.
+  size_t image_size = static_cast<size_t>(input.stride()) * input.height();
+  output->resize(kBmpHeaderSize + image_size);
+  WriteHeader(input.width(), input.height(), &(*output)[0]);
+
+  uint8_t* dst = &(*output)[kBmpHeaderSize];
+  for (int y = input.height() - 1; y >= 0; --y) {
+    memcpy(dst, input.row(y), input.stride());
+    dst += input.stride();
+  }
+  return true;
+}
+
+bool BmpEncoder::EncodeToFile(const PixelBuffer& input,
+                              const std::string& path,
+                              std::string* error) {
+  if (input.format() != PIXEL_FORMAT_BGR24) {
+    *error = "BMP encoder expects BGR24 pixels.";
+    return false;
+  }
+
+  uint8_t header[kBmpHeaderSize];
+  WriteHeader(input.width(), input.height(), header);
+
+  std::vector<FileChunk> chunks(input.height() + 1);
+  chunks[0].data = header;
+  chunks[0].size = kBmpHeaderSize;
+  for (int y = 0; y < input.height(); ++y) {
+    FileChunk& chunk = chunks[input.height() - y];
+    chunk.data = input.row(y);
+    chunk.size = input.stride();
+  }
+  if (!WriteChunksToFile(path, &chunks[0], chunks.size())) {
+    *error = "Unable to write " + path;
+    return false;
+  }
+  return true;
+}
+
+ImageFileWriter* BmpEncoder::CreateFileWriter(const std::string& path) {
+  return new BmpFileWriter(path);
+}
+
+void BmpEncoder::WriteHeader(int width, int height, uint8_t* header) {
+  uint32_t image_size =
+      static_cast<uint32_t>(PixelBuffer::StrideFor(width, PIXEL_FORMAT_BGR24)) *
+      height;
+
+  memset(header, 0, kBmpHeaderSize);
+
+  // BITMAPFILEHEADER
+  header[0] = 'B';
+  header[1] = 'M';
+  WriteLE32(header + 2, kBmpHeaderSize + image_size);
+  WriteLE32(header + 10, kBmpHeaderSize);
+
+  // BITMAPINFOHEADER
+  uint8_t* info = header + 14;
+  WriteLE32(info, 40);
+  WriteLE32(info + 4, static_cast<uint32_t>(width));
+  WriteLE32(info + 8, static_cast<uint32_t>(height));
+  WriteLE16(info + 12, 1);
+  WriteLE16(info + 14, 24);
+  WriteLE32(info + 16, kBiRgb);
+  WriteLE32(info + 20, image_size);
+  // 2835 pixels per meter is 72 DPI.
+  WriteLE32(info + 24, 2835);
+  WriteLE32(info + 28, 2835);
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,51 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_BMP_CODEC_H_
+#define ENGINE_BMP_CODEC_H_
+
+#include "image_decoder.h"
+#include "image_encoder.h"
+
+namespace set_wallpaper_extension {
+
+// Size of BITMAPFILEHEADER followed by BITMAPINFOHEADER, which is all the
+// header a 24-bit BMP needs.
+const int kBmpHeaderSize = 14 + 40;
+
+// Decodes uncompressed Windows bitmaps: 1, 4 and 8-bit palettized images and
+// 16, 24 and 32-bit images, bottom-up or top-down. The output is BGRA32.
+class BmpDecoder : public ImageDecoder {
+ public:
+  virtual bool CanDecode(ImageFormat format) const;
+  virtual bool Decode(const uint8_t* data, size_t size,
+                      PixelBuffer* output, std::string* error);
+  virtual bool DecodeRows(const uint8_t* data, size_t size, RowSink* sink,
+                          std::string* error);
+};
+
+// Encodes BGR24 pixels as a bottom-up 24-bit BMP, the one format every
+// version of Windows accepts as a desktop background.
+class BmpEncoder : public ImageEncoder {
+ public:
+  virtual ImageFormat format() const { return IMAGE_FORMAT_BMP; }
+  virtual bool Encode(const PixelBuffer& input,
+                      std::vector<uint8_t>* output,
+                      std::string* error);
+  virtual ImageFileWriter* CreateFileWriter(const std::string& path);
+
+  // Writes |input| as a BMP at |path| without encoding it in memory first:
+  // the header and the rows, bottom one first, go straight from |input| to
+  // the file, see WriteChunksToFile().
+  static bool EncodeToFile(const PixelBuffer& input, const std::string& path,
+                           std::string* error);
+
+  // Writes the file and info headers of a |width| x |height| 24-bit BMP into
+  // the kBmpHeaderSize bytes at |header|.
+  static void WriteHeader(int width, int height, uint8_t* header);
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_BMP_CODEC_H_
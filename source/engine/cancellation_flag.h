@@ -0,0 +1,27 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_CANCELLATION_FLAG_H_
+#define ENGINE_CANCELLATION_FLAG_H_
+
+#include <atomic>
+
+namespace set_wallpaper_extension {
+
+// Lets one thread call off work another thread is doing. The work checks the
+// flag at points where stopping is cheap and gives up once it is set.
+class CancellationFlag {
+ public:
+  CancellationFlag() : cancelled_(false) {}
+
+  void Cancel() { cancelled_ = true; }
+  bool IsCancelled() const { return cancelled_; }
+
+ private:
+  std::atomic<bool> cancelled_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_CANCELLATION_FLAG_H_
@@ -0,0 +1,23 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_CLOCK_H_
+#define ENGINE_CLOCK_H_
+
+#include <stdint.h>
+
+#include <chrono>
+
+namespace set_wallpaper_extension {
+
+// Nanoseconds on a monotonic clock with an unspecified epoch. Only useful for
+// measuring intervals.
+inline int64_t MonotonicNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_CLOCK_H_
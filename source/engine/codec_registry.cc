@@ -0,0 +1,48 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "codec_registry.h"
+
+namespace set_wallpaper_extension {
+
+CodecRegistry::CodecRegistry() {
+  for (int i = 0; i < IMAGE_FORMAT_COUNT; ++i) {
+    decoders_[i] = NULL;
+    encoders_[i] = NULL;
+  }
+}
+
+void CodecRegistry::AddDecoder(ImageDecoder* decoder) {
+  if (NULL == decoder)
+    return;
+  // Nothing decodes unknown data.
+  for (int i = IMAGE_FORMAT_UNKNOWN + 1; i < IMAGE_FORMAT_COUNT; ++i) {
+    if (NULL == decoders_[i] &&
+        decoder->CanDecode(static_cast<ImageFormat>(i)))
+      decoders_[i] = decoder;
+  }
+}
+
+void CodecRegistry::AddEncoder(ImageEncoder* encoder) {
+  if (NULL == encoder)
+    return;
+  ImageFormat format = encoder->format();
+  if (format > IMAGE_FORMAT_UNKNOWN && format < IMAGE_FORMAT_COUNT &&
+      NULL == encoders_[format])
+    encoders_[format] = encoder;
+}
+
+ImageDecoder* CodecRegistry::DecoderFor(ImageFormat format) const {
+  if (format < 0 || format >= IMAGE_FORMAT_COUNT)
+    return NULL;
+  return decoders_[format];
+}
+
+ImageEncoder* CodecRegistry::EncoderFor(ImageFormat format) const {
+  if (format < 0 || format >= IMAGE_FORMAT_COUNT)
+    return NULL;
+  return encoders_[format];
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,43 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_CODEC_REGISTRY_H_
+#define ENGINE_CODEC_REGISTRY_H_
+
+#include "image_decoder.h"
+#include "image_encoder.h"
+
+namespace set_wallpaper_extension {
+
+// Which decoder and encoder handle each ImageFormat. Codecs are added once,
+// while the engine and the platform set up, and lookups are then an array
+// index instead of asking every codec in turn on every image. The format of
+// a source comes from SniffImageFormat(): every format with a decoder has a
+// signature, and the MIME type a server sends is often generic or wrong, so
+// it is not consulted.
+class CodecRegistry {
+ public:
+  CodecRegistry();
+
+  // Makes |decoder| the decoder of every format it CanDecode() that doesn't
+  // have one yet. The first codec added for a format wins, so the fastest
+  // ones go first. Not owned.
+  void AddDecoder(ImageDecoder* decoder);
+
+  // Makes |encoder| the encoder of its format, unless it has one already.
+  // Not owned.
+  void AddEncoder(ImageEncoder* encoder);
+
+  // The decoder or encoder for |format|, or NULL if there is none.
+  ImageDecoder* DecoderFor(ImageFormat format) const;
+  ImageEncoder* EncoderFor(ImageFormat format) const;
+
+ private:
+  ImageDecoder* decoders_[IMAGE_FORMAT_COUNT];
+  ImageEncoder* encoders_[IMAGE_FORMAT_COUNT];
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_CODEC_REGISTRY_H_
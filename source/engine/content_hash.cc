@@ -0,0 +1,134 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "content_hash.h"
+
+#include <string.h>
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+const uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+const size_t kStripeSize = 32;
+
+inline uint64_t RotateLeft(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+// Reads little endian values regardless of alignment and of the byte order
+// of the machine.
+inline uint64_t Read64(const uint8_t* p) {
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; --i)
+    value = (value << 8) | p[i];
+  return value;
+}
+
+inline uint32_t Read32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint64_t Round(uint64_t accumulator, uint64_t input) {
+  accumulator += input * kPrime2;
+  accumulator = RotateLeft(accumulator, 31);
+  return accumulator * kPrime1;
+}
+
+inline uint64_t MergeRound(uint64_t hash, uint64_t accumulator) {
+  hash ^= Round(0, accumulator);
+  return hash * kPrime1 + kPrime4;
+}
+
+}  // namespace
+
+ContentHasher::ContentHasher()
+    : pending_size_(0),
+      total_size_(0) {
+  accumulators_[0] = kPrime1 + kPrime2;
+  accumulators_[1] = kPrime2;
+  accumulators_[2] = 0;
+  accumulators_[3] = 0 - kPrime1;
+}
+
+void ContentHasher::Update(const uint8_t* data, size_t size) {
+  total_size_ += size;
+
+  if (pending_size_ > 0) {
+    size_t needed = kStripeSize - pending_size_;
+    if (size < needed) {
+      memcpy(pending_ + pending_size_, data, size);
+      pending_size_ += size;
+      return;
+    }
+    memcpy(pending_ + pending_size_, data, needed);
+    ProcessStripe(pending_);
+    pending_size_ = 0;
+    data += needed;
+    size -= needed;
+  }
+
+  for (; size >= kStripeSize; data += kStripeSize, size -= kStripeSize)
+    ProcessStripe(data);
+
+  memcpy(pending_, data, size);
+  pending_size_ = size;
+}
+
+uint64_t ContentHasher::Finish() const {
+  uint64_t hash;
+  if (total_size_ >= kStripeSize) {
+    hash = RotateLeft(accumulators_[0], 1) + RotateLeft(accumulators_[1], 7) +
+           RotateLeft(accumulators_[2], 12) + RotateLeft(accumulators_[3], 18);
+    for (int i = 0; i < 4; ++i)
+      hash = MergeRound(hash, accumulators_[i]);
+  } else {
+    hash = kPrime5;
+  }
+  hash += total_size_;
+
+  const uint8_t* p = pending_;
+  size_t size = pending_size_;
+  for (; size >= 8; p += 8, size -= 8) {
+    hash ^= Round(0, Read64(p));
+    hash = RotateLeft(hash, 27) * kPrime1 + kPrime4;
+  }
+  if (size >= 4) {
+    hash ^= static_cast<uint64_t>(Read32(p)) * kPrime1;
+    hash = RotateLeft(hash, 23) * kPrime2 + kPrime3;
+    p += 4;
+    size -= 4;
+  }
+  for (; size > 0; ++p, --size) {
+    hash ^= *p * kPrime5;
+    hash = RotateLeft(hash, 11) * kPrime1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= kPrime2;
+  hash ^= hash >> 29;
+  hash *= kPrime3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+uint64_t ContentHasher::Hash(const uint8_t* data, size_t size) {
+  ContentHasher hasher;
+  hasher.Update(data, size);
+  return hasher.Finish();
+}
+
+void ContentHasher::ProcessStripe(const uint8_t* stripe) {
+  for (int i = 0; i < 4; ++i)
+    accumulators_[i] = Round(accumulators_[i], Read64(stripe + i * 8));
+}
+
+}  // namespace set_wallpaper_extension
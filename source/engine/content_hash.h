@@ -0,0 +1,46 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_CONTENT_HASH_H_
+#define ENGINE_CONTENT_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace set_wallpaper_extension {
+
+// Fast 64-bit non-cryptographic hash of a byte stream, fed in chunks of any
+// size as they arrive. The result is XXH64 with a zero seed, so it does not
+// depend on how the stream was split. It identifies content, it is not meant
+// to resist anybody crafting collisions.
+class ContentHasher {
+ public:
+  ContentHasher();
+
+  // Adds the next |size| bytes of the stream.
+  void Update(const uint8_t* data, size_t size);
+
+  // Hash of everything passed to Update() so far. Doesn't reset the state,
+  // more data can still be added.
+  uint64_t Finish() const;
+
+  // Number of bytes hashed so far.
+  uint64_t total_size() const { return total_size_; }
+
+  // Hash of a single buffer.
+  static uint64_t Hash(const uint8_t* data, size_t size);
+
+ private:
+  void ProcessStripe(const uint8_t* stripe);
+
+  uint64_t accumulators_[4];
+  // Bytes that didn't fill a complete 32-byte stripe yet.
+  uint8_t pending_[32];
+  size_t pending_size_;
+  uint64_t total_size_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_CONTENT_HASH_H_
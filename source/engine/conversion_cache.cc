@@ -0,0 +1,118 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "conversion_cache.h"
+
+namespace set_wallpaper_extension {
+
+bool ConversionKey::operator<(const ConversionKey& other) const {
+  if (content_hash != other.content_hash)
+    return content_hash < other.content_hash;
+  if (content_size != other.content_size)
+    return content_size < other.content_size;
+  if (style != other.style)
+    return style < other.style;
+  if (screen_width != other.screen_width)
+    return screen_width < other.screen_width;
+  if (screen_height != other.screen_height)
+    return screen_height < other.screen_height;
+  if (background_color != other.background_color)
+    return background_color < other.background_color;
+  return format < other.format;
+}
+
+ConversionCache::ConversionCache(size_t capacity)
+    : capacity_(capacity),
+      size_(0),
+      hits_(0),
+      misses_(0) {
+}
+
+ConversionCache::~ConversionCache() {
+}
+
+std::shared_ptr<const CachedConversion> ConversionCache::Lookup(
+    const ConversionKey& key) {
+  std::lock_guard<std::mutex> guard(lock_);
+  EntryMap::iterator it = entries_.find(key);
+  if (it == entries_.end()) {
+    ++misses_;
+    return std::shared_ptr<const CachedConversion>();
+  }
+  ++hits_;
+  recency_.splice(recency_.begin(), recency_, it->second.recency);
+  return it->second.conversion;
+}
+
+void ConversionCache::Insert(
+    const ConversionKey& key,
+    const std::shared_ptr<const CachedConversion>& conversion) {
+  std::lock_guard<std::mutex> guard(lock_);
+  size_t size = conversion->encoded.size();
+  if (size > capacity_)
+    return;
+
+  EntryMap::iterator it = entries_.find(key);
+  if (it != entries_.end()) {
+    size_ -= it->second.conversion->encoded.size();
+    it->second.conversion = conversion;
+    recency_.splice(recency_.begin(), recency_, it->second.recency);
+  } else {
+    recency_.push_front(key);
+    Entry& entry = entries_[key];
+    entry.conversion = conversion;
+    entry.recency = recency_.begin();
+  }
+  size_ += size;
+  EvictLocked();
+}
+
+void ConversionCache::Clear() {
+  std::lock_guard<std::mutex> guard(lock_);
+  entries_.clear();
+  recency_.clear();
+  size_ = 0;
+}
+
+void ConversionCache::set_capacity(size_t capacity) {
+  std::lock_guard<std::mutex> guard(lock_);
+  capacity_ = capacity;
+  EvictLocked();
+}
+
+size_t ConversionCache::capacity() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return capacity_;
+}
+
+size_t ConversionCache::size() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return size_;
+}
+
+size_t ConversionCache::entry_count() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return entries_.size();
+}
+
+int64_t ConversionCache::hits() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return hits_;
+}
+
+int64_t ConversionCache::misses() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return misses_;
+}
+
+void ConversionCache::EvictLocked() {
+  while (size_ > capacity_ && !recency_.empty()) {
+    EntryMap::iterator it = entries_.find(recency_.back());
+    size_ -= it->second.conversion->encoded.size();
+    entries_.erase(it);
+    recency_.pop_back();
+  }
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,107 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_CONVERSION_CACHE_H_
+#define ENGINE_CONVERSION_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "image_decoder.h"
+
+namespace set_wallpaper_extension {
+
+// Identifies a conversion by the content of the source image and everything
+// the output depends on, its format included. Two downloads of the same
+// bytes converted for the same screen to the same format produce the same
+// file.
+struct ConversionKey {
+  ConversionKey()
+      : content_hash(0),
+        content_size(0),
+        style(0),
+        screen_width(0),
+        screen_height(0),
+        background_color(0),
+        format(IMAGE_FORMAT_UNKNOWN) {}
+
+  bool operator<(const ConversionKey& other) const;
+
+  uint64_t content_hash;
+  uint64_t content_size;
+  int style;
+  int screen_width;
+  int screen_height;
+  uint32_t background_color;
+  ImageFormat format;
+};
+
+// A converted image, as written to disk.
+struct CachedConversion {
+  CachedConversion() : format(IMAGE_FORMAT_UNKNOWN), pixels(0) {}
+
+  ImageFormat format;
+  int64_t pixels;
+  std::vector<uint8_t> encoded;
+};
+
+// Keeps the most recently produced conversions in memory, up to a budget in
+// bytes, so converting an image again only costs writing it out. Safe to use
+// from several threads.
+class ConversionCache {
+ public:
+  explicit ConversionCache(size_t capacity);
+  ~ConversionCache();
+
+  // Returns the conversion stored for |key| and counts a hit, or NULL and
+  // counts a miss.
+  std::shared_ptr<const CachedConversion> Lookup(const ConversionKey& key);
+
+  // Stores |conversion| for |key|, evicting the least recently used entries
+  // as needed. Conversions larger than the whole budget are not kept.
+  void Insert(const ConversionKey& key,
+              const std::shared_ptr<const CachedConversion>& conversion);
+
+  // Drops every entry. The counters are kept.
+  void Clear();
+
+  // Changes the budget, evicting entries if it shrinks. 0 disables caching.
+  void set_capacity(size_t capacity);
+
+  size_t capacity() const;
+  size_t size() const;
+  size_t entry_count() const;
+  int64_t hits() const;
+  int64_t misses() const;
+
+ private:
+  typedef std::list<ConversionKey> RecencyList;
+  struct Entry {
+    std::shared_ptr<const CachedConversion> conversion;
+    RecencyList::iterator recency;
+  };
+  typedef std::map<ConversionKey, Entry> EntryMap;
+
+  // Evicts entries until size_ fits capacity_. |lock_| must be held.
+  void EvictLocked();
+
+  mutable std::mutex lock_;
+  EntryMap entries_;
+  // Most recently used first.
+  RecencyList recency_;
+  size_t capacity_;
+  size_t size_;
+  int64_t hits_;
+  int64_t misses_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_CONVERSION_CACHE_H_
@@ -0,0 +1,57 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "cpu_features.h"
+
+#if defined(ENGINE_ARCH_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+struct CpuFeatures {
+  CpuFeatures() : sse2(false), avx2(false) {
+#if defined(ENGINE_ARCH_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+    __cpuid(info, 1);
+    sse2 = (info[3] & (1 << 26)) != 0;
+    // AVX2 also needs the OS to save the upper halves of the registers.
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (max_leaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+      __cpuidex(info, 7, 0);
+      avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#elif defined(ENGINE_ARCH_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    sse2 = __builtin_cpu_supports("sse2") != 0;
+    avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+  }
+
+  bool sse2;
+  bool avx2;
+};
+
+const CpuFeatures& GetCpuFeatures() {
+  static const CpuFeatures features;
+  return features;
+}
+
+}  // namespace
+
+bool CpuHasSse2() {
+  return GetCpuFeatures().sse2;
+}
+
+bool CpuHasAvx2() {
+  return GetCpuFeatures().avx2;
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,30 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_CPU_FEATURES_H_
+#define ENGINE_CPU_FEATURES_H_
+
+// Vector kernels are only compiled for x86, and only where the compiler can
+// build them without special flags for the whole file.
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || \
+    defined(__x86_64__)
+#define ENGINE_ARCH_X86 1
+#endif
+
+#if defined(ENGINE_ARCH_X86) && defined(__GNUC__)
+// Lets a single function use instructions the rest of the file can't.
+#define ENGINE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define ENGINE_TARGET(isa)
+#endif
+
+namespace set_wallpaper_extension {
+
+// Instruction set extensions of the CPU we are running on. Detected once.
+bool CpuHasSse2();
+bool CpuHasAvx2();
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_CPU_FEATURES_H_
@@ -0,0 +1,39 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_DESKTOP_BACKEND_H_
+#define ENGINE_DESKTOP_BACKEND_H_
+
+#include <string>
+
+#include "wallpaper_layout.h"
+
+namespace set_wallpaper_extension {
+
+// Whatever sets the wallpaper of the desktop. An ApplyQueue only calls it from
+// its own thread, so an implementation can hold on to thread affine state,
+// such as a COM apartment and the interfaces created in it, from one
+// wallpaper to the next.
+class DesktopBackend {
+ public:
+  virtual ~DesktopBackend() {}
+
+  // Sets up whatever Apply() needs. Called before the first Apply(), and
+  // again after Disconnect(). On failure, returns false and describes the
+  // problem in |error|.
+  virtual bool Connect(std::string* error) = 0;
+
+  // Tears down what Connect() set up. Called after an Apply() that failed, in
+  // case the connection went stale, and before the backend is destroyed.
+  virtual void Disconnect() = 0;
+
+  // Makes the image file at |path| the wallpaper, displayed with |style|. On
+  // failure, returns false and describes the problem in |error|.
+  virtual bool Apply(const std::string& path, WallpaperStyle style,
+                     std::string* error) = 0;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_DESKTOP_BACKEND_H_
@@ -0,0 +1,79 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "fake_desktop_backend.h"
+
+#include <chrono>
+#include <thread>
+
+namespace set_wallpaper_extension {
+
+FakeDesktopBackend::FakeDesktopBackend()
+    : connect_nanoseconds_(0),
+      apply_nanoseconds_(0),
+      connected_(false),
+      connects_(0),
+      failures_left_(0) {
+}
+
+FakeDesktopBackend::~FakeDesktopBackend() {
+}
+
+void FakeDesktopBackend::FailNextApplies(int count) {
+  std::lock_guard<std::mutex> hold(lock_);
+  failures_left_ = count;
+}
+
+bool FakeDesktopBackend::Connect(std::string* error) {
+  Pause(connect_nanoseconds_);
+  std::lock_guard<std::mutex> hold(lock_);
+  if (connected_) {
+    *error = "Already connected.";
+    return false;
+  }
+  connected_ = true;
+  ++connects_;
+  return true;
+}
+
+void FakeDesktopBackend::Disconnect() {
+  std::lock_guard<std::mutex> hold(lock_);
+  connected_ = false;
+}
+
+bool FakeDesktopBackend::Apply(const std::string& path, WallpaperStyle style,
+                               std::string* error) {
+  Pause(apply_nanoseconds_);
+  std::lock_guard<std::mutex> hold(lock_);
+  if (!connected_) {
+    *error = "Not connected.";
+    return false;
+  }
+  if (failures_left_ > 0) {
+    --failures_left_;
+    *error = "Apply failed.";
+    return false;
+  }
+  applied_paths_.push_back(path);
+  return true;
+}
+
+int FakeDesktopBackend::connects() const {
+  std::lock_guard<std::mutex> hold(lock_);
+  return connects_;
+}
+
+std::vector<std::string> FakeDesktopBackend::applied_paths() const {
+  std::lock_guard<std::mutex> hold(lock_);
+  return applied_paths_;
+}
+
+void FakeDesktopBackend::Pause(int64_t nanoseconds) {
+  // The real desktop mostly waits on other processes, so sleeping is close
+  // enough.
+  if (nanoseconds > 0)
+    std::this_thread::sleep_for(std::chrono::nanoseconds(nanoseconds));
+}
+
+}  // namespace set_wallpaper_extension
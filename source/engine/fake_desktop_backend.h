@@ -0,0 +1,62 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_FAKE_DESKTOP_BACKEND_H_
+#define ENGINE_FAKE_DESKTOP_BACKEND_H_
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "desktop_backend.h"
+
+namespace set_wallpaper_extension {
+
+// DesktopBackend that only keeps track of what it was asked to do, so the
+// ApplyQueue and the pipeline in front of it can be exercised and measured on
+// machines without a desktop. Connecting and applying can be made to take a
+// while, the way they do on a real desktop.
+class FakeDesktopBackend : public DesktopBackend {
+ public:
+  FakeDesktopBackend();
+  virtual ~FakeDesktopBackend();
+
+  // How long Connect() and Apply() take, in nanoseconds. 0 by default.
+  void set_connect_nanoseconds(int64_t nanoseconds) {
+    connect_nanoseconds_ = nanoseconds;
+  }
+  void set_apply_nanoseconds(int64_t nanoseconds) {
+    apply_nanoseconds_ = nanoseconds;
+  }
+
+  // Makes the next |count| calls to Apply() fail.
+  void FailNextApplies(int count);
+
+  virtual bool Connect(std::string* error);
+  virtual void Disconnect();
+  virtual bool Apply(const std::string& path, WallpaperStyle style,
+                     std::string* error);
+
+  // What happened so far. May be called from any thread.
+  int connects() const;
+  std::vector<std::string> applied_paths() const;
+
+ private:
+  static void Pause(int64_t nanoseconds);
+
+  int64_t connect_nanoseconds_;
+  int64_t apply_nanoseconds_;
+
+  mutable std::mutex lock_;
+  bool connected_;
+  int connects_;
+  int failures_left_;
+  std::vector<std::string> applied_paths_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_FAKE_DESKTOP_BACKEND_H_
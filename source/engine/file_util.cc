@@ -0,0 +1,559 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "file_util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// What WriteChunksToFile() adds to a path while the file is being written.
+const char kPartialSuffix[] = ".part";
+
+#if defined(_WIN32)
+
+// Windows only gathers page-aligned buffers into one write, so chunks smaller
+// than this are copied together first.
+const size_t kStagingBytes = 1 << 20;
+
+// The most WriteFile() is asked to write at once.
+const size_t kMaxWrite = 1 << 30;
+
+std::wstring UTF8ToWide(const std::string& utf8) {
+  int length = MultiByteToWideChar(CP_UTF8, 0, utf8.c_str(), -1, NULL, 0);
+  if (length <= 0)
+    return std::wstring();
+  std::wstring wide(length, 0);
+  MultiByteToWideChar(CP_UTF8, 0, utf8.c_str(), -1, &wide[0], length);
+  wide.resize(length - 1);
+  return wide;
+}
+
+std::string WideToUTF8(const std::wstring& wide) {
+  int length = WideCharToMultiByte(CP_UTF8, 0, wide.c_str(), -1, NULL, 0,
+                                   NULL, NULL);
+  if (length <= 0)
+    return std::string();
+  std::string utf8(length, 0);
+  WideCharToMultiByte(CP_UTF8, 0, wide.c_str(), -1, &utf8[0], length, NULL,
+                      NULL);
+  utf8.resize(length - 1);
+  return utf8;
+}
+
+bool WriteToHandle(HANDLE file, const uint8_t* data, size_t size) {
+  while (size > 0) {
+    DWORD written;
+    DWORD piece = static_cast<DWORD>(size > kMaxWrite ? kMaxWrite : size);
+    if (!WriteFile(file, data, piece, &written, NULL) || 0 == written)
+      return false;
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+bool WriteChunksToHandle(HANDLE file, const FileChunk* chunks, size_t count) {
+  std::vector<uint8_t> staging;
+  staging.reserve(kStagingBytes);
+  for (size_t i = 0; i < count; ++i) {
+    if (staging.size() + chunks[i].size > kStagingBytes) {
+      if (!WriteToHandle(file, staging.data(), staging.size()))
+        return false;
+      staging.clear();
+    }
+    if (chunks[i].size >= kStagingBytes) {
+      if (!WriteToHandle(file, chunks[i].data, chunks[i].size))
+        return false;
+    } else {
+      staging.insert(staging.end(), chunks[i].data,
+                     chunks[i].data + chunks[i].size);
+    }
+  }
+  return WriteToHandle(file, staging.data(), staging.size());
+}
+
+#else
+
+#if defined(IOV_MAX)
+const int kMaxVectors = IOV_MAX;
+#else
+const int kMaxVectors = 1024;
+#endif
+
+bool WriteChunksToDescriptor(int file, const FileChunk* chunks,
+                             size_t count) {
+  // |offset| bytes of chunks[index] are already written.
+  size_t index = 0;
+  size_t offset = 0;
+  struct iovec vectors[kMaxVectors];
+  while (index < count) {
+    int used = 0;
+    for (size_t i = index; i < count && used < kMaxVectors; ++i, ++used) {
+      size_t skip = i == index ? offset : 0;
+      vectors[used].iov_base = const_cast<uint8_t*>(chunks[i].data) + skip;
+      vectors[used].iov_len = chunks[i].size - skip;
+    }
+    ssize_t written = writev(file, vectors, used);
+    if (written < 0) {
+      if (EINTR == errno)
+        continue;
+      return false;
+    }
+    size_t left = static_cast<size_t>(written);
+    while (index < count && left >= chunks[index].size - offset) {
+      left -= chunks[index].size - offset;
+      offset = 0;
+      ++index;
+    }
+    offset += left;
+  }
+  return true;
+}
+
+#endif
+
+}  // namespace
+
+FILE* OpenFile(const std::string& path, const char* mode) {
+#if defined(_WIN32)
+  std::wstring wide_mode(mode, mode + strlen(mode));
+  return _wfopen(UTF8ToWide(path).c_str(), wide_mode.c_str());
+#else
+  return fopen(path.c_str(), mode);
+#endif
+}
+
+bool ReadFileToBuffer(const std::string& path, std::vector<uint8_t>* contents) {
+  FILE* file = OpenFile(path, "rb");
+  if (!file)
+    return false;
+  bool ok = ReadFileToBuffer(file, contents);
+  fclose(file);
+  return ok;
+}
+
+bool ReadFileToBuffer(FILE* file, std::vector<uint8_t>* contents) {
+  contents->clear();
+  long start = ftell(file);
+  if (start >= 0 && fseek(file, 0, SEEK_END) == 0) {
+    long size = ftell(file) - start;
+    if (size > 0)
+      contents->reserve(static_cast<size_t>(size));
+    fseek(file, start, SEEK_SET);
+  }
+
+  uint8_t chunk[64 * 1024];
+  size_t read;
+  while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    contents->insert(contents->end(), chunk, chunk + read);
+
+  return !ferror(file);
+}
+
+bool WriteBufferToFile(const std::string& path, const uint8_t* data,
+                       size_t size) {
+  FILE* file = OpenFile(path, "wb");
+  if (!file)
+    return false;
+
+  bool ok = fwrite(data, 1, size, file) == size;
+  ok = (fclose(file) == 0) && ok;
+  return ok;
+}
+
+bool WriteChunksToFile(const std::string& path, const FileChunk* chunks,
+                       size_t count) {
+  uint64_t size = 0;
+  for (size_t i = 0; i < count; ++i)
+    size += chunks[i].size;
+  std::string partial_path = path + kPartialSuffix;
+
+#if defined(_WIN32)
+  HANDLE file = CreateFileW(UTF8ToWide(partial_path).c_str(), GENERIC_WRITE,
+                            0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN,
+                            NULL);
+  if (INVALID_HANDLE_VALUE == file)
+    return false;
+  // Setting the end first reserves the clusters in one go.
+  LARGE_INTEGER end, start;
+  end.QuadPart = static_cast<LONGLONG>(size);
+  start.QuadPart = 0;
+  bool ok = SetFilePointerEx(file, end, NULL, FILE_BEGIN) &&
+            SetEndOfFile(file) &&
+            SetFilePointerEx(file, start, NULL, FILE_BEGIN) &&
+            WriteChunksToHandle(file, chunks, count);
+  ok = CloseHandle(file) && ok;
+#else
+  int file = open(partial_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (file < 0)
+    return false;
+#if defined(__linux__)
+  // Only a hint, file systems that can't reserve space just grow the file.
+  // Unlike posix_fallocate(), this never falls back to writing zeros.
+  if (size > 0)
+    fallocate(file, 0, 0, static_cast<off_t>(size));
+#endif
+  bool ok = WriteChunksToDescriptor(file, chunks, count);
+  ok = (close(file) == 0) && ok;
+#endif
+
+  if (!ok || !RenameFile(partial_path, path)) {
+    RemoveFile(partial_path);
+    return false;
+  }
+  return true;
+}
+
+PartialFile::~PartialFile() {
+  Discard();
+}
+
+bool PartialFile::Commit() {
+  if (path_.empty())
+    return false;
+  bool ok = Close();
+  std::string partial_path = path_ + kPartialSuffix;
+  if (!ok || !RenameFile(partial_path, path_)) {
+    RemoveFile(partial_path);
+    path_.clear();
+    return false;
+  }
+  path_.clear();
+  return true;
+}
+
+void PartialFile::Discard() {
+  Close();
+  if (!path_.empty())
+    RemoveFile(path_ + kPartialSuffix);
+  path_.clear();
+}
+
+#if defined(_WIN32)
+
+PartialFile::PartialFile()
+    : file_(INVALID_HANDLE_VALUE) {
+}
+
+bool PartialFile::Open(const std::string& path, uint64_t size) {
+  Discard();
+  HANDLE file = CreateFileW(UTF8ToWide(path + kPartialSuffix).c_str(),
+                            GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+  if (INVALID_HANDLE_VALUE == file)
+    return false;
+  file_ = file;
+  path_ = path;
+  // Setting the end first reserves the clusters in one go.
+  LARGE_INTEGER end;
+  end.QuadPart = static_cast<LONGLONG>(size);
+  if (size > 0 &&
+      (!SetFilePointerEx(file, end, NULL, FILE_BEGIN) || !SetEndOfFile(file))) {
+    Discard();
+    return false;
+  }
+  return true;
+}
+
+bool PartialFile::WriteAt(uint64_t offset, const uint8_t* data, size_t size) {
+  while (size > 0) {
+    OVERLAPPED overlapped;
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.Offset = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    DWORD written;
+    DWORD piece = static_cast<DWORD>(size > kMaxWrite ? kMaxWrite : size);
+    if (!WriteFile(static_cast<HANDLE>(file_), data, piece, &written,
+                   &overlapped) || 0 == written) {
+      return false;
+    }
+    data += written;
+    size -= written;
+    offset += written;
+  }
+  return true;
+}
+
+bool PartialFile::Close() {
+  if (INVALID_HANDLE_VALUE == file_)
+    return false;
+  bool ok = CloseHandle(static_cast<HANDLE>(file_)) != 0;
+  file_ = INVALID_HANDLE_VALUE;
+  return ok;
+}
+
+#else
+
+PartialFile::PartialFile()
+    : file_(-1) {
+}
+
+bool PartialFile::Open(const std::string& path, uint64_t size) {
+  Discard();
+  int file = open((path + kPartialSuffix).c_str(),
+                  O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (file < 0)
+    return false;
+  file_ = file;
+  path_ = path;
+#if defined(__linux__)
+  // Only a hint, like in WriteChunksToFile().
+  if (size > 0)
+    fallocate(file, 0, 0, static_cast<off_t>(size));
+#endif
+  return true;
+}
+
+bool PartialFile::WriteAt(uint64_t offset, const uint8_t* data, size_t size) {
+  while (size > 0) {
+    ssize_t written = pwrite(file_, data, size, static_cast<off_t>(offset));
+    if (written < 0) {
+      if (EINTR == errno)
+        continue;
+      return false;
+    }
+    if (0 == written)
+      return false;
+    data += written;
+    size -= static_cast<size_t>(written);
+    offset += static_cast<uint64_t>(written);
+  }
+  return true;
+}
+
+bool PartialFile::Close() {
+  if (file_ < 0)
+    return false;
+  bool ok = close(file_) == 0;
+  file_ = -1;
+  return ok;
+}
+
+#endif
+
+bool RenameFile(const std::string& from, const std::string& to) {
+#if defined(_WIN32)
+  return MoveFileExW(UTF8ToWide(from).c_str(), UTF8ToWide(to).c_str(),
+                     MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+  return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+bool RemoveFile(const std::string& path) {
+#if defined(_WIN32)
+  return DeleteFileW(UTF8ToWide(path).c_str()) != 0;
+#else
+  return remove(path.c_str()) == 0;
+#endif
+}
+
+std::string TemporaryDirectory() {
+#if defined(_WIN32)
+  WCHAR path[MAX_PATH + 1];
+  DWORD length = GetTempPathW(MAX_PATH + 1, path);
+  if (0 == length || length > MAX_PATH)
+    return ".";
+  // GetTempPathW() ends the path with a backslash.
+  return WideToUTF8(std::wstring(path, length - 1));
+#else
+  const char* directory = getenv("TMPDIR");
+  if (NULL == directory || directory[0] != '/')
+    return "/tmp";
+  std::string result(directory);
+  if (result.size() > 1 && '/' == result[result.size() - 1])
+    result.erase(result.size() - 1);
+  return result;
+#endif
+}
+
+MappedFile::MappedFile()
+    : data_(NULL),
+      size_(0) {
+}
+
+MappedFile::~MappedFile() {
+  Unmap();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::Map(const std::string& path) {
+  Unmap();
+  // Sharing everything lets whoever owns the file delete it while it is
+  // mapped, like unix allows.
+  HANDLE file = CreateFileW(UTF8ToWide(path).c_str(), GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE |
+                                FILE_SHARE_DELETE,
+                            NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+                            NULL);
+  if (INVALID_HANDLE_VALUE == file)
+    return false;
+  LARGE_INTEGER size;
+  HANDLE mapping = NULL;
+  if (GetFileSizeEx(file, &size) && size.QuadPart > 0 &&
+      static_cast<uint64_t>(size.QuadPart) <= SIZE_MAX) {
+    mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  }
+  CloseHandle(file);
+  if (NULL == mapping)
+    return false;
+  // The view keeps the mapping alive.
+  void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (NULL == view)
+    return false;
+  data_ = static_cast<const uint8_t*>(view);
+  size_ = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+void MappedFile::Unmap() {
+  if (data_)
+    UnmapViewOfFile(data_);
+  data_ = NULL;
+  size_ = 0;
+}
+
+#else
+
+bool MappedFile::Map(const std::string& path) {
+  Unmap();
+  int file = open(path.c_str(), O_RDONLY);
+  if (file < 0)
+    return false;
+  struct stat info;
+  void* view = MAP_FAILED;
+  if (0 == fstat(file, &info) && info.st_size > 0 &&
+      static_cast<uint64_t>(info.st_size) <= SIZE_MAX) {
+    view = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ,
+                MAP_PRIVATE, file, 0);
+  }
+  // The mapping keeps the file alive.
+  close(file);
+  if (MAP_FAILED == view)
+    return false;
+  madvise(view, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+  data_ = static_cast<const uint8_t*>(view);
+  size_ = static_cast<size_t>(info.st_size);
+  return true;
+}
+
+void MappedFile::Unmap() {
+  if (data_)
+    munmap(const_cast<uint8_t*>(data_), size_);
+  data_ = NULL;
+  size_ = 0;
+}
+
+#endif
+
+ScratchMapping::ScratchMapping()
+    : data_(NULL),
+      size_(0) {
+}
+
+ScratchMapping::~ScratchMapping() {
+  Unmap();
+}
+
+void ScratchMapping::Swap(ScratchMapping* other) {
+  std::swap(data_, other->data_);
+  std::swap(size_, other->size_);
+}
+
+#if defined(_WIN32)
+
+bool ScratchMapping::Map(const std::string& directory, size_t size) {
+  Unmap();
+  if (0 == size)
+    return false;
+  WCHAR path[MAX_PATH];
+  if (!GetTempFileNameW(UTF8ToWide(directory).c_str(), L"swe", 0, path))
+    return false;
+  // Windows only deletes a file once every handle is closed, and the mapping
+  // holds on to it, so it goes away with the view.
+  HANDLE file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                            CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_TEMPORARY |
+                                FILE_FLAG_DELETE_ON_CLOSE,
+                            NULL);
+  if (INVALID_HANDLE_VALUE == file) {
+    DeleteFileW(path);
+    return false;
+  }
+  uint64_t bytes = size;
+  HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READWRITE,
+                                      static_cast<DWORD>(bytes >> 32),
+                                      static_cast<DWORD>(bytes), NULL);
+  CloseHandle(file);
+  if (NULL == mapping)
+    return false;
+  void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+  CloseHandle(mapping);
+  if (NULL == view)
+    return false;
+  data_ = static_cast<uint8_t*>(view);
+  size_ = size;
+  return true;
+}
+
+void ScratchMapping::Unmap() {
+  if (data_)
+    UnmapViewOfFile(data_);
+  data_ = NULL;
+  size_ = 0;
+}
+
+#else
+
+bool ScratchMapping::Map(const std::string& directory, size_t size) {
+  Unmap();
+  if (0 == size)
+    return false;
+  std::string path = directory + "/scratch-XXXXXX";
+  int file = mkstemp(&path[0]);
+  if (file < 0)
+    return false;
+  // The mapping keeps the file alive without a name.
+  unlink(path.c_str());
+  void* view = MAP_FAILED;
+  if (0 == ftruncate(file, static_cast<off_t>(size)))
+    view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+  close(file);
+  if (MAP_FAILED == view)
+    return false;
+  data_ = static_cast<uint8_t*>(view);
+  size_ = size;
+  return true;
+}
+
+void ScratchMapping::Unmap() {
+  if (data_)
+    munmap(data_, size_);
+  data_ = NULL;
+  size_ = 0;
+}
+
+#endif
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,168 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_FILE_UTIL_H_
+#define ENGINE_FILE_UTIL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+namespace set_wallpaper_extension {
+
+// All engine paths are UTF-8. These helpers take care of converting them to
+// whatever the platform's file API expects.
+
+// Opens |path| with the fopen-style |mode|. Returns NULL on failure.
+FILE* OpenFile(const std::string& path, const char* mode);
+
+// Reads the whole file at |path| into |contents|.
+bool ReadFileToBuffer(const std::string& path, std::vector<uint8_t>* contents);
+
+// Reads what is left of |file| into |contents|. Useful for files that may be
+// deleted once they were opened.
+bool ReadFileToBuffer(FILE* file, std::vector<uint8_t>* contents);
+
+// Creates or truncates |path| and writes |size| bytes from |data| into it.
+bool WriteBufferToFile(const std::string& path, const uint8_t* data,
+                       size_t size);
+
+// A run of bytes for WriteChunksToFile().
+struct FileChunk {
+  const uint8_t* data;
+  size_t size;
+};
+
+// Writes the |count| |chunks| one after the other to |path|, replacing it.
+// The file is sized up front rather than grown write by write, and the
+// chunks go out in as few large writes as the system takes. They are written
+// under a temporary name that is only renamed to |path| once complete, so
+// |path| is never seen half written.
+bool WriteChunksToFile(const std::string& path, const FileChunk* chunks,
+                       size_t count);
+
+// A file written a piece at a time, at whatever offsets the pieces go to,
+// for output produced as it is written rather than held whole first. Like
+// WriteChunksToFile(), it is written under a temporary name and only
+// replaces its path once committed. Deleted if it never is.
+class PartialFile {
+ public:
+  PartialFile();
+
+  // Deletes the file unless it was committed.
+  ~PartialFile();
+
+  // Creates the file that is to replace |path|, |size| bytes long if that
+  // is known up front, 0 otherwise.
+  bool Open(const std::string& path, uint64_t size);
+
+  // Writes |size| bytes from |data| at |offset|, growing the file as needed.
+  bool WriteAt(uint64_t offset, const uint8_t* data, size_t size);
+
+  // Closes the file and moves it to its path in a single step.
+  bool Commit();
+
+  // Closes and deletes the file.
+  void Discard();
+
+  const std::string& path() const { return path_; }
+
+ private:
+  // Closes the file, returning false if anything failed to reach it.
+  bool Close();
+
+  std::string path_;
+#if defined(_WIN32)
+  // A HANDLE, INVALID_HANDLE_VALUE when closed.
+  void* file_;
+#else
+  // -1 when closed.
+  int file_;
+#endif
+
+  PartialFile(const PartialFile&);
+  void operator=(const PartialFile&);
+};
+
+// Moves the file at |from| to |to|, replacing whatever |to| held, in a single
+// step so |to| is never missing or half written.
+bool RenameFile(const std::string& from, const std::string& to);
+
+// Deletes the file at |path|.
+bool RemoveFile(const std::string& path);
+
+// The directory the system keeps temporary files in, without a trailing
+// separator.
+std::string TemporaryDirectory();
+
+// A file mapped read-only into memory, so it can be decoded without reading
+// it into a buffer first. Pages are read in as they are touched, and the
+// system is told they will be touched in order so it reads well ahead. The
+// file must not be truncated while it is mapped.
+class MappedFile {
+ public:
+  MappedFile();
+
+  // Unmaps the file.
+  ~MappedFile();
+
+  // Maps the whole file at |path|, unmapping whatever was mapped before.
+  // The file itself isn't kept open, it can be deleted or replaced while the
+  // mapping stays valid. Returns false if it can't be mapped or is empty.
+  bool Map(const std::string& path);
+
+  // Gives the address space back. data() is NULL from then on.
+  void Unmap();
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const uint8_t* data_;
+  size_t size_;
+
+  MappedFile(const MappedFile&);
+  void operator=(const MappedFile&);
+};
+
+// Read-write memory backed by a file of its own instead of by swap, for
+// buffers too large to keep in memory. The system writes its pages out to
+// the file and drops them whenever it needs the memory for something else.
+// The file is deleted as soon as nothing maps it anymore, or right away
+// where the system allows it, so none are left behind even after a crash.
+class ScratchMapping {
+ public:
+  ScratchMapping();
+
+  // Unmaps the memory.
+  ~ScratchMapping();
+
+  // Maps |size| bytes of zeros backed by a new file in |directory|,
+  // unmapping whatever was mapped before. Returns false if the file can't be
+  // created or mapped.
+  bool Map(const std::string& directory, size_t size);
+
+  // Gives the memory and the file back. data() is NULL from then on.
+  void Unmap();
+
+  // Exchanges what this and |other| map.
+  void Swap(ScratchMapping* other);
+
+  uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  uint8_t* data_;
+  size_t size_;
+
+  ScratchMapping(const ScratchMapping&);
+  void operator=(const ScratchMapping&);
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_FILE_UTIL_H_
@@ -0,0 +1,108 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "image_decoder.h"
+
+#include <string.h>
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+struct FormatInfo {
+  const char* name;
+  const char* mime_type;
+  const char* extension;
+};
+
+// Indexed by ImageFormat.
+const FormatInfo kFormats[] = {
+  { "unknown", NULL, "" },
+  { "BMP", "image/bmp", ".bmp" },
+  { "JPEG", "image/jpeg", ".jpg" },
+  { "PNG", "image/png", ".png" },
+  { "GIF", "image/gif", ".gif" },
+};
+
+static_assert(sizeof(kFormats) / sizeof(kFormats[0]) == IMAGE_FORMAT_COUNT,
+              "every ImageFormat needs an entry in kFormats");
+
+// Leading bytes of each format. A format may have several.
+struct Signature {
+  ImageFormat format;
+  const char* bytes;
+  size_t size;
+};
+
+const Signature kSignatures[] = {
+  { IMAGE_FORMAT_BMP, "BM", 2 },
+  { IMAGE_FORMAT_JPEG, "\xFF\xD8\xFF", 3 },
+  { IMAGE_FORMAT_PNG, "\x89PNG\r\n\x1A\n", 8 },
+  { IMAGE_FORMAT_GIF, "GIF87a", 6 },
+  { IMAGE_FORMAT_GIF, "GIF89a", 6 },
+};
+
+const FormatInfo& InfoFor(ImageFormat format) {
+  if (format < 0 || format >= IMAGE_FORMAT_COUNT)
+    return kFormats[IMAGE_FORMAT_UNKNOWN];
+  return kFormats[format];
+}
+
+}  // namespace
+
+ImageFormat SniffImageFormat(const uint8_t* data, size_t size) {
+  for (size_t i = 0; i < sizeof(kSignatures) / sizeof(kSignatures[0]); ++i) {
+    const Signature& signature = kSignatures[i];
+    if (size >= signature.size &&
+        memcmp(data, signature.bytes, signature.size) == 0)
+      return signature.format;
+  }
+  return IMAGE_FORMAT_UNKNOWN;
+}
+
+const char* ImageFormatName(ImageFormat format) {
+  return InfoFor(format).name;
+}
+
+const char* ImageFormatMimeType(ImageFormat format) {
+  return InfoFor(format).mime_type;
+}
+
+const char* ImageFormatExtension(ImageFormat format) {
+  return InfoFor(format).extension;
+}
+
+ImageFormat ImageFormatForMimeType(const char* mime_type) {
+  for (int i = IMAGE_FORMAT_UNKNOWN + 1; i < IMAGE_FORMAT_COUNT; ++i) {
+    if (strcmp(kFormats[i].mime_type, mime_type) == 0)
+      return static_cast<ImageFormat>(i);
+  }
+  return IMAGE_FORMAT_UNKNOWN;
+}
+
+bool CopyRowsToSink(const PixelBuffer& image, RowSink* sink) {
+  if (!sink->Begin(image.width(), image.height(), image.format()))
+    return false;
+  size_t bytes = static_cast<size_t>(image.width()) *
+                 PixelBuffer::BytesPerPixel(image.format());
+  for (int y = 0; y < image.height(); ++y) {
+    memcpy(sink->BeginRow(y), image.row(y), bytes);
+    sink->EndRow(y);
+  }
+  return true;
+}
+
+bool ImageDecoder::DecodeRows(const uint8_t* data, size_t size,
+                              RowSink* sink, std::string* error) {
+  PixelBuffer image;
+  if (!Decode(data, size, &image, error))
+    return false;
+  if (!CopyRowsToSink(image, sink)) {
+    *error = "Unable to store the decoded image.";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,137 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_IMAGE_DECODER_H_
+#define ENGINE_IMAGE_DECODER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "pixel_buffer.h"
+
+namespace set_wallpaper_extension {
+
+// Container formats the engine can recognize from their leading bytes.
+enum ImageFormat {
+  IMAGE_FORMAT_UNKNOWN,
+  IMAGE_FORMAT_BMP,
+  IMAGE_FORMAT_JPEG,
+  IMAGE_FORMAT_PNG,
+  IMAGE_FORMAT_GIF,
+  IMAGE_FORMAT_COUNT
+};
+
+// Looks at the magic bytes at the start of |data| to figure out the format of
+// the encoded image.
+ImageFormat SniffImageFormat(const uint8_t* data, size_t size);
+
+// Human readable name of |format|, used for log messages.
+const char* ImageFormatName(ImageFormat format);
+
+// MIME type of |format|, or NULL if it has none.
+const char* ImageFormatMimeType(ImageFormat format);
+
+// File extension, including the dot, for files of |format|. Empty if it has
+// none.
+const char* ImageFormatExtension(ImageFormat format);
+
+// The format with MIME type |mime_type|, or IMAGE_FORMAT_UNKNOWN.
+ImageFormat ImageFormatForMimeType(const char* mime_type);
+
+// Where a decoder puts the rows of an image as it decodes them, top to
+// bottom. The sink hands out the memory each row is decoded into, so rows go
+// straight to wherever the next stage wants them, and that stage can work on
+// a few rows at a time instead of on the whole image.
+class RowSink {
+ public:
+  virtual ~RowSink() {}
+
+  // Called before Begin() by decoders able to decode the image smaller for
+  // less than it costs to decode it whole, like JPEG. Returns how many times
+  // smaller than |width| x |height| the sink wants it: 1, or a power of two
+  // up to |max_reduction|. Begin() then gets the reduced size, rounded up.
+  // The default takes the image whole.
+  virtual int ChooseReduction(int width, int height, int max_reduction) {
+    return 1;
+  }
+
+  // Called once the size of the image is known, before any row. Returns
+  // false if the image can't be taken, which fails the decoder.
+  virtual bool Begin(int width, int height, PixelFormat format) = 0;
+
+  // Memory for row |y|, |width| 32-bit pixels, to decode it into. Rows are
+  // requested in order, each once.
+  virtual uint8_t* BeginRow(int y) = 0;
+
+  // Row |y| is decoded into the memory BeginRow() returned for it.
+  virtual void EndRow(int y) = 0;
+};
+
+// RowSink decoding into a PixelBuffer, for when the whole image is needed.
+class PixelBufferSink : public RowSink {
+ public:
+  explicit PixelBufferSink(PixelBuffer* output) : output_(output) {}
+
+  virtual bool Begin(int width, int height, PixelFormat format) {
+    return output_->Allocate(width, height, format);
+  }
+  virtual uint8_t* BeginRow(int y) { return output_->row(y); }
+  virtual void EndRow(int) {}
+
+ private:
+  PixelBuffer* output_;
+};
+
+// Hands every row of |image| over to |sink|, for decoders that can't help
+// decoding the whole image first. Returns false if |sink| won't take it.
+bool CopyRowsToSink(const PixelBuffer& image, RowSink* sink);
+
+// A decoder that consumes the encoded image piece by piece, as it arrives
+// from the network, so decoding overlaps with the download. Rows go to the
+// RowSink it was created for as soon as they are decoded.
+class IncrementalDecoder {
+ public:
+  virtual ~IncrementalDecoder() {}
+
+  // Consumes the next |size| bytes of the encoded image. On failure, returns
+  // false and describes the problem in |error|.
+  virtual bool Write(const uint8_t* data, size_t size, std::string* error) = 0;
+
+  // Signals the end of the input. Every row has reached the sink once this
+  // returns true.
+  virtual bool Finish(std::string* error) = 0;
+};
+
+// Decode stage of the engine. Turns an encoded image held in memory into
+// 32-bit pixels with straight alpha.
+class ImageDecoder {
+ public:
+  virtual ~ImageDecoder() {}
+
+  // Returns true if this decoder understands images of |format|.
+  virtual bool CanDecode(ImageFormat format) const = 0;
+
+  // Decodes |size| bytes at |data| into |output|. On failure, returns false
+  // and describes the problem in |error|.
+  virtual bool Decode(const uint8_t* data, size_t size,
+                      PixelBuffer* output, std::string* error) = 0;
+
+  // Same as Decode() with the rows going to |sink|. The default decodes the
+  // whole image and copies its rows over, decoders able to hand them over as
+  // they go override it.
+  virtual bool DecodeRows(const uint8_t* data, size_t size, RowSink* sink,
+                          std::string* error);
+
+  // Returns a new IncrementalDecoder for this format feeding |sink|, owned
+  // by the caller, or NULL if the decoder can only work on complete images.
+  virtual IncrementalDecoder* CreateIncrementalDecoder(RowSink* sink) {
+    return NULL;
+  }
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_IMAGE_DECODER_H_
@@ -0,0 +1,67 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_IMAGE_ENCODER_H_
+#define ENGINE_IMAGE_ENCODER_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "image_decoder.h"
+#include "pixel_buffer.h"
+
+namespace set_wallpaper_extension {
+
+// Encodes an image into a file as its rows come, top to bottom, so it never
+// has to be held whole. The file only replaces its path once Finish()
+// succeeds, see PartialFile, and is deleted with the writer otherwise.
+class ImageFileWriter {
+ public:
+  virtual ~ImageFileWriter() {}
+
+  // Starts a |width| x |height| image. On failure, returns false and
+  // describes the problem in |error|, like the other methods.
+  virtual bool Begin(int width, int height, std::string* error) = 0;
+
+  // Encodes the next row, |width| BGR24 pixels padded like the rows of a
+  // PixelBuffer.
+  virtual bool WriteRow(const uint8_t* row, std::string* error) = 0;
+
+  // Completes the file once every row is written.
+  virtual bool Finish(std::string* error) = 0;
+
+  // The container format written.
+  virtual ImageFormat format() const = 0;
+
+  // Number of bytes in the file so far.
+  virtual uint64_t bytes_written() const = 0;
+};
+
+// Encode stage of the engine. Turns a BGR24 PixelBuffer into the bytes of an
+// image file the operating system can use as a desktop background.
+class ImageEncoder {
+ public:
+  virtual ~ImageEncoder() {}
+
+  // The container format this encoder produces.
+  virtual ImageFormat format() const = 0;
+
+  // Encodes |input| into |output|. On failure, returns false and describes
+  // the problem in |error|.
+  virtual bool Encode(const PixelBuffer& input,
+                      std::vector<uint8_t>* output,
+                      std::string* error) = 0;
+
+  // Returns a new ImageFileWriter encoding into the file at |path|, owned by
+  // the caller, or NULL if the encoder can only work on complete images.
+  virtual ImageFileWriter* CreateFileWriter(const std::string& path) {
+    return NULL;
+  }
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_IMAGE_ENCODER_H_
@@ -0,0 +1,361 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "jpeg_decoder.h"
+
+#if defined(HAVE_LIBJPEG)
+
+#include <setjmp.h>
+#include <stdio.h>
+
+#include <vector>
+
+extern "C" {
+#include <jpeglib.h>
+}
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// libjpeg decodes images down to 1/8 of their size, from a single
+// coefficient per 8x8 block.
+const int kMaxReduction = 8;
+
+// libjpeg reports fatal errors by calling error_exit, which must not return.
+// We jump back into the decoder instead of letting it call exit().
+struct JpegErrorManager {
+  jpeg_error_mgr pub;
+  jmp_buf setjmp_buffer;
+  char message[JMSG_LENGTH_MAX];
+};
+
+void JpegErrorExit(j_common_ptr cinfo) {
+  JpegErrorManager* err = reinterpret_cast<JpegErrorManager*>(cinfo->err);
+  (*cinfo->err->format_message)(cinfo, err->message);
+  longjmp(err->setjmp_buffer, 1);
+}
+
+void JpegOutputMessage(j_common_ptr) {
+  // Warnings are not interesting enough to print anywhere.
+}
+
+void InitErrorManager(jpeg_decompress_struct* cinfo, JpegErrorManager* jerr) {
+  cinfo->err = jpeg_std_error(&jerr->pub);
+  jerr->pub.error_exit = &JpegErrorExit;
+  jerr->pub.output_message = &JpegOutputMessage;
+  jerr->message[0] = 0;
+}
+
+// Picks the output color space once the header has been read. Returns true
+// if the image is CMYK, which libjpeg can't convert to RGB itself. Those
+// (rare, mostly print oriented) files are decoded as CMYK and converted row
+// by row in FinishRow().
+bool SetOutputColorSpace(jpeg_decompress_struct* cinfo) {
+  bool cmyk = cinfo->jpeg_color_space == JCS_CMYK ||
+              cinfo->jpeg_color_space == JCS_YCCK;
+  if (cmyk) {
+    cinfo->out_color_space = JCS_CMYK;
+  } else {
+#if defined(JCS_EXTENSIONS)
+    // libjpeg-turbo can write RGBA directly, which saves a pass over the rows.
+    cinfo->out_color_space = JCS_EXT_RGBA;
+#else
+    cinfo->out_color_space = JCS_RGB;
+#endif
+  }
+  return cmyk;
+}
+
+// Has libjpeg decode the image at the reduction |sink| chooses. At 1/2, 1/4
+// or 1/8 it only runs the inverse DCT on the coefficients that size needs,
+// which cuts the decode work along with the memory.
+void SetOutputScale(jpeg_decompress_struct* cinfo, RowSink* sink) {
+  int reduction = sink->ChooseReduction(cinfo->image_width,
+                                        cinfo->image_height, kMaxReduction);
+  cinfo->scale_num = 1;
+  cinfo->scale_denom = 1;
+  while (cinfo->scale_denom < static_cast<unsigned int>(reduction) &&
+         cinfo->scale_denom < static_cast<unsigned int>(kMaxReduction)) {
+    cinfo->scale_denom *= 2;
+  }
+}
+
+// Turns a freshly decoded scanline into RGBA32 in place.
+void FinishRow(JSAMPROW row, int width, bool cmyk) {
+  if (cmyk) {
+    // Adobe writes inverted CMYK, so each channel times K is the RGB value.
+    for (int x = 0; x < width; ++x) {
+      uint8_t* p = row + x * 4;
+      int k = p[3];
+      p[0] = static_cast<uint8_t>(p[0] * k / 255);
+      p[1] = static_cast<uint8_t>(p[1] * k / 255);
+      p[2] = static_cast<uint8_t>(p[2] * k / 255);
+      p[3] = 0xFF;
+    }
+    return;
+  }
+#if !defined(JCS_EXTENSIONS)
+  // Expand RGB to RGBA in place, back to front.
+  for (int x = width - 1; x >= 0; --x) {
+    row[x * 4 + 3] = 0xFF;
+    row[x * 4 + 2] = row[x * 3 + 2];
+    row[x * 4 + 1] = row[x * 3 + 1];
+    row[x * 4] = row[x * 3];
+  }
+#endif
+}
+
+// Drives libjpeg with a suspending data source: whenever it runs out of
+// buffered input it returns to the caller, and picks up where it left off
+// the next time Write() hands it more bytes.
+class JpegIncrementalDecoder : public IncrementalDecoder {
+ public:
+  explicit JpegIncrementalDecoder(RowSink* sink);
+  virtual ~JpegIncrementalDecoder();
+
+  virtual bool Write(const uint8_t* data, size_t size, std::string* error);
+  virtual bool Finish(std::string* error);
+
+ private:
+  enum State {
+    STATE_HEADER,
+    STATE_START,
+    STATE_SCANLINES,
+    STATE_FINISH,
+    STATE_DONE,
+    STATE_ERROR
+  };
+
+  // Advances libjpeg as far as the buffered input allows.
+  bool Pump(std::string* error);
+
+  // jpeg_source_mgr callbacks.
+  static void InitSource(j_decompress_ptr cinfo);
+  static boolean FillInputBuffer(j_decompress_ptr cinfo);
+  static void SkipInputData(j_decompress_ptr cinfo, long num_bytes);
+  static void TermSource(j_decompress_ptr cinfo);
+
+  jpeg_decompress_struct cinfo_;
+  JpegErrorManager jerr_;
+  jpeg_source_mgr source_;
+
+  // Input libjpeg has not consumed yet, starting at the first unread byte.
+  std::vector<uint8_t> buffer_;
+  // Bytes libjpeg asked to skip that haven't arrived yet.
+  size_t pending_skip_;
+  bool end_of_input_;
+  bool cmyk_;
+  State state_;
+  RowSink* sink_;
+  // The row libjpeg is decoding into, kept while it waits for more input.
+  JSAMPROW row_;
+};
+
+JpegIncrementalDecoder::JpegIncrementalDecoder(RowSink* sink)
+    : pending_skip_(0),
+      end_of_input_(false),
+      cmyk_(false),
+      state_(STATE_HEADER),
+      sink_(sink),
+      row_(NULL) {
+  InitErrorManager(&cinfo_, &jerr_);
+  jpeg_create_decompress(&cinfo_);
+  cinfo_.client_data = this;
+
+  source_.next_input_byte = NULL;
+  source_.bytes_in_buffer = 0;
+  source_.init_source = &InitSource;
+  source_.fill_input_buffer = &FillInputBuffer;
+  source_.skip_input_data = &SkipInputData;
+  source_.resync_to_restart = &jpeg_resync_to_restart;
+  source_.term_source = &TermSource;
+  cinfo_.src = &source_;
+}
+
+JpegIncrementalDecoder::~JpegIncrementalDecoder() {
+  jpeg_destroy_decompress(&cinfo_);
+}
+
+bool JpegIncrementalDecoder::Write(const uint8_t* data, size_t size,
+                                   std::string* error) {
+  if (state_ == STATE_ERROR) {
+    *error = "JPEG decoder already failed.";
+    return false;
+  }
+
+  size_t skip = pending_skip_ < size ? pending_skip_ : size;
+  pending_skip_ -= skip;
+  data += skip;
+  size -= skip;
+
+  // Drop what libjpeg consumed and append the new bytes. libjpeg allows the
+  // unread data to move around between calls as long as the source manager
+  // is updated to match.
+  size_t consumed = buffer_.size() - source_.bytes_in_buffer;
+  buffer_.erase(buffer_.begin(), buffer_.begin() + consumed);
+  buffer_.insert(buffer_.end(), data, data + size);
+  source_.next_input_byte = buffer_.empty() ? NULL : &buffer_[0];
+  source_.bytes_in_buffer = buffer_.size();
+
+  return Pump(error);
+}
+
+bool JpegIncrementalDecoder::Finish(std::string* error) {
+  end_of_input_ = true;
+  if (!Pump(error))
+    return false;
+  if (state_ != STATE_DONE) {
+    *error = "Truncated JPEG image.";
+    return false;
+  }
+  return true;
+}
+
+bool JpegIncrementalDecoder::Pump(std::string* error) {
+  if (setjmp(jerr_.setjmp_buffer)) {
+    state_ = STATE_ERROR;
+    *error = std::string("JPEG decode failed: ") + jerr_.message;
+    return false;
+  }
+
+  if (state_ == STATE_HEADER) {
+    if (jpeg_read_header(&cinfo_, TRUE) == JPEG_SUSPENDED)
+      return true;
+    cmyk_ = SetOutputColorSpace(&cinfo_);
+    SetOutputScale(&cinfo_, sink_);
+    state_ = STATE_START;
+  }
+
+  if (state_ == STATE_START) {
+    if (!jpeg_start_decompress(&cinfo_))
+      return true;
+    if (!sink_->Begin(cinfo_.output_width, cinfo_.output_height,
+                      PIXEL_FORMAT_RGBA32)) {
+      state_ = STATE_ERROR;
+      *error = "Invalid JPEG dimensions.";
+      return false;
+    }
+    state_ = STATE_SCANLINES;
+  }
+
+  if (state_ == STATE_SCANLINES) {
+    while (cinfo_.output_scanline < cinfo_.output_height) {
+      int y = cinfo_.output_scanline;
+      if (NULL == row_)
+        row_ = sink_->BeginRow(y);
+      if (jpeg_read_scanlines(&cinfo_, &row_, 1) != 1)
+        return true;
+      FinishRow(row_, cinfo_.output_width, cmyk_);
+      sink_->EndRow(y);
+      row_ = NULL;
+    }
+    state_ = STATE_FINISH;
+  }
+
+  if (state_ == STATE_FINISH) {
+    if (!jpeg_finish_decompress(&cinfo_))
+      return true;
+    state_ = STATE_DONE;
+  }
+  return true;
+}
+
+void JpegIncrementalDecoder::InitSource(j_decompress_ptr) {
+}
+
+boolean JpegIncrementalDecoder::FillInputBuffer(j_decompress_ptr cinfo) {
+  JpegIncrementalDecoder* decoder =
+      static_cast<JpegIncrementalDecoder*>(cinfo->client_data);
+  if (!decoder->end_of_input_)
+    return FALSE;  // Suspend until Write() brings more data.
+
+  // The stream ended early. Hand libjpeg a fake EOI marker so it finishes
+  // the image (with gray rows) instead of failing, like browsers do.
+  static const JOCTET kEndOfImage[] = { 0xFF, JPEG_EOI };
+  decoder->source_.next_input_byte = kEndOfImage;
+  decoder->source_.bytes_in_buffer = sizeof(kEndOfImage);
+  return TRUE;
+}
+
+void JpegIncrementalDecoder::SkipInputData(j_decompress_ptr cinfo,
+                                           long num_bytes) {
+  if (num_bytes <= 0)
+    return;
+  JpegIncrementalDecoder* decoder =
+      static_cast<JpegIncrementalDecoder*>(cinfo->client_data);
+  jpeg_source_mgr* source = &decoder->source_;
+  size_t skip = static_cast<size_t>(num_bytes);
+  if (skip <= source->bytes_in_buffer) {
+    source->next_input_byte += skip;
+    source->bytes_in_buffer -= skip;
+  } else {
+    decoder->pending_skip_ += skip - source->bytes_in_buffer;
+    source->next_input_byte += source->bytes_in_buffer;
+    source->bytes_in_buffer = 0;
+  }
+}
+
+void JpegIncrementalDecoder::TermSource(j_decompress_ptr) {
+}
+
+}  // namespace
+
+bool JpegDecoder::CanDecode(ImageFormat format) const {
+  return format == IMAGE_FORMAT_JPEG;
+}
+
+bool JpegDecoder::Decode(const uint8_t* data, size_t size,
+                         PixelBuffer* output, std::string* error) {
+  PixelBufferSink sink(output);
+  return DecodeRows(data, size, &sink, error);
+}
+
+bool JpegDecoder::DecodeRows(const uint8_t* data, size_t size, RowSink* sink,
+                             std::string* error) {
+  jpeg_decompress_struct cinfo;
+  JpegErrorManager jerr;
+
+  InitErrorManager(&cinfo, &jerr);
+  if (setjmp(jerr.setjmp_buffer)) {
+    *error = std::string("JPEG decode failed: ") + jerr.message;
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo, const_cast<unsigned char*>(data),
+               static_cast<unsigned long>(size));
+  jpeg_read_header(&cinfo, TRUE);
+  bool cmyk = SetOutputColorSpace(&cinfo);
+  SetOutputScale(&cinfo, sink);
+  jpeg_start_decompress(&cinfo);
+
+  if (!sink->Begin(cinfo.output_width, cinfo.output_height,
+                   PIXEL_FORMAT_RGBA32)) {
+    *error = "Invalid JPEG dimensions.";
+    jpeg_destroy_decompress(&cinfo);
+    return false;
+  }
+
+  while (cinfo.output_scanline < cinfo.output_height) {
+    int y = cinfo.output_scanline;
+    JSAMPROW row = sink->BeginRow(y);
+    jpeg_read_scanlines(&cinfo, &row, 1);
+    FinishRow(row, cinfo.output_width, cmyk);
+    sink->EndRow(y);
+  }
+
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  return true;
+}
+
+IncrementalDecoder* JpegDecoder::CreateIncrementalDecoder(RowSink* sink) {
+  return new JpegIncrementalDecoder(sink);
+}
+
+}  // namespace set_wallpaper_extension
+
+#endif  // defined(HAVE_LIBJPEG)
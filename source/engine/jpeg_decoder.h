@@ -0,0 +1,26 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_JPEG_DECODER_H_
+#define ENGINE_JPEG_DECODER_H_
+
+#include "image_decoder.h"
+
+namespace set_wallpaper_extension {
+
+// JPEG decoder backed by libjpeg. Only compiled in when the build found the
+// library (HAVE_LIBJPEG), otherwise the platform decoder handles JPEG.
+class JpegDecoder : public ImageDecoder {
+ public:
+  virtual bool CanDecode(ImageFormat format) const;
+  virtual bool Decode(const uint8_t* data, size_t size,
+                      PixelBuffer* output, std::string* error);
+  virtual bool DecodeRows(const uint8_t* data, size_t size, RowSink* sink,
+                          std::string* error);
+  virtual IncrementalDecoder* CreateIncrementalDecoder(RowSink* sink);
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_JPEG_DECODER_H_
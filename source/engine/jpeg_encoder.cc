@@ -0,0 +1,260 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "jpeg_encoder.h"
+
+#if defined(HAVE_LIBJPEG)
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+extern "C" {
+#include <jpeglib.h>
+#include <jerror.h>
+}
+
+#include "file_util.h"
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+struct JpegErrorManager {
+  jpeg_error_mgr pub;
+  jmp_buf setjmp_buffer;
+  char message[JMSG_LENGTH_MAX];
+};
+
+void JpegErrorExit(j_common_ptr cinfo) {
+  JpegErrorManager* err = reinterpret_cast<JpegErrorManager*>(cinfo->err);
+  (*cinfo->err->format_message)(cinfo, err->message);
+  longjmp(err->setjmp_buffer, 1);
+}
+
+// Bytes compressed before they are handed to the file.
+const size_t kDestinationBytes = 64 * 1024;
+
+// libjpeg destination writing the compressed bytes to a PartialFile a buffer
+// at a time.
+struct FileDestination {
+  jpeg_destination_mgr pub;
+  PartialFile* file;
+  uint64_t offset;
+  JOCTET buffer[kDestinationBytes];
+};
+
+// Writes the first |size| bytes of the buffer of |cinfo| out.
+void FlushDestination(j_compress_ptr cinfo, size_t size) {
+  FileDestination* dest = reinterpret_cast<FileDestination*>(cinfo->dest);
+  if (!dest->file->WriteAt(dest->offset, dest->buffer, size))
+    ERREXIT(cinfo, JERR_FILE_WRITE);
+  dest->offset += size;
+  dest->pub.next_output_byte = dest->buffer;
+  dest->pub.free_in_buffer = kDestinationBytes;
+}
+
+void InitDestination(j_compress_ptr cinfo) {
+  FileDestination* dest = reinterpret_cast<FileDestination*>(cinfo->dest);
+  dest->pub.next_output_byte = dest->buffer;
+  dest->pub.free_in_buffer = kDestinationBytes;
+}
+
+boolean EmptyOutputBuffer(j_compress_ptr cinfo) {
+  FlushDestination(cinfo, kDestinationBytes);
+  return TRUE;
+}
+
+void TermDestination(j_compress_ptr cinfo) {
+  FlushDestination(cinfo, kDestinationBytes - cinfo->dest->free_in_buffer);
+}
+
+// Compresses rows as they come and writes the JPEG out as it fills up.
+class JpegFileWriter : public ImageFileWriter {
+ public:
+  JpegFileWriter(const std::string& path, int quality)
+      : path_(path),
+        quality_(quality),
+        created_(false),
+        failed_(false) {
+    dest_.file = &file_;
+    dest_.offset = 0;
+  }
+
+  virtual ~JpegFileWriter() {
+    if (created_)
+      jpeg_destroy_compress(&cinfo_);
+  }
+
+  virtual bool Begin(int width, int height, std::string* error) {
+    if (!file_.Open(path_, 0)) {
+      *error = "Unable to write " + path_;
+      return false;
+    }
+    cinfo_.err = jpeg_std_error(&jerr_.pub);
+    jerr_.pub.error_exit = &JpegErrorExit;
+    if (setjmp(jerr_.setjmp_buffer))
+      return Fail(error);
+
+    jpeg_create_compress(&cinfo_);
+    created_ = true;
+    dest_.pub.init_destination = &InitDestination;
+    dest_.pub.empty_output_buffer = &EmptyOutputBuffer;
+    dest_.pub.term_destination = &TermDestination;
+    cinfo_.dest = &dest_.pub;
+
+    cinfo_.image_width = width;
+    cinfo_.image_height = height;
+    cinfo_.input_components = 3;
+#if defined(JCS_EXTENSIONS)
+    cinfo_.in_color_space = JCS_EXT_BGR;
+#else
+    cinfo_.in_color_space = JCS_RGB;
+    rgb_row_.resize(width * 3);
+#endif
+    jpeg_set_defaults(&cinfo_);
+    jpeg_set_quality(&cinfo_, quality_, TRUE);
+    jpeg_start_compress(&cinfo_, TRUE);
+    return true;
+  }
+
+  virtual bool WriteRow(const uint8_t* row, std::string* error) {
+    if (failed_ || !created_) {
+      *error = "Unable to write " + path_;
+      return false;
+    }
+    if (setjmp(jerr_.setjmp_buffer))
+      return Fail(error);
+    JSAMPROW scanline = const_cast<JSAMPROW>(row);
+#if !defined(JCS_EXTENSIONS)
+    // Same as in JpegEncoder::Encode().
+    uint8_t* rgb = &rgb_row_[0];
+    for (size_t x = 0; x < rgb_row_.size(); x += 3) {
+      rgb[x] = row[x + 2];
+      rgb[x + 1] = row[x + 1];
+      rgb[x + 2] = row[x];
+    }
+    scanline = rgb;
+#endif
+    jpeg_write_scanlines(&cinfo_, &scanline, 1);
+    return true;
+  }
+
+  virtual bool Finish(std::string* error) {
+    if (failed_ || !created_ ||
+        cinfo_.next_scanline != cinfo_.image_height) {
+      *error = "Unable to write " + path_;
+      return false;
+    }
+    if (setjmp(jerr_.setjmp_buffer))
+      return Fail(error);
+    jpeg_finish_compress(&cinfo_);
+    if (!file_.Commit()) {
+      *error = "Unable to write " + path_;
+      return false;
+    }
+    return true;
+  }
+
+  virtual ImageFormat format() const { return IMAGE_FORMAT_JPEG; }
+  virtual uint64_t bytes_written() const { return dest_.offset; }
+
+ private:
+  // Where libjpeg jumps back to when it fails.
+  bool Fail(std::string* error) {
+    failed_ = true;
+    *error = std::string("JPEG encode failed: ") + jerr_.message;
+    file_.Discard();
+    return false;
+  }
+
+  std::string path_;
+  int quality_;
+  PartialFile file_;
+  jpeg_compress_struct cinfo_;
+  JpegErrorManager jerr_;
+  FileDestination dest_;
+  bool created_;
+  bool failed_;
+  std::vector<uint8_t> rgb_row_;
+
+  JpegFileWriter(const JpegFileWriter&);
+  void operator=(const JpegFileWriter&);
+};
+
+}  // namespace
+
+JpegEncoder::JpegEncoder(int quality)
+    : quality_(quality) {
+}
+
+bool JpegEncoder::Encode(const PixelBuffer& input,
+                         std::vector<uint8_t>* output,
+                         std::string* error) {
+  if (input.format() != PIXEL_FORMAT_BGR24) {
+    *error = "JPEG encoder expects BGR24 pixels.";
+    return false;
+  }
+
+  jpeg_compress_struct cinfo;
+  JpegErrorManager jerr;
+  // The destination manager grows |memory| as needed, the caller frees it.
+  unsigned char* memory = NULL;
+  unsigned long memory_size = 0;
+  std::vector<uint8_t> rgb_row;
+
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = &JpegErrorExit;
+  if (setjmp(jerr.setjmp_buffer)) {
+    *error = std::string("JPEG encode failed: ") + jerr.message;
+    jpeg_destroy_compress(&cinfo);
+    free(memory);
+    return false;
+  }
+
+  jpeg_create_compress(&cinfo);
+  jpeg_mem_dest(&cinfo, &memory, &memory_size);
+
+  cinfo.image_width = input.width();
+  cinfo.image_height = input.height();
+  cinfo.input_components = 3;
+#if defined(JCS_EXTENSIONS)
+  cinfo.in_color_space = JCS_EXT_BGR;
+#else
+  cinfo.in_color_space = JCS_RGB;
+  rgb_row.resize(input.width() * 3);
+#endif
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, quality_, TRUE);
+  jpeg_start_compress(&cinfo, TRUE);
+
+  while (cinfo.next_scanline < cinfo.image_height) {
+    JSAMPROW row = const_cast<JSAMPROW>(input.row(cinfo.next_scanline));
+#if !defined(JCS_EXTENSIONS)
+    // Plain libjpeg only takes RGB, swap the channels into a scratch row.
+    uint8_t* rgb = &rgb_row[0];
+    for (int x = 0; x < input.width(); ++x) {
+      rgb[x * 3] = row[x * 3 + 2];
+      rgb[x * 3 + 1] = row[x * 3 + 1];
+      rgb[x * 3 + 2] = row[x * 3];
+    }
+    row = rgb;
+#endif
+    jpeg_write_scanlines(&cinfo, &row, 1);
+  }
+
+  jpeg_finish_compress(&cinfo);
+  output->assign(memory, memory + memory_size);
+  jpeg_destroy_compress(&cinfo);
+  free(memory);
+  return true;
+}
+
+ImageFileWriter* JpegEncoder::CreateFileWriter(const std::string& path) {
+  return new JpegFileWriter(path, quality_);
+}
+
+}  // namespace set_wallpaper_extension
+
+#endif  // defined(HAVE_LIBJPEG)
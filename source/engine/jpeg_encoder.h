@@ -0,0 +1,32 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_JPEG_ENCODER_H_
+#define ENGINE_JPEG_ENCODER_H_
+
+#include "image_encoder.h"
+
+namespace set_wallpaper_extension {
+
+// JPEG encoder backed by libjpeg. Only compiled in when the build found the
+// library (HAVE_LIBJPEG), otherwise the platform encoder, if any, is used.
+class JpegEncoder : public ImageEncoder {
+ public:
+  // |quality| ranges from 0 to 100. Wallpapers are looked at full screen,
+  // so the default is on the high side.
+  explicit JpegEncoder(int quality = 95);
+
+  virtual ImageFormat format() const { return IMAGE_FORMAT_JPEG; }
+  virtual bool Encode(const PixelBuffer& input,
+                      std::vector<uint8_t>* output,
+                      std::string* error);
+  virtual ImageFileWriter* CreateFileWriter(const std::string& path);
+
+ private:
+  int quality_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_JPEG_ENCODER_H_
@@ -0,0 +1,92 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "output_format_selector.h"
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// Weight of a new sample in the moving averages.
+const double kSmoothing = 0.25;
+
+// One selection out of this many re-measures the stalest candidate.
+const int64_t kExplorePeriod = 32;
+
+}  // namespace
+
+OutputFormatSelector::OutputFormatSelector()
+    : selections_(0) {
+}
+
+ImageFormat OutputFormatSelector::Select(
+    const std::vector<ImageFormat>& candidates) {
+  std::lock_guard<std::mutex> hold(lock_);
+  ++selections_;
+
+  // Anything we know nothing about gets tried first.
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    if (EstimatedCostLocked(candidates[i]) < 0)
+      return candidates[i];
+  }
+
+  if (candidates.size() > 1 && selections_ % kExplorePeriod == 0) {
+    ImageFormat stalest = candidates[0];
+    for (size_t i = 1; i < candidates.size(); ++i) {
+      if (estimates_[candidates[i]].last_sample <
+          estimates_[stalest].last_sample) {
+        stalest = candidates[i];
+      }
+    }
+    return stalest;
+  }
+
+  ImageFormat best = candidates[0];
+  for (size_t i = 1; i < candidates.size(); ++i) {
+    if (EstimatedCostLocked(candidates[i]) < EstimatedCostLocked(best))
+      best = candidates[i];
+  }
+  return best;
+}
+
+void OutputFormatSelector::RecordConversion(ImageFormat format, int64_t pixels,
+                                            int64_t nanoseconds) {
+  std::lock_guard<std::mutex> hold(lock_);
+  Estimate& estimate = estimates_[format];
+  Update(&estimate.conversion, pixels, nanoseconds);
+  estimate.last_sample = selections_;
+}
+
+void OutputFormatSelector::RecordApply(ImageFormat format, int64_t pixels,
+                                       int64_t nanoseconds) {
+  std::lock_guard<std::mutex> hold(lock_);
+  Update(&estimates_[format].apply, pixels, nanoseconds);
+}
+
+double OutputFormatSelector::EstimatedCost(ImageFormat format) const {
+  std::lock_guard<std::mutex> hold(lock_);
+  return EstimatedCostLocked(format);
+}
+
+double OutputFormatSelector::EstimatedCostLocked(ImageFormat format) const {
+  std::map<ImageFormat, Estimate>::const_iterator it = estimates_.find(format);
+  if (it == estimates_.end() || it->second.conversion < 0)
+    return -1.0;
+  // Platforms that don't report apply times simply compare conversion costs.
+  double apply = it->second.apply < 0 ? 0.0 : it->second.apply;
+  return it->second.conversion + apply;
+}
+
+void OutputFormatSelector::Update(double* average, int64_t pixels,
+                                  int64_t nanoseconds) {
+  if (pixels <= 0)
+    return;
+  double sample = static_cast<double>(nanoseconds) / pixels;
+  if (*average < 0)
+    *average = sample;
+  else
+    *average += kSmoothing * (sample - *average);
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,69 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_OUTPUT_FORMAT_SELECTOR_H_
+#define ENGINE_OUTPUT_FORMAT_SELECTOR_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "image_decoder.h"
+
+namespace set_wallpaper_extension {
+
+// Picks the output format with the lowest measured cost. The cost of a format
+// is what it takes to encode and write a wallpaper in it, plus what the
+// desktop needs to apply it, normalized per pixel. Formats that haven't been
+// measured yet are tried first, and every so often the format measured the
+// longest time ago is retried so the estimates follow changes in the machine
+// (disk cache, AV scanners, ...).
+//
+// Conversions running on different threads share one selector, so every
+// method may be called concurrently.
+class OutputFormatSelector {
+ public:
+  OutputFormatSelector();
+
+  // Returns the cheapest of |candidates|, which must not be empty.
+  ImageFormat Select(const std::vector<ImageFormat>& candidates);
+
+  // Records that encoding and writing |pixels| pixels as |format| took
+  // |nanoseconds|.
+  void RecordConversion(ImageFormat format, int64_t pixels,
+                        int64_t nanoseconds);
+
+  // Records that the desktop took |nanoseconds| to apply a |pixels| pixel
+  // wallpaper stored as |format|.
+  void RecordApply(ImageFormat format, int64_t pixels, int64_t nanoseconds);
+
+  // Current cost estimate for |format| in nanoseconds per pixel, or a
+  // negative value if it hasn't been measured.
+  double EstimatedCost(ImageFormat format) const;
+
+ private:
+  struct Estimate {
+    Estimate() : conversion(-1.0), apply(-1.0), last_sample(0) {}
+    // Exponential moving averages in nanoseconds per pixel.
+    double conversion;
+    double apply;
+    // Value of selections_ when this format was last measured.
+    int64_t last_sample;
+  };
+
+  // EstimatedCost() with |lock_| held.
+  double EstimatedCostLocked(ImageFormat format) const;
+
+  static void Update(double* average, int64_t pixels, int64_t nanoseconds);
+
+  mutable std::mutex lock_;
+  std::map<ImageFormat, Estimate> estimates_;
+  int64_t selections_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_OUTPUT_FORMAT_SELECTOR_H_
@@ -0,0 +1,96 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "parallel_for.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "worker_pool.h"
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// More chunks than threads so a thread that got a slower chunk, or was
+// descheduled, doesn't hold everybody else up.
+const int kChunksPerThread = 4;
+
+// A ParallelFor() call, shared with the workers it asked for help. A worker
+// may only get to it after the call returned, so it is reference counted,
+// and |function| is only used while a chunk is claimed.
+struct ParallelForState {
+  std::atomic<int> next;
+  int end;
+  int chunk_size;
+  const std::function<void(int first, int last)>* function;
+
+  std::mutex lock;
+  std::condition_variable done;
+  int chunks_left;
+};
+
+// Runs the chunks of |state| nobody claimed yet.
+void RunChunks(ParallelForState* state) {
+  for (;;) {
+    int first = state->next.fetch_add(state->chunk_size);
+    if (first >= state->end)
+      return;
+    (*state->function)(first, std::min(first + state->chunk_size, state->end));
+
+    std::lock_guard<std::mutex> hold(state->lock);
+    if (0 == --state->chunks_left)
+      state->done.notify_all();
+  }
+}
+
+}  // namespace
+
+int DefaultThreadCount() {
+  int cores = static_cast<int>(std::thread::hardware_concurrency());
+  return std::max(cores, 1);
+}
+
+void ParallelFor(int begin, int end, int grain, int threads, WorkerPool* pool,
+                 const std::function<void(int first, int last)>& function) {
+  int count = end - begin;
+  if (count <= 0)
+    return;
+  grain = std::max(grain, 1);
+  if (threads <= 0)
+    threads = DefaultThreadCount();
+
+  int max_chunks = (count + grain - 1) / grain;
+  threads = std::min(threads, max_chunks);
+  // More helpers than the pool has workers would only queue up.
+  if (pool)
+    threads = std::min(threads, pool->thread_count() + 1);
+  if (NULL == pool || threads <= 1) {
+    function(begin, end);
+    return;
+  }
+
+  int chunks = std::min(max_chunks, threads * kChunksPerThread);
+  int chunk_size = (count + chunks - 1) / chunks;
+  std::shared_ptr<ParallelForState> state(new ParallelForState());
+  state->next = begin;
+  state->end = end;
+  state->chunk_size = chunk_size;
+  state->function = &function;
+  state->chunks_left = (count + chunk_size - 1) / chunk_size;
+
+  for (int i = 1; i < threads; ++i)
+    pool->Post([state]() { RunChunks(state.get()); });
+  RunChunks(state.get());
+
+  // The chunks other threads claimed may still be running.
+  std::unique_lock<std::mutex> hold(state->lock);
+  state->done.wait(hold, [&state]() { return 0 == state->chunks_left; });
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,31 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_PARALLEL_FOR_H_
+#define ENGINE_PARALLEL_FOR_H_
+
+#include <functional>
+
+namespace set_wallpaper_extension {
+
+class WorkerPool;
+
+// Number of threads worth using on this machine, at least 1.
+int DefaultThreadCount();
+
+// Calls |function| on consecutive [first, last) chunks covering [begin, end),
+// each at least |grain| items long except maybe the last one. Chunks are
+// handed out to up to |threads| threads, 0 meaning DefaultThreadCount(), as
+// they become idle: the calling thread and workers of |pool|, which may be
+// NULL to do everything on the calling thread. No thread is started, so
+// however many calls run at once, the pool bounds how many threads they
+// share. The call returns once every chunk is done, without waiting for
+// workers that didn't get to one. |function| must be safe to run
+// concurrently on different chunks.
+void ParallelFor(int begin, int end, int grain, int threads, WorkerPool* pool,
+                 const std::function<void(int first, int last)>& function);
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_PARALLEL_FOR_H_
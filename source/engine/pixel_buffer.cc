@@ -0,0 +1,144 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "pixel_buffer.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+
+#include "stats.h"
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// Refuse anything bigger than this on either side. Besides protecting us from
+// corrupt headers, it keeps every stride inside an int.
+const int kMaxDimension = 1 << 16;
+
+// Bytes the buffers hold in memory, which is what the budget caps, and the
+// budget itself, 0 if there is none.
+std::atomic<uint64_t> g_memory_bytes(0);
+std::atomic<uint64_t> g_memory_budget(0);
+
+std::mutex g_scratch_lock;
+// Empty for TemporaryDirectory(). Guarded by |g_scratch_lock|.
+std::string g_scratch_directory;
+
+std::string ScratchDirectory() {
+  std::lock_guard<std::mutex> guard(g_scratch_lock);
+  return g_scratch_directory.empty() ? TemporaryDirectory()
+                                     : g_scratch_directory;
+}
+
+}  // namespace
+
+PixelBuffer::PixelBuffer()
+    : width_(0),
+      height_(0),
+      stride_(0),
+      format_(PIXEL_FORMAT_RGBA32),
+      data_(NULL),
+      size_(0) {
+}
+
+PixelBuffer::~PixelBuffer() {
+  Clear();
+}
+
+bool PixelBuffer::Allocate(int width, int height, PixelFormat format) {
+  if (width <= 0 || height <= 0 ||
+      width > kMaxDimension || height > kMaxDimension) {
+    return false;
+  }
+
+  uint64_t bytes = static_cast<uint64_t>(StrideFor(width, format)) * height;
+  if (bytes > static_cast<uint64_t>(static_cast<size_t>(-1)))
+    return false;
+
+  Clear();
+  size_t size = static_cast<size_t>(bytes);
+  uint64_t budget = g_memory_budget.load(std::memory_order_relaxed);
+  uint64_t in_memory =
+      g_memory_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+  // Every pixel gets written by whoever allocated the buffer, so the memory
+  // isn't cleared first. Without memory for it, the scratch file may still
+  // have room.
+  if (0 == budget || in_memory <= budget)
+    memory_.reset(new(std::nothrow) uint8_t[size]);
+  if (memory_) {
+    data_ = memory_.get();
+    Stats::AddBufferBytes(static_cast<int64_t>(size));
+  } else {
+    g_memory_bytes.fetch_sub(size, std::memory_order_relaxed);
+    if (!scratch_.Map(ScratchDirectory(), size))
+      return false;
+    data_ = scratch_.data();
+  }
+
+  width_ = width;
+  height_ = height;
+  format_ = format;
+  stride_ = StrideFor(width, format);
+  size_ = size;
+
+  // The padding at the end of rows is never written but goes to disk with
+  // BGR24 rows, so it is cleared. Scratch files start out zeroed.
+  int row_bytes = width * BytesPerPixel(format);
+  if (memory_ && stride_ > row_bytes) {
+    for (int y = 0; y < height; ++y)
+      memset(row(y) + row_bytes, 0, stride_ - row_bytes);
+  }
+  return true;
+}
+
+void PixelBuffer::Clear() {
+  if (memory_) {
+    g_memory_bytes.fetch_sub(size_, std::memory_order_relaxed);
+    Stats::AddBufferBytes(-static_cast<int64_t>(size_));
+    memory_.reset();
+  }
+  scratch_.Unmap();
+  data_ = NULL;
+  size_ = 0;
+  width_ = height_ = stride_ = 0;
+}
+
+void PixelBuffer::Swap(PixelBuffer* other) {
+  std::swap(width_, other->width_);
+  std::swap(height_, other->height_);
+  std::swap(stride_, other->stride_);
+  std::swap(format_, other->format_);
+  std::swap(data_, other->data_);
+  std::swap(size_, other->size_);
+  memory_.swap(other->memory_);
+  scratch_.Swap(&other->scratch_);
+}
+
+int PixelBuffer::BytesPerPixel(PixelFormat format) {
+  return format == PIXEL_FORMAT_BGR24 ? 3 : 4;
+}
+
+int PixelBuffer::StrideFor(int width, PixelFormat format) {
+  return (width * BytesPerPixel(format) + 3) & ~3;
+}
+
+void PixelBuffer::SetMemoryBudget(size_t bytes) {
+  g_memory_budget.store(bytes, std::memory_order_relaxed);
+}
+
+size_t PixelBuffer::memory_budget() {
+  return static_cast<size_t>(g_memory_budget.load(std::memory_order_relaxed));
+}
+
+void PixelBuffer::SetScratchDirectory(const std::string& directory) {
+  std::lock_guard<std::mutex> guard(g_scratch_lock);
+  g_scratch_directory = directory;
+}
+
+}  // namespace set_wallpaper_extension
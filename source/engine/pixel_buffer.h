@@ -0,0 +1,105 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_PIXEL_BUFFER_H_
+#define ENGINE_PIXEL_BUFFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "file_util.h"
+
+namespace set_wallpaper_extension {
+
+// Memory layouts understood by the engine stages. Decoders produce one of the
+// 32-bit formats (straight, non-premultiplied alpha), the pixel converter
+// turns those into BGR24 which is what the encoders consume.
+enum PixelFormat {
+  PIXEL_FORMAT_RGBA32,
+  PIXEL_FORMAT_BGRA32,
+  PIXEL_FORMAT_BGR24
+};
+
+// A top-down block of pixels. Rows are padded to a multiple of four bytes so
+// that BGR24 rows have the same layout as a DIB scanline and can be written
+// to disk without another copy. The bytes every buffer holds in memory are
+// added up in Stats.
+//
+// Buffers stay within a memory budget shared by the whole process: once the
+// buffers in memory hold as much as it allows, new ones go to a scratch file
+// instead, see ScratchMapping. They work the same, only their pages can be
+// written out and dropped when the system runs short of memory, which is
+// what keeps a gigapixel image from taking the browser down with it.
+class PixelBuffer {
+ public:
+  PixelBuffer();
+  ~PixelBuffer();
+
+  // Allocates storage for a |width| x |height| image in |format|. Existing
+  // content is discarded. Returns false if the dimensions are not sane or
+  // there is neither memory nor scratch space left for them.
+  bool Allocate(int width, int height, PixelFormat format);
+
+  // Releases the pixel storage.
+  void Clear();
+
+  // Exchanges the content of this buffer with |other| without copying.
+  void Swap(PixelBuffer* other);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  int stride() const { return stride_; }
+  PixelFormat format() const { return format_; }
+  bool empty() const { return NULL == data_; }
+
+  uint8_t* data() { return data_; }
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  uint8_t* row(int y) { return data() + static_cast<size_t>(y) * stride_; }
+  const uint8_t* row(int y) const {
+    return data() + static_cast<size_t>(y) * stride_;
+  }
+
+  // True if the pixels live in a scratch file rather than in memory.
+  bool spilled() const { return NULL != scratch_.data(); }
+
+  // Number of bytes one pixel of |format| occupies.
+  static int BytesPerPixel(PixelFormat format);
+
+  // Number of bytes a row of |width| pixels occupies, including padding.
+  static int StrideFor(int width, PixelFormat format);
+
+  // Caps the bytes all buffers together hold in memory at |bytes|. 0, the
+  // default, leaves them unbounded. Buffers allocated before aren't moved.
+  static void SetMemoryBudget(size_t bytes);
+  static size_t memory_budget();
+
+  // Where buffers over the budget go, TemporaryDirectory() by default. Best
+  // on a disk, a directory in RAM like most /tmp on Linux only moves the
+  // memory out of the process.
+  static void SetScratchDirectory(const std::string& directory);
+
+ private:
+  int width_;
+  int height_;
+  int stride_;
+  PixelFormat format_;
+  // Points into |memory_| or |scratch_|, whichever holds the pixels.
+  uint8_t* data_;
+  size_t size_;
+  std::unique_ptr<uint8_t[]> memory_;
+  ScratchMapping scratch_;
+
+  // Copying would have the bytes counted twice, and isn't needed.
+  PixelBuffer(const PixelBuffer&);
+  void operator=(const PixelBuffer&);
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_PIXEL_BUFFER_H_
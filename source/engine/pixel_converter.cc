@@ -0,0 +1,270 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "pixel_converter.h"
+
+#include <string.h>
+
+#include "cpu_features.h"
+
+#if defined(ENGINE_ARCH_X86)
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// What a row conversion needs to know besides the pixels.
+struct RowParams {
+  // True for RGBA sources, whose red and blue have to be swapped.
+  bool swap;
+  // Background channels in the order of the source channels.
+  uint8_t background[3];
+};
+
+typedef void (*ConvertRowFunction)(const uint8_t* src, uint8_t* dst,
+                                   int width, const RowParams& params);
+
+// (color * alpha + background * (255 - alpha)) / 255, rounded to nearest.
+// Adding 128 and then t >> 8 before the final shift is an exact division by
+// 255 for every value this can take, the vector kernels do the same math on
+// 16-bit lanes.
+inline uint8_t Blend(int color, int alpha, int background) {
+  int t = color * alpha + background * (255 - alpha) + 128;
+  return static_cast<uint8_t>((t + (t >> 8)) >> 8);
+}
+
+void ConvertRowScalar(const uint8_t* src, uint8_t* dst, int width,
+                      const RowParams& params) {
+  int blue = params.swap ? 2 : 0;
+  int red = 2 - blue;
+  const uint8_t* background = params.background;
+  for (int x = 0; x < width; ++x, src += 4, dst += 3) {
+    int alpha = src[3];
+    dst[0] = Blend(src[blue], alpha, background[blue]);
+    dst[1] = Blend(src[1], alpha, background[1]);
+    dst[2] = Blend(src[red], alpha, background[red]);
+  }
+}
+
+#if defined(ENGINE_ARCH_X86)
+
+// Blend() on two pixels widened to 16-bit lanes. Every intermediate value
+// fits in an unsigned 16-bit lane, so the low half of the products is exact.
+ENGINE_TARGET("sse2")
+inline __m128i BlendSse2(__m128i color, __m128i background) {
+  const __m128i max = _mm_set1_epi16(255);
+  const __m128i half = _mm_set1_epi16(128);
+  __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(color, 0xFF), 0xFF);
+  __m128i t = _mm_add_epi16(
+      _mm_add_epi16(_mm_mullo_epi16(color, alpha),
+                    _mm_mullo_epi16(background, _mm_sub_epi16(max, alpha))),
+      half);
+  return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// Four pixels per iteration. SSE2 has no byte shuffle, so red and blue are
+// swapped while the channels are 16 bits wide and the 32 to 24-bit packing
+// is done with shifts and masks.
+template <bool kSwap>
+ENGINE_TARGET("sse2")
+void ConvertRowSse2(const uint8_t* src, uint8_t* dst, int width,
+                    const RowParams& params) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i background = _mm_setr_epi16(
+      params.background[0], params.background[1], params.background[2], 0,
+      params.background[0], params.background[1], params.background[2], 0);
+  // Masks over each 64-bit half for the first pixel and for the second one
+  // once it is moved next to the first.
+  const __m128i first_pixel = _mm_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF);
+  const __m128i second_pixel = _mm_set_epi32(
+      0x0000FFFF, static_cast<int>(0xFF000000),
+      0x0000FFFF, static_cast<int>(0xFF000000));
+  // Masks for bytes 0-5 and 6-11 of the result.
+  const __m128i low_half = _mm_set_epi32(0, 0, 0x0000FFFF, -1);
+  const __m128i high_half =
+      _mm_set_epi32(0, -1, static_cast<int>(0xFFFF0000), 0);
+
+  int x = 0;
+  for (; x + 4 <= width; x += 4, src += 16, dst += 12) {
+    __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    __m128i low = BlendSse2(_mm_unpacklo_epi8(pixels, zero), background);
+    __m128i high = BlendSse2(_mm_unpackhi_epi8(pixels, zero), background);
+    if (kSwap) {
+      low = _mm_shufflehi_epi16(_mm_shufflelo_epi16(low, 0xC6), 0xC6);
+      high = _mm_shufflehi_epi16(_mm_shufflelo_epi16(high, 0xC6), 0xC6);
+    }
+    __m128i packed = _mm_packus_epi16(low, high);
+
+    // Two pixels per 64-bit half, 6 bytes each...
+    packed = _mm_or_si128(_mm_and_si128(packed, first_pixel),
+                          _mm_and_si128(_mm_srli_epi64(packed, 8),
+                                        second_pixel));
+    // ... and the halves next to each other, 12 bytes.
+    packed = _mm_or_si128(_mm_and_si128(packed, low_half),
+                          _mm_and_si128(_mm_srli_si128(packed, 2),
+                                        high_half));
+
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), packed);
+    int32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(packed, 8));
+    memcpy(dst + 8, &tail, 4);
+  }
+  ConvertRowScalar(src, dst, width - x, params);
+}
+
+// Blend() on 2 x 2 pixels widened to 16-bit lanes.
+ENGINE_TARGET("avx2")
+inline __m256i BlendAvx2(__m256i color, __m256i background) {
+  const __m256i max = _mm256_set1_epi16(255);
+  const __m256i half = _mm256_set1_epi16(128);
+  __m256i alpha =
+      _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(color, 0xFF), 0xFF);
+  __m256i t = _mm256_add_epi16(
+      _mm256_add_epi16(
+          _mm256_mullo_epi16(color, alpha),
+          _mm256_mullo_epi16(background, _mm256_sub_epi16(max, alpha))),
+      half);
+  return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+// Eight pixels per iteration. The swizzle and the 32 to 24-bit packing are a
+// single byte shuffle per 128-bit lane, then the two 12-byte halves are moved
+// next to each other and stored with a mask so nothing past them is touched.
+ENGINE_TARGET("avx2")
+void ConvertRowAvx2(const uint8_t* src, uint8_t* dst, int width,
+                    const RowParams& params) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i background = _mm256_setr_epi16(
+      params.background[0], params.background[1], params.background[2], 0,
+      params.background[0], params.background[1], params.background[2], 0,
+      params.background[0], params.background[1], params.background[2], 0,
+      params.background[0], params.background[1], params.background[2], 0);
+  const __m256i shuffle = params.swap ?
+      _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                       -1, -1, -1, -1,
+                       2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                       -1, -1, -1, -1) :
+      _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14,
+                       -1, -1, -1, -1,
+                       0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14,
+                       -1, -1, -1, -1);
+  const __m256i compact = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+  const __m256i store_mask = _mm256_setr_epi32(-1, -1, -1, -1, -1, -1, 0, 0);
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8, src += 32, dst += 24) {
+    __m256i pixels =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+    __m256i low = BlendAvx2(_mm256_unpacklo_epi8(pixels, zero), background);
+    __m256i high = BlendAvx2(_mm256_unpackhi_epi8(pixels, zero), background);
+    __m256i packed = _mm256_packus_epi16(low, high);
+    packed = _mm256_shuffle_epi8(packed, shuffle);
+    packed = _mm256_permutevar8x32_epi32(packed, compact);
+    _mm256_maskstore_epi32(reinterpret_cast<int*>(dst), store_mask, packed);
+  }
+  ConvertRowScalar(src, dst, width - x, params);
+}
+
+#endif  // defined(ENGINE_ARCH_X86)
+
+ConvertRowFunction RowFunctionFor(PixelKernel kernel, bool swap) {
+  switch (kernel) {
+#if defined(ENGINE_ARCH_X86)
+  case PIXEL_KERNEL_SSE2:
+    return swap ? &ConvertRowSse2<true> : &ConvertRowSse2<false>;
+  case PIXEL_KERNEL_AVX2:
+    return &ConvertRowAvx2;
+#endif
+  default:
+    return &ConvertRowScalar;
+  }
+}
+
+// Converts the first |rows| rows of |source| into |output| with |kernel|.
+void ConvertRows(PixelKernel kernel, const PixelBuffer& source, int rows,
+                 uint32_t background, PixelBuffer* output) {
+  RowParams params;
+  params.swap = source.format() == PIXEL_FORMAT_RGBA32;
+  uint8_t red = static_cast<uint8_t>(background >> 16);
+  uint8_t green = static_cast<uint8_t>(background >> 8);
+  uint8_t blue = static_cast<uint8_t>(background);
+  params.background[0] = params.swap ? red : blue;
+  params.background[1] = green;
+  params.background[2] = params.swap ? blue : red;
+
+  ConvertRowFunction convert_row = RowFunctionFor(kernel, params.swap);
+  for (int y = 0; y < rows; ++y)
+    convert_row(source.row(y), output->row(y), source.width(), params);
+}
+
+}  // namespace
+
+bool PixelConverter::ToBGR24(const PixelBuffer& source, uint32_t background,
+                             PixelBuffer* output) {
+  return ToBGR24WithKernel(BestKernel(), source, background, output);
+}
+
+bool PixelConverter::ToBGR24WithKernel(PixelKernel kernel,
+                                       const PixelBuffer& source,
+                                       uint32_t background,
+                                       PixelBuffer* output) {
+  if (source.format() == PIXEL_FORMAT_BGR24 || !IsKernelSupported(kernel))
+    return false;
+  if (!output->Allocate(source.width(), source.height(), PIXEL_FORMAT_BGR24))
+    return false;
+  ConvertRows(kernel, source, source.height(), background, output);
+  return true;
+}
+
+bool PixelConverter::RowsToBGR24(const PixelBuffer& source, int rows,
+                                 uint32_t background, PixelBuffer* output) {
+  if (source.format() == PIXEL_FORMAT_BGR24 ||
+      output->format() != PIXEL_FORMAT_BGR24 ||
+      output->width() != source.width() || rows > source.height() ||
+      rows > output->height()) {
+    return false;
+  }
+  ConvertRows(BestKernel(), source, rows, background, output);
+  return true;
+}
+
+bool PixelConverter::IsKernelSupported(PixelKernel kernel) {
+  switch (kernel) {
+  case PIXEL_KERNEL_SCALAR:
+    return true;
+#if defined(ENGINE_ARCH_X86)
+  case PIXEL_KERNEL_SSE2:
+    return CpuHasSse2();
+  case PIXEL_KERNEL_AVX2:
+    return CpuHasAvx2();
+#endif
+  default:
+    return false;
+  }
+}
+
+PixelKernel PixelConverter::BestKernel() {
+  if (IsKernelSupported(PIXEL_KERNEL_AVX2))
+    return PIXEL_KERNEL_AVX2;
+  if (IsKernelSupported(PIXEL_KERNEL_SSE2))
+    return PIXEL_KERNEL_SSE2;
+  return PIXEL_KERNEL_SCALAR;
+}
+
+const char* PixelConverter::KernelName(PixelKernel kernel) {
+  switch (kernel) {
+  case PIXEL_KERNEL_SCALAR:
+    return "scalar";
+  case PIXEL_KERNEL_SSE2:
+    return "sse2";
+  case PIXEL_KERNEL_AVX2:
+    return "avx2";
+  default:
+    return "unknown";
+  }
+}
+
+}  // namespace set_wallpaper_extension
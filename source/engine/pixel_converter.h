@@ -0,0 +1,62 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_PIXEL_CONVERTER_H_
+#define ENGINE_PIXEL_CONVERTER_H_
+
+#include <stdint.h>
+
+#include "pixel_buffer.h"
+
+namespace set_wallpaper_extension {
+
+// Implementations of the conversion loop. All of them produce bit-identical
+// output, the vector ones just get there faster.
+enum PixelKernel {
+  PIXEL_KERNEL_SCALAR,
+  PIXEL_KERNEL_SSE2,
+  PIXEL_KERNEL_AVX2
+};
+
+// Pixel-convert stage of the engine. Turns decoded 32-bit pixels into the
+// BGR24 layout the encoders write. Swizzling the channels, premultiplying by
+// alpha and compositing over the desktop background color happen in a single
+// pass over the pixels:
+//
+//   out = (color * alpha + background * (255 - alpha)) / 255
+//
+// rounded to nearest, so opaque pixels come out unchanged and transparent
+// ones take the background color, the way the desktop shows them.
+class PixelConverter {
+ public:
+  // Converts |source| into a BGR24 |output| composited over |background|,
+  // given as 0xRRGGBB, using the fastest kernel the CPU supports.
+  static bool ToBGR24(const PixelBuffer& source, uint32_t background,
+                      PixelBuffer* output);
+
+  // Same as ToBGR24() with a specific |kernel|, which must be supported.
+  static bool ToBGR24WithKernel(PixelKernel kernel,
+                                const PixelBuffer& source,
+                                uint32_t background,
+                                PixelBuffer* output);
+
+  // Same as ToBGR24() for the first |rows| rows of |source|, into the first
+  // rows of |output|, a BGR24 buffer of the same width allocated already.
+  // For images converted a few rows at a time.
+  static bool RowsToBGR24(const PixelBuffer& source, int rows,
+                          uint32_t background, PixelBuffer* output);
+
+  // True if |kernel| can run on this CPU and was compiled in.
+  static bool IsKernelSupported(PixelKernel kernel);
+
+  // The fastest supported kernel.
+  static PixelKernel BestKernel();
+
+  // Human readable name of |kernel|, for benchmarks and logs.
+  static const char* KernelName(PixelKernel kernel);
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_PIXEL_CONVERTER_H_
@@ -0,0 +1,213 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "png_decoder.h"
+
+#if defined(HAVE_LIBPNG)
+
+#include <string.h>
+
+#include <png.h>
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// Feeds libpng's progressive reader. Rows go to the sink as soon as libpng
+// has them, so by the time the last byte arrives the image is already
+// decoded. Interlaced images only have complete rows once the last pass is
+// in, so they are put together whole and handed over at the end.
+class PngIncrementalDecoder : public IncrementalDecoder {
+ public:
+  explicit PngIncrementalDecoder(RowSink* sink);
+  virtual ~PngIncrementalDecoder();
+
+  virtual bool Write(const uint8_t* data, size_t size, std::string* error);
+  virtual bool Finish(std::string* error);
+
+ private:
+  // libpng progressive callbacks.
+  static void InfoCallback(png_structp png, png_infop info);
+  static void RowCallback(png_structp png, png_bytep new_row,
+                          png_uint_32 row_num, int pass);
+  static void EndCallback(png_structp png, png_infop info);
+  static void ErrorCallback(png_structp png, png_const_charp message);
+  static void WarningCallback(png_structp png, png_const_charp message);
+
+  png_structp png_;
+  png_infop info_;
+  std::string error_;
+  bool failed_;
+  bool done_;
+  RowSink* sink_;
+  // The passes of an interlaced image, empty otherwise.
+  PixelBuffer interlaced_;
+};
+
+PngIncrementalDecoder::PngIncrementalDecoder(RowSink* sink)
+    : png_(NULL),
+      info_(NULL),
+      failed_(false),
+      done_(false),
+      sink_(sink) {
+  png_ = png_create_read_struct(PNG_LIBPNG_VER_STRING, this,
+                                &ErrorCallback, &WarningCallback);
+  if (png_)
+    info_ = png_create_info_struct(png_);
+  if (!png_ || !info_) {
+    failed_ = true;
+    error_ = "Unable to initialize libpng.";
+    return;
+  }
+  png_set_progressive_read_fn(png_, this, &InfoCallback, &RowCallback,
+                              &EndCallback);
+}
+
+PngIncrementalDecoder::~PngIncrementalDecoder() {
+  png_destroy_read_struct(&png_, info_ ? &info_ : NULL, NULL);
+}
+
+bool PngIncrementalDecoder::Write(const uint8_t* data, size_t size,
+                                  std::string* error) {
+  if (!failed_ && !done_) {
+    if (setjmp(png_jmpbuf(png_))) {
+      failed_ = true;
+    } else {
+      png_process_data(png_, info_, const_cast<uint8_t*>(data), size);
+    }
+  }
+  if (failed_) {
+    *error = "PNG decode failed: " + error_;
+    return false;
+  }
+  return true;
+}
+
+bool PngIncrementalDecoder::Finish(std::string* error) {
+  if (failed_) {
+    *error = "PNG decode failed: " + error_;
+    return false;
+  }
+  if (!done_) {
+    *error = "Truncated PNG image.";
+    return false;
+  }
+  return true;
+}
+
+void PngIncrementalDecoder::InfoCallback(png_structp png, png_infop info) {
+  PngIncrementalDecoder* decoder =
+      static_cast<PngIncrementalDecoder*>(png_get_progressive_ptr(png));
+
+  // Normalize everything to 8-bit RGBA.
+  png_set_expand(png);
+  png_set_strip_16(png);
+  png_set_gray_to_rgb(png);
+  png_set_add_alpha(png, 0xFF, PNG_FILLER_AFTER);
+  png_set_interlace_handling(png);
+  png_read_update_info(png, info);
+
+  int width = png_get_image_width(png, info);
+  int height = png_get_image_height(png, info);
+  bool ok;
+  if (png_get_interlace_type(png, info) != PNG_INTERLACE_NONE) {
+    ok = decoder->interlaced_.Allocate(width, height, PIXEL_FORMAT_RGBA32);
+  } else {
+    ok = decoder->sink_->Begin(width, height, PIXEL_FORMAT_RGBA32);
+  }
+  if (!ok)
+    png_error(png, "Invalid PNG dimensions.");
+}
+
+void PngIncrementalDecoder::RowCallback(png_structp png, png_bytep new_row,
+                                        png_uint_32 row_num, int) {
+  PngIncrementalDecoder* decoder =
+      static_cast<PngIncrementalDecoder*>(png_get_progressive_ptr(png));
+  if (!new_row)
+    return;
+  PixelBuffer* interlaced = &decoder->interlaced_;
+  if (!interlaced->empty()) {
+    if (row_num < static_cast<png_uint_32>(interlaced->height()))
+      png_progressive_combine_row(png, interlaced->row(row_num), new_row);
+    return;
+  }
+  // Without interlacing every row comes once, in order.
+  int y = static_cast<int>(row_num);
+  png_progressive_combine_row(png, decoder->sink_->BeginRow(y), new_row);
+  decoder->sink_->EndRow(y);
+}
+
+void PngIncrementalDecoder::EndCallback(png_structp png, png_infop) {
+  PngIncrementalDecoder* decoder =
+      static_cast<PngIncrementalDecoder*>(png_get_progressive_ptr(png));
+  if (!decoder->interlaced_.empty()) {
+    if (!CopyRowsToSink(decoder->interlaced_, decoder->sink_))
+      png_error(png, "Invalid PNG dimensions.");
+    decoder->interlaced_.Clear();
+  }
+  decoder->done_ = true;
+}
+
+void PngIncrementalDecoder::ErrorCallback(png_structp png,
+                                          png_const_charp message) {
+  PngIncrementalDecoder* decoder =
+      static_cast<PngIncrementalDecoder*>(png_get_error_ptr(png));
+  decoder->error_ = message;
+  png_longjmp(png, 1);
+}
+
+void PngIncrementalDecoder::WarningCallback(png_structp, png_const_charp) {
+  // Warnings are not interesting enough to print anywhere.
+}
+
+}  // namespace
+
+bool PngDecoder::CanDecode(ImageFormat format) const {
+  return format == IMAGE_FORMAT_PNG;
+}
+
+bool PngDecoder::Decode(const uint8_t* data, size_t size,
+                        PixelBuffer* output, std::string* error) {
+  // The simplified API takes care of palettes, grayscale, 16-bit channels,
+  // tRNS chunks and interlacing for us.
+  png_image image;
+  memset(&image, 0, sizeof(image));
+  image.version = PNG_IMAGE_VERSION;
+
+  if (!png_image_begin_read_from_memory(&image, data, size)) {
+    *error = std::string("PNG decode failed: ") + image.message;
+    return false;
+  }
+
+  image.format = PNG_FORMAT_RGBA;
+  if (!output->Allocate(image.width, image.height, PIXEL_FORMAT_RGBA32)) {
+    *error = "Invalid PNG dimensions.";
+    png_image_free(&image);
+    return false;
+  }
+
+  if (!png_image_finish_read(&image, NULL, output->data(), output->stride(),
+                             NULL)) {
+    *error = std::string("PNG decode failed: ") + image.message;
+    png_image_free(&image);
+    return false;
+  }
+  return true;
+}
+
+bool PngDecoder::DecodeRows(const uint8_t* data, size_t size, RowSink* sink,
+                            std::string* error) {
+  // The progressive reader hands rows over one at a time, which the
+  // simplified API can't.
+  PngIncrementalDecoder decoder(sink);
+  return decoder.Write(data, size, error) && decoder.Finish(error);
+}
+
+IncrementalDecoder* PngDecoder::CreateIncrementalDecoder(RowSink* sink) {
+  return new PngIncrementalDecoder(sink);
+}
+
+}  // namespace set_wallpaper_extension
+
+#endif  // defined(HAVE_LIBPNG)
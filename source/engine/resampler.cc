@@ -0,0 +1,215 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "resampler.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "parallel_for.h"
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+const int kWeightBits = 14;
+const int kWeightOne = 1 << kWeightBits;
+const int kRounding = 1 << (kWeightBits - 1);
+
+// Smallest band handed to a thread, in rows. Keeps the per-band overhead
+// negligible on small images.
+const int kMinBandRows = 16;
+
+// Catmull-Rom cubic (B = 0, C = 0.5). Sharp enough for photos without the
+// ringing of wider windowed-sinc filters.
+double CatmullRom(double x) {
+  x = fabs(x);
+  if (x < 1.0)
+    return (1.5 * x - 2.5) * x * x + 1.0;
+  if (x < 2.0)
+    return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+  return 0.0;
+}
+
+uint8_t ClampToByte(int32_t value) {
+  value = (value + kRounding) >> kWeightBits;
+  return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+}  // namespace
+
+ResampleFilter::ResampleFilter(int source_size, int dest_size)
+    : source_size_(source_size),
+      dest_size_(dest_size),
+      taps_(0) {
+  Initialize(dest_size, 0);
+}
+
+ResampleFilter::ResampleFilter(int source_size, int scaled_size, int offset,
+                               int dest_size)
+    : source_size_(source_size),
+      dest_size_(dest_size),
+      taps_(0) {
+  Initialize(scaled_size, offset);
+}
+
+void ResampleFilter::Initialize(int scaled_size, int offset) {
+  int source_size = source_size_;
+  int dest_size = dest_size_;
+  double scale = static_cast<double>(source_size) / scaled_size;
+  // When shrinking, widen the kernel so every source sample contributes.
+  double filter_scale = std::max(scale, 1.0);
+  double support = 2.0 * filter_scale;
+
+  taps_ = std::min(static_cast<int>(ceil(support)) * 2 + 1, source_size);
+  start_.resize(dest_size);
+  weights_.assign(static_cast<size_t>(dest_size) * taps_, 0);
+
+  std::vector<double> raw(taps_);
+  for (int i = 0; i < dest_size; ++i) {
+    double center = (i + offset + 0.5) * scale - 0.5;
+    int left = static_cast<int>(floor(center - support)) + 1;
+    int right = static_cast<int>(floor(center + support));
+
+    // Keep the window inside the source. Samples falling off an edge are
+    // folded onto the edge sample, which is the same as clamping the
+    // coordinates.
+    int start = std::min(std::max(left, 0), source_size - taps_);
+    start_[i] = start;
+    std::fill(raw.begin(), raw.end(), 0.0);
+    double total = 0.0;
+    for (int j = left; j <= right; ++j) {
+      double weight = CatmullRom((j - center) / filter_scale);
+      if (weight == 0.0)
+        continue;
+      int index = std::min(std::max(j, 0), source_size - 1) - start;
+      index = std::min(std::max(index, 0), taps_ - 1);
+      raw[index] += weight;
+      total += weight;
+    }
+
+    // Quantize and push the rounding error into the largest tap so the
+    // weights sum to exactly kWeightOne.
+    int16_t* weights = &weights_[static_cast<size_t>(i) * taps_];
+    int sum = 0;
+    int largest = 0;
+    for (int k = 0; k < taps_; ++k) {
+      weights[k] = static_cast<int16_t>(
+          floor(raw[k] / total * kWeightOne + 0.5));
+      sum += weights[k];
+      if (weights[k] > weights[largest])
+        largest = k;
+    }
+    weights[largest] =
+        static_cast<int16_t>(weights[largest] + kWeightOne - sum);
+  }
+}
+
+bool Resampler::Resample(const PixelBuffer& source, int width, int height,
+                         int threads, WorkerPool* pool,
+                         PixelBuffer* output) {
+  return ResampleRegion(source, width, height, 0, 0, width, height, threads,
+                        pool, output);
+}
+
+bool Resampler::ResampleRegion(const PixelBuffer& source,
+                               int scaled_width, int scaled_height,
+                               int x, int y, int width, int height,
+                               int threads, WorkerPool* pool,
+                               PixelBuffer* output) {
+  if (source.format() == PIXEL_FORMAT_BGR24 || source.empty())
+    return false;
+  if (width <= 0 || height <= 0 || x < 0 || y < 0 ||
+      x + width > scaled_width || y + height > scaled_height) {
+    return false;
+  }
+
+  ResampleFilter horizontal(source.width(), scaled_width, x, width);
+  ResampleFilter vertical(source.height(), scaled_height, y, height);
+
+  // Only the source rows the vertical pass reads need horizontal filtering.
+  int first_row = vertical.start(0);
+  int last_row = vertical.start(height - 1) + vertical.taps();
+
+  PixelBuffer intermediate;
+  if (!intermediate.Allocate(width, source.height(), source.format()))
+    return false;
+  ParallelFor(first_row, last_row, kMinBandRows, threads, pool,
+              [&](int first, int last) {
+    HorizontalPass(source, horizontal, first, last, &intermediate);
+  });
+
+  if (!output->Allocate(width, height, source.format()))
+    return false;
+  ParallelFor(0, height, kMinBandRows, threads, pool,
+              [&](int first, int last) {
+    VerticalPass(intermediate, vertical, first, last, output);
+  });
+  return true;
+}
+
+void Resampler::HorizontalPass(const PixelBuffer& source,
+                               const ResampleFilter& filter,
+                               int first_row, int last_row,
+                               PixelBuffer* output) {
+  for (int y = first_row; y < last_row; ++y)
+    FilterRow(source.row(y), filter, output->row(y));
+}
+
+void Resampler::VerticalPass(const PixelBuffer& source,
+                             const ResampleFilter& filter,
+                             int first_row, int last_row,
+                             PixelBuffer* output) {
+  int bytes = source.width() * 4;
+  std::vector<int32_t> accumulator(bytes);
+  std::vector<const uint8_t*> rows(filter.taps());
+  for (int y = first_row; y < last_row; ++y) {
+    for (int k = 0; k < filter.taps(); ++k)
+      rows[k] = source.row(filter.start(y) + k);
+    FilterColumns(&rows[0], filter, y, bytes, &accumulator[0],
+                  output->row(y));
+  }
+}
+
+void Resampler::FilterRow(const uint8_t* source, const ResampleFilter& filter,
+                          uint8_t* output) {
+  int taps = filter.taps();
+  uint8_t* dst = output;
+  for (int x = 0; x < filter.dest_size(); ++x, dst += 4) {
+    const uint8_t* pixel = source + filter.start(x) * 4;
+    const int16_t* weights = filter.weights(x);
+    int32_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+    for (int k = 0; k < taps; ++k, pixel += 4) {
+      c0 += weights[k] * pixel[0];
+      c1 += weights[k] * pixel[1];
+      c2 += weights[k] * pixel[2];
+      c3 += weights[k] * pixel[3];
+    }
+    dst[0] = ClampToByte(c0);
+    dst[1] = ClampToByte(c1);
+    dst[2] = ClampToByte(c2);
+    dst[3] = ClampToByte(c3);
+  }
+}
+
+void Resampler::FilterColumns(const uint8_t* const* rows,
+                              const ResampleFilter& filter, int y, int bytes,
+                              int32_t* accumulator, uint8_t* output) {
+  std::fill(accumulator, accumulator + bytes, 0);
+  const int16_t* weights = filter.weights(y);
+  for (int k = 0; k < filter.taps(); ++k) {
+    const uint8_t* src = rows[k];
+    int32_t weight = weights[k];
+    if (weight == 0)
+      continue;
+    for (int i = 0; i < bytes; ++i)
+      accumulator[i] += weight * src[i];
+  }
+  for (int i = 0; i < bytes; ++i)
+    output[i] = ClampToByte(accumulator[i]);
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,104 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_RESAMPLER_H_
+#define ENGINE_RESAMPLER_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "pixel_buffer.h"
+
+namespace set_wallpaper_extension {
+
+class WorkerPool;
+
+// Precomputed Catmull-Rom weights for scaling one axis from |source_size| to
+// |dest_size| samples. Weights are 2.14 fixed point and sum to exactly 1.0 for
+// every output sample, so the result does not depend on the order in which
+// rows or columns are processed.
+class ResampleFilter {
+ public:
+  ResampleFilter(int source_size, int dest_size);
+
+  // Filter producing only |dest_size| samples, starting at |offset|, of the
+  // |scaled_size| samples scaling the whole source would produce. Used to
+  // scale and crop in one go without computing the cropped samples.
+  ResampleFilter(int source_size, int scaled_size, int offset, int dest_size);
+
+  int source_size() const { return source_size_; }
+  int dest_size() const { return dest_size_; }
+
+  // Number of source samples contributing to every output sample.
+  int taps() const { return taps_; }
+
+  // First source sample contributing to output sample |i|.
+  int start(int i) const { return start_[i]; }
+
+  // The taps() weights for output sample |i|.
+  const int16_t* weights(int i) const { return &weights_[i * taps_]; }
+
+ private:
+  void Initialize(int scaled_size, int offset);
+
+  int source_size_;
+  int dest_size_;
+  int taps_;
+  std::vector<int> start_;
+  std::vector<int16_t> weights_;
+};
+
+// Resample stage of the engine. Scales 32-bit images with a separable filter,
+// horizontally first and then vertically. Both passes are split into bands of
+// rows processed on up to |threads| threads, 0 meaning one per core, the
+// calling one and workers of |pool|, see ParallelFor(). Every output pixel is
+// computed the same way whichever band it falls in, so the result is
+// bit-identical for any number of threads.
+class Resampler {
+ public:
+  // Scales |source| to |width| x |height| and stores the result in |output|
+  // using the same pixel format. Returns false for non 32-bit input.
+  static bool Resample(const PixelBuffer& source, int width, int height,
+                       int threads, WorkerPool* pool, PixelBuffer* output);
+
+  // Scales |source| to |scaled_width| x |scaled_height| but only produces the
+  // |width| x |height| block at |x|, |y| of the result, which must lie within
+  // the scaled image.
+  static bool ResampleRegion(const PixelBuffer& source,
+                             int scaled_width, int scaled_height,
+                             int x, int y, int width, int height,
+                             int threads, WorkerPool* pool,
+                             PixelBuffer* output);
+
+  // Filters |source| rows [first_row, last_row) horizontally through
+  // |filter| into the same rows of |output|.
+  static void HorizontalPass(const PixelBuffer& source,
+                             const ResampleFilter& filter,
+                             int first_row, int last_row,
+                             PixelBuffer* output);
+
+  // Produces |output| rows [first_row, last_row) by filtering the rows of
+  // |source| vertically through |filter|.
+  static void VerticalPass(const PixelBuffer& source,
+                           const ResampleFilter& filter,
+                           int first_row, int last_row,
+                           PixelBuffer* output);
+
+  // Filters the row of 32-bit pixels at |source| horizontally through
+  // |filter| into the filter.dest_size() pixels at |output|.
+  static void FilterRow(const uint8_t* source, const ResampleFilter& filter,
+                        uint8_t* output);
+
+  // Produces row |y| of the output of the vertical |filter| into the |bytes|
+  // at |output|. |rows| are the filter.taps() rows of |bytes| starting at
+  // filter.start(y). |accumulator| is scratch space for |bytes| values.
+  static void FilterColumns(const uint8_t* const* rows,
+                            const ResampleFilter& filter, int y, int bytes,
+                            int32_t* accumulator, uint8_t* output);
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_RESAMPLER_H_
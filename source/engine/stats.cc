@@ -0,0 +1,215 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "stats.h"
+
+#include <string.h>
+
+#include <atomic>
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// Latencies are bucketed by their power of two and the next two bits below
+// it, so four buckets per doubling. 40 doublings go past 18 minutes.
+const int kSubBucketBits = 2;
+const int kSubBuckets = 1 << kSubBucketBits;
+const int kBuckets = 40 * kSubBuckets;
+
+// What one thread recorded. Only the thread that claimed a shard writes to
+// it, so updates are a plain load and store, the atomics are there for
+// Read(). A shard outlives its thread, what it counted still counts, and
+// goes to the next thread that needs one.
+struct Shard {
+  std::atomic<bool> in_use;
+  std::atomic<int64_t> counters[STATS_COUNTER_COUNT];
+  std::atomic<int64_t> buckets[STATS_STAGE_COUNT][kBuckets];
+  // Set before the shard is published, never changed after.
+  Shard* next;
+};
+
+// Every shard ever created, never freed. Threads come and go with the
+// plugin instances, so there are about as many as there were threads at
+// once.
+std::atomic<Shard*> g_shards(NULL);
+
+std::atomic<int64_t> g_buffer_bytes(0);
+std::atomic<int64_t> g_peak_buffer_bytes(0);
+
+Shard* ClaimShard() {
+  for (Shard* shard = g_shards.load(std::memory_order_acquire); shard;
+       shard = shard->next) {
+    bool in_use = false;
+    if (!shard->in_use.load(std::memory_order_relaxed) &&
+        shard->in_use.compare_exchange_strong(in_use, true,
+                                              std::memory_order_acquire)) {
+      return shard;
+    }
+  }
+  // Value initialized, so every count starts at zero.
+  Shard* shard = new Shard();
+  shard->in_use.store(true, std::memory_order_relaxed);
+  shard->next = g_shards.load(std::memory_order_relaxed);
+  while (!g_shards.compare_exchange_weak(shard->next, shard,
+                                         std::memory_order_release)) {
+  }
+  return shard;
+}
+
+// Hands the shard of the thread back when the thread exits.
+class ThreadShard {
+ public:
+  ThreadShard() : shard_(ClaimShard()) {}
+  ~ThreadShard() { shard_->in_use.store(false, std::memory_order_release); }
+
+  Shard* get() const { return shard_; }
+
+ private:
+  Shard* shard_;
+};
+
+Shard* CurrentShard() {
+  static thread_local ThreadShard shard;
+  return shard.get();
+}
+
+void Increment(std::atomic<int64_t>* value, int64_t delta) {
+  value->store(value->load(std::memory_order_relaxed) + delta,
+               std::memory_order_relaxed);
+}
+
+int FloorLog2(uint64_t value) {
+  int log = 0;
+  for (int shift = 32; shift > 0; shift >>= 1) {
+    if (value >> shift) {
+      value >>= shift;
+      log += shift;
+    }
+  }
+  return log;
+}
+
+int BucketFor(int64_t nanoseconds) {
+  if (nanoseconds < kSubBuckets)
+    return nanoseconds < 0 ? 0 : static_cast<int>(nanoseconds);
+  uint64_t value = static_cast<uint64_t>(nanoseconds);
+  int log = FloorLog2(value);
+  int sub = static_cast<int>(value >> (log - kSubBucketBits)) &
+            (kSubBuckets - 1);
+  int bucket = (log - kSubBucketBits + 1) * kSubBuckets + sub;
+  return bucket < kBuckets ? bucket : kBuckets - 1;
+}
+
+// The middle of the range of |bucket|.
+int64_t BucketValue(int bucket) {
+  if (bucket < kSubBuckets)
+    return bucket;
+  int shift = bucket / kSubBuckets - 1;
+  int64_t width = static_cast<int64_t>(1) << shift;
+  int64_t lower = (kSubBuckets + bucket % kSubBuckets) * width;
+  return lower + width / 2;
+}
+
+// The value |percent| of the |count| recordings in |buckets| are at or
+// below.
+int64_t Percentile(const int64_t* buckets, int64_t count, int percent) {
+  int64_t rank = (count * percent + 99) / 100;
+  if (rank < 1)
+    rank = 1;
+  int64_t seen = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    seen += buckets[i];
+    if (seen >= rank)
+      return BucketValue(i);
+  }
+  return BucketValue(kBuckets - 1);
+}
+
+}  // namespace
+
+void Stats::Add(StatsCounter counter, int64_t value) {
+  Increment(&CurrentShard()->counters[counter], value);
+}
+
+void Stats::AddLatency(StatsStage stage, int64_t nanoseconds) {
+  Increment(&CurrentShard()->buckets[stage][BucketFor(nanoseconds)], 1);
+}
+
+void Stats::AddBufferBytes(int64_t delta) {
+  int64_t bytes = g_buffer_bytes.fetch_add(delta, std::memory_order_relaxed) +
+                  delta;
+  int64_t peak = g_peak_buffer_bytes.load(std::memory_order_relaxed);
+  while (bytes > peak &&
+         !g_peak_buffer_bytes.compare_exchange_weak(
+             peak, bytes, std::memory_order_relaxed)) {
+  }
+}
+
+void Stats::ResetPeakBufferBytes() {
+  g_peak_buffer_bytes.store(g_buffer_bytes.load(std::memory_order_relaxed),
+                            std::memory_order_relaxed);
+}
+
+void Stats::Read(Snapshot* snapshot) {
+  memset(snapshot, 0, sizeof(*snapshot));
+  Shard* shards = g_shards.load(std::memory_order_acquire);
+  for (Shard* shard = shards; shard; shard = shard->next) {
+    for (int i = 0; i < STATS_COUNTER_COUNT; ++i)
+      snapshot->counters[i] +=
+          shard->counters[i].load(std::memory_order_relaxed);
+  }
+
+  for (int stage = 0; stage < STATS_STAGE_COUNT; ++stage) {
+    int64_t buckets[kBuckets] = { 0 };
+    Latency* latency = &snapshot->latencies[stage];
+    for (Shard* shard = shards; shard; shard = shard->next) {
+      for (int i = 0; i < kBuckets; ++i) {
+        int64_t count =
+            shard->buckets[stage][i].load(std::memory_order_relaxed);
+        buckets[i] += count;
+        latency->count += count;
+      }
+    }
+    if (0 == latency->count)
+      continue;
+    latency->p50 = Percentile(buckets, latency->count, 50);
+    latency->p95 = Percentile(buckets, latency->count, 95);
+    latency->p99 = Percentile(buckets, latency->count, 99);
+  }
+  snapshot->buffer_bytes = g_buffer_bytes.load(std::memory_order_relaxed);
+  snapshot->peak_buffer_bytes =
+      g_peak_buffer_bytes.load(std::memory_order_relaxed);
+}
+
+const char* Stats::CounterName(StatsCounter counter) {
+  static const char* const kNames[STATS_COUNTER_COUNT] = {
+    "jobsStarted",
+    "jobsCompleted",
+    "jobsFailed",
+    "jobsCancelled",
+    "bytesDownloaded",
+    "bytesWritten",
+    "cacheHits",
+    "cacheMisses"
+  };
+  return kNames[counter];
+}
+
+const char* Stats::StageName(StatsStage stage) {
+  static const char* const kNames[STATS_STAGE_COUNT] = {
+    "queue",
+    "download",
+    "decode",
+    "resample",
+    "convert",
+    "encode",
+    "write",
+    "apply",
+    "total"
+  };
+  return kNames[stage];
+}
+
+}  // namespace set_wallpaper_extension
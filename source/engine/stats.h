@@ -0,0 +1,90 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_STATS_H_
+#define ENGINE_STATS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace set_wallpaper_extension {
+
+// Things counted for the whole process.
+enum StatsCounter {
+  STATS_JOBS_STARTED,
+  STATS_JOBS_COMPLETED,
+  STATS_JOBS_FAILED,
+  STATS_JOBS_CANCELLED,
+  STATS_BYTES_DOWNLOADED,
+  STATS_BYTES_WRITTEN,
+  STATS_CACHE_HITS,
+  STATS_CACHE_MISSES,
+  STATS_COUNTER_COUNT
+};
+
+// Stages of a wallpaper whose latency is recorded. TOTAL is the time from
+// starting the download to completing the job.
+enum StatsStage {
+  STATS_STAGE_QUEUE,
+  STATS_STAGE_DOWNLOAD,
+  STATS_STAGE_DECODE,
+  STATS_STAGE_RESAMPLE,
+  STATS_STAGE_CONVERT,
+  STATS_STAGE_ENCODE,
+  STATS_STAGE_WRITE,
+  STATS_STAGE_APPLY,
+  STATS_STAGE_TOTAL,
+  STATS_STAGE_COUNT
+};
+
+// Counters and latency histograms for the whole process, cheap enough to
+// update on every wallpaper. Each thread updates its own copy without
+// locking or contending with the others, and Read() adds the copies up.
+// Latencies go into buckets a quarter of a power of two wide, so the
+// percentiles read back are within about 12% of the real ones. Safe to use
+// from any thread.
+class Stats {
+ public:
+  struct Latency {
+    int64_t count;
+    // Nanoseconds.
+    int64_t p50;
+    int64_t p95;
+    int64_t p99;
+  };
+
+  struct Snapshot {
+    int64_t counters[STATS_COUNTER_COUNT];
+    Latency latencies[STATS_STAGE_COUNT];
+    // Bytes PixelBuffers hold in memory now, and the most they ever held at
+    // once. Buffers spilled to scratch files don't count.
+    int64_t buffer_bytes;
+    int64_t peak_buffer_bytes;
+  };
+
+  // Adds |value| to |counter|.
+  static void Add(StatsCounter counter, int64_t value);
+
+  // Records that |stage| took |nanoseconds|.
+  static void AddLatency(StatsStage stage, int64_t nanoseconds);
+
+  // Adds |delta|, which may be negative, to the bytes PixelBuffers hold in
+  // memory.
+  static void AddBufferBytes(int64_t delta);
+
+  // Starts tracking the peak of the bytes held by PixelBuffers over from
+  // what they hold now, to find the peak of a stretch of work.
+  static void ResetPeakBufferBytes();
+
+  // Adds up what every thread recorded so far.
+  static void Read(Snapshot* snapshot);
+
+  // Names of the counters and stages, in the camelCase script uses.
+  static const char* CounterName(StatsCounter counter);
+  static const char* StageName(StatsStage stage);
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_STATS_H_
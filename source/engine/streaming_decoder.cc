@@ -0,0 +1,114 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "streaming_decoder.h"
+
+#include "clock.h"
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// Enough bytes to tell every format SniffImageFormat() knows apart.
+const size_t kSniffSize = 8;
+
+}  // namespace
+
+StreamingDecoder::StreamingDecoder(WallpaperEngine* engine,
+                                   const ConversionOptions& options,
+                                   const std::string& output_base)
+    : engine_(engine),
+      options_(options),
+      output_base_(output_base),
+      decoder_selected_(false),
+      passes_through_(false),
+      keeps_encoded_(false),
+      bytes_received_(0),
+      decode_nanoseconds_(0),
+      band_(options.style, options.screen_width, options.screen_height,
+            engine->thread_count(), engine->worker_pool()) {
+}
+
+StreamingDecoder::~StreamingDecoder() {
+}
+
+bool StreamingDecoder::Write(const uint8_t* data, size_t size,
+                             std::string* error) {
+  bytes_received_ += size;
+  hasher_.Update(data, size);
+  if (incremental_.get()) {
+    if (keeps_encoded_)
+      encoded_.insert(encoded_.end(), data, data + size);
+    int64_t start = MonotonicNanoseconds();
+    bool ok = incremental_->Write(data, size, error);
+    decode_nanoseconds_ += MonotonicNanoseconds() - start;
+    return ok;
+  }
+
+  buffer_.insert(buffer_.end(), data, data + size);
+  if (!decoder_selected_ && buffer_.size() >= kSniffSize)
+    return SelectDecoder(error);
+  return true;
+}
+
+bool StreamingDecoder::Finish(PixelBuffer* output, std::string* error) {
+  if (!decoder_selected_ && !SelectDecoder(error))
+    return false;
+
+  int64_t start = MonotonicNanoseconds();
+  if (incremental_.get()) {
+    bool ok = incremental_->Finish(error);
+    decode_nanoseconds_ += MonotonicNanoseconds() - start;
+    return ok && band_.Finish(output, error);
+  }
+
+  if (buffer_.empty()) {
+    *error = "The image stream was empty.";
+    return false;
+  }
+  bool ok = engine_->DecodeRows(&buffer_[0], buffer_.size(), &band_, error);
+  decode_nanoseconds_ += MonotonicNanoseconds() - start;
+  if (!keeps_encoded_)
+    std::vector<uint8_t>().swap(buffer_);
+  return ok && band_.Finish(output, error);
+}
+
+bool StreamingDecoder::SelectDecoder(std::string* error) {
+  decoder_selected_ = true;
+
+  ImageFormat format = buffer_.empty() ? IMAGE_FORMAT_UNKNOWN :
+      SniffImageFormat(&buffer_[0], buffer_.size());
+  if (engine_->CanPassThrough(format, options_)) {
+    if (!engine_->NeedsDimensions(options_)) {
+      passes_through_ = true;
+      return true;
+    }
+    keeps_encoded_ = true;
+  }
+  engine_->PrepareBand(format, options_, output_base_, &band_);
+
+  ImageDecoder* decoder = engine_->DecoderFor(format);
+  if (!decoder) {
+    *error = std::string("No decoder for ") + ImageFormatName(format) +
+             " images.";
+    return false;
+  }
+
+  incremental_.reset(decoder->CreateIncrementalDecoder(&band_));
+  if (!incremental_.get())
+    return true;
+
+  // Replay what was buffered while sniffing, from now on bytes go straight
+  // to the decoder.
+  std::vector<uint8_t> sniffed;
+  sniffed.swap(buffer_);
+  if (keeps_encoded_)
+    encoded_ = sniffed;
+  int64_t start = MonotonicNanoseconds();
+  bool ok = incremental_->Write(sniffed.data(), sniffed.size(), error);
+  decode_nanoseconds_ += MonotonicNanoseconds() - start;
+  return ok;
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,109 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_STREAMING_DECODER_H_
+#define ENGINE_STREAMING_DECODER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "band_resampler.h"
+#include "content_hash.h"
+#include "image_decoder.h"
+#include "pixel_buffer.h"
+#include "wallpaper_engine.h"
+
+namespace set_wallpaper_extension {
+
+// Decodes an image while it is being downloaded. Bytes are handed over in
+// whatever chunks the network delivers them. Once enough of them arrived to
+// recognize the format, they are routed to an IncrementalDecoder if the
+// engine has one for that format, otherwise they are buffered and decoded
+// in one go when the stream ends. Either way the rows are scaled and cropped
+// for the screen as they are decoded, see BandResampler, and images too
+// large to hold go straight to the output file, see
+// WallpaperEngine::PrepareBand(). Streams the engine can pass through for
+// |options| are not decoded at all, their bytes are kept for the engine. If
+// that depends on the size of the image, they are decoded and kept.
+class StreamingDecoder {
+ public:
+  // Decodes for a conversion with |options| to |output_base| plus an
+  // extension. An empty |output_base| has the image held whatever its size.
+  StreamingDecoder(WallpaperEngine* engine, const ConversionOptions& options,
+                   const std::string& output_base);
+  ~StreamingDecoder();
+
+  // Consumes the next |size| bytes of the image. On failure, returns false
+  // and describes the problem in |error|. The stream should then be aborted.
+  bool Write(const uint8_t* data, size_t size, std::string* error);
+
+  // Signals the end of the stream and stores the decoded image, laid out
+  // for the screen, in |output|, unless it went to the writer of band().
+  bool Finish(PixelBuffer* output, std::string* error);
+
+  // Where the rows went as they were decoded.
+  const BandResampler& band() const { return band_; }
+
+  // Total number of bytes received so far.
+  size_t bytes_received() const { return bytes_received_; }
+
+  // Time spent decoding so far, while the bytes arrived and in Finish(),
+  // resampling included.
+  int64_t decode_nanoseconds() const { return decode_nanoseconds_; }
+
+  // The part of decode_nanoseconds() spent resampling.
+  int64_t resample_nanoseconds() const {
+    return band_.resample_nanoseconds();
+  }
+
+  // True if the image Finish() stores was scaled or cropped, false if it is
+  // the image as decoded.
+  bool resampled() const { return band_.resampled(); }
+
+  // Hash of the bytes received so far, computed as they arrive.
+  uint64_t content_hash() const { return hasher_.Finish(); }
+
+  // True once the data is going through an IncrementalDecoder.
+  bool is_incremental() const { return incremental_.get() != NULL; }
+
+  // True if the stream is in a format the desktop takes as is, in which case
+  // encoded() holds every byte received and Finish() must not be called.
+  bool passes_through() const { return passes_through_; }
+
+  // Every byte received if the stream passes through or may pass through
+  // depending on its size, empty otherwise.
+  const std::vector<uint8_t>& encoded() const {
+    return incremental_.get() ? encoded_ : buffer_;
+  }
+
+ private:
+  // Picks the decoder once the format is known and flushes buffered bytes.
+  bool SelectDecoder(std::string* error);
+
+  WallpaperEngine* engine_;
+  ConversionOptions options_;
+  std::string output_base_;
+  bool decoder_selected_;
+  bool passes_through_;
+  bool keeps_encoded_;
+  std::unique_ptr<IncrementalDecoder> incremental_;
+  // Bytes received before the format was known, or all of them when the
+  // format has no incremental decoder or passes through.
+  std::vector<uint8_t> buffer_;
+  // Copy of the bytes fed to the IncrementalDecoder when keeps_encoded_.
+  std::vector<uint8_t> encoded_;
+  size_t bytes_received_;
+  int64_t decode_nanoseconds_;
+  ContentHasher hasher_;
+  // Where the rows go.
+  BandResampler band_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_STREAMING_DECODER_H_
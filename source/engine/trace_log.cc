@@ -0,0 +1,125 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "trace_log.h"
+
+#include <stdio.h>
+
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "file_util.h"
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// Spans kept per recording, about 3 MB. A wallpaper records around ten, so
+// this only runs out if tracing is left on for days.
+const size_t kMaxSpans = 100000;
+
+struct Span {
+  const char* name;
+  int id;
+  int thread;
+  int64_t start;
+  int64_t end;
+};
+
+struct TraceState {
+  std::mutex lock;
+  std::vector<Span> spans;
+  // Small numbers for the threads that recorded spans, in order of
+  // appearance, which read better than the ids of the system.
+  std::map<std::thread::id, int> threads;
+  size_t dropped;
+};
+
+// Never freed, spans may be recorded while the process shuts down.
+TraceState* State() {
+  static TraceState* state = new TraceState();
+  return state;
+}
+
+}  // namespace
+
+std::atomic<bool> TraceLog::enabled_(false);
+
+void TraceLog::SetEnabled(bool enabled) {
+  TraceState* state = State();
+  std::lock_guard<std::mutex> guard(state->lock);
+  if (enabled && !enabled_) {
+    state->spans.clear();
+    state->dropped = 0;
+  }
+  enabled_ = enabled;
+}
+
+void TraceLog::Record(const char* name, int id, int64_t start, int64_t end) {
+  TraceState* state = State();
+  std::lock_guard<std::mutex> guard(state->lock);
+  if (state->spans.size() >= kMaxSpans) {
+    ++state->dropped;
+    return;
+  }
+  std::map<std::thread::id, int>::iterator it =
+      state->threads.insert(std::make_pair(
+          std::this_thread::get_id(),
+          static_cast<int>(state->threads.size()) + 1)).first;
+  Span span = { name, id, it->second, start, end };
+  state->spans.push_back(span);
+}
+
+bool TraceLog::WriteJson(const std::string& path, std::string* error) {
+  std::vector<Span> spans;
+  size_t dropped;
+  {
+    TraceState* state = State();
+    std::lock_guard<std::mutex> guard(state->lock);
+    spans = state->spans;
+    dropped = state->dropped;
+  }
+
+  // Timestamps are microseconds from the first span.
+  int64_t origin = 0;
+  for (size_t i = 0; i < spans.size(); ++i) {
+    if (0 == i || spans[i].start < origin)
+      origin = spans[i].start;
+  }
+
+  std::string json = "{\"traceEvents\":[";
+  char event[256];
+  for (size_t i = 0; i < spans.size(); ++i) {
+    const Span& span = spans[i];
+    sprintf(event,
+            "%s\n{\"name\":\"%s\",\"cat\":\"wallpaper\",\"ph\":\"X\","
+            "\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+            "\"args\":{\"job\":%d}}",
+            i ? "," : "", span.name, span.thread,
+            (span.start - origin) / 1e3, (span.end - span.start) / 1e3,
+            span.id);
+    json += event;
+  }
+  sprintf(event, "\n],\"displayTimeUnit\":\"ms\","
+                 "\"otherData\":{\"dropped_spans\":%d}}\n",
+          static_cast<int>(dropped));
+  json += event;
+
+  if (!WriteBufferToFile(path, reinterpret_cast<const uint8_t*>(json.data()),
+                         json.size())) {
+    *error = "Unable to write " + path;
+    return false;
+  }
+  return true;
+}
+
+size_t TraceLog::size() {
+  TraceState* state = State();
+  std::lock_guard<std::mutex> guard(state->lock);
+  return state->spans.size();
+}
+
+}  // namespace set_wallpaper_extension
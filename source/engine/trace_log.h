@@ -0,0 +1,76 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_TRACE_LOG_H_
+#define ENGINE_TRACE_LOG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+#include "clock.h"
+
+namespace set_wallpaper_extension {
+
+// Records spans of work, such as the stages of each wallpaper, for the whole
+// process and writes them out in the Trace Event format chrome://tracing and
+// Perfetto load. Tracing is off until SetEnabled(true), and while off
+// recording a span is one relaxed load, so spans can stay in the code that
+// runs for every wallpaper. Safe to use from any thread.
+class TraceLog {
+ public:
+  static bool IsEnabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  // Starts or stops recording. Starting drops the spans of the last
+  // recording.
+  static void SetEnabled(bool enabled);
+
+  // Records the span |name| from |start| to |end|, MonotonicNanoseconds(), on
+  // the calling thread, for the wallpaper |id|, 0 if none. |name| must be a
+  // string literal. Nothing happens unless tracing is enabled.
+  static void AddSpan(const char* name, int id, int64_t start, int64_t end) {
+    if (IsEnabled())
+      Record(name, id, start, end);
+  }
+
+  // Writes the spans recorded so far to |path| as JSON.
+  static bool WriteJson(const std::string& path, std::string* error);
+
+  // Number of spans recorded so far.
+  static size_t size();
+
+ private:
+  static void Record(const char* name, int id, int64_t start, int64_t end);
+
+  static std::atomic<bool> enabled_;
+};
+
+// Records the time from its construction to its destruction as a span, for
+// code that doesn't time itself already. Only reads the clock when tracing
+// is enabled.
+class ScopedTrace {
+ public:
+  ScopedTrace(const char* name, int id)
+      : name_(name),
+        id_(id),
+        start_(TraceLog::IsEnabled() ? MonotonicNanoseconds() : 0) {}
+
+  ~ScopedTrace() {
+    if (start_)
+      TraceLog::AddSpan(name_, id_, start_, MonotonicNanoseconds());
+  }
+
+ private:
+  const char* name_;
+  int id_;
+  int64_t start_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_TRACE_LOG_H_
@@ -0,0 +1,546 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "wallpaper_engine.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "band_resampler.h"
+#include "clock.h"
+#include "content_hash.h"
+#include "file_util.h"
+#include "pixel_converter.h"
+#include "resampler.h"
+#include "stats.h"
+#include "streaming_decoder.h"
+#include "trace_log.h"
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// Enough for a few dozen 1080p JPEGs or a handful of BMPs.
+const size_t kDefaultCacheCapacity = 64 << 20;
+
+// True, with |error| saying so, if whoever asked for the conversion no
+// longer wants it.
+bool Cancelled(const ConversionOptions& options, std::string* error) {
+  if (!options.cancellation || !options.cancellation->IsCancelled())
+    return false;
+  *error = "The conversion was cancelled.";
+  return true;
+}
+
+// Sets |timing| to the time since |start| and records it as the span of the
+// |stage| of the conversion.
+void EndStage(const char* stage, const ConversionOptions& options,
+              int64_t start, int64_t* timing) {
+  int64_t end = MonotonicNanoseconds();
+  *timing = end - start;
+  TraceLog::AddSpan(stage, options.trace_id, start, end);
+}
+
+}  // namespace
+
+WallpaperEngine::WallpaperEngine()
+    : cache_(kDefaultCacheCapacity),
+      thread_count_(0),
+      worker_pool_(NULL) {
+  // Built-in codecs come first, they are faster than going through the
+  // platform and behave the same everywhere.
+  codecs_.AddDecoder(&bmp_decoder_);
+#if defined(HAVE_LIBJPEG)
+  codecs_.AddDecoder(&jpeg_decoder_);
+#endif
+#if defined(HAVE_LIBPNG)
+  codecs_.AddDecoder(&png_decoder_);
+#endif
+
+  codecs_.AddEncoder(&bmp_encoder_);
+#if defined(HAVE_LIBJPEG)
+  codecs_.AddEncoder(&jpeg_encoder_);
+#endif
+
+  // Every desktop we know of displays BMP.
+  desktop_formats_.push_back(IMAGE_FORMAT_BMP);
+}
+
+WallpaperEngine::~WallpaperEngine() {
+}
+
+void WallpaperEngine::AddDesktopFormat(ImageFormat format) {
+  if (std::find(desktop_formats_.begin(), desktop_formats_.end(), format) ==
+      desktop_formats_.end()) {
+    desktop_formats_.push_back(format);
+  }
+}
+
+bool WallpaperEngine::ConvertFile(const std::string& source_path,
+                                  const ConversionOptions& options,
+                                  const std::string& output_base,
+                                  ConversionResult* result,
+                                  std::string* error) {
+  MappedFile file;
+  if (!file.Map(source_path)) {
+    *error = "Unable to read " + source_path;
+    return false;
+  }
+  return ConvertMapped(&file, options, output_base, result, error);
+}
+
+bool WallpaperEngine::ConvertEncoded(const uint8_t* data, size_t size,
+                                     const ConversionOptions& options,
+                                     const std::string& output_base,
+                                     ConversionResult* result,
+                                     std::string* error) {
+  ConversionKey key = MakeKey(ContentHasher::Hash(data, size), size, options);
+  return ConvertEncodedWithKey(data, size, NULL, key, options, output_base,
+                               result, error);
+}
+
+bool WallpaperEngine::ConvertMapped(MappedFile* file,
+                                    const ConversionOptions& options,
+                                    const std::string& output_base,
+                                    ConversionResult* result,
+                                    std::string* error) {
+  const uint8_t* data = file->data();
+  size_t size = file->size();
+  ConversionKey key = MakeKey(ContentHasher::Hash(data, size), size, options);
+  return ConvertEncodedWithKey(data, size, file, key, options, output_base,
+                               result, error);
+}
+
+bool WallpaperEngine::ConvertStream(StreamingDecoder* decoder,
+                                    const ConversionOptions& options,
+                                    const std::string& output_base,
+                                    ConversionResult* result,
+                                    std::string* error) {
+  ConversionKey key = MakeKey(decoder->content_hash(),
+                              decoder->bytes_received(), options);
+  if (decoder->passes_through()) {
+    const std::vector<uint8_t>& encoded = decoder->encoded();
+    if (encoded.empty()) {
+      *error = "The image stream was empty.";
+      return false;
+    }
+    return ConvertEncodedWithKey(encoded.data(), encoded.size(), NULL, key,
+                                 options, output_base, result, error);
+  }
+
+  // Whatever wasn't decoded while downloading doesn't have to be.
+  std::shared_ptr<const CachedConversion> cached = LookupCache(&key);
+  if (cached)
+    return WriteCached(*cached, options, output_base, result, error);
+
+  if (Cancelled(options, error))
+    return false;
+  PixelBuffer image;
+  bool decoded;
+  {
+    ScopedTrace trace("decode", options.trace_id);
+    decoded = decoder->Finish(&image, error);
+  }
+  result->timings.resample = decoder->resample_nanoseconds();
+  result->timings.decode = decoder->decode_nanoseconds() -
+                           result->timings.resample;
+  if (!decoded)
+    return false;
+  if (decoder->band().writer())
+    return FinishWritten(decoder->band(), options, output_base, result, error);
+  const std::vector<uint8_t>& encoded = decoder->encoded();
+  if (encoded.empty())
+    return ConvertPixels(&image, options, &key, output_base, result, error);
+  return ConvertDecoded(&image, decoder->resampled(), encoded.data(),
+                        encoded.size(), NULL,
+                        SniffImageFormat(encoded.data(), encoded.size()), key,
+                        options, output_base, result, error);
+}
+
+bool WallpaperEngine::ConvertImage(PixelBuffer* image,
+                                   const ConversionOptions& options,
+                                   const std::string& output_base,
+                                   ConversionResult* result,
+                                   std::string* error) {
+  PrescalePlan plan;
+  if (PlanPrescale(options.style, image->width(), image->height(),
+                   options.screen_width, options.screen_height, &plan) &&
+      !plan.IsIdentity(image->width(), image->height())) {
+    if (Cancelled(options, error))
+      return false;
+    int64_t start = MonotonicNanoseconds();
+    bool scaled = Prescale(image, plan, error);
+    EndStage("resample", options, start, &result->timings.resample);
+    if (!scaled)
+      return false;
+  }
+  return ConvertPixels(image, options, NULL, output_base, result, error);
+}
+
+bool WallpaperEngine::CanPassThrough(ImageFormat format,
+                                     const ConversionOptions& options) const {
+  if (!options.allow_pass_through || format == IMAGE_FORMAT_UNKNOWN)
+    return false;
+  return std::find(desktop_formats_.begin(), desktop_formats_.end(),
+                   format) != desktop_formats_.end();
+}
+
+bool WallpaperEngine::NeedsDimensions(const ConversionOptions& options) const {
+  return options.style != WALLPAPER_STYLE_TILE &&
+         options.screen_width > 0 && options.screen_height > 0;
+}
+
+bool WallpaperEngine::ConvertEncodedWithKey(const uint8_t* data, size_t size,
+                                            MappedFile* mapped,
+                                            ConversionKey key,
+                                            const ConversionOptions& options,
+                                            const std::string& output_base,
+                                            ConversionResult* result,
+                                            std::string* error) {
+  ImageFormat format = SniffImageFormat(data, size);
+  if (CanPassThrough(format, options) && !NeedsDimensions(options)) {
+    result->passed_through = true;
+    result->from_cache = false;
+    result->pixels = 0;
+    return WriteOutput(data, size, format, options, output_base, result,
+                       error);
+  }
+
+  std::shared_ptr<const CachedConversion> cached = LookupCache(&key);
+  if (cached)
+    return WriteCached(*cached, options, output_base, result, error);
+
+  if (Cancelled(options, error))
+    return false;
+  // The rows are resampled as they are decoded, the span covers both.
+  BandResampler band(options.style, options.screen_width,
+                     options.screen_height, thread_count_, worker_pool_);
+  PrepareBandFor(format, key.format, options, output_base, &band);
+  int64_t start = MonotonicNanoseconds();
+  bool decoded = DecodeRows(data, size, &band, error);
+  EndStage("decode", options, start, &result->timings.decode);
+  result->timings.resample = band.resample_nanoseconds();
+  result->timings.decode -= result->timings.resample;
+  PixelBuffer image;
+  if (!decoded || !band.Finish(&image, error))
+    return false;
+  if (band.writer())
+    return FinishWritten(band, options, output_base, result, error);
+  return ConvertDecoded(&image, band.resampled(), data, size, mapped, format,
+                        key, options, output_base, result, error);
+}
+
+bool WallpaperEngine::ConvertDecoded(PixelBuffer* image, bool resampled,
+                                     const uint8_t* data, size_t size,
+                                     MappedFile* mapped,
+                                     ImageFormat format,
+                                     const ConversionKey& key,
+                                     const ConversionOptions& options,
+                                     const std::string& output_base,
+                                     ConversionResult* result,
+                                     std::string* error) {
+  // An image that didn't need resampling is already what the desktop shows.
+  if (!resampled && CanPassThrough(format, options)) {
+    image->Clear();
+    result->passed_through = true;
+    result->from_cache = false;
+    result->pixels = 0;
+    return WriteOutput(data, size, format, options, output_base, result,
+                       error);
+  }
+  // Only the pixels matter from here on.
+  if (mapped)
+    mapped->Unmap();
+  return ConvertPixels(image, options, &key, output_base, result, error);
+}
+
+bool WallpaperEngine::ConvertPixels(PixelBuffer* image,
+                                    const ConversionOptions& options,
+                                    const ConversionKey* key,
+                                    const std::string& output_base,
+                                    ConversionResult* result,
+                                    std::string* error) {
+  if (Cancelled(options, error))
+    return false;
+  int64_t convert_start = MonotonicNanoseconds();
+  bool converted = Convert(image, options.background_color, error);
+  EndStage("convert", options, convert_start, &result->timings.convert);
+  if (!converted)
+    return false;
+
+  std::shared_ptr<CachedConversion> conversion(new CachedConversion());
+  conversion->format = key ? key->format : SelectOutputFormat();
+  conversion->pixels = static_cast<int64_t>(image->width()) * image->height();
+
+  if (Cancelled(options, error))
+    return false;
+  int64_t start = MonotonicNanoseconds();
+  result->passed_through = false;
+  result->from_cache = false;
+  result->pixels = conversion->pixels;
+
+  // A BMP is the pixels behind a header. When the cache wouldn't keep it
+  // anyway, the rows go from |image| to the file rather than through a copy.
+  uint64_t bmp_size = kBmpHeaderSize +
+                      static_cast<uint64_t>(image->stride()) * image->height();
+  if (conversion->format == IMAGE_FORMAT_BMP &&
+      EncoderFor(IMAGE_FORMAT_BMP) == &bmp_encoder_ &&
+      (!key || bmp_size > cache_.capacity())) {
+    if (!WriteBmp(*image, options, output_base, result, error))
+      return false;
+    image->Clear();
+    format_selector_.RecordConversion(IMAGE_FORMAT_BMP, conversion->pixels,
+                                      MonotonicNanoseconds() - start);
+    return true;
+  }
+
+  bool encoded = Encode(*image, conversion->format, &conversion->encoded,
+                        error);
+  EndStage("encode", options, start, &result->timings.encode);
+  if (!encoded)
+    return false;
+  image->Clear();
+
+  if (!WriteOutput(conversion->encoded.data(), conversion->encoded.size(),
+                   conversion->format, options, output_base, result,
+                   error)) {
+    return false;
+  }
+  format_selector_.RecordConversion(conversion->format, conversion->pixels,
+                                    MonotonicNanoseconds() - start);
+
+  if (key)
+    cache_.Insert(*key, conversion);
+  return true;
+}
+
+void WallpaperEngine::PrepareBand(ImageFormat format,
+                                  const ConversionOptions& options,
+                                  const std::string& output_base,
+                                  BandResampler* band) {
+  PrepareBandFor(format, SelectOutputFormat(), options, output_base, band);
+}
+
+void WallpaperEngine::PrepareBandFor(ImageFormat format,
+                                     ImageFormat output_format,
+                                     const ConversionOptions& options,
+                                     const std::string& output_base,
+                                     BandResampler* band) {
+  if (CanPassThrough(format, options)) {
+    band->set_drop_whole(true);
+    return;
+  }
+  ImageEncoder* encoder = EncoderFor(output_format);
+  if (output_base.empty() || !encoder)
+    return;
+  std::unique_ptr<ImageFileWriter> writer(encoder->CreateFileWriter(
+      output_base + ImageFormatExtension(output_format)));
+  // What the cache would keep anyway is better held, and cached.
+  if (writer) {
+    band->set_writer(std::move(writer), options.background_color,
+                     cache_.capacity());
+  }
+}
+
+bool WallpaperEngine::FinishWritten(const BandResampler& band,
+                                    const ConversionOptions& options,
+                                    const std::string& output_base,
+                                    ConversionResult* result,
+                                    std::string* error) {
+  // The file is deleted along with the writer unless it is completed.
+  if (Cancelled(options, error))
+    return false;
+  ImageFileWriter* writer = band.writer();
+  result->passed_through = false;
+  result->from_cache = false;
+  result->pixels = static_cast<int64_t>(band.source_width()) *
+                   band.source_height();
+  result->output_path = output_base + ImageFormatExtension(writer->format());
+  result->format = writer->format();
+  // Converting and encoding happened between the rows being decoded.
+  result->timings.convert = band.convert_nanoseconds();
+  result->timings.encode = band.encode_nanoseconds();
+  result->timings.decode -= result->timings.convert + result->timings.encode;
+
+  int64_t start = MonotonicNanoseconds();
+  bool written = writer->Finish(error);
+  EndStage("write", options, start, &result->timings.write);
+  if (!written)
+    return false;
+  Stats::Add(STATS_BYTES_WRITTEN,
+             static_cast<int64_t>(writer->bytes_written()));
+  format_selector_.RecordConversion(writer->format(), result->pixels,
+                                    result->timings.convert +
+                                        result->timings.encode +
+                                        result->timings.write);
+  return true;
+}
+
+ConversionKey WallpaperEngine::MakeKey(uint64_t content_hash,
+                                       uint64_t content_size,
+                                       const ConversionOptions& options) {
+  ConversionKey key;
+  key.content_hash = content_hash;
+  key.content_size = content_size;
+  key.style = options.style;
+  key.screen_width = options.screen_width;
+  key.screen_height = options.screen_height;
+  key.background_color = options.background_color;
+  return key;
+}
+
+ImageFormat WallpaperEngine::SelectOutputFormat() {
+  std::vector<ImageFormat> candidates;
+  for (size_t i = 0; i < desktop_formats_.size(); ++i) {
+    if (EncoderFor(desktop_formats_[i]))
+      candidates.push_back(desktop_formats_[i]);
+  }
+  return format_selector_.Select(candidates);
+}
+
+std::shared_ptr<const CachedConversion> WallpaperEngine::LookupCache(
+    ConversionKey* key) {
+  key->format = SelectOutputFormat();
+  std::shared_ptr<const CachedConversion> cached = cache_.Lookup(*key);
+  Stats::Add(cached ? STATS_CACHE_HITS : STATS_CACHE_MISSES, 1);
+  return cached;
+}
+
+bool WallpaperEngine::WriteCached(const CachedConversion& cached,
+                                  const ConversionOptions& options,
+                                  const std::string& output_base,
+                                  ConversionResult* result,
+                                  std::string* error) {
+  result->passed_through = false;
+  result->from_cache = true;
+  result->pixels = cached.pixels;
+  return WriteOutput(cached.encoded.data(), cached.encoded.size(),
+                     cached.format, options, output_base, result, error);
+}
+
+bool WallpaperEngine::Decode(const uint8_t* data, size_t size,
+                             PixelBuffer* output, std::string* error) {
+  PixelBufferSink sink(output);
+  return DecodeRows(data, size, &sink, error);
+}
+
+bool WallpaperEngine::DecodeRows(const uint8_t* data, size_t size,
+                                 RowSink* sink, std::string* error) {
+  ImageFormat format = SniffImageFormat(data, size);
+  ImageDecoder* decoder = DecoderFor(format);
+  if (!decoder) {
+    *error = std::string("No decoder for ") + ImageFormatName(format) +
+             " images.";
+    return false;
+  }
+  return decoder->DecodeRows(data, size, sink, error);
+}
+
+bool WallpaperEngine::Resample(PixelBuffer* image, int width, int height,
+                               std::string* error) {
+  PixelBuffer scaled;
+  if (!Resampler::Resample(*image, width, height, thread_count_, worker_pool_,
+                           &scaled)) {
+    *error = "Unable to resample the image.";
+    return false;
+  }
+  image->Swap(&scaled);
+  return true;
+}
+
+bool WallpaperEngine::Prescale(PixelBuffer* image, const PrescalePlan& plan,
+                               std::string* error) {
+  PixelBuffer scaled;
+  bool ok;
+  if (plan.scaled_width == image->width() &&
+      plan.scaled_height == image->height()) {
+    // Only cropping, e.g. CENTER on a screen smaller than the image.
+    ok = scaled.Allocate(plan.width, plan.height, image->format());
+    if (ok) {
+      int bytes = plan.width * PixelBuffer::BytesPerPixel(image->format());
+      int offset = plan.crop_x * PixelBuffer::BytesPerPixel(image->format());
+      for (int y = 0; y < plan.height; ++y)
+        memcpy(scaled.row(y), image->row(plan.crop_y + y) + offset, bytes);
+    }
+  } else {
+    ok = Resampler::ResampleRegion(*image, plan.scaled_width,
+                                   plan.scaled_height, plan.crop_x,
+                                   plan.crop_y, plan.width, plan.height,
+                                   thread_count_, worker_pool_, &scaled);
+  }
+  if (!ok) {
+    *error = "Unable to resample the image.";
+    return false;
+  }
+  image->Swap(&scaled);
+  return true;
+}
+
+bool WallpaperEngine::Convert(PixelBuffer* image, uint32_t background,
+                              std::string* error) {
+  PixelBuffer converted;
+  if (!PixelConverter::ToBGR24(*image, background, &converted)) {
+    *error = "Unable to convert the image to BGR24.";
+    return false;
+  }
+  image->Swap(&converted);
+  return true;
+}
+
+bool WallpaperEngine::Encode(const PixelBuffer& image, ImageFormat format,
+                             std::vector<uint8_t>* output,
+                             std::string* error) {
+  ImageEncoder* encoder = EncoderFor(format);
+  if (!encoder) {
+    *error = std::string("No encoder for ") + ImageFormatName(format) +
+             " images.";
+    return false;
+  }
+  return encoder->Encode(image, output, error);
+}
+
+bool WallpaperEngine::WriteOutput(const uint8_t* data, size_t size,
+                                  ImageFormat format,
+                                  const ConversionOptions& options,
+                                  const std::string& output_base,
+                                  ConversionResult* result,
+                                  std::string* error) {
+  if (Cancelled(options, error))
+    return false;
+  result->output_path = output_base + ImageFormatExtension(format);
+  result->format = format;
+  int64_t start = MonotonicNanoseconds();
+  FileChunk chunk = {data, size};
+  bool written = WriteChunksToFile(result->output_path, &chunk, 1);
+  EndStage("write", options, start, &result->timings.write);
+  if (!written) {
+    *error = "Unable to write " + result->output_path;
+    return false;
+  }
+  Stats::Add(STATS_BYTES_WRITTEN, static_cast<int64_t>(size));
+  return true;
+}
+
+bool WallpaperEngine::WriteBmp(const PixelBuffer& image,
+                               const ConversionOptions& options,
+                               const std::string& output_base,
+                               ConversionResult* result,
+                               std::string* error) {
+  if (Cancelled(options, error))
+    return false;
+  result->output_path = output_base + ImageFormatExtension(IMAGE_FORMAT_BMP);
+  result->format = IMAGE_FORMAT_BMP;
+  int64_t start = MonotonicNanoseconds();
+  bool written = BmpEncoder::EncodeToFile(image, result->output_path, error);
+  EndStage("write", options, start, &result->timings.write);
+  if (!written)
+    return false;
+  int64_t size = kBmpHeaderSize +
+                 static_cast<int64_t>(image.stride()) * image.height();
+  Stats::Add(STATS_BYTES_WRITTEN, size);
+  return true;
+}
+
+}  // namespace set_wallpaper_extension
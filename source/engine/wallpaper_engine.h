@@ -0,0 +1,360 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_WALLPAPER_ENGINE_H_
+#define ENGINE_WALLPAPER_ENGINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bmp_codec.h"
+#include "cancellation_flag.h"
+#include "codec_registry.h"
+#include "conversion_cache.h"
+#include "image_decoder.h"
+#include "image_encoder.h"
+#include "jpeg_decoder.h"
+#include "jpeg_encoder.h"
+#include "output_format_selector.h"
+#include "pixel_buffer.h"
+#include "png_decoder.h"
+#include "wallpaper_layout.h"
+
+namespace set_wallpaper_extension {
+
+class BandResampler;
+class MappedFile;
+class StreamingDecoder;
+class WorkerPool;
+
+// Knobs for a single conversion.
+struct ConversionOptions {
+  ConversionOptions()
+      : style(WALLPAPER_STYLE_STRETCH),
+        screen_width(0),
+        screen_height(0),
+        background_color(0),
+        allow_pass_through(true),
+        cancellation(NULL),
+        trace_id(0) {}
+
+  // How the desktop positions the wallpaper on a |screen_width| x
+  // |screen_height| screen. When the screen size is known, the image is
+  // scaled and cropped for |style| ahead of time so it has no more pixels
+  // than are visible. Zero leaves the size of the image to the desktop.
+  WallpaperStyle style;
+  int screen_width;
+  int screen_height;
+
+  // Desktop background color as 0xRRGGBB. Transparent images are composited
+  // over it, which is what the desktop would show through them.
+  uint32_t background_color;
+
+  // Hand sources the desktop accepts as they are (see AddDesktopFormat())
+  // over untouched instead of decoding and re-encoding them.
+  bool allow_pass_through;
+
+  // Checked before each stage, the conversion fails without doing any more
+  // work or writing anything once it is set. Not owned, may be NULL.
+  const CancellationFlag* cancellation;
+
+  // Identifies the conversion in the spans its stages record, see TraceLog.
+  int trace_id;
+};
+
+// How long each stage of a conversion took, in nanoseconds. Stages that
+// didn't run, e.g. because the source passed through or was found in the
+// cache, are 0.
+struct ConversionTimings {
+  ConversionTimings()
+      : decode(0),
+        resample(0),
+        convert(0),
+        encode(0),
+        write(0) {}
+
+  int64_t decode;
+  int64_t resample;
+  int64_t convert;
+  int64_t encode;
+  int64_t write;
+};
+
+// What a conversion produced.
+struct ConversionResult {
+  ConversionResult()
+      : format(IMAGE_FORMAT_UNKNOWN),
+        passed_through(false),
+        from_cache(false),
+        pixels(0) {}
+
+  // The file that was written, the output base path plus the extension of
+  // |format|.
+  std::string output_path;
+  ImageFormat format;
+  // True if the source bytes were written without decoding them.
+  bool passed_through;
+  // True if the output was produced earlier for the same source and options
+  // and came out of the conversion cache.
+  bool from_cache;
+  // Number of pixels encoded, zero when passed through.
+  int64_t pixels;
+  ConversionTimings timings;
+};
+
+// Platform neutral image pipeline that turns a downloaded image into a file
+// the desktop can use as its background. The work is split into four stages,
+// decode, resample, pixel-convert and encode, each of which is also exposed
+// on its own so it can be benchmarked and tuned in isolation.
+//
+// Sources the desktop can already display are passed through untouched when
+// the resample stage has nothing to do for them. Everything else is encoded
+// in whichever format the desktop accepts that has proven cheapest so far,
+// see OutputFormatSelector, and kept in a ConversionCache keyed by a hash of
+// the source bytes so converting the same image again skips every stage.
+//
+// Once the platform codecs and desktop formats are set up, any number of
+// conversions may run at the same time on different threads, as long as
+// they don't write to the same output base.
+class WallpaperEngine {
+ public:
+  WallpaperEngine();
+  ~WallpaperEngine();
+
+  // Decoder for the formats the built-in decoders don't handle, typically
+  // the one the operating system provides. Not owned.
+  void AddPlatformDecoder(ImageDecoder* decoder) {
+    codecs_.AddDecoder(decoder);
+  }
+
+  // Encoder for a format the built-in encoders don't produce. Not owned.
+  void AddPlatformEncoder(ImageEncoder* encoder) {
+    codecs_.AddEncoder(encoder);
+  }
+
+  // Number of threads the resample stage may use. 0, the default, uses one
+  // per core. The output doesn't depend on it.
+  void set_thread_count(int threads) { thread_count_ = threads; }
+  int thread_count() const { return thread_count_; }
+
+  // Workers the resample stage spreads rows over, next to the thread
+  // converting. NULL, the default, keeps it on that thread. Not owned.
+  void set_worker_pool(WorkerPool* pool) { worker_pool_ = pool; }
+  WorkerPool* worker_pool() const { return worker_pool_; }
+
+  // Declares that the desktop can use files of |format| as its background.
+  // BMP is always accepted.
+  void AddDesktopFormat(ImageFormat format);
+
+  // Runs the whole pipeline on the image stored at |source_path| and writes
+  // the result to |output_base| plus an extension. On failure, returns false
+  // and describes the problem in |error|.
+  bool ConvertFile(const std::string& source_path,
+                   const ConversionOptions& options,
+                   const std::string& output_base,
+                   ConversionResult* result,
+                   std::string* error);
+
+  // Same as ConvertFile() for an encoded image held in memory.
+  bool ConvertEncoded(const uint8_t* data, size_t size,
+                      const ConversionOptions& options,
+                      const std::string& output_base,
+                      ConversionResult* result,
+                      std::string* error);
+
+  // Same as ConvertEncoded() for the image in |file|, which is unmapped as
+  // soon as the engine is done with the encoded bytes, usually right after
+  // decoding them.
+  bool ConvertMapped(MappedFile* file,
+                     const ConversionOptions& options,
+                     const std::string& output_base,
+                     ConversionResult* result,
+                     std::string* error);
+
+  // Same as ConvertFile() for an image that went through |decoder|, which
+  // must have been created with the same |options| and |output_base| and
+  // seen the whole stream.
+  bool ConvertStream(StreamingDecoder* decoder,
+                     const ConversionOptions& options,
+                     const std::string& output_base,
+                     ConversionResult* result,
+                     std::string* error);
+
+  // Runs the stages after decode on an already decoded |image|. |image| is
+  // consumed in the process.
+  bool ConvertImage(PixelBuffer* image,
+                    const ConversionOptions& options,
+                    const std::string& output_base,
+                    ConversionResult* result,
+                    std::string* error);
+
+  // True if a source of |format| may be handed to the desktop as is. Whether
+  // it actually is can depend on its dimensions, see NeedsDimensions().
+  bool CanPassThrough(ImageFormat format,
+                      const ConversionOptions& options) const;
+
+  // True if |options| call for pre-scaling, so the size of the image has to
+  // be known before deciding whether it can be passed through.
+  bool NeedsDimensions(const ConversionOptions& options) const;
+
+  // Sets |band| up for an image of |format| about to be converted with
+  // |options| to |output_base| plus an extension. If the image is left
+  // whole, its rows are dropped when it can pass through, and encoded
+  // straight into the output file when it is too large to cache, see
+  // BandResampler::set_writer(). An empty |output_base| has it held then.
+  void PrepareBand(ImageFormat format, const ConversionOptions& options,
+                   const std::string& output_base, BandResampler* band);
+
+  // Returns the decoder to use for |format|, or NULL if there is none.
+  ImageDecoder* DecoderFor(ImageFormat format) const {
+    return codecs_.DecoderFor(format);
+  }
+
+  // Returns the encoder producing |format|, or NULL if there is none.
+  ImageEncoder* EncoderFor(ImageFormat format) const {
+    return codecs_.EncoderFor(format);
+  }
+
+  // Decode stage. Picks a decoder based on the content of |data|.
+  bool Decode(const uint8_t* data, size_t size, PixelBuffer* output,
+              std::string* error);
+
+  // Same as Decode() but hands the rows to |sink| as they are decoded, so
+  // the whole image needn't be held at once.
+  bool DecodeRows(const uint8_t* data, size_t size, RowSink* sink,
+                  std::string* error);
+
+  // Resample stage. Scales |image| in place to |width| x |height|.
+  bool Resample(PixelBuffer* image, int width, int height,
+                std::string* error);
+
+  // Resample stage for a given screen. Scales and crops |image| in place as
+  // described by |plan|.
+  bool Prescale(PixelBuffer* image, const PrescalePlan& plan,
+                std::string* error);
+
+  // Pixel-convert stage. Replaces |image| with its BGR24 equivalent
+  // composited over |background|, given as 0xRRGGBB.
+  bool Convert(PixelBuffer* image, uint32_t background, std::string* error);
+
+  // Encode stage. Encodes the BGR24 |image| as |format| into |output|.
+  bool Encode(const PixelBuffer& image, ImageFormat format,
+              std::vector<uint8_t>* output, std::string* error);
+
+  // Platforms report how long the desktop took to apply each wallpaper
+  // through RecordApply() so the choice of output format accounts for it.
+  OutputFormatSelector* format_selector() { return &format_selector_; }
+
+  // Recently converted images, with hit and miss counters.
+  ConversionCache* cache() { return &cache_; }
+
+ private:
+  // ConvertEncoded() once the |key| of the data is known. If the data is
+  // the content of |mapped|, which may be NULL, it is unmapped once it isn't
+  // needed anymore.
+  bool ConvertEncodedWithKey(const uint8_t* data, size_t size,
+                             MappedFile* mapped,
+                             ConversionKey key,
+                             const ConversionOptions& options,
+                             const std::string& output_base,
+                             ConversionResult* result,
+                             std::string* error);
+
+  // Converts the already decoded |image| whose |size| encoded bytes of
+  // |format| are at |data|, in |mapped| if it isn't NULL. |resampled| tells
+  // whether |image| was already laid out for the screen while it was
+  // decoded. The encoded bytes are written instead when the conversion would
+  // leave the image as is.
+  bool ConvertDecoded(PixelBuffer* image, bool resampled,
+                      const uint8_t* data, size_t size, MappedFile* mapped,
+                      ImageFormat format,
+                      const ConversionKey& key,
+                      const ConversionOptions& options,
+                      const std::string& output_base,
+                      ConversionResult* result,
+                      std::string* error);
+
+  // Runs the stages after resample on |image|, already laid out for the
+  // screen. If |key| isn't NULL, the output is in its format and cached
+  // under it.
+  bool ConvertPixels(PixelBuffer* image,
+                     const ConversionOptions& options,
+                     const ConversionKey* key,
+                     const std::string& output_base,
+                     ConversionResult* result,
+                     std::string* error);
+
+  // PrepareBand() for an output of |output_format|.
+  void PrepareBandFor(ImageFormat format, ImageFormat output_format,
+                      const ConversionOptions& options,
+                      const std::string& output_base, BandResampler* band);
+
+  // Completes the file the writer of |band| encoded the image into while it
+  // was decoded and fills in |result| like WriteOutput().
+  bool FinishWritten(const BandResampler& band,
+                     const ConversionOptions& options,
+                     const std::string& output_base,
+                     ConversionResult* result,
+                     std::string* error);
+
+  static ConversionKey MakeKey(uint64_t content_hash, uint64_t content_size,
+                               const ConversionOptions& options);
+
+  // The format to encode the next conversion in, among the ones the desktop
+  // takes.
+  ImageFormat SelectOutputFormat();
+
+  // Picks the output format of |key| and returns the conversion cached for
+  // it, or NULL.
+  std::shared_ptr<const CachedConversion> LookupCache(ConversionKey* key);
+
+  // Writes |cached| to |output_base| plus its extension.
+  bool WriteCached(const CachedConversion& cached,
+                   const ConversionOptions& options,
+                   const std::string& output_base,
+                   ConversionResult* result,
+                   std::string* error);
+
+  // Writes |data| to |output_base| plus the extension of |format| and fills
+  // in the path and format of |result|.
+  bool WriteOutput(const uint8_t* data, size_t size, ImageFormat format,
+                   const ConversionOptions& options,
+                   const std::string& output_base, ConversionResult* result,
+                   std::string* error);
+
+  // Writes |image|, in BGR24, as a BMP at |output_base| plus its extension
+  // without encoding it in memory first, and fills in |result| like
+  // WriteOutput().
+  bool WriteBmp(const PixelBuffer& image, const ConversionOptions& options,
+                const std::string& output_base, ConversionResult* result,
+                std::string* error);
+
+  BmpDecoder bmp_decoder_;
+#if defined(HAVE_LIBJPEG)
+  JpegDecoder jpeg_decoder_;
+#endif
+#if defined(HAVE_LIBPNG)
+  PngDecoder png_decoder_;
+#endif
+
+  BmpEncoder bmp_encoder_;
+#if defined(HAVE_LIBJPEG)
+  JpegEncoder jpeg_encoder_;
+#endif
+  CodecRegistry codecs_;
+
+  std::vector<ImageFormat> desktop_formats_;
+  OutputFormatSelector format_selector_;
+  ConversionCache cache_;
+  int thread_count_;
+  WorkerPool* worker_pool_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_WALLPAPER_ENGINE_H_
@@ -0,0 +1,113 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "wallpaper_layout.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// Scales the image proportionally until it covers the whole screen, the
+// sides that stick out are cropped. Windows does the same for
+// WPSTYLE_CROPTOFIT and GNOME for "zoom". Same as
+// PreviewRenderer._renderFill().
+void PlaceFill(double screen_width, double screen_height,
+               double* width, double* height) {
+  // The aspect ratios are compared without dividing.
+  if (*width * screen_height > *height * screen_width) {
+    *width = (*width * screen_height) / *height;
+    *height = screen_height;
+  } else {
+    *height = (*height * screen_width) / *width;
+    *width = screen_width;
+  }
+}
+
+// Scales the image proportionally until it just fits on the screen, the rest
+// of the screen is left to the background color. Windows does the same for
+// WPSTYLE_KEEPASPECT and GNOME for "scaled". Same as
+// PreviewRenderer._renderFit().
+void PlaceFit(double screen_width, double screen_height,
+              double* width, double* height) {
+  if (*width * screen_height < *height * screen_width) {
+    *width = (*width * screen_height) / *height;
+    *height = screen_height;
+  } else {
+    *height = (*height * screen_width) / *width;
+    *width = screen_width;
+  }
+}
+
+// Size of the visible part of a |scaled| long span centered on a |screen|
+// long one, and where it starts in the span.
+void CropSpan(int scaled, int screen, int* offset, int* size) {
+  if (scaled > screen) {
+    *offset = (scaled - screen) / 2;
+    *size = screen;
+  } else {
+    *offset = 0;
+    *size = scaled;
+  }
+}
+
+}  // namespace
+
+WallpaperPlacement PlaceWallpaper(WallpaperStyle style,
+                                  int image_width, int image_height,
+                                  int screen_width, int screen_height) {
+  WallpaperPlacement placement;
+  placement.width = image_width;
+  placement.height = image_height;
+
+  switch (style) {
+  case WALLPAPER_STYLE_STRETCH:
+    placement.width = screen_width;
+    placement.height = screen_height;
+    return placement;
+  case WALLPAPER_STYLE_TILE:
+    return placement;
+  case WALLPAPER_STYLE_FILL:
+    PlaceFill(screen_width, screen_height,
+              &placement.width, &placement.height);
+    break;
+  case WALLPAPER_STYLE_FIT:
+    PlaceFit(screen_width, screen_height,
+             &placement.width, &placement.height);
+    break;
+  case WALLPAPER_STYLE_CENTER:
+  default:
+    break;
+  }
+
+  // Move the wallpaper to the center.
+  placement.x = (screen_width - placement.width) / 2;
+  placement.y = (screen_height - placement.height) / 2;
+  return placement;
+}
+
+bool PlanPrescale(WallpaperStyle style,
+                  int image_width, int image_height,
+                  int screen_width, int screen_height,
+                  PrescalePlan* plan) {
+  if (style == WALLPAPER_STYLE_TILE || image_width <= 0 ||
+      image_height <= 0 || screen_width <= 0 || screen_height <= 0) {
+    return false;
+  }
+
+  WallpaperPlacement placement = PlaceWallpaper(
+      style, image_width, image_height, screen_width, screen_height);
+  plan->scaled_width =
+      std::max(1, static_cast<int>(floor(placement.width + 0.5)));
+  plan->scaled_height =
+      std::max(1, static_cast<int>(floor(placement.height + 0.5)));
+  CropSpan(plan->scaled_width, screen_width, &plan->crop_x, &plan->width);
+  CropSpan(plan->scaled_height, screen_height, &plan->crop_y, &plan->height);
+  return true;
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,79 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_WALLPAPER_LAYOUT_H_
+#define ENGINE_WALLPAPER_LAYOUT_H_
+
+namespace set_wallpaper_extension {
+
+// How the wallpaper is positioned on the screen. The values are the ones of
+// PositionEnum in js/position_enum.js, which are also the WPSTYLE_* values
+// Windows expects.
+enum WallpaperStyle {
+  WALLPAPER_STYLE_CENTER = 0,
+  WALLPAPER_STYLE_TILE = 1,
+  WALLPAPER_STYLE_STRETCH = 2,
+  WALLPAPER_STYLE_FIT = 3,
+  WALLPAPER_STYLE_FILL = 4
+};
+
+// Rectangle the image covers on the screen, in screen pixels. It can extend
+// past the screen on any side, in which case that part is cropped.
+struct WallpaperPlacement {
+  WallpaperPlacement() : x(0.0), y(0.0), width(0.0), height(0.0) {}
+
+  double x;
+  double y;
+  double width;
+  double height;
+};
+
+// Computes where an |image_width| x |image_height| image lands on a
+// |screen_width| x |screen_height| screen for |style|. This is the geometry
+// of PreviewRenderer (js/preview_renderer.js) with the canvas being the screen
+// itself, so the preview and the wallpaper the engine produces agree. TILE
+// places the first tile only.
+WallpaperPlacement PlaceWallpaper(WallpaperStyle style,
+                                  int image_width, int image_height,
+                                  int screen_width, int screen_height);
+
+// Integer version of a placement that the engine can execute: scale the image
+// to |scaled_width| x |scaled_height|, then keep the |width| x |height| block
+// at |crop_x|, |crop_y| of the scaled image. The result is what is visible on
+// the screen. Centering it on the screen, which every style does for an image
+// that size, reproduces the placement.
+struct PrescalePlan {
+  PrescalePlan()
+      : scaled_width(0),
+        scaled_height(0),
+        crop_x(0),
+        crop_y(0),
+        width(0),
+        height(0) {}
+
+  // True if the plan leaves the image as it is.
+  bool IsIdentity(int image_width, int image_height) const {
+    return scaled_width == image_width && scaled_height == image_height &&
+           width == image_width && height == image_height;
+  }
+
+  int scaled_width;
+  int scaled_height;
+  int crop_x;
+  int crop_y;
+  int width;
+  int height;
+};
+
+// Fills |plan| for the placement of PlaceWallpaper(). Returns false if the
+// image can't be prepared ahead of time, which is the case for TILE, or if
+// any size is not positive.
+bool PlanPrescale(WallpaperStyle style,
+                  int image_width, int image_height,
+                  int screen_width, int screen_height,
+                  PrescalePlan* plan);
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_WALLPAPER_LAYOUT_H_
@@ -0,0 +1,155 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "worker_pool.h"
+
+#include "parallel_for.h"
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// Pool and queue of the worker running on this thread, if any, so tasks
+// posted from a task stay on the worker that posted them.
+thread_local const WorkerPool* current_pool = NULL;
+thread_local size_t current_worker = 0;
+
+}  // namespace
+
+WorkerPool::WorkerPool(int threads)
+    : pending_(0),
+      stopping_(false),
+      next_worker_(0) {
+  if (threads <= 0)
+    threads = DefaultThreadCount();
+  for (int i = 0; i < threads; ++i)
+    workers_.push_back(std::unique_ptr<Worker>(new Worker));
+  for (size_t i = 0; i < workers_.size(); ++i)
+    workers_[i]->thread = std::thread(&WorkerPool::Run, this, i);
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> hold(lock_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (size_t i = 0; i < workers_.size(); ++i)
+    workers_[i]->thread.join();
+}
+
+void WorkerPool::Post(const Task& task) {
+  size_t index;
+  {
+    std::lock_guard<std::mutex> hold(lock_);
+    if (stopping_)
+      return;
+    if (current_pool == this)
+      index = current_worker;
+    else
+      index = next_worker_++ % workers_.size();
+    // Counted before it is queued so Take() never gets ahead of the count.
+    ++pending_;
+  }
+
+  {
+    std::lock_guard<std::mutex> hold(workers_[index]->lock);
+    workers_[index]->tasks.push_back(task);
+  }
+  wake_.notify_one();
+}
+
+void WorkerPool::Run(size_t index) {
+  current_pool = this;
+  current_worker = index;
+
+  for (;;) {
+    Task task;
+    if (Take(index, &task)) {
+      task();
+      continue;
+    }
+
+    // A task counted in |pending_| may not be queued yet, or already taken
+    // by a worker that hasn't decremented it, in which case this just goes
+    // around once more.
+    std::unique_lock<std::mutex> hold(lock_);
+    wake_.wait(hold, [this]() { return stopping_ || pending_ > 0; });
+    if (stopping_)
+      return;
+  }
+}
+
+bool WorkerPool::Take(size_t index, Task* task) {
+  bool found = false;
+  {
+    Worker* own = workers_[index].get();
+    std::lock_guard<std::mutex> hold(own->lock);
+    if (!own->tasks.empty()) {
+      task->swap(own->tasks.back());
+      own->tasks.pop_back();
+      found = true;
+    }
+  }
+
+  for (size_t i = 1; !found && i < workers_.size(); ++i) {
+    Worker* victim = workers_[(index + i) % workers_.size()].get();
+    std::lock_guard<std::mutex> hold(victim->lock);
+    if (!victim->tasks.empty()) {
+      task->swap(victim->tasks.front());
+      victim->tasks.pop_front();
+      found = true;
+    }
+  }
+
+  if (found) {
+    std::lock_guard<std::mutex> hold(lock_);
+    --pending_;
+  }
+  return found;
+}
+
+std::shared_ptr<TaskSequence> TaskSequence::Create(WorkerPool* pool) {
+  return std::shared_ptr<TaskSequence>(new TaskSequence(pool));
+}
+
+TaskSequence::TaskSequence(WorkerPool* pool)
+    : pool_(pool),
+      running_(false) {
+}
+
+void TaskSequence::Post(const WorkerPool::Task& task) {
+  {
+    std::lock_guard<std::mutex> hold(lock_);
+    tasks_.push_back(task);
+    if (running_)
+      return;
+    running_ = true;
+  }
+  std::shared_ptr<TaskSequence> self = shared_from_this();
+  pool_->Post([self]() { self->RunNext(); });
+}
+
+void TaskSequence::RunNext() {
+  WorkerPool::Task task;
+  {
+    std::lock_guard<std::mutex> hold(lock_);
+    task.swap(tasks_.front());
+    tasks_.pop_front();
+  }
+
+  task();
+
+  {
+    std::lock_guard<std::mutex> hold(lock_);
+    if (tasks_.empty()) {
+      running_ = false;
+      return;
+    }
+  }
+  std::shared_ptr<TaskSequence> self = shared_from_this();
+  pool_->Post([self]() { self->RunNext(); });
+}
+
+}  // namespace set_wallpaper_extension
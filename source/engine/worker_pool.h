@@ -0,0 +1,88 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef ENGINE_WORKER_POOL_H_
+#define ENGINE_WORKER_POOL_H_
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace set_wallpaper_extension {
+
+// Long lived threads that run tasks posted from any thread. Each worker has
+// its own queue: tasks posted by a worker go to the back of its queue and it
+// takes the newest one first, which keeps the data it just touched in cache,
+// while tasks posted from elsewhere are spread over the queues. A worker that
+// runs out of tasks steals the oldest one from another worker's queue.
+class WorkerPool {
+ public:
+  typedef std::function<void()> Task;
+
+  // Starts |threads| workers, 0 meaning DefaultThreadCount().
+  explicit WorkerPool(int threads);
+
+  // Waits for the tasks that are running to return. Tasks that haven't
+  // started are discarded.
+  ~WorkerPool();
+
+  // Queues |task| to run on one of the workers.
+  void Post(const Task& task);
+
+  int thread_count() const { return static_cast<int>(workers_.size()); }
+
+ private:
+  struct Worker {
+    std::mutex lock;
+    std::deque<Task> tasks;
+    std::thread thread;
+  };
+
+  void Run(size_t index);
+
+  // Takes the next task for worker |index|, from its own queue if possible.
+  bool Take(size_t index, Task* task);
+
+  std::vector<std::unique_ptr<Worker> > workers_;
+
+  // Guards |pending_| and |stopping_|, and is what idle workers wait on.
+  std::mutex lock_;
+  std::condition_variable wake_;
+  size_t pending_;
+  bool stopping_;
+  size_t next_worker_;
+};
+
+// Runs the tasks posted to it one at a time, in the order they were posted,
+// on a WorkerPool. Different sequences run concurrently. Must be created with
+// Create() since queued tasks keep the sequence alive.
+class TaskSequence : public std::enable_shared_from_this<TaskSequence> {
+ public:
+  static std::shared_ptr<TaskSequence> Create(WorkerPool* pool);
+
+  // Queues |task| to run after every task posted before it.
+  void Post(const WorkerPool::Task& task);
+
+ private:
+  explicit TaskSequence(WorkerPool* pool);
+
+  // Runs the oldest task, then hands the rest back to the pool so one busy
+  // sequence doesn't hold on to a worker.
+  void RunNext();
+
+  WorkerPool* pool_;
+  std::mutex lock_;
+  std::deque<WorkerPool::Task> tasks_;
+  bool running_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // ENGINE_WORKER_POOL_H_
@@ -0,0 +1,66 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "gdiplus_decoder.h"
+
+#include <windows.h>
+#include <gdiplus.h>
+#include <shlwapi.h>
+#include <string.h>
+
+#include <memory>
+
+using namespace Gdiplus;
+
+namespace set_wallpaper_extension {
+
+bool GdiplusDecoder::CanDecode(ImageFormat format) const {
+  return format != IMAGE_FORMAT_UNKNOWN;
+}
+
+bool GdiplusDecoder::Decode(const uint8_t* data, size_t size,
+                            PixelBuffer* output, std::string* error) {
+  IStream* stream = SHCreateMemStream(data, static_cast<UINT>(size));
+  if (NULL == stream) {
+    *error = "Unable to create a stream for the image.";
+    return false;
+  }
+
+  std::unique_ptr<Bitmap> bitmap(new Bitmap(stream));
+  if (Ok != bitmap->GetLastStatus()) {
+    *error = "Something went wrong reading the downloaded image.";
+    bitmap.reset();
+    stream->Release();
+    return false;
+  }
+
+  // GDI+ stores PixelFormat32bppARGB as B, G, R, A in memory.
+  if (!output->Allocate(bitmap->GetWidth(), bitmap->GetHeight(),
+                        PIXEL_FORMAT_BGRA32)) {
+    *error = "Invalid image dimensions.";
+    bitmap.reset();
+    stream->Release();
+    return false;
+  }
+
+  Rect rect(0, 0, output->width(), output->height());
+  BitmapData bitmap_data;
+  bool ok = Ok == bitmap->LockBits(&rect, ImageLockModeRead,
+                                   PixelFormat32bppARGB, &bitmap_data);
+  if (ok) {
+    const uint8_t* src = static_cast<const uint8_t*>(bitmap_data.Scan0);
+    for (int y = 0; y < output->height(); ++y, src += bitmap_data.Stride)
+      memcpy(output->row(y), src, output->width() * 4);
+    bitmap->UnlockBits(&bitmap_data);
+  } else {
+    *error = "Something went wrong reading the image pixels.";
+  }
+
+  // The bitmap holds on to the stream, so it has to go first.
+  bitmap.reset();
+  stream->Release();
+  return ok;
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,24 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef GDIPLUS_DECODER_H_
+#define GDIPLUS_DECODER_H_
+
+#include "engine/image_decoder.h"
+
+namespace set_wallpaper_extension {
+
+// Decodes anything GDI+ understands. Registered with the engine as the
+// platform decoder so formats without a built-in decoder still work on
+// Windows. GDI+ must have been started by the caller.
+class GdiplusDecoder : public ImageDecoder {
+ public:
+  virtual bool CanDecode(ImageFormat format) const;
+  virtual bool Decode(const uint8_t* data, size_t size,
+                      PixelBuffer* output, std::string* error);
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // GDIPLUS_DECODER_H_
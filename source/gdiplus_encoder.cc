@@ -0,0 +1,118 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "gdiplus_encoder.h"
+
+#include <gdiplus.h>
+#include <string.h>
+
+#include <memory>
+#include <vector>
+
+using namespace Gdiplus;
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// The CLSID of the GDI+ encoder of each ImageFormat, matched by MIME type.
+struct EncoderTable {
+  EncoderTable() {
+    for (int i = 0; i < IMAGE_FORMAT_COUNT; ++i)
+      found[i] = false;
+
+    // http://msdn.microsoft.com/en-us/library/ms533843(VS.85).aspx
+    UINT num = 0;
+    UINT size = 0;
+    GetImageEncodersSize(&num, &size);
+    if (size == 0)
+      return;
+    std::vector<uint8_t> buffer(size);
+    ImageCodecInfo* codecs = reinterpret_cast<ImageCodecInfo*>(&buffer[0]);
+    if (GetImageEncoders(num, size, codecs) != Ok)
+      return;
+
+    for (UINT i = 0; i < num; ++i) {
+      char mime_type[64];
+      if (!WideCharToMultiByte(CP_UTF8, 0, codecs[i].MimeType, -1, mime_type,
+                               sizeof(mime_type), NULL, NULL))
+        continue;
+      ImageFormat format = ImageFormatForMimeType(mime_type);
+      if (format != IMAGE_FORMAT_UNKNOWN && !found[format]) {
+        clsids[format] = codecs[i].Clsid;
+        found[format] = true;
+      }
+    }
+  }
+
+  bool found[IMAGE_FORMAT_COUNT];
+  CLSID clsids[IMAGE_FORMAT_COUNT];
+};
+
+}  // namespace
+
+GdiplusEncoder::GdiplusEncoder(ImageFormat format, const CLSID& clsid)
+    : format_(format),
+      clsid_(clsid) {
+}
+
+GdiplusEncoder* GdiplusEncoder::Create(ImageFormat format) {
+  // The encoders GDI+ comes with don't change while it runs.
+  static const EncoderTable table;
+  if (format <= IMAGE_FORMAT_UNKNOWN || format >= IMAGE_FORMAT_COUNT ||
+      !table.found[format])
+    return NULL;
+  return new GdiplusEncoder(format, table.clsids[format]);
+}
+
+bool GdiplusEncoder::Encode(const PixelBuffer& input,
+                            std::vector<uint8_t>* output,
+                            std::string* error) {
+  if (input.format() != PIXEL_FORMAT_BGR24 || input.empty()) {
+    *error = "Only BGR24 images can be encoded.";
+    return false;
+  }
+
+  // PixelFormat24bppRGB is B, G, R in memory with DWORD aligned rows, which
+  // is exactly the layout of a BGR24 PixelBuffer, so GDI+ can read it in
+  // place.
+  std::unique_ptr<Bitmap> bitmap(new Bitmap(
+      input.width(), input.height(), static_cast<INT>(input.stride()),
+      PixelFormat24bppRGB, const_cast<BYTE*>(input.data())));
+  if (Ok != bitmap->GetLastStatus()) {
+    *error = "Unable to wrap the image for GDI+.";
+    return false;
+  }
+
+  IStream* stream = NULL;
+  if (FAILED(CreateStreamOnHGlobal(NULL, TRUE, &stream))) {
+    *error = "Unable to create a stream for the encoded image.";
+    return false;
+  }
+
+  bool ok = Ok == bitmap->Save(stream, &clsid_, NULL);
+  if (ok) {
+    STATSTG stat;
+    LARGE_INTEGER origin = {0};
+    ok = SUCCEEDED(stream->Stat(&stat, STATFLAG_NONAME)) &&
+         SUCCEEDED(stream->Seek(origin, STREAM_SEEK_SET, NULL));
+    if (ok) {
+      output->resize(static_cast<size_t>(stat.cbSize.QuadPart));
+      ULONG read = 0;
+      ok = output->empty() ||
+           (SUCCEEDED(stream->Read(&(*output)[0],
+                                   static_cast<ULONG>(output->size()),
+                                   &read)) &&
+            read == output->size());
+    }
+  }
+  if (!ok)
+    *error = "GDI+ was unable to encode the image.";
+
+  bitmap.reset();
+  stream->Release();
+  return ok;
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,37 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef GDIPLUS_ENCODER_H_
+#define GDIPLUS_ENCODER_H_
+
+#include <windows.h>
+
+#include "engine/image_encoder.h"
+
+namespace set_wallpaper_extension {
+
+// Encodes through the GDI+ encoder identified by |clsid|. Registered with the
+// engine as the platform encoder for formats the engine can't produce itself.
+// GDI+ must have been started by the caller.
+class GdiplusEncoder : public ImageEncoder {
+ public:
+  GdiplusEncoder(ImageFormat format, const CLSID& clsid);
+
+  // Returns a new encoder for |format|, owned by the caller, or NULL if GDI+
+  // has none. GDI+ is asked for its list of encoders the first time only.
+  static GdiplusEncoder* Create(ImageFormat format);
+
+  virtual ImageFormat format() const { return format_; }
+  virtual bool Encode(const PixelBuffer& input,
+                      std::vector<uint8_t>* output,
+                      std::string* error);
+
+ private:
+  ImageFormat format_;
+  CLSID clsid_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // GDIPLUS_ENCODER_H_
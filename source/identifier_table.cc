@@ -0,0 +1,65 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "identifier_table.h"
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// Multipliers tried for each table size before giving up on it.
+const int kAttemptsPerSize = 64;
+
+// Next odd number of a fixed pseudo random sequence (splitmix64), so the
+// table comes out the same for the same identifiers.
+uint64_t NextMultiplier(uint64_t* state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return (z ^ (z >> 31)) | 1;
+}
+
+}  // namespace
+
+IdentifierTable::IdentifierTable(const NPUTF8* const* names, size_t count)
+    : ids_(count),
+      multiplier_(0),
+      shift_(63) {
+  if (count > 0) {
+    NPN_GetStringIdentifiers(const_cast<const NPUTF8**>(names),
+                             static_cast<int32_t>(count), &ids_[0]);
+  }
+
+  // Start with a table at least twice as large as the number of names, which
+  // leaves enough room for a collision free multiplier to turn up quickly.
+  int bits = 1;
+  while ((size_t(1) << bits) < 2 * count)
+    ++bits;
+  uint64_t state = 0;
+  for (;; ++bits) {
+    for (int attempt = 0; attempt < kAttemptsPerSize; ++attempt) {
+      if (Place(NextMultiplier(&state), bits))
+        return;
+    }
+  }
+}
+
+bool IdentifierTable::Place(uint64_t multiplier, int bits) {
+  Slot empty = { NULL, -1 };
+  slots_.assign(size_t(1) << bits, empty);
+  multiplier_ = multiplier;
+  shift_ = 64 - bits;
+  for (size_t i = 0; i < ids_.size(); ++i) {
+    Slot& slot = slots_[Hash(ids_[i])];
+    if (slot.id == ids_[i])
+      continue;  // The same name twice.
+    if (slot.id != NULL)
+      return false;
+    slot.id = ids_[i];
+    slot.index = static_cast<int>(i);
+  }
+  return true;
+}
+
+}  // namespace set_wallpaper_extension
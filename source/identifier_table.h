@@ -0,0 +1,59 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef IDENTIFIER_TABLE_H_
+#define IDENTIFIER_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "npapi.h"
+#include "npruntime.h"
+
+namespace set_wallpaper_extension {
+
+// Finds which of a fixed list of names an NPIdentifier stands for with one
+// multiply and one compare. The names are interned when the table is built,
+// and the browser keeps identifiers for the life of the process, so a table
+// built once serves every plugin instance. The hash is chosen at that point
+// so that no two of the identifiers share a slot.
+class IdentifierTable {
+ public:
+  // Interns the |count| |names|. Must be called on the plugin thread.
+  IdentifierTable(const NPUTF8* const* names, size_t count);
+
+  // Position in |names| of the name |id| stands for, or -1.
+  int Find(NPIdentifier id) const {
+    const Slot& slot = slots_[Hash(id)];
+    return slot.id == id ? slot.index : -1;
+  }
+
+  NPIdentifier id(int index) const { return ids_[index]; }
+  size_t size() const { return ids_.size(); }
+
+ private:
+  struct Slot {
+    NPIdentifier id;
+    int index;
+  };
+
+  size_t Hash(NPIdentifier id) const {
+    uint64_t bits = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(id));
+    return static_cast<size_t>((bits * multiplier_) >> shift_);
+  }
+
+  // Tries to lay out |ids_| in a table of 2^|bits| slots with |multiplier|.
+  bool Place(uint64_t multiplier, int bits);
+
+  std::vector<NPIdentifier> ids_;
+  std::vector<Slot> slots_;
+  uint64_t multiplier_;
+  int shift_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // IDENTIFIER_TABLE_H_
@@ -0,0 +1,196 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#include "linux_desktop_service.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <new>
+#include <utility>
+
+#include "command_desktop_backend.h"
+#include "engine/fake_desktop_backend.h"
+
+#define CONSOLE_LOG(x) LOG_TO_CONSOLE(this, LOG_LEVEL_DEBUG, x)
+
+namespace set_wallpaper_extension {
+
+namespace {
+
+// Linux desktops have no system color, what shows around a wallpaper that
+// doesn't cover the screen is up to each of them. Most show black.
+const uint32_t kBackgroundColor = 0x000000;
+
+// Where the connectors of the graphics cards are, each with whether a
+// monitor is connected and the modes it supports, preferred one first.
+// Unlike asking the X server, this works under Wayland and without a display.
+const char kDrmPath[] = "/sys/class/drm";
+
+// The first line of the file at |path|, without the line break.
+std::string ReadFirstLine(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "r");
+  if (NULL == file)
+    return std::string();
+  char line[64];
+  std::string result;
+  if (fgets(line, sizeof(line), file)) {
+    result = line;
+    if (!result.empty() && '\n' == result[result.size() - 1])
+      result.erase(result.size() - 1);
+  }
+  fclose(file);
+  return result;
+}
+
+// The preferred size of the first connected monitor. Leaves |width| and
+// |height| alone if there is none.
+void ReadScreenSize(int* width, int* height) {
+  DIR* drm = opendir(kDrmPath);
+  if (NULL == drm)
+    return;
+  while (dirent* entry = readdir(drm)) {
+    // Connectors are named after their card, as in card0-HDMI-A-1.
+    if (NULL == strchr(entry->d_name, '-'))
+      continue;
+    std::string connector = std::string(kDrmPath) + "/" + entry->d_name;
+    if (ReadFirstLine(connector + "/status") != "connected")
+      continue;
+    int mode_width, mode_height;
+    if (2 == sscanf(ReadFirstLine(connector + "/modes").c_str(), "%dx%d",
+                    &mode_width, &mode_height) &&
+        mode_width > 0 && mode_height > 0) {
+      *width = mode_width;
+      *height = mode_height;
+      break;
+    }
+  }
+  closedir(drm);
+}
+
+// The directory of the extension under $XDG_DATA_HOME, created along with
+// its parents if they're missing.
+std::string MakeDataDirectory() {
+  std::string directory;
+  const char* data_home = getenv("XDG_DATA_HOME");
+  const char* home = getenv("HOME");
+  if (data_home && data_home[0] == '/') {
+    directory = data_home;
+  } else if (home && home[0] == '/') {
+    directory = std::string(home) + "/.local/share";
+  } else {
+    directory = "/tmp";
+  }
+  directory += "/set-wallpaper-extension";
+
+  for (size_t slash = directory.find('/', 1); ;
+       slash = directory.find('/', slash + 1)) {
+    mkdir(directory.substr(0, slash).c_str(), 0700);
+    if (std::string::npos == slash)
+      break;
+  }
+  return directory;
+}
+
+// The backend SET_WALLPAPER_SINK names, or NULL if it names none.
+DesktopBackend* CreateBackend() {
+  const char* sink = getenv("SET_WALLPAPER_SINK");
+  if (NULL == sink || '\0' == sink[0] || 0 == strcmp(sink, "command")) {
+    const char* command = getenv("SET_WALLPAPER_COMMAND");
+    return new CommandDesktopBackend(
+        command ? command : CommandDesktopBackend::kGnomeCommand);
+  }
+  if (0 == strcmp(sink, "fake"))
+    return new FakeDesktopBackend();
+  return NULL;
+}
+
+}  // namespace
+
+DesktopService* CreateDesktopService(NPP npp) {
+  std::unique_ptr<DesktopBackend> backend(CreateBackend());
+  if (!backend) {
+    // There is no console to tell yet, the browser shows what the plugin
+    // writes to stderr in its own output.
+    fprintf(stderr, "Unknown SET_WALLPAPER_SINK \"%s\", expected \"command\" "
+            "or \"fake\".\n", getenv("SET_WALLPAPER_SINK"));
+    return NULL;
+  }
+  return new(std::nothrow) LinuxDesktopService(npp, std::move(backend));
+}
+
+LinuxDesktopService::LinuxDesktopService(
+    NPP npp, std::unique_ptr<DesktopBackend> backend)
+    : DesktopService(npp, std::move(backend)),
+      directory_(MakeDataDirectory()),
+      screen_width_(0),
+      screen_height_(0),
+      style_(WALLPAPER_STYLE_FILL) {
+  ReadScreenSize(&screen_width_, &screen_height_);
+  // Next to the wallpapers rather than in /tmp, which is often in memory.
+  PixelBuffer::SetScratchDirectory(directory_);
+
+  // Desktops on Linux load wallpapers with GdkPixbuf or the like, which
+  // reads JPEG and PNG as well as BMP.
+  engine()->AddDesktopFormat(IMAGE_FORMAT_JPEG);
+  engine()->AddDesktopFormat(IMAGE_FORMAT_PNG);
+}
+
+LinuxDesktopService::~LinuxDesktopService() {
+  StopWorkers();
+}
+
+bool LinuxDesktopService::GetSystemColor(NPVariant* result) {
+  char* hex_color = static_cast<char*>(NPN_MemAlloc(7));
+  sprintf(hex_color, "%06X", kBackgroundColor);
+  STRINGN_TO_NPVARIANT(hex_color, 6, *result);
+  return true;
+}
+
+bool LinuxDesktopService::GetWallpaperStyle(NPVariant* result) {
+  INT32_TO_NPVARIANT(style_, *result);
+  return true;
+}
+
+bool LinuxDesktopService::SetWallpaper(NPVariant* result,
+                                       const StringView& image_url,
+                                       int style,
+                                       NPObject* callback) {
+  CONSOLE_LOG("SetWallpaper::URL " << image_url.ToString());
+
+  int id = StartImageDownload(image_url, style, callback);
+  if (!id)
+    return false;
+
+  style_ = static_cast<WallpaperStyle>(style);
+  INT32_TO_NPVARIANT(id, *result);
+  return true;
+}
+
+ConversionOptions LinuxDesktopService::GetConversionOptions(
+    WallpaperStyle style) {
+  // Laid out for the screen when it is known, otherwise the desktop sizes
+  // the image itself.
+  ConversionOptions options;
+  options.style = style;
+  options.screen_width = screen_width_;
+  options.screen_height = screen_height_;
+  options.background_color = kBackgroundColor;
+  return options;
+}
+
+std::string LinuxDesktopService::GetWallpaperBasePath() {
+  return directory_ + "/wallpaper";
+}
+
+void LinuxDesktopService::DownloadCompletionStatus(const char* url,
+                                                   NPReason reason) {
+  LOG_TO_CONSOLE(this, LOG_LEVEL_DEBUG, "GetURL of " << url
+                 << " done. Reason: " << reason);
+}
+
+}  // namespace set_wallpaper_extension
@@ -0,0 +1,55 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef LINUX_DESKTOP_SERVICE_H_
+#define LINUX_DESKTOP_SERVICE_H_
+
+#include "npfunctions.h"
+#include "desktop_service.h"
+
+#include <memory>
+#include <string>
+
+namespace set_wallpaper_extension {
+
+// Sets wallpapers on Linux, with the same pipeline as on Windows. Converted
+// images are dropped at one path under $XDG_DATA_HOME and handed to a
+// DesktopBackend picked with the SET_WALLPAPER_SINK environment variable:
+// - "command", the default when it isn't set, runs the shell command in
+//   SET_WALLPAPER_COMMAND, or the one GNOME takes, see CommandDesktopBackend.
+// - "fake" only records the wallpapers, for machines without a desktop such
+//   as the ones CI runs on, see FakeDesktopBackend.
+// Any other value is a mistake, CreateDesktopService() fails and the plugin
+// doesn't load.
+class LinuxDesktopService : public DesktopService {
+ public:
+  LinuxDesktopService(NPP npp, std::unique_ptr<DesktopBackend> backend);
+  ~LinuxDesktopService();
+
+  virtual bool GetSystemColor(NPVariant* result);
+  virtual bool GetWallpaperStyle(NPVariant* result);
+  virtual bool SetWallpaper(NPVariant* result, const StringView& path,
+                            int style, NPObject* callback);
+
+  virtual void DownloadCompletionStatus(const char* url, NPReason reason);
+
+ protected:
+  virtual ConversionOptions GetConversionOptions(WallpaperStyle style);
+  virtual std::string GetWallpaperBasePath();
+
+ private:
+  // The directory the wallpapers go to, created if needed. Set once.
+  std::string directory_;
+
+  // Size of the screen the images are laid out for, 0 if unknown.
+  int screen_width_;
+  int screen_height_;
+
+  // Style of the last wallpaper set. Plugin thread only.
+  WallpaperStyle style_;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // LINUX_DESKTOP_SERVICE_H_
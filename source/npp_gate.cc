@@ -3,11 +3,11 @@
 // be found in the LICENSE file.
 
 #include <stdio.h>
-#include <new>
 
 #include "npapi.h"
-#include "win_desktop_service.h"
+#include "desktop_service.h"
 
+using set_wallpaper_extension::CreateDesktopService;
 using set_wallpaper_extension::DesktopService;
 
 extern "C" {
@@ -31,7 +31,7 @@ NPError NPP_New(NPMIMEType mime_type,
     return NPERR_INVALID_INSTANCE_ERROR;
   }
 
-  DesktopService* desktop_service = new(std::nothrow)set_wallpaper_extension::WindowsDesktopService(instance);
+  DesktopService* desktop_service = CreateDesktopService(instance);
   if (desktop_service == NULL) {
     return NPERR_OUT_OF_MEMORY_ERROR;
   }
@@ -109,22 +109,47 @@ NPError NPP_NewStream(NPP instance,
                       NPStream* stream,
                       NPBool seekable,
                       uint16_t* stype) {
-  // Set stype to NP_ASFILEONLY since we need the image as a file anyway to be
-  // able to set the wallpaper. This causes NPP_StreamAsFile() to be called when
-  // the download is complete.
-  *stype = NP_ASFILEONLY;
-  return NPERR_NO_ERROR;
+  DesktopService* desktop_service = static_cast<DesktopService*>(instance->pdata);
+
+  // When streaming, use NP_NORMAL so the bytes come through NPP_Write() and
+  // get decoded while the rest of the image is still downloading. Otherwise
+  // set stype to NP_ASFILEONLY, which causes NPP_StreamAsFile() to be called
+  // once the browser wrote the whole image to disk. Images that were
+  // cancelled before their stream opened aren't downloaded at all. |type| is
+  // whatever the server claimed, the decoder goes by the leading bytes.
+  return desktop_service->BeginImageStream(stream, stype);
+}
+
+// Called by the browser before each NPP_Write() to find out how many bytes the
+// plugin is ready to accept.
+int32_t NPP_WriteReady(NPP instance, NPStream* stream) {
+  // Large chunks keep the number of round trips down, as long as the workers
+  // decoding them keep up.
+  DesktopService* desktop_service = static_cast<DesktopService*>(instance->pdata);
+  return desktop_service->ImageStreamWriteReady(stream);
+}
+
+// Called by the browser with the next chunk of an NP_NORMAL stream.
+int32_t NPP_Write(NPP instance,
+                  NPStream* stream,
+                  int32_t offset,
+                  int32_t len,
+                  void* buffer) {
+  DesktopService* desktop_service = static_cast<DesktopService*>(instance->pdata);
+  return desktop_service->WriteImageStream(stream, buffer, len);
 }
 
 // Called by the browser when GetURL request is complete and present as a file
 // in the local filesystem.
 void NPP_StreamAsFile(NPP instance, NPStream* stream, const char* fname) {
   DesktopService* desktop_service = static_cast<DesktopService*>(instance->pdata);
-  desktop_service->ImageDownloadComplete(stream, fname);
+  desktop_service->ImageFileReady(stream, fname);
 }
 
 // Called by the browser when the stream is finished.
 NPError NPP_DestroyStream(NPP instance, NPStream* stream, NPReason reason) {
+  DesktopService* desktop_service = static_cast<DesktopService*>(instance->pdata);
+  desktop_service->EndImageStream(stream, reason);
   return NPERR_NO_ERROR;
 }
 
@@ -135,7 +160,7 @@ void NPP_URLNotify(NPP instance,
                    NPReason reason,
                    void* notifyData) {
   DesktopService* desktop_service = static_cast<DesktopService*>(instance->pdata);
-  desktop_service->DownloadCompletionStatus(url, reason);
+  desktop_service->ImageDownloadFinished(url, reason, notifyData);
 }
 
 } // extern "C"
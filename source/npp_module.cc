@@ -2,6 +2,8 @@
 // Use of this source code is governed by a BSD-style license that can
 // be found in the LICENSE file.
 
+#include <string.h>
+
 #include "npapi.h"
 #include "npfunctions.h"
 
@@ -22,20 +24,21 @@ NPError OSCALL NP_GetEntryPoints(NPPluginFuncs *plugin_functions) {
   plugin_functions->event         = &NPP_HandleEvent;
   plugin_functions->getvalue      = &NPP_GetValue;
   plugin_functions->newstream     = &NPP_NewStream;
+  plugin_functions->writeready    = &NPP_WriteReady;
+  plugin_functions->write         = &NPP_Write;
   plugin_functions->asfile        = &NPP_StreamAsFile;
   plugin_functions->destroystream = &NPP_DestroyStream;
   plugin_functions->urlnotify     = &NPP_URLNotify;
   return NPERR_NO_ERROR;
 }
 
-// Provides global initialization for a plug-in.
-// Declaration: npapi.h
-// Documentation URL: https://developer.mozilla.org/en/NP_Initialize
-NPError OSCALL NP_Initialize(NPNetscapeFuncs *npnf) {
+// Keeps the list of functions the browser implements, |npnf|, for the NPN_
+// functions in npn_gate.cc to call.
+static NPError InitializeBrowserFunctions(NPNetscapeFuncs *npnf) {
   if(npnf == NULL)
     return NPERR_INVALID_FUNCTABLE_ERROR;
 
-  if(HIBYTE(npnf->version) > NP_VERSION_MAJOR)
+  if((npnf->version >> 8) > NP_VERSION_MAJOR)
     return NPERR_INCOMPATIBLE_VERSION_ERROR;
 
   if(npnf->size < sizeof(NPNetscapeFuncs)) 
@@ -45,6 +48,52 @@ NPError OSCALL NP_Initialize(NPNetscapeFuncs *npnf) {
   return NPERR_NO_ERROR;
 }
 
+// Provides global initialization for a plug-in.
+// Declaration: npapi.h
+// Documentation URL: https://developer.mozilla.org/en/NP_Initialize
+#if defined(XP_UNIX) && !defined(XP_MACOSX)
+// Browsers on unix don't call NP_GetEntryPoints, they pass the list to fill
+// in here instead.
+NPError OSCALL NP_Initialize(NPNetscapeFuncs *npnf,
+                             NPPluginFuncs *plugin_functions) {
+  NPError error = InitializeBrowserFunctions(npnf);
+  if (error != NPERR_NO_ERROR)
+    return error;
+  return NP_GetEntryPoints(plugin_functions);
+}
+#else
+NPError OSCALL NP_Initialize(NPNetscapeFuncs *npnf) {
+  return InitializeBrowserFunctions(npnf);
+}
+#endif
+
+#if defined(XP_UNIX) && !defined(XP_MACOSX)
+// On Windows the browser reads these from the version resource
+// (setwallpaper_plugin.rc), on unix it asks the plugin.
+char* NP_GetMIMEDescription() {
+  return const_cast<char*>(
+      "application/x-vnd-set-wallpaper::Set Wallpaper Plugin");
+}
+
+char* NP_GetPluginVersion() {
+  return const_cast<char*>("3.0.0.0");
+}
+
+NPError OSCALL NP_GetValue(void* future, NPPVariable variable, void* value) {
+  switch (variable) {
+  case NPPVpluginNameString:
+    *static_cast<const char**>(value) = "Set Wallpaper Plugin";
+    return NPERR_NO_ERROR;
+  case NPPVpluginDescriptionString:
+    *static_cast<const char**>(value) =
+        "NPAPI Plugin that sets an image as a wallpaper";
+    return NPERR_NO_ERROR;
+  default:
+    return NPERR_INVALID_PARAM;
+  }
+}
+#endif
+
 // Provides global deinitialization for a plug-in.
 // Declaration: npapi.h
 // Documentation URL: https://developer.mozilla.org/en/NP_Shutdown
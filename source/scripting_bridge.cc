@@ -4,22 +4,60 @@
 
 #include "scripting_bridge.h"
 
-#include "win_desktop_service.h"
+#include "desktop_service.h"
+#include "identifier_table.h"
 
 namespace set_wallpaper_extension {
 
-ScriptingBridge::ScriptingBridge(NPP npp)
-    : npp_(npp),
-      id_system_color_(NPN_GetStringIdentifier("systemColor")),
-      id_style_(NPN_GetStringIdentifier("wallpaperStyle")),
-      id_wallaper_(NPN_GetStringIdentifier("setWallpaper")),
-      id_debug_(NPN_GetStringIdentifier("debug")) {
-  method_table_.insert(MethodMap::value_type(id_system_color_, &ScriptingBridge::GetSystemColor));
-  method_table_.insert(MethodMap::value_type(id_style_, &ScriptingBridge::GetWallpaperStyle));
-  method_table_.insert(MethodMap::value_type(id_wallaper_, &ScriptingBridge::SetWallpaper));
+namespace {
+
+// A method or property script sees on the plugin object. Methods have a
+// |method|, properties a |get| and possibly a |set|.
+struct Member {
+  const NPUTF8* name;
+  ScriptingBridge::MethodThunk method;
+  ScriptingBridge::GetPropertySelector get;
+  ScriptingBridge::SetPropertyThunk set;
+};
+
+const Member kMembers[] = {
+  { "systemColor", NP_METHOD(ScriptingBridge, GetSystemColor), NULL, NULL },
+  { "wallpaperStyle", NP_METHOD(ScriptingBridge, GetWallpaperStyle), NULL,
+    NULL },
+  { "setWallpaper", NP_METHOD(ScriptingBridge, SetWallpaper), NULL, NULL },
+  { "cancelWallpaper", NP_METHOD(ScriptingBridge, CancelWallpaper), NULL,
+    NULL },
+  { "writeTrace", NP_METHOD(ScriptingBridge, WriteTrace), NULL, NULL },
+  { "stats", NULL, &ScriptingBridge::GetStats, NULL },
+  { "debug", NULL, &ScriptingBridge::GetDebug,
+    NP_SETTER(ScriptingBridge, SetDebug) },
+  { "streaming", NULL, &ScriptingBridge::GetStreaming,
+    NP_SETTER(ScriptingBridge, SetStreaming) },
+  { "tracing", NULL, &ScriptingBridge::GetTracing,
+    NP_SETTER(ScriptingBridge, SetTracing) },
+};
+
+const size_t kMemberCount = sizeof(kMembers) / sizeof(kMembers[0]);
+
+// The member |name| stands for, or NULL. The identifiers of kMembers are
+// interned by the first plugin instance and shared by the others. The table
+// is never freed, just like the identifiers themselves.
+const Member* FindMember(NPIdentifier name) {
+  static const IdentifierTable* identifiers = NULL;
+  if (NULL == identifiers) {
+    const NPUTF8* names[kMemberCount];
+    for (size_t i = 0; i < kMemberCount; ++i)
+      names[i] = kMembers[i].name;
+    identifiers = new IdentifierTable(names, kMemberCount);
+  }
+  int index = identifiers->Find(name);
+  return index < 0 ? NULL : &kMembers[index];
+}
+
+}  // namespace
 
-  get_property_table_.insert(GetPropMap::value_type(id_debug_, &ScriptingBridge::GetDebug));
-  set_property_table_.insert(SetPropMap::value_type(id_debug_, &ScriptingBridge::SetDebug));
+ScriptingBridge::ScriptingBridge(NPP npp)
+    : npp_(npp) {
 }
 
 ScriptingBridge::~ScriptingBridge() {
@@ -80,8 +118,8 @@ void ScriptingBridge::Invalidate(NPObject*) {
 // Called by NPN_HasMethod, declared in npruntime.h
 // Documentation URL: https://developer.mozilla.org/en/NPClass
 bool ScriptingBridge::HasMethod(NPObject* object, NPIdentifier name) {
-  ScriptingBridge* bridge = static_cast<ScriptingBridge*>(object);
-  return bridge->method_table_.end() != bridge->method_table_.find(name);
+  const Member* member = FindMember(name);
+  return member && member->method;
 }
 
 // Called by the browser to invoke a function object whose name is |name|.
@@ -93,11 +131,11 @@ bool ScriptingBridge::Invoke(NPObject* object,
                              uint32_t arg_count,
                              NPVariant* result) {
   ScriptingBridge* bridge = static_cast<ScriptingBridge*>(object);
-  MethodMap::iterator I = bridge->method_table_.find(name);
-  if (I == bridge->method_table_.end()) {
+  const Member* member = FindMember(name);
+  if (NULL == member || NULL == member->method) {
     return false;
   }
-  return (bridge->*(I->second))(args, arg_count, result);
+  return member->method(bridge, args, arg_count, result);
 }
 
 // Called by the browser to invoke the default method on an NPObject. In this
@@ -115,8 +153,8 @@ bool ScriptingBridge::InvokeDefault(NPObject*, const NPVariant*, uint32_t, NPVar
 // npruntime.h Documentation URL: https://developer.mozilla.org/en/NPClass
 bool ScriptingBridge::HasProperty(NPObject* object,
                                   NPIdentifier name) {
-  ScriptingBridge* bridge = static_cast<ScriptingBridge*>(object);
-  return bridge->get_property_table_.end() != bridge->get_property_table_.find(name);
+  const Member* member = FindMember(name);
+  return member && member->get;
 }
 
 // Returns the value of the property called |name| in |result| and true.
@@ -127,11 +165,11 @@ bool ScriptingBridge::GetProperty(NPObject* object,
                                   NPIdentifier name, NPVariant* result) {
   ScriptingBridge* bridge = static_cast<ScriptingBridge*>(object);
   VOID_TO_NPVARIANT(*result);
-  GetPropMap::iterator I = bridge->get_property_table_.find(name);
-  if (I == bridge->get_property_table_.end()) {
+  const Member* member = FindMember(name);
+  if (NULL == member || NULL == member->get) {
     return false;
   }
-  return (bridge->*(I->second))(result);
+  return (bridge->*(member->get))(result);
 }
 
 // Sets the property |name| of |object| to |value| and return true.
@@ -142,11 +180,11 @@ bool ScriptingBridge::GetProperty(NPObject* object,
 bool ScriptingBridge::SetProperty(NPObject* object,
                                   NPIdentifier name, const NPVariant* value) {
   ScriptingBridge* bridge = static_cast<ScriptingBridge*>(object);
-  SetPropMap::iterator I = bridge->set_property_table_.find(name);
-  if (I == bridge->set_property_table_.end()) {
+  const Member* member = FindMember(name);
+  if (NULL == member || NULL == member->set) {
     return false;
   }
-  return (bridge->*(I->second))(value);
+  return member->set(bridge, value);
 }
 
 // Removes the property |name| from |object| and returns true.
@@ -160,9 +198,7 @@ bool ScriptingBridge::RemoveProperty(NPObject*, NPIdentifier) {
 
 // =============================================================================
 
-bool ScriptingBridge::GetSystemColor(const NPVariant* args,
-                                     uint32_t arg_count,
-                                     NPVariant* result) {
+bool ScriptingBridge::GetSystemColor(NPVariant* result) {
   DesktopService* desktop_service = static_cast<DesktopService*>(npp_->pdata);
   if (desktop_service) {
     return desktop_service->GetSystemColor(result);
@@ -170,9 +206,7 @@ bool ScriptingBridge::GetSystemColor(const NPVariant* args,
   return false;
 }
 
-bool ScriptingBridge::GetWallpaperStyle(const NPVariant* args,
-                                        uint32_t arg_count,
-                                        NPVariant* result) {
+bool ScriptingBridge::GetWallpaperStyle(NPVariant* result) {
   DesktopService* desktop_service = static_cast<DesktopService*>(npp_->pdata);
   if (desktop_service) {
     return desktop_service->GetWallpaperStyle(result);
@@ -180,39 +214,38 @@ bool ScriptingBridge::GetWallpaperStyle(const NPVariant* args,
   return false;
 }
 
-bool ScriptingBridge::SetWallpaper(const NPVariant* args,
-                                   uint32_t arg_count,
-                                   NPVariant* result) {
-  // The JavaScript signature must have three arguments, otherwise just fail
-  // silently.
-  if (arg_count != 2)
-    return false;
-
-  const NPVariant pathArgument = args[0];
-  const NPVariant styleArgument = args[1];
+bool ScriptingBridge::SetWallpaper(NPVariant* result, StringView url,
+                                   int32_t style, NPObject* callback) {
+  DesktopService* desktop_service = static_cast<DesktopService*>(npp_->pdata);
+  if (desktop_service)
+    return desktop_service->SetWallpaper(result, url, style, callback);
+  return false;
+}
 
-  // Verify the arguments, we don't want to deal with any casts here.
-  // Chrome has this weird bug http://crbug.com/68175 that doesn't like ints.
-  if (pathArgument.type != NPVariantType_String || 
-      (styleArgument.type != NPVariantType_Int32 &&
-       styleArgument.type != NPVariantType_Double)) {
+bool ScriptingBridge::CancelWallpaper(NPVariant* result, int32_t id) {
+  DesktopService* desktop_service = static_cast<DesktopService*>(npp_->pdata);
+  if (NULL == desktop_service)
     return false;
-  }
-
-  const NPString path = NPVARIANT_TO_STRING(pathArgument);
-  int32_t style = 0;
-  if (styleArgument.type == NPVariantType_Int32)
-    style = NPVARIANT_TO_INT32(styleArgument);
-  else
-    style = (int32_t) NPVARIANT_TO_DOUBLE(styleArgument);
-
+  BOOLEAN_TO_NPVARIANT(desktop_service->CancelWallpaper(id), *result);
+  return true;
+}
 
+bool ScriptingBridge::WriteTrace(NPVariant* result) {
   DesktopService* desktop_service = static_cast<DesktopService*>(npp_->pdata);
   if (desktop_service)
-    return desktop_service->SetWallpaper(result, path, style);
+    return desktop_service->WriteTrace(result);
   return false;
 }
 
+bool ScriptingBridge::GetStats(NPVariant* value) {
+  DesktopService* desktop_service = static_cast<DesktopService*>(npp_->pdata);
+  if (NULL == desktop_service) {
+    VOID_TO_NPVARIANT(*value);
+    return false;
+  }
+  return desktop_service->GetStats(value);
+}
+
 bool ScriptingBridge::GetDebug(NPVariant* value) {
   DesktopService* desktop_service = static_cast<DesktopService*>(npp_->pdata);
   if (NULL == desktop_service) {
@@ -223,17 +256,53 @@ bool ScriptingBridge::GetDebug(NPVariant* value) {
   return true;
 }
 
-bool ScriptingBridge::SetDebug(const NPVariant* value) {
+bool ScriptingBridge::SetDebug(bool value) {
   DesktopService* desktop_service = static_cast<DesktopService*>(npp_->pdata);
   if (NULL == desktop_service) {
     return false;
   }
 
-  if (NPVariantType_Bool != value->type) {
+  desktop_service->set_is_debug(value);
+  return true;
+}
+
+bool ScriptingBridge::GetStreaming(NPVariant* value) {
+  DesktopService* desktop_service = static_cast<DesktopService*>(npp_->pdata);
+  if (NULL == desktop_service) {
+    VOID_TO_NPVARIANT(*value);
+    return false;
+  }
+  BOOLEAN_TO_NPVARIANT(desktop_service->is_streaming(), *value);
+  return true;
+}
+
+bool ScriptingBridge::SetStreaming(bool value) {
+  DesktopService* desktop_service = static_cast<DesktopService*>(npp_->pdata);
+  if (NULL == desktop_service) {
+    return false;
+  }
+
+  desktop_service->set_is_streaming(value);
+  return true;
+}
+
+bool ScriptingBridge::GetTracing(NPVariant* value) {
+  DesktopService* desktop_service = static_cast<DesktopService*>(npp_->pdata);
+  if (NULL == desktop_service) {
+    VOID_TO_NPVARIANT(*value);
+    return false;
+  }
+  BOOLEAN_TO_NPVARIANT(desktop_service->is_tracing(), *value);
+  return true;
+}
+
+bool ScriptingBridge::SetTracing(bool value) {
+  DesktopService* desktop_service = static_cast<DesktopService*>(npp_->pdata);
+  if (NULL == desktop_service) {
     return false;
   }
 
-  desktop_service->set_is_debug(NPVARIANT_TO_BOOLEAN(*value));
+  desktop_service->set_is_tracing(value);
   return true;
 }
 
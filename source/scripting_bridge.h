@@ -5,24 +5,22 @@
 #ifndef SCRIPTING_BRIDGE_H_
 #define SCRIPTING_BRIDGE_H_
 
-#include <map>
-
 #include "npapi.h"
 #include "npfunctions.h"
+#include "variant_binding.h"
 
 namespace set_wallpaper_extension {
   
 // The class that gets exposed to the browser code.
 class ScriptingBridge : public NPObject {
  public:
-  typedef bool (ScriptingBridge::*MethodSelector)(const NPVariant* args,
-                                                  uint32_t arg_count,
-                                                  NPVariant* result);
+  // Methods and setters are called through thunks NP_METHOD() and
+  // NP_SETTER() generate from their C++ signature, see variant_binding.h.
+  typedef bool (*MethodThunk)(ScriptingBridge* bridge, const NPVariant* args,
+                              uint32_t arg_count, NPVariant* result);
   typedef bool (ScriptingBridge::*GetPropertySelector)(NPVariant* value);
-  typedef bool (ScriptingBridge::*SetPropertySelector)(const NPVariant* result);
-  typedef std::map<NPIdentifier, MethodSelector>      MethodMap;
-  typedef std::map<NPIdentifier, GetPropertySelector> GetPropMap;
-  typedef std::map<NPIdentifier, SetPropertySelector> SetPropMap;
+  typedef bool (*SetPropertyThunk)(ScriptingBridge* bridge,
+                                   const NPVariant* value);
 
   explicit ScriptingBridge(NPP npp);
   virtual ~ScriptingBridge();
@@ -51,34 +49,40 @@ class ScriptingBridge : public NPObject {
 
   // These methods are exposed via the scripting bridge to the browser.
   // Each one is mapped to a string id, which is the name of the method that
-  // the broswer sees. Each of these methods wraps a method in the associated
-  // DesktopService object, which is where the actual implementation lies.
+  // the broswer sees, by the kMembers table in scripting_bridge.cc. Each of
+  // these methods wraps a method in the associated DesktopService object,
+  // which is where the actual implementation lies.
 
   // Gets the system background color.
-  bool GetSystemColor(const NPVariant* args, uint32_t arg_count,
-                      NPVariant* result);
+  bool GetSystemColor(NPVariant* result);
   // Gets the tile and wallpaper style.
-  bool GetWallpaperStyle(const NPVariant* args, uint32_t arg_count,
-                         NPVariant* result);
-  // Sets the wallpaper.
-  bool SetWallpaper(const NPVariant* args, uint32_t arg_count,
-                    NPVariant* result);
+  bool GetWallpaperStyle(NPVariant* result);
+  // Sets the wallpaper to the image at |url| with |style|. |callback| is
+  // optional.
+  bool SetWallpaper(NPVariant* result, StringView url, int32_t style,
+                    NPObject* callback);
+  // Cancels the wallpaper SetWallpaper() returned |id| for.
+  bool CancelWallpaper(NPVariant* result, int32_t id);
+  // Writes the spans traced so far to a file and returns its path.
+  bool WriteTrace(NPVariant* result);
+
+  // Accessor for the read-only stats property.
+  bool GetStats(NPVariant* value);
 
   // Accessor/mutator for the debug property.
   bool GetDebug(NPVariant* value);
-  bool SetDebug(const NPVariant* value);
+  bool SetDebug(bool value);
 
- private:
-  NPP npp_;
+  // Accessor/mutator for the streaming property.
+  bool GetStreaming(NPVariant* value);
+  bool SetStreaming(bool value);
 
-  NPIdentifier id_system_color_;
-  NPIdentifier id_wallaper_;
-  NPIdentifier id_style_;
-  NPIdentifier id_debug_;
+  // Accessor/mutator for the tracing property.
+  bool GetTracing(NPVariant* value);
+  bool SetTracing(bool value);
 
-  MethodMap method_table_;
-  GetPropMap get_property_table_;
-  SetPropMap set_property_table_;
+ private:
+  NPP npp_;
 };
 
 }  // namespace set_wallpaper_extension
@@ -0,0 +1,209 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef VARIANT_BINDING_H_
+#define VARIANT_BINDING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+#include "npapi.h"
+#include "npruntime.h"
+
+namespace set_wallpaper_extension {
+
+// A string script passed in, pointing into the NPVariant it came from, so it
+// is only valid during the call. It is not NUL terminated: use ToString()
+// where a C string is needed.
+class StringView {
+ public:
+  StringView() : data_(NULL), size_(0) {}
+  StringView(const NPUTF8* data, size_t size) : data_(data), size_(size) {}
+
+  const NPUTF8* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return 0 == size_; }
+
+  std::string ToString() const { return std::string(data_, size_); }
+
+ private:
+  const NPUTF8* data_;
+  size_t size_;
+};
+
+// Converts |variant| to the type of |value|, the way script values should
+// map to a C++ argument of that type, and returns whether it could.
+inline bool FromVariant(const NPVariant& variant, bool* value) {
+  if (!NPVARIANT_IS_BOOLEAN(variant))
+    return false;
+  *value = NPVARIANT_TO_BOOLEAN(variant);
+  return true;
+}
+
+// Numbers may arrive as a Double even when they are integers, see
+// http://crbug.com/68175. Doubles that are NaN, infinite or out of range
+// don't convert; the comparison is false for NaN.
+inline bool FromVariant(const NPVariant& variant, int32_t* value) {
+  if (NPVARIANT_IS_INT32(variant)) {
+    *value = NPVARIANT_TO_INT32(variant);
+    return true;
+  }
+  if (NPVARIANT_IS_DOUBLE(variant)) {
+    double number = NPVARIANT_TO_DOUBLE(variant);
+    if (!(number > INT32_MIN - 1.0 && number < INT32_MAX + 1.0))
+      return false;
+    *value = static_cast<int32_t>(number);
+    return true;
+  }
+  return false;
+}
+
+inline bool FromVariant(const NPVariant& variant, double* value) {
+  if (NPVARIANT_IS_DOUBLE(variant)) {
+    *value = NPVARIANT_TO_DOUBLE(variant);
+    return true;
+  }
+  if (NPVARIANT_IS_INT32(variant)) {
+    *value = NPVARIANT_TO_INT32(variant);
+    return true;
+  }
+  return false;
+}
+
+inline bool FromVariant(const NPVariant& variant, StringView* value) {
+  if (!NPVARIANT_IS_STRING(variant))
+    return false;
+  const NPString& string = NPVARIANT_TO_STRING(variant);
+  *value = StringView(string.UTF8Characters, string.UTF8Length);
+  return true;
+}
+
+// Objects are optional: null, undefined and a missing argument are NULL.
+// Not retained.
+inline bool FromVariant(const NPVariant& variant, NPObject** value) {
+  if (NPVARIANT_IS_OBJECT(variant)) {
+    *value = NPVARIANT_TO_OBJECT(variant);
+    return true;
+  }
+  if (NPVARIANT_IS_NULL(variant) || NPVARIANT_IS_VOID(variant)) {
+    *value = NULL;
+    return true;
+  }
+  return false;
+}
+
+namespace internal {
+
+template <size_t... Indices>
+struct IndexList {};
+
+template <size_t Count, size_t... Indices>
+struct MakeIndexList : MakeIndexList<Count - 1, Count - 1, Indices...> {};
+
+template <size_t... Indices>
+struct MakeIndexList<0, Indices...> {
+  typedef IndexList<Indices...> type;
+};
+
+// The argument at |index|, or undefined if script passed fewer.
+inline const NPVariant& ArgumentAt(const NPVariant* args, uint32_t arg_count,
+                                   size_t index) {
+  static const NPVariant kVoid = { NPVariantType_Void, { false } };
+  return index < arg_count ? args[index] : kVoid;
+}
+
+inline bool AllTrue(const bool* values, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    if (!values[i])
+      return false;
+  }
+  return true;
+}
+
+}  // namespace internal
+
+// Binds a C++ method of |Object| declared as
+//   bool Method(NPVariant* result, Args... args);
+// to the NPClass calling convention: Invoke<&Object::Method>() checks and
+// converts the arguments script passed with FromVariant() and calls it, or
+// returns false if one doesn't convert or there are too many. Arguments
+// script left out are undefined, so only the optional ones may be. Nothing
+// is copied or allocated on the way. Use NP_METHOD() to name the thunk.
+template <typename Object, typename... Args>
+class NPMethod {
+ public:
+  typedef bool (Object::*Method)(NPVariant* result, Args... args);
+  typedef std::tuple<typename std::decay<Args>::type...> Values;
+
+  template <Method method>
+  static bool Invoke(Object* object, const NPVariant* args,
+                     uint32_t arg_count, NPVariant* result) {
+    if (arg_count > sizeof...(Args))
+      return false;
+    Values values;
+    typename internal::MakeIndexList<sizeof...(Args)>::type indices;
+    if (!Convert(args, arg_count, &values, indices))
+      return false;
+    return Call<method>(object, result, values, indices);
+  }
+
+ private:
+  template <size_t... Indices>
+  static bool Convert(const NPVariant* args, uint32_t arg_count,
+                      Values* values, internal::IndexList<Indices...>) {
+    // The leading true keeps the array from being empty.
+    const bool converted[] = {
+      true,
+      FromVariant(internal::ArgumentAt(args, arg_count, Indices),
+                  &std::get<Indices>(*values))...
+    };
+    return internal::AllTrue(converted, sizeof(converted) / sizeof(bool));
+  }
+
+  template <Method method, size_t... Indices>
+  static bool Call(Object* object, NPVariant* result, const Values& values,
+                   internal::IndexList<Indices...>) {
+    return (object->*method)(result, std::get<Indices>(values)...);
+  }
+};
+
+// Binds a setter of |Object| declared as bool Setter(T value) the same way:
+// Set<&Object::Setter>() converts the value script assigns.
+template <typename Object, typename T>
+class NPSetter {
+ public:
+  typedef bool (Object::*Setter)(T value);
+
+  template <Setter setter>
+  static bool Set(Object* object, const NPVariant* variant) {
+    typename std::decay<T>::type value;
+    return FromVariant(*variant, &value) && (object->*setter)(value);
+  }
+};
+
+// Only used through decltype, to deduce the binding of a method.
+template <typename Object, typename... Args>
+NPMethod<Object, Args...> MethodBinding(
+    bool (Object::*)(NPVariant*, Args...));
+template <typename Object, typename T>
+NPSetter<Object, T> SetterBinding(bool (Object::*)(T));
+
+}  // namespace set_wallpaper_extension
+
+// The thunk that calls Class::method with the arguments of an NPClass invoke.
+#define NP_METHOD(Class, method) \
+  (&decltype(::set_wallpaper_extension::MethodBinding(&Class::method)) \
+      ::Invoke<&Class::method>)
+
+// The thunk that calls Class::method with the value of an NPClass
+// setProperty.
+#define NP_SETTER(Class, method) \
+  (&decltype(::set_wallpaper_extension::SetterBinding(&Class::method)) \
+      ::Set<&Class::method>)
+
+#endif  // VARIANT_BINDING_H_
@@ -0,0 +1,81 @@
+// Copyright 2012 Mohamed Mansour. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can
+// be found in the LICENSE file.
+
+#ifndef WALLPAPER_JOB_H_
+#define WALLPAPER_JOB_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "npapi.h"
+#include "npruntime.h"
+#include "engine/cancellation_flag.h"
+#include "engine/wallpaper_engine.h"
+
+namespace set_wallpaper_extension {
+
+// What became of a SetWallpaper() call. Handed to the callback script passed
+// to it, so the page can tell when the wallpaper changed and where the time
+// went.
+struct WallpaperReport {
+  WallpaperReport() : success(false), queue(0), download(0), apply(0) {}
+
+  bool success;
+  // What went wrong, empty on success.
+  std::string error;
+  // The conversion, including how long each of its stages took.
+  ConversionResult conversion;
+  // Nanoseconds spent waiting for a worker, downloading the image and
+  // having the desktop apply it.
+  int64_t queue;
+  int64_t download;
+  int64_t apply;
+};
+
+// One SetWallpaper() call on its way from the download request to its
+// callback. The browser hands it back as the notifyData of the download and
+// its stream, so any number of jobs can be in flight without mixing up their
+// images and styles.
+struct WallpaperJob {
+  WallpaperJob(int id, const ConversionOptions& options, NPObject* callback)
+      : id(id),
+        options(options),
+        callback(callback),
+        stream(NULL),
+        download_start(0),
+        download_finished(false) {
+    this->options.cancellation = &cancellation;
+    this->options.trace_id = id;
+  }
+
+  // Identifies the job to script, SetWallpaper() returns it.
+  const int id;
+
+  // Set from the plugin thread once the wallpaper isn't wanted anymore,
+  // because a newer one was asked for or script cancelled it. Every stage
+  // checks it before starting, and |options| hand it to the engine.
+  CancellationFlag cancellation;
+  ConversionOptions options;
+
+  // Retained until the outcome is reported, may be NULL. Only used on the
+  // plugin thread.
+  NPObject* callback;
+
+  // The stream delivering the image while the browser has it open, so a
+  // cancelled download can be aborted. Only used on the plugin thread.
+  NPStream* stream;
+
+  // When the download was requested, and whether its outcome was taken care
+  // of. Only used on the plugin thread.
+  int64_t download_start;
+  bool download_finished;
+
+  // Filled in as the job makes progress, by one thread at a time.
+  WallpaperReport report;
+};
+
+}  // namespace set_wallpaper_extension
+
+#endif  // WALLPAPER_JOB_H_
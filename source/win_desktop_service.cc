@@ -11,38 +11,45 @@
 #include <shlobj.h>
 #include <urlmon.h>
 #include <userenv.h>
+#include <new>
 #include <sstream>
 
+#include "active_desktop_backend.h"
+#include "engine/clock.h"
 #include "scripting_bridge.h"
 
-#define CONSOLE_LOG(x) \
-do { \
-  std::ostringstream oss; \
-  oss << x; \
-  WriteToConsole(oss.str().c_str()); \
-} while (0)
+#define CONSOLE_LOG(x) LOG_TO_CONSOLE(this, LOG_LEVEL_DEBUG, x)
   
-#define CONSOLE_ERR(x) \
-do { \
-  std::ostringstream oss; \
-  oss << "ERROR: " << x << " " << GetLastError(); \
-  NPN_SetException(GetScriptableObject(), oss.str().c_str()); \
-  WriteToConsole(oss.str().c_str()); \
-} while (0)
-
 using namespace Gdiplus;
 
 namespace set_wallpaper_extension {
 
+DesktopService* CreateDesktopService(NPP npp) {
+  return new(std::nothrow) WindowsDesktopService(npp);
+}
+
 WindowsDesktopService::WindowsDesktopService(NPP npp)
-    : DesktopService(npp),
-      gdiplus_token_(NULL),
-      style_(0) {
+    : DesktopService(npp, std::unique_ptr<DesktopBackend>(
+          new ActiveDesktopBackend())),
+      gdiplus_token_(NULL) {
   GdiplusStartupInput gdiplus_startup_input;
   GdiplusStartup(&gdiplus_token_, &gdiplus_startup_input, NULL);
+  engine()->AddPlatformDecoder(&gdiplus_decoder_);
+
+  // Depending on the version of Windows, JPEG files can be used directly as
+  // the wallpaper. Which of BMP and JPEG ends up cheaper to produce and apply
+  // is left to the engine to measure.
+  if (IsJPEGSupported()) {
+    engine()->AddDesktopFormat(IMAGE_FORMAT_JPEG);
+    if (!engine()->EncoderFor(IMAGE_FORMAT_JPEG)) {
+      gdiplus_jpeg_encoder_.reset(GdiplusEncoder::Create(IMAGE_FORMAT_JPEG));
+      engine()->AddPlatformEncoder(gdiplus_jpeg_encoder_.get());
+    }
+  }
 }
 
 WindowsDesktopService::~WindowsDesktopService() {
+  StopWorkers();
   if (gdiplus_token_)
     GdiplusShutdown(gdiplus_token_);
 }
@@ -67,113 +74,61 @@ bool WindowsDesktopService::GetWallpaperStyle(NPVariant* result) {
 }
 
 bool WindowsDesktopService::SetWallpaper(NPVariant* result,
-                                         const NPString& image_url,
-                                         int style) {
-  CONSOLE_LOG("SetWallpaper::URL " << image_url.UTF8Characters);
-
-  // Save the style type for later one after we recieve the image.
-  style_ = style;
+                                         const StringView& image_url,
+                                         int style,
+                                         NPObject* callback) {
+  CONSOLE_LOG("SetWallpaper::URL " << image_url.ToString());
+
+  // The style travels with the job until we recieve the image.
+  int id = StartImageDownload(image_url, style, callback);
+  if (!id)
+    return false;
 
-  return StartImageDownload(image_url);
+  INT32_TO_NPVARIANT(id, *result);
+  return true;
 }
 
-class ScopedCOMInitialize {
-public:
-  ScopedCOMInitialize()
-  {
-    CoInitialize(NULL);
-  }
-
-  ~ScopedCOMInitialize()
-  {
-    CoUninitialize();
-  }
-};
-
-void WindowsDesktopService::ImageDownloadComplete(NPStream* stream, const char* img_path) {
-  // Image has arrived. Finish setting wallpaper.
-  CONSOLE_LOG("Stream " << stream << " resulted in file downloaded to " << img_path);
-
-  // Copy from char* to TCHAR* for SetWallpaper's benefit.
-  size_t path_len = std::strlen(img_path);
-  WCHAR* temp_file_path = new WCHAR[path_len + 1];
-  temp_file_path[path_len] = 0;
-  std::copy(img_path, img_path + path_len, temp_file_path);
+ConversionOptions WindowsDesktopService::GetConversionOptions(
+    WallpaperStyle style) {
+  // Lay the image out for the primary monitor the way the shell would, so it
+  // mostly has to display it. Windows still applies |style| to the result:
+  // STRETCH and FILL results are the size of the screen and FIT ones match
+  // it on one side, so they come out the same, give or take the pixel the
+  // layout rounds to. CENTER results are at most the size of the screen and
+  // only get centered.
+  ConversionOptions options;
+  options.style = style;
+  options.screen_width = GetSystemMetrics(SM_CXSCREEN);
+  options.screen_height = GetSystemMetrics(SM_CYSCREEN);
+
+  // Transparent images show the same color GetSystemColor() reports, instead
+  // of whatever the shell would make of the alpha channel.
+  DWORD color = GetSysColor(COLOR_BACKGROUND);
+  options.background_color = (GetRValue(color) << 16) |
+                             (GetGValue(color) << 8) | GetBValue(color);
+  return options;
+}
 
+std::string WindowsDesktopService::GetWallpaperBasePath() {
   // Construct the permanent location path since we don't want to store it
   // in temporary directory. Some users remove that daily and when they restart
   // it will remove the desktop.
   WCHAR current_path[MAX_PATH];
   GetCurrentDirectoryW(MAX_PATH, current_path);
   WCHAR file_name[MAX_PATH];
+  wsprintf(file_name, L"%s\\SetWallpaperExtensionImage", current_path);
 
-  ScopedCOMInitialize com;
-
-  // Use IActiveDesktop for setting wallpaper and wallpaper options. This
-  // method seems to be the simplest and is supported on Win2K and later.
-  HRESULT hr;
-  LPACTIVEDESKTOP active_desktop;
-  hr = CoCreateInstance(CLSID_ActiveDesktop, NULL, CLSCTX_INPROC_SERVER,
-                        IID_IActiveDesktop, (void**)&active_desktop);
-  if (FAILED(hr)) {
-    CONSOLE_ERR("SetWallpaper::Creation failed!");
-    return;
-  }
-
-  // The rules of which version of Windows supports which image formats for a
-  // desktop background are seemingly non-trivial. So we opt to always convert
-  // to the lowest common demoniator, BMP, and use the resulting file as the
-  // desktop wallpaper.
-  wsprintf(file_name, L"%s\\SetWallpaperExtensionImage.bmp", current_path);
-
-  // Get file_name in multi-byte form for the purpose of log messages.
-  char file_name_chars[MAX_PATH];
-  size_t file_name_len = wcslen(file_name) + 1;
-  size_t converted_chars = 0;
-  wcstombs_s(&converted_chars, file_name_chars, file_name_len, file_name, _TRUNCATE);
-
-  // Open existing file as an image.
-  std::auto_ptr<Image> image(new Image(temp_file_path));
-  if (NULL == image.get()) {
-    CONSOLE_ERR("Something went wrong reading the downloaded image.");
-    return;
-  }
-
-  // Encode it to BMP.
-  CLSID clsid;
-  GetEncoderClsid(L"image/bmp", &clsid);
-  if (Ok != image->Save(file_name, &clsid)) {
-    CONSOLE_ERR("Something went wrong while converting the image to BMP.");
-    return;
-  }
-
-  CONSOLE_LOG("Converted and saved wallpaper to " << file_name_chars);
-
-  hr = active_desktop->SetWallpaper(file_name, 0);
-  if (FAILED(hr)) {
-    CONSOLE_ERR("SetWallpaper::Image failed!");
-    return;
-  }
-
-  WALLPAPEROPT wallpaper_options;
-  wallpaper_options.dwSize = sizeof(WALLPAPEROPT);
-  wallpaper_options.dwStyle = style_;
-  hr = active_desktop->SetWallpaperOptions(&wallpaper_options, 0);
-  if (FAILED(hr)) {
-    CONSOLE_ERR("SetWallpaper::Options failed!");
-    return;
-  }
-
-  hr = active_desktop->ApplyChanges(AD_APPLY_ALL);
-  if (FAILED(hr)) {
-    CONSOLE_ERR("SetWallpaper::Apply::Error");
-    return;
-  }
-
-  CONSOLE_LOG("SetWallpaper success!");
+  // The engine works with UTF-8 paths.
+  char file_name_chars[MAX_PATH * 3];
+  WideCharToMultiByte(CP_UTF8, 0, file_name, -1, file_name_chars,
+                      sizeof(file_name_chars), NULL, NULL);
+  return file_name_chars;
 }
 
 void WindowsDesktopService::DownloadCompletionStatus(const char* url, NPReason reason) {
+  if (!IsLogging(LOG_LEVEL_DEBUG))
+    return;
+
   std::ostringstream oss;
   oss << "GetURL of " << url << " done. Reason: ";
   switch (reason) {
@@ -189,35 +144,7 @@ void WindowsDesktopService::DownloadCompletionStatus(const char* url, NPReason r
     oss << "NPRES_NETWORK_ERR";
     break;
   }
-  WriteToConsole(oss.str().c_str());
-}
-
-int WindowsDesktopService::GetEncoderClsid(const TCHAR* format, CLSID* pClsid) {
-  UINT  num = 0;  // Number of image encoders.
-  UINT  size = 0; // Size of the image encoder array in bytes.
-
-  ImageCodecInfo* image_codec_info = NULL;
-
-  GetImageEncodersSize(&num, &size);
-  if (size == 0)
-    return -1;  // Failure.
-
-  image_codec_info = (ImageCodecInfo*)(malloc(size));
-  if (image_codec_info == NULL)
-    return -1;  // Failure.
-
-  GetImageEncoders(num, size, image_codec_info);
-
-  for (UINT j = 0; j < num; ++j) {
-    if (wcscmp(image_codec_info[j].MimeType, format) == 0 ) {
-      *pClsid = image_codec_info[j].Clsid;
-      free(image_codec_info);
-      return j;  // Success.
-    }
-  }
-
-  free(image_codec_info);
-  return -1;  // Failure.
+  WriteToConsole(LOG_LEVEL_DEBUG, oss.str());
 }
 
 bool WindowsDesktopService::IsJPEGSupported() {
@@ -7,6 +7,11 @@
 
 #include "npfunctions.h"
 #include "desktop_service.h"
+#include "gdiplus_decoder.h"
+#include "gdiplus_encoder.h"
+
+#include <memory>
+#include <string>
 
 namespace set_wallpaper_extension {
 
@@ -17,17 +22,16 @@ class WindowsDesktopService : public DesktopService {
 
   virtual bool GetSystemColor(NPVariant* result);
   virtual bool GetWallpaperStyle(NPVariant* result);
-  virtual bool SetWallpaper(NPVariant* result, const NPString& path, int style);
+  virtual bool SetWallpaper(NPVariant* result, const StringView& path,
+                            int style, NPObject* callback);
 
-  virtual void ImageDownloadComplete(NPStream* stream, const char* fname);
   virtual void DownloadCompletionStatus(const char* url, NPReason reason);
 
- private:
-  // Get the requested image encoder class ID used for encoding from the given
-  // |format| the result will be set to |pClsid|.
-  // http://msdn.microsoft.com/en-us/library/ms533843(VS.85).aspx
-  int GetEncoderClsid(const TCHAR* format, CLSID* pClsid);
+ protected:
+  virtual ConversionOptions GetConversionOptions(WallpaperStyle style);
+  virtual std::string GetWallpaperBasePath();
 
+ private:
   // Depending on the operating system, the supported images differ.
   // - Windows Vista / 7 supports JPG / BMP.
   // - Others supports just BMP.
@@ -35,7 +39,10 @@ class WindowsDesktopService : public DesktopService {
 
  private:
   ULONG_PTR gdiplus_token_;
-  int style_;
+
+  // GDI+ is only used for formats the engine has no built-in codec for.
+  GdiplusDecoder gdiplus_decoder_;
+  std::unique_ptr<GdiplusEncoder> gdiplus_jpeg_encoder_;
 };
 
 }  // namespace set_wallpaper_extension